@@ -4,6 +4,10 @@
  * aes.h
  *
  * AES stuff for cryptopals.com challenges.
+ *
+ * The AES block_cipher structs are constant and their functions keep no state
+ * besides the expanded key owned by the caller: they may be used by any number
+ * of threads at once.
  */
 #include "bytes.h"
 #include "block_cipher.h"
@@ -4,6 +4,10 @@
  * block_cipher.h
  *
  * Block Cipher interfaces.
+ *
+ * Implementations must not keep mutable state of their own. An expanded key is
+ * only read by encrypt() and decrypt(), so the modes of operation share it
+ * between the threads of the pool.
  */
 #include "bytes.h"
 
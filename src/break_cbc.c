@@ -4,6 +4,7 @@
  * CBC analysis stuff for cryptopals.com challenges.
  */
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/conf.h>
@@ -14,12 +15,83 @@
 #include "xor.h"
 #include "aes.h"
 #include "cbc.h"
+#include "pool.h"
 #include "break_cbc.h"
 
 #define	CBC_BITFLIPPING_PREFIX	"comment1=cooking%20MCs;userdata="
 #define	CBC_BITFLIPPING_SUFFIX	";comment2=%20like%20a%20pound%20of%20bacon"
 
 
+/*
+ * opaque struct used by oracles created by cbc_padding_oracle_new().
+ */
+struct cbc_padding_oracle_opaque {
+	struct bytes *key;
+};
+
+/* struct oracle method members implementations */
+static int	cbc_padding_oracle_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p);
+static int	cbc_padding_oracle_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs);
+static void	cbc_padding_oracle_free(struct oracle *oracle);
+
+/*
+ * Maximum count of guesses submitted at once to the oracle by
+ * cbc_padding_breaker() through oracle_find(). Each position starts with a
+ * single guess and double the batch size on every miss, so that likely guesses
+ * don't waste queries while unlikely ones are submitted in large batches.
+ */
+#define	CBC_PADDING_MAX_BATCH	32
+
+/*
+ * State shared by the cbc_padding_breaker() tasks.
+ */
+struct cbc_padding_job {
+	struct oracle *oracle;
+	const struct bytes *ciphertext, *iv;
+	/* the padded plaintext, each task write the blocks it broke */
+	struct bytes *padded;
+	size_t nblocks;
+	/* plaintext byte guesses, from the most to the least likely */
+	uint8_t text_guesses[UINT8_MAX + 1];
+	/* like text_guesses but with the PKCS#7 padding values first */
+	uint8_t padding_guesses[UINT8_MAX + 1];
+};
+
+/*
+ * Fill guesses with every byte value, ordered from the most to the least
+ * likely in an english plaintext. When padding is non-zero the PKCS#7 padding
+ * values come first.
+ */
+static void	cbc_padding_guesses(uint8_t *guesses, int padding);
+
+/*
+ * cbc_padding_breaker() cp_parallel_for() routine, break the blocks from lo to
+ * hi (excluded).
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int	cbc_padding_break_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Break the ciphertext block at index n of the given job, writing the
+ * recovered plaintext block into the job padded member.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int	cbc_padding_break_block(struct cbc_padding_job *job, size_t n);
+
+/*
+ * Implementation of cbc_padding_oracle() using the given OpenSSL cipher
+ * context, so that it can be reused by batched queries.
+ */
+static int	cbc_padding_oracle_ctx(EVP_CIPHER_CTX *ctx,
+		    const uint8_t *ciphertext, size_t len,
+		    const struct bytes *key, const uint8_t *iv);
+
+
 struct bytes *
 cbc_bitflipping_escape(const struct bytes *payload)
 {
@@ -202,236 +274,119 @@ int
 cbc_padding_oracle(const struct bytes *ciphertext,
 		    const struct bytes *key, const struct bytes *iv)
 {
-	/*
-	 * NOTE: implement AES-CBC decryption using OpenSSL since our own code
-	 * doesn't provide a way to decrypt without removing the PKCS#7 padding.
-	 */
-	const EVP_CIPHER *cipher = EVP_aes_128_cbc();
-	const size_t blocksize = EVP_CIPHER_block_size(cipher);
 	EVP_CIPHER_CTX *ctx = NULL;
-	struct bytes *plaintext = NULL;
-	int padding = -1, success = 0;
+	int padding = -1;
 
 	/* sanity checks */
-	if (ciphertext == NULL || key == NULL)
-		goto cleanup;
-	if (ciphertext->len > INT_MAX || key->len > INT_MAX)
-		goto cleanup;
+	if (ciphertext == NULL || key == NULL || iv == NULL)
+		return (-1);
+	if (iv->len != aes_128_blocksize())
+		return (-1);
 
 	/* create the context */
 	ctx = EVP_CIPHER_CTX_new();
 	if (ctx == NULL)
-		goto cleanup;
+		return (-1);
 
-	/* setup the context cipher */
-	if (EVP_DecryptInit_ex(ctx, cipher, NULL, NULL, NULL) != 1)
-		goto cleanup;
+	padding = cbc_padding_oracle_ctx(ctx, ciphertext->data, ciphertext->len,
+		    key, iv->data);
 
-	/* setup the context cipher key and iv */
-	if (EVP_CIPHER_CTX_set_key_length(ctx, key->len) != 1)
-		goto cleanup;
-	if (iv->len != (size_t)EVP_CIPHER_CTX_iv_length(ctx))
-		goto cleanup;
-	if (EVP_DecryptInit_ex(ctx, NULL, NULL, key->data, iv->data) != 1)
-		goto cleanup;
+	EVP_CIPHER_CTX_free(ctx);
+	return (padding);
+}
 
-	/* setup the context cipher padding */
-	if (EVP_CIPHER_CTX_set_padding(ctx, /* no padding */0) != 1)
-		goto cleanup;
 
-	/* NOTE: add twice the block size needed by enc update and final */
-	plaintext = bytes_zeroed(ciphertext->len + blocksize * 2);
-	if (plaintext == NULL)
-		goto cleanup;
+struct oracle *
+cbc_padding_oracle_new(const struct bytes *key)
+{
+	struct oracle *oracle = NULL;
+	int success = 0;
 
-	/* update */
-	int uplen = -1;
-	int ret = EVP_DecryptUpdate(ctx, plaintext->data, &uplen, ciphertext->data, ciphertext->len);
-	if (ret != 1 || uplen < 0)
+	/* sanity check */
+	if (key == NULL)
 		goto cleanup;
 
-	/* finalize */
-	int finlen = -1;
-	ret = EVP_DecryptFinal_ex(ctx, plaintext->data + uplen, &finlen);
-	if (ret != 1 || finlen < 0 || (INT_MAX - uplen) < finlen)
+	oracle = calloc(1, sizeof(struct oracle));
+	if (oracle == NULL)
 		goto cleanup;
-	const size_t outlen = uplen + finlen;
 
-	/* set the output buffer length */
-	if (plaintext->len < outlen)
-		abort();
-	plaintext->len = outlen;
+	oracle->opaque = calloc(1, sizeof(struct cbc_padding_oracle_opaque));
+	if (oracle->opaque == NULL)
+		goto cleanup;
+	struct cbc_padding_oracle_opaque *info = oracle->opaque;
 
-	/* verify if the plaintext has a PKCS#7 padding */
-	padding = bytes_pkcs7_padding(plaintext, NULL);
-	if (padding == -1)
+	info->key = bytes_dup(key);
+	if (info->key == NULL)
 		goto cleanup;
 
+	oracle->query = cbc_padding_oracle_query;
+	oracle->batch = cbc_padding_oracle_batch;
+	oracle->free  = cbc_padding_oracle_free;
+
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	EVP_CIPHER_CTX_free(ctx);
-	/* XXX: we don't provide any clue on what happened on error */
-	bytes_free(plaintext);
-	return (success ? padding : -1);
+	if (!success) {
+		cbc_padding_oracle_free(oracle);
+		oracle = NULL;
+	}
+	return (oracle);
 }
 
 
 struct bytes *
 cbc_padding_breaker(const struct bytes *ciphertext,
-		    const void *key, const struct bytes *iv)
-#define oracle(x, iv)	cbc_padding_oracle((x), key, (iv))
+		    struct oracle *oracle, const struct bytes *iv, size_t nthreads)
 {
 	const size_t blocksize = aes_128_blocksize();
-	size_t nblocks = 0;
+	struct cbc_padding_job job;
+	struct cp_pool *pool = NULL;
 	struct bytes *padded = NULL, *plaintext = NULL;
 	int success = 0;
 
 	/* sanity checks */
-	if (ciphertext == NULL || key == NULL || iv == NULL)
+	if (ciphertext == NULL || oracle == NULL || iv == NULL)
 		goto cleanup;
 	if (ciphertext->len % blocksize != 0)
 		goto cleanup;
 	if (iv->len != blocksize)
 		goto cleanup;
 
-	/* total block count in the ciphertext */
-	nblocks = ciphertext->len / blocksize;
-
-	/* padded plaintext, will be filled block per block. */
+	/* padded plaintext, will be filled block per block by the tasks */
 	padded = bytes_zeroed(ciphertext->len);
 	if (padded == NULL)
 		goto cleanup;
 
-	/*
-	 * Here is how CBC decryption works:
-	 *
-	 *  ciphertext block c0    ciphertext block c1
-	 * [...................]  [...................]
-	 *         |                        |
-	 *         |                        v
-	 *         |               ___________________
-	 *         |              |                   |
-	 *         |              |    block cipher   | <- key
-	 *         |              |     decryption    |
-	 *         |               ___________________
-	 *         |                        |
-	 *         |                        v
-	 *         |              intermediate state i1
-	 *         |              [...................]
-	 *         |                        |
-	 *         |                        v
-	 *         ----------------------> XOR
-	 *                                  |
-	 *                                  v
-	 *                            plaintext p1
-	 *                        [...................]
-	 *
-	 * We break one block c1 at a time. We alter c0, used as the IV, in
-	 * order to recover the intermediate state i1 block. From that point we
-	 * can compute the plaintext p1 by simply XOR'ing c0 and i1.
-	 */
-	for (size_t n = 0; n < nblocks; n++) {
-		struct bytes *c0 = NULL, *c1 = NULL, *i1 = NULL;
-		int loop_success = 0;
-
-		/* setup c0 and c1 for the current block */
-		if (n == 0) {
-			/* first pass */
-			c0 = bytes_dup(iv);
-		} else {
-			/* use the previous block as IV */
-			c0 = bytes_slice(ciphertext, (n - 1) * blocksize,
-				    blocksize);
-		}
-		c1 = bytes_slice(ciphertext, n * blocksize, blocksize);
-		if (c0 == NULL || c1 == NULL)
-			goto loop_cleanup;
-
-		/* create i1 so that we can fill it byte by byte */
-		i1 = bytes_zeroed(blocksize);
-		if (i1 == NULL)
-			goto loop_cleanup;
-
-		/* recover i1 by breaking one byte at a time, from the last to
-		   the first */
-		for (size_t pad = 1; pad <= blocksize; pad++) {
-			/* here we aim for the block c1 to decrypt to a
-			   plaintext with a valid padding of value `pad' */
-			struct bytes *a0 = bytes_dup(c0);
-			if (a0 == NULL)
-				goto loop_cleanup;
-
-			/* setup padding bytes after the one we are cracking so
-			   that they decrypt to `pad' */
-			const uint8_t original = c0->data[blocksize - pad];
-			uint8_t *altered = a0->data + blocksize - 1;
-			uint8_t *istate  = i1->data + blocksize - 1;
-			for (size_t p = 1; p < pad; p++)
-				*altered-- = *istate-- ^ pad;
-			/* `altered' and `istate' point to the target byte */
-
-			int found = 0;
-			for (uint16_t byte = 0; byte <= UINT8_MAX; byte++) {
-				*altered = original ^ (uint8_t)byte;
-				if (oracle(c1, a0) != 0)
-					continue;
-				/*
-				 * If we flip something in the byte before the
-				 * target padding byte (i.e. the first padding
-				 * byte), the padding should be still correct.
-				 * If not, then the byte before the target byte
-				 * was "accidently" taken as part of the
-				 * padding. We only need to do this confirmation
-				 * check when the padding is 0x1.
-				 */
-				if (pad == 1) {
-					altered[-1] += 1;
-					const int ret = oracle(c1, a0);
-					altered[-1] -= 1;
-					if (ret != 0) {
-						/* the confirmation check
-						   failed. */
-						continue;
-					}
-				}
-				found = 1;
-				/*
-				 * We've hacked `a0' in a way yielding a valid
-				 * padding, in other words we have:
-				 *     altered ^ istate == pad
-				 * So we can recover the istate byte.
-				 */
-				*istate = *altered ^ pad;
-				break;
-			}
-			bytes_free(a0);
-			if (!found)
-				goto loop_cleanup;
-		}
-
-		/* We've successfully recovered i1, now compute the plaintext
-		   block using it. */
-		if (bytes_xor(i1, c0) != 0)
-			goto loop_cleanup;
-		if (bytes_put(padded, n * blocksize, i1) != 0)
-			goto loop_cleanup;
-
-		loop_success = 1;
-		/* FALLTHROUGH */
-loop_cleanup:
-		bytes_free(i1);
-		bytes_free(c1);
-		bytes_free(c0);
-		if (!loop_success)
+	/* setup the job shared by all the tasks */
+	(void)memset(&job, 0, sizeof(struct cbc_padding_job));
+	job.oracle = oracle;
+	job.ciphertext = ciphertext;
+	job.iv = iv;
+	job.padded = padded;
+	job.nblocks = ciphertext->len / blocksize;
+	cbc_padding_guesses(job.text_guesses, 0);
+	cbc_padding_guesses(job.padding_guesses, 1);
+
+	/* use the library pool unless a count of threads is requested, no need
+	   for more threads than blocks to break */
+	if (nthreads > job.nblocks)
+		nthreads = job.nblocks;
+	if (nthreads > 0) {
+		pool = cp_pool_create(nthreads);
+		if (pool == NULL)
 			goto cleanup;
 	}
+	/* break one block per task */
+	if (cp_parallel_for(pool, job.nblocks, 1, cbc_padding_break_range,
+		    &job) != 0)
+		goto cleanup;
 
 	plaintext = bytes_pkcs7_unpadded(padded);
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
+	cp_pool_free(pool);
 	bytes_free(padded);
 	if (!success) {
 		bytes_free(plaintext);
@@ -439,7 +394,6 @@ cleanup:
 	}
 	return (plaintext);
 }
-#undef oracle
 
 
 int
@@ -535,3 +489,376 @@ cleanup:
 	return (p1);
 }
 #undef oracle
+
+
+static int
+cbc_padding_oracle_query(struct oracle *oracle, const struct bytes *input,
+		    struct bytes **output_p)
+{
+	const struct bytes *const inputs[1] = { input };
+	int answer = -1;
+
+	if (output_p != NULL)
+		*output_p = NULL;
+	if (cbc_padding_oracle_batch(oracle, 1, inputs, &answer, NULL) != 0)
+		return (-1);
+	return (answer);
+}
+
+
+static int
+cbc_padding_oracle_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs)
+{
+	const size_t blocksize = aes_128_blocksize();
+	EVP_CIPHER_CTX *ctx = NULL;
+	int success = 0;
+
+	/* sanity checks */
+	if (oracle == NULL || oracle->opaque == NULL)
+		goto cleanup;
+	const struct cbc_padding_oracle_opaque *info = oracle->opaque;
+
+	/* one context for the whole batch */
+	ctx = EVP_CIPHER_CTX_new();
+	if (ctx == NULL)
+		goto cleanup;
+
+	for (size_t i = 0; i < count; i++) {
+		const struct bytes *input = inputs[i];
+		if (outputs != NULL)
+			outputs[i] = NULL;
+		/* the input is [iv . ciphertext] */
+		if (input == NULL || input->len < blocksize)
+			goto cleanup;
+		answers[i] = cbc_padding_oracle_ctx(ctx,
+			    input->data + blocksize, input->len - blocksize,
+			    info->key, input->data);
+		if (answers[i] == -1)
+			goto cleanup;
+	}
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	EVP_CIPHER_CTX_free(ctx);
+	return (success ? 0 : -1);
+}
+
+
+static void
+cbc_padding_oracle_free(struct oracle *oracle)
+{
+	if (oracle == NULL)
+		return;
+
+	struct cbc_padding_oracle_opaque *info = oracle->opaque;
+	if (info != NULL) {
+		bytes_free(info->key);
+		freezero(info, sizeof(struct cbc_padding_oracle_opaque));
+	}
+	freezero(oracle, sizeof(struct oracle));
+}
+
+
+static int
+cbc_padding_oracle_ctx(EVP_CIPHER_CTX *ctx,
+		    const uint8_t *ciphertext, size_t len,
+		    const struct bytes *key, const uint8_t *iv)
+{
+	/*
+	 * NOTE: implement AES-CBC decryption using OpenSSL since our own code
+	 * doesn't provide a way to decrypt without removing the PKCS#7 padding.
+	 */
+	const EVP_CIPHER *cipher = EVP_aes_128_cbc();
+	const size_t blocksize = EVP_CIPHER_block_size(cipher);
+	struct bytes *plaintext = NULL;
+	int padding = -1, success = 0;
+
+	/* sanity checks */
+	if (ctx == NULL || ciphertext == NULL || key == NULL || iv == NULL)
+		goto cleanup;
+	if (len > INT_MAX || key->len > INT_MAX)
+		goto cleanup;
+
+	/* setup the context cipher */
+	if (EVP_DecryptInit_ex(ctx, cipher, NULL, NULL, NULL) != 1)
+		goto cleanup;
+
+	/* setup the context cipher key and iv */
+	if (EVP_CIPHER_CTX_set_key_length(ctx, key->len) != 1)
+		goto cleanup;
+	if (blocksize != (size_t)EVP_CIPHER_CTX_iv_length(ctx))
+		goto cleanup;
+	if (EVP_DecryptInit_ex(ctx, NULL, NULL, key->data, iv) != 1)
+		goto cleanup;
+
+	/* setup the context cipher padding */
+	if (EVP_CIPHER_CTX_set_padding(ctx, /* no padding */0) != 1)
+		goto cleanup;
+
+	/* NOTE: add twice the block size needed by enc update and final */
+	plaintext = bytes_zeroed(len + blocksize * 2);
+	if (plaintext == NULL)
+		goto cleanup;
+
+	/* update */
+	int uplen = -1;
+	int ret = EVP_DecryptUpdate(ctx, plaintext->data, &uplen, ciphertext, len);
+	if (ret != 1 || uplen < 0)
+		goto cleanup;
+
+	/* finalize */
+	int finlen = -1;
+	ret = EVP_DecryptFinal_ex(ctx, plaintext->data + uplen, &finlen);
+	if (ret != 1 || finlen < 0 || (INT_MAX - uplen) < finlen)
+		goto cleanup;
+	const size_t outlen = uplen + finlen;
+
+	/* set the output buffer length */
+	if (plaintext->len < outlen)
+		abort();
+	plaintext->len = outlen;
+
+	/* verify if the plaintext has a PKCS#7 padding */
+	padding = bytes_pkcs7_padding(plaintext, NULL);
+	if (padding == -1)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	/* XXX: we don't provide any clue on what happened on error */
+	bytes_free(plaintext);
+	return (success ? padding : -1);
+}
+
+
+static void
+cbc_padding_guesses(uint8_t *guesses, int padding)
+{
+	/* english letters by frequency, then the other printable characters */
+	static const char *likely =
+		    " etaoinshrdlcumwfgypbvkjxqz"
+		    "ETAOINSHRDLCUMWFGYPBVKJXQZ"
+		    ".,'\"-!?;:0123456789\n()/&*#@$%+=<>[]_\\^`{|}~\t";
+	const size_t blocksize = aes_128_blocksize();
+	uint8_t seen[UINT8_MAX + 1] = { 0 };
+	size_t count = 0;
+
+	if (padding) {
+		for (size_t i = 1; i <= blocksize; i++) {
+			guesses[count++] = (uint8_t)i;
+			seen[i] = 1;
+		}
+	}
+	for (const char *p = likely; *p != '\0'; p++) {
+		const uint8_t byte = (uint8_t)*p;
+		if (!seen[byte]) {
+			guesses[count++] = byte;
+			seen[byte] = 1;
+		}
+	}
+	/* PKCS#7 padding values are likely in the last block only */
+	for (size_t i = 1; i <= blocksize; i++) {
+		if (!seen[i]) {
+			guesses[count++] = (uint8_t)i;
+			seen[i] = 1;
+		}
+	}
+	/* everything else */
+	for (size_t i = 0; i <= UINT8_MAX; i++) {
+		if (!seen[i])
+			guesses[count++] = (uint8_t)i;
+	}
+}
+
+
+static int
+cbc_padding_break_range(size_t lo, size_t hi, void *arg)
+{
+	struct cbc_padding_job *job = arg;
+
+	for (size_t n = lo; n < hi; n++) {
+		if (cbc_padding_break_block(job, n) != 0)
+			return (-1);
+	}
+
+	return (0);
+}
+
+
+static int
+cbc_padding_break_block(struct cbc_padding_job *job, size_t n)
+{
+	const size_t blocksize = aes_128_blocksize();
+	const int last = (n == job->nblocks - 1);
+	struct bytes *queries[CBC_PADDING_MAX_BATCH] = { NULL };
+	uint8_t guesses[UINT8_MAX + 1];
+	uint8_t *i1 = NULL;
+	int success = 0;
+
+	/*
+	 * Here is how CBC decryption works:
+	 *
+	 *  ciphertext block c0    ciphertext block c1
+	 * [...................]  [...................]
+	 *         |                        |
+	 *         |                        v
+	 *         |               ___________________
+	 *         |              |                   |
+	 *         |              |    block cipher   | <- key
+	 *         |              |     decryption    |
+	 *         |               ___________________
+	 *         |                        |
+	 *         |                        v
+	 *         |              intermediate state i1
+	 *         |              [...................]
+	 *         |                        |
+	 *         |                        v
+	 *         ----------------------> XOR
+	 *                                  |
+	 *                                  v
+	 *                            plaintext p1
+	 *                        [...................]
+	 *
+	 * We break one block c1 at a time. We alter c0, used as the IV, in
+	 * order to recover the intermediate state i1 block. From that point we
+	 * can compute the plaintext p1 by simply XOR'ing c0 and i1. Since c1
+	 * only depends on c0, the blocks are broken independently.
+	 */
+	const uint8_t *c0 = (n == 0 ? job->iv->data :
+		    job->ciphertext->data + (n - 1) * blocksize);
+	const uint8_t *c1 = job->ciphertext->data + n * blocksize;
+
+	/* the queries submitted to the oracle are [a0 . c1] where a0 is our
+	   altered version of c0 used as IV. */
+	for (size_t j = 0; j < CBC_PADDING_MAX_BATCH; j++) {
+		queries[j] = bytes_zeroed(2 * blocksize);
+		if (queries[j] == NULL)
+			goto cleanup;
+		(void)memcpy(queries[j]->data, c0, blocksize);
+		(void)memcpy(queries[j]->data + blocksize, c1, blocksize);
+	}
+
+	/* create i1 so that we can fill it byte by byte */
+	i1 = calloc(blocksize, sizeof(uint8_t));
+	if (i1 == NULL)
+		goto cleanup;
+
+	/* recover i1 by breaking one byte at a time, from the last to the
+	   first */
+	for (size_t pad = 1; pad <= blocksize; pad++) {
+		/* here we aim for the block c1 to decrypt to a plaintext with a
+		   valid padding of value `pad' */
+		const size_t target = blocksize - pad;
+
+		/* setup padding bytes after the one we are cracking so that
+		   they decrypt to `pad' */
+		for (size_t j = 0; j < CBC_PADDING_MAX_BATCH; j++) {
+			uint8_t *a0 = queries[j]->data;
+			for (size_t k = target + 1; k < blocksize; k++)
+				a0[k] = i1[k] ^ pad;
+		}
+
+		/*
+		 * Guess the plaintext bytes from the most to the least likely.
+		 * In the last block, once we know its last byte (i.e. the
+		 * padding value) we expect as much bytes with the same value.
+		 */
+		const uint8_t *order = (last && pad == 1) ?
+			    job->padding_guesses : job->text_guesses;
+		size_t nguesses = 0;
+		if (last && pad > 1) {
+			const uint8_t value = i1[blocksize - 1] ^ c0[blocksize - 1];
+			if (pad <= value)
+				guesses[nguesses++] = value;
+		}
+		for (size_t i = 0; i <= UINT8_MAX; i++) {
+			if (nguesses == 0 || order[i] != guesses[0])
+				guesses[nguesses++] = order[i];
+		}
+
+		int found = 0;
+		size_t batch = 1;
+		for (size_t i = 0; i < nguesses && !found; i += batch) {
+			if (i > 0 && batch < CBC_PADDING_MAX_BATCH)
+				batch *= 2;
+			if (batch > nguesses - i)
+				batch = nguesses - i;
+			/*
+			 * A guessed plaintext byte p yields a valid padding
+			 * when a0 ^ i1 == pad, where i1 == p ^ c0. Thus we
+			 * set the altered byte to a0 = c0 ^ p ^ pad.
+			 */
+			for (size_t j = 0; j < batch; j++) {
+				queries[j]->data[target] =
+					    c0[target] ^ guesses[i + j] ^ pad;
+			}
+
+			/* look for a guess yielding a valid padding */
+			size_t start = 0;
+			while (!found && start < batch) {
+				size_t index = 0;
+				const int ret = oracle_find(job->oracle,
+					    batch - start,
+					    (const struct bytes *const *)
+					    (queries + start), 0, &index);
+				if (ret == -1)
+					goto cleanup;
+				if (ret == 1)
+					break;
+				const size_t j = start + index;
+				start = j + 1;
+				uint8_t *a0 = queries[j]->data;
+				/*
+				 * If we flip something in the byte before the
+				 * target padding byte (i.e. the first padding
+				 * byte), the padding should be still correct.
+				 * If not, then the byte before the target byte
+				 * was "accidently" taken as part of the
+				 * padding. We only need to do this confirmation
+				 * check when the padding is 0x1.
+				 */
+				if (pad == 1 && target > 0) {
+					a0[target - 1] += 1;
+					const int confirm = oracle_query(
+						    job->oracle, queries[j], NULL);
+					a0[target - 1] -= 1;
+					if (confirm == -1)
+						goto cleanup;
+					if (confirm != 0) {
+						/* the confirmation check
+						   failed. */
+						continue;
+					}
+				}
+				found = 1;
+				/*
+				 * We've hacked `a0' in a way yielding a valid
+				 * padding, in other words we have:
+				 *     a0 ^ i1 == pad
+				 * So we can recover the i1 byte.
+				 */
+				i1[target] = a0[target] ^ pad;
+			}
+		}
+		if (!found)
+			goto cleanup;
+	}
+
+	/* We've successfully recovered i1, now compute the plaintext block
+	   using it. */
+	uint8_t *p1 = job->padded->data + n * blocksize;
+	for (size_t k = 0; k < blocksize; k++)
+		p1[k] = i1[k] ^ c0[k];
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	freezero(i1, blocksize);
+	for (size_t j = 0; j < CBC_PADDING_MAX_BATCH; j++)
+		bytes_free(queries[j]);
+	return (success ? 0 : -1);
+}
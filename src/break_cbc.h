@@ -4,8 +4,12 @@
  * break_cbc.h
  *
  * CBC analysis stuff for cryptopals.com challenges.
+ *
+ * The padding oracle is queried from the threads of a pool and thus must be
+ * thread-safe (see oracle.h).
  */
 #include "bytes.h"
+#include "oracle.h"
 
 /*
  * CBC Encryption function as described by Set 2 / Challenge 16.
@@ -47,14 +51,31 @@ struct bytes	*cbc_bitflipping_breaker(const void *key, const void *iv);
 int	cbc_padding_oracle(const struct bytes *ciphertext,
 	    const struct bytes *key, const struct bytes *iv);
 
+/*
+ * Create an oracle answering like cbc_padding_oracle() under the given key.
+ * The oracle input is [iv . ciphertext], i.e. the IV followed by the
+ * ciphertext to decrypt, and it has no output.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure.
+ */
+struct oracle	*cbc_padding_oracle_new(const struct bytes *key);
+
 /*
  * CBC Attack as described by Set 3 / Challenge 17.
  *
+ * The given oracle should behave like the ones created by
+ * cbc_padding_oracle_new(). Byte guesses are made from the most to the least
+ * likely plaintext value and submitted in batches, while distinct ciphertext
+ * blocks are broken concurrently by a pool of nthreads threads. When nthreads
+ * is 0, the library pool from cp_pool_default() is used.
+ *
  * Returns a pointer to a newly allocated bytes struct that should passed to
  * bytes_free(), or NULL if malloc(3) failed or if any given parameter is NULL.
  */
 struct bytes	*cbc_padding_breaker(const struct bytes *ciphertext,
-		    const void *key, const struct bytes *iv);
+		    struct oracle *oracle, const struct bytes *iv,
+		    size_t nthreads);
 
 /*
  * Decrypt the given ciphertext with the provided key/iv using AES128-CBC and
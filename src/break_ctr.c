@@ -89,66 +89,36 @@ cleanup:
 }
 
 
-struct bytes *
-aes_128_ctr_edit_oracle(const struct bytes *ciphertext,
+int
+aes_128_ctr_edit_oracle(struct bytes *ciphertext,
 		    const struct bytes *key, uint64_t nonce,
 		    size_t offset, const struct bytes *replacement)
 {
-	struct bytes *zeroes = NULL, *keystream = NULL, *rkeystream = NULL;
-	struct bytes *before = NULL, *rct = NULL, *after = NULL, *output = NULL;
-	int success = 0;
-
 	/* sanity checks */
 	if (ciphertext == NULL || key == NULL || replacement == NULL)
-		goto cleanup;
+		return (-1);
 	if (offset > ciphertext->len)
-		goto cleanup;
+		return (-1);
 	if (ciphertext->len - offset < replacement->len)
-		goto cleanup;
+		return (-1);
 
 	/*
-	 * We build the output as:
+	 * Patch the ciphertext in place:
 	 *
-	 *    before  offset  rct   bound  after
-	 *       v      |      v      |      v
-	 * [ ......... ][ .......... ][ .......... ]
+	 *             offset          bound
+	 *               |               |
+	 * [ ......... ][ replacement ][ .......... ]
 	 *
-	 * Here rct is the "replacement ciphertext", i.e. the encrypted version
-	 * of replacement. before and after are untouched slices of the original
-	 * ciphertext.
+	 * and then encrypt only the replacement bytes using the keystream
+	 * starting at offset.
 	 */
+	if (bytes_put(ciphertext, offset, replacement) != 0)
+		return (-1);
+	if (aes_128_ctr_crypt_at(ciphertext, offset, replacement->len,
+		    key, nonce) != 0)
+		return (-1);
 
-	const size_t bound = offset + replacement->len;
-
-	/* encrypt as many 0x0 as we need in order to get the keystream */
-	zeroes = bytes_zeroed(bound);
-	keystream = aes_128_ctr_encrypt(zeroes, key, nonce);
-	/* get the part of the keystream needed to encrypt the replacement */
-	rkeystream = bytes_slice(keystream, offset, replacement->len);
-	rct = bytes_dup(replacement);
-	if (bytes_xor(rct, rkeystream) != 0)
-		goto cleanup;
-
-	/* find the copied parts from the ciphertext before and after the
-	   replacement */
-	before = bytes_slice(ciphertext, 0, offset);
-	after  = bytes_slice(ciphertext, bound, ciphertext->len - bound);
-	output = bytes_joined(3, before, rct, after);
-
-	success = 1;
-	/* FALLTHROUGH */
-cleanup:
-	bytes_free(after);
-	bytes_free(before);
-	bytes_free(rct);
-	bytes_free(rkeystream);
-	bytes_free(keystream);
-	bytes_free(zeroes);
-	if (!success) {
-		bytes_free(output);
-		output = NULL;
-	}
-	return (output);
+	return (0);
 }
 
 
@@ -158,7 +128,29 @@ aes_128_ctr_edit_breaker(const struct bytes *ciphertext,
 #define oracle(ct, off, rep) \
 		aes_128_ctr_edit_oracle((ct), key, nonce, (off), (rep))
 {
-	return (oracle(ciphertext, 0, ciphertext));
+	struct bytes *recovered = NULL;
+	int success = 0;
+
+	/* sanity check */
+	if (ciphertext == NULL)
+		goto cleanup;
+
+	/* "replacing" the plaintext with the ciphertext itself yields the
+	   plaintext, as the keystream is XOR'ed twice */
+	recovered = bytes_dup(ciphertext);
+	if (recovered == NULL)
+		goto cleanup;
+	if (oracle(recovered, 0, ciphertext) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		bytes_free(recovered);
+		recovered = NULL;
+	}
+	return (recovered);
 }
 #undef oracle
 
@@ -4,6 +4,8 @@
  * break_ctr.h
  *
  * CTR analysis stuff for cryptopals.com challenges.
+ *
+ * Reentrant.
  */
 #include "bytes.h"
 
@@ -20,8 +22,14 @@ struct bytes	*break_ctr_fixed_nonce(struct bytes **ciphertexts, size_t count);
 
 /*
  * "edit" function from Set 4 / Challenge 25.
+ *
+ * Replace in place the plaintext of the given ciphertext at offset by
+ * replacement, only the replaced bytes are re-encrypted.
+ *
+ * Returns 0 on success, -1 on error (including when the replacement doesn't fit
+ * into the ciphertext at offset).
  */
-struct bytes	*aes_128_ctr_edit_oracle(const struct bytes *ciphertext,
+int	aes_128_ctr_edit_oracle(struct bytes *ciphertext,
 		    const struct bytes *key, uint64_t nonce,
 		    size_t offset, const struct bytes *replacement);
 
@@ -4,6 +4,8 @@
  * break_dh.h
  *
  * Diffie–Hellman–Merkle key exchange Man-In-The-Middle stuff.
+ *
+ * Like the endpoints, a MITM is owned by a single thread.
  */
 #include "dh.h"
 
@@ -3,6 +3,7 @@
  *
  * ECB analysis stuff for cryptopals.com challenges.
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "compat.h"
@@ -13,6 +14,38 @@
 #include "break_ecb.h"
 
 
+/*
+ * opaque struct used by oracles created by ecb_byte_at_a_time_oracle14_new().
+ */
+struct ecb_byte_at_a_time_oracle_opaque {
+	struct bytes *prefix, *message, *key;
+};
+
+/* struct oracle method members implementations */
+static int	ecb_byte_at_a_time_oracle_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p);
+static void	ecb_byte_at_a_time_oracle_free(struct oracle *oracle);
+
+/*
+ * Submit the given payload to the oracle.
+ *
+ * Returns the ciphertext that should be passed to bytes_free(), or NULL on
+ * error.
+ */
+static struct bytes	*ecb_oracle_encrypt(struct oracle *oracle,
+		    const struct bytes *payload);
+
+/*
+ * Submit the given payloads in a single batch to the oracle.
+ *
+ * Returns 0 on success, -1 on error. On success ct0_p and ct1_p are set to the
+ * respective ciphertexts of p0 and p1 that must be passed to bytes_free().
+ */
+static int	ecb_oracle_encrypt2(struct oracle *oracle,
+		    const struct bytes *p0, const struct bytes *p1,
+		    struct bytes **ct0_p, struct bytes **ct1_p);
+
+
 int
 ecb_detect(const struct bytes *buf, double *score_p)
 {
@@ -180,12 +213,13 @@ ecb_byte_at_a_time_oracle12(
 
 
 struct bytes *
-ecb_byte_at_a_time_breaker12(const void *message, const void *key)
+ecb_byte_at_a_time_breaker12(const void *message, const void *key,
+		    struct ecb_byte_at_a_time_stats *stats_p)
 {
 	struct bytes *prefix, *result;
 
 	prefix = bytes_from_str("");
-	result = ecb_byte_at_a_time_breaker14(prefix, message, key);
+	result = ecb_byte_at_a_time_breaker14(prefix, message, key, stats_p);
 	bytes_free(prefix);
 	return (result);
 }
@@ -353,12 +387,76 @@ cleanup:
 }
 
 
+struct oracle *
+ecb_byte_at_a_time_oracle14_new(
+		    const struct bytes *prefix,
+		    const struct bytes *message,
+		    const struct bytes *key)
+{
+	struct oracle *oracle = NULL;
+	int success = 0;
+
+	/* sanity checks */
+	if (prefix == NULL || message == NULL || key == NULL)
+		goto cleanup;
+
+	oracle = calloc(1, sizeof(struct oracle));
+	if (oracle == NULL)
+		goto cleanup;
+
+	oracle->opaque = calloc(1,
+		    sizeof(struct ecb_byte_at_a_time_oracle_opaque));
+	if (oracle->opaque == NULL)
+		goto cleanup;
+	struct ecb_byte_at_a_time_oracle_opaque *info = oracle->opaque;
+
+	info->prefix  = bytes_dup(prefix);
+	info->message = bytes_dup(message);
+	info->key     = bytes_dup(key);
+	if (info->prefix == NULL || info->message == NULL || info->key == NULL)
+		goto cleanup;
+
+	oracle->query = ecb_byte_at_a_time_oracle_query;
+	oracle->batch = NULL;
+	oracle->free  = ecb_byte_at_a_time_oracle_free;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		ecb_byte_at_a_time_oracle_free(oracle);
+		oracle = NULL;
+	}
+	return (oracle);
+}
+
+
 struct bytes *
 ecb_byte_at_a_time_breaker14(
 		    const void *prefix,
 		    const void *message,
-		    const void *key)
-#define oracle(x)	ecb_byte_at_a_time_oracle14(prefix, (x), message, key)
+		    const void *key,
+		    struct ecb_byte_at_a_time_stats *stats_p)
+{
+	struct oracle *oracle = NULL;
+	struct bytes *recovered = NULL;
+
+	oracle = ecb_byte_at_a_time_oracle14_new(prefix, message, key);
+	if (oracle == NULL)
+		return (NULL);
+
+	recovered = ecb_byte_at_a_time_breaker(oracle);
+	if (recovered != NULL && stats_p != NULL)
+		stats_p->queries = oracle->stats.queries;
+
+	oracle_free(oracle);
+	return (recovered);
+}
+
+
+struct bytes *
+ecb_byte_at_a_time_breaker(struct oracle *oracle)
+#define encrypt(x)	ecb_oracle_encrypt(oracle, (x))
 {
 	const size_t expected_blocksize = aes_128_blocksize();
 	size_t blocksize = 0;
@@ -375,7 +473,7 @@ ecb_byte_at_a_time_breaker14(
 	size_t prevsize = 0;
 	for (size_t i = 0; i <= expected_blocksize && blocksize == 0; i++) {
 		payload = bytes_repeated(i, (uint8_t)'A');
-		ciphertext = oracle(payload);
+		ciphertext = encrypt(payload);
 		bytes_free(payload);
 		if (ciphertext == NULL)
 			goto cleanup;
@@ -402,21 +500,18 @@ ecb_byte_at_a_time_breaker14(
 	 * full blocks intact as the first one may be "mixed" with the prefix.
 	 */
 	payload = bytes_repeated(4 * blocksize, 0x0);
-	ciphertext = oracle(payload);
-	bytes_free(payload);
-	if (ciphertext == NULL)
-		goto cleanup;
 	/*
 	 * build a confirmation ciphertext, so that part of the prefix or
 	 * message cannot be misinterpreted as part of our payload
 	 */
-	payload = bytes_repeated(4 * blocksize, 0x1);
-	struct bytes *confirm = oracle(payload);
+	struct bytes *cpayload = bytes_repeated(4 * blocksize, 0x1);
+	struct bytes *confirm = NULL;
+	const int err = ecb_oracle_encrypt2(oracle, payload, cpayload,
+		    &ciphertext, &confirm);
+	bytes_free(cpayload);
 	bytes_free(payload);
-	if (confirm == NULL) {
-		bytes_free(ciphertext);
+	if (err != 0)
 		goto cleanup;
-	}
 	int ecb_found = 0;
 	for (size_t i = 0; i < ciphertext->len && !ecb_found; i += blocksize) {
 		double score = -1;
@@ -478,32 +573,36 @@ ecb_byte_at_a_time_breaker14(
 	 */
 	/* build ref0 and ref1 */
 	const size_t off = prefixlen - blocksize;
-	payload = bytes_repeated(blocksize, 0x0);
-	ciphertext = oracle(payload);
-	bytes_free(payload);
-	struct bytes *ref0 = bytes_slice(ciphertext, off, blocksize);
-	bytes_free(ciphertext);
-	if (ref0 == NULL)
-		goto cleanup;
-	payload = bytes_repeated(blocksize, 0x1);
-	ciphertext = oracle(payload);
-	bytes_free(payload);
-	struct bytes *ref1 = bytes_slice(ciphertext, off, blocksize);
-	bytes_free(ciphertext);
-	if (ref1 == NULL)
+	struct bytes *ref0 = NULL, *ref1 = NULL;
+	struct bytes *p0 = bytes_repeated(blocksize, 0x0);
+	struct bytes *p1 = bytes_repeated(blocksize, 0x1);
+	struct bytes *ct0 = NULL, *ct1 = NULL;
+	if (ecb_oracle_encrypt2(oracle, p0, p1, &ct0, &ct1) == 0) {
+		ref0 = bytes_slice(ct0, off, blocksize);
+		ref1 = bytes_slice(ct1, off, blocksize);
+	}
+	bytes_free(ct1);
+	bytes_free(ct0);
+	bytes_free(p1);
+	bytes_free(p0);
+	if (ref0 == NULL || ref1 == NULL) {
+		bytes_free(ref1);
+		bytes_free(ref0);
 		goto cleanup;
+	}
 	/* decrease the payload one byte at a time */
 	for (size_t i = 1; i <= blocksize; i++) {
-		payload = bytes_repeated(blocksize - i, 0x0);
-		ciphertext = oracle(payload);
-		bytes_free(payload);
-		struct bytes *block0 = bytes_slice(ciphertext, off, blocksize);
-		bytes_free(ciphertext);
-		payload = bytes_repeated(blocksize - i, 0x1);
-		ciphertext = oracle(payload);
-		bytes_free(payload);
-		struct bytes *block1 = bytes_slice(ciphertext, off, blocksize);
-		bytes_free(ciphertext);
+		struct bytes *block0 = NULL, *block1 = NULL;
+		p0 = bytes_repeated(blocksize - i, 0x0);
+		p1 = bytes_repeated(blocksize - i, 0x1);
+		if (ecb_oracle_encrypt2(oracle, p0, p1, &ct0, &ct1) == 0) {
+			block0 = bytes_slice(ct0, off, blocksize);
+			block1 = bytes_slice(ct1, off, blocksize);
+			bytes_free(ct1);
+			bytes_free(ct0);
+		}
+		bytes_free(p1);
+		bytes_free(p0);
 		if (block0 == NULL || block1 == NULL) {
 			bytes_free(block1);
 			bytes_free(block0);
@@ -536,53 +635,78 @@ recover:
 	const size_t ignblock = prefixlen / blocksize + 1;
 	/* the length of the prefix padding we need to generate */
 	const size_t prefixpadlen = ignblock * blocksize - prefixlen;
-	/* count of block needed to hold the full message */
-	const size_t nblocks = msglen / blocksize + 1;
-	/* a buffer holding our attempt at cracking the message bytes */
-	payload = bytes_zeroed(prefixpadlen + nblocks * blocksize);
-	if (payload == NULL)
-		goto cleanup;
-	/* offset of the last block in the ciphertext, the one holding the byte
-	   we are guessing */
-	const size_t coffset = (ignblock + nblocks - 1) * blocksize;
-	/* processing loop, breaking one message byte at a time */
-	for (size_t i = 1; i <= msglen; i++) {
-		struct bytes *pre, *ct, *iblock;
-		/* the index of the byte we are breaking in this iteration in
-		   the ciphertext given by the oracle */
-		const size_t index = prefixpadlen + nblocks * blocksize - i;
-		/* pad the start of the choosen plaintext so that the byte at
-		   index is at the very end of the block at coffset */
-		pre = bytes_repeated(index, (uint8_t)'A');
-		ct = oracle(pre);
-		/* retrieve the block holding the byte we are guessing */
-		iblock = bytes_slice(ct, coffset, blocksize);
-		bytes_free(ct);
-		/*
-		 * Our guess payload is of the form [pre . guessed . guess].
-		 * Just like for iblock `pre' is leading, `guessed' are the byte
-		 * we already know and `guess' is our try for the byte at index.
-		 */
-		(void)bytes_put(payload, 0, pre);
-		(void)bytes_sput(payload, index, recovered, 0, i);
-		/* try each possible value for the byte until we find a match */
-		for (uint16_t byte = 0; byte <= UINT8_MAX; byte++) {
-			struct bytes *block;
-			payload->data[index + i - 1] = (uint8_t)byte;
-			ct = oracle(payload);
-			block = bytes_slice(ct, coffset, blocksize);
-			bytes_free(ct);
-			const int found = (bytes_bcmp(block, iblock) == 0);
-			bytes_free(block);
-			if (found) {
-				recovered->data[i - 1] = (uint8_t)byte;
-				break;
+	/* count of dictionary blocks, one per possible byte value */
+	const size_t ndict = UINT8_MAX + 1;
+	/*
+	 * processing loop, breaking one message byte at a time.
+	 *
+	 * Because ECB encrypts every block independently, we don't need one
+	 * oracle call per guess. Instead, each payload holds the full
+	 * dictionary of 256 guess blocks followed by the "filler" shifting the
+	 * message byte we are breaking at the very end of a block, visually:
+	 *
+	 *     [p . pp][g . 0x00]...[g . 0xff][A* . m0 ... mi][...]
+	 *             \___________________/ \__________/
+	 *                  dictionary          target
+	 *
+	 * where p is the prefix, pp the prefix padding, g the blocksize - 1
+	 * bytes preceding the message byte mi (either filler or already
+	 * recovered bytes), and A* the filler. Exactly one dictionary block
+	 * encrypts to the same ciphertext as the target block, giving away mi
+	 * in a single oracle call.
+	 */
+	for (size_t i = 0; i < msglen; i++) {
+		/* the filler length, so that the message byte at i is at the
+		   very end of a block */
+		const size_t fillerlen = blocksize - 1 - i % blocksize;
+		const size_t dictoff = prefixpadlen;
+		payload = bytes_repeated(dictoff + ndict * blocksize + fillerlen,
+			    (uint8_t)'A');
+		if (payload == NULL)
+			goto cleanup;
+		/* build the dictionary, each block being the blocksize - 1
+		   bytes preceding the message byte at i followed by a guess */
+		for (size_t byte = 0; byte < ndict; byte++) {
+			uint8_t *const block = payload->data + dictoff +
+				    byte * blocksize;
+			for (size_t j = 0; j < blocksize - 1; j++) {
+				/* the stream position of this block byte, from
+				   the start of the filler */
+				const size_t pos = i + j + 1;
+				if (pos >= blocksize)
+					block[j] = recovered->data[pos - blocksize];
 			}
+			block[blocksize - 1] = (uint8_t)byte;
+		}
+		ciphertext = encrypt(payload);
+		bytes_free(payload);
+		payload = NULL;
+		if (ciphertext == NULL)
+			goto cleanup;
+		/* offset of the dictionary and the target block in the
+		   ciphertext */
+		const size_t doffset = ignblock * blocksize;
+		const size_t toffset = (ignblock + ndict + i / blocksize) *
+			    blocksize;
+		if (toffset + blocksize > ciphertext->len) {
+			bytes_free(ciphertext);
+			goto cleanup;
+		}
+		/* find the dictionary block matching the target block */
+		const uint8_t *const target = ciphertext->data + toffset;
+		size_t byte;
+		for (byte = 0; byte < ndict; byte++) {
+			const uint8_t *const block = ciphertext->data +
+				    doffset + byte * blocksize;
+			/* NOTE: we don't need const time comparison here */
+			if (memcmp(block, target, blocksize) == 0)
+				break;
 		}
-		bytes_free(iblock);
-		bytes_free(pre);
+		bytes_free(ciphertext);
+		if (byte == ndict)
+			goto cleanup;
+		recovered->data[i] = (uint8_t)byte;
 	}
-	bytes_free(payload);
 
 	success = 1;
 	/* FALLTHROUGH */
@@ -593,4 +717,92 @@ cleanup:
 	}
 	return (recovered);
 }
-#undef oracle
+#undef encrypt
+
+
+static struct bytes *
+ecb_oracle_encrypt(struct oracle *oracle, const struct bytes *payload)
+{
+	struct bytes *ciphertext = NULL;
+
+	if (oracle_query(oracle, payload, &ciphertext) != 0) {
+		bytes_free(ciphertext);
+		ciphertext = NULL;
+	}
+
+	return (ciphertext);
+}
+
+
+static int
+ecb_oracle_encrypt2(struct oracle *oracle,
+		    const struct bytes *p0, const struct bytes *p1,
+		    struct bytes **ct0_p, struct bytes **ct1_p)
+{
+	const struct bytes *inputs[2] = { p0, p1 };
+	struct bytes *outputs[2] = { NULL, NULL };
+	int answers[2] = { -1, -1 };
+	int success = 0;
+
+	if (oracle_batch(oracle, 2, inputs, answers, outputs) != 0)
+		goto cleanup;
+	if (answers[0] != 0 || answers[1] != 0)
+		goto cleanup;
+	if (outputs[0] == NULL || outputs[1] == NULL)
+		goto cleanup;
+
+	success = 1;
+
+	*ct0_p = outputs[0];
+	*ct1_p = outputs[1];
+
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		bytes_free(outputs[1]);
+		bytes_free(outputs[0]);
+	}
+	return (success ? 0 : -1);
+}
+
+
+static int
+ecb_byte_at_a_time_oracle_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p)
+{
+	struct ecb_byte_at_a_time_oracle_opaque *info = NULL;
+	struct bytes *ciphertext = NULL;
+
+	/* sanity checks */
+	if (oracle == NULL || oracle->opaque == NULL)
+		return (-1);
+	info = oracle->opaque;
+
+	ciphertext = ecb_byte_at_a_time_oracle14(info->prefix, input,
+		    info->message, info->key);
+	if (ciphertext == NULL)
+		return (-1);
+
+	if (output_p != NULL)
+		*output_p = ciphertext;
+	else
+		bytes_free(ciphertext);
+	return (0);
+}
+
+
+static void
+ecb_byte_at_a_time_oracle_free(struct oracle *oracle)
+{
+	if (oracle == NULL)
+		return;
+
+	struct ecb_byte_at_a_time_oracle_opaque *info = oracle->opaque;
+	if (info != NULL) {
+		bytes_free(info->key);
+		bytes_free(info->message);
+		bytes_free(info->prefix);
+		freezero(info, sizeof(struct ecb_byte_at_a_time_oracle_opaque));
+	}
+	freezero(oracle, sizeof(struct oracle));
+}
@@ -4,9 +4,21 @@
  * break_ecb.h
  *
  * ECB analysis stuff for cryptopals.com challenges.
+ *
+ * Reentrant as long as the given oracle is.
  */
 #include "bytes.h"
 #include "cookie.h"
+#include "oracle.h"
+
+
+/*
+ * Statistics about a byte-at-a-time ECB breaker run.
+ */
+struct ecb_byte_at_a_time_stats {
+	/* count of calls made to the encryption oracle */
+	size_t queries;
+};
 
 
 /*
@@ -61,9 +73,11 @@ struct bytes	*ecb_byte_at_a_time_oracle12(
  *
  * Returns a pointer to a newly allocated bytes struct that should passed to
  * bytes_free(), or NULL if malloc(3) failed or if any given parameter is NULL.
+ *
+ * If stats_p is not NULL, it is set to the statistics of the run on success.
  */
 struct bytes	*ecb_byte_at_a_time_breaker12(const void *message,
-		    const void *key);
+		    const void *key, struct ecb_byte_at_a_time_stats *stats_p);
 
 /*
  * ECB Encryption Oracle as described by Set 2 / Challenge 13.
@@ -105,15 +119,45 @@ struct bytes	*ecb_byte_at_a_time_oracle14(
 		    const struct bytes *message,
 		    const struct bytes *key);
 
+/*
+ * Create an oracle answering like ecb_byte_at_a_time_oracle14() with the given
+ * prefix, message and key. The oracle input is the payload, its output the
+ * ciphertext and its answer always 0.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure.
+ */
+struct oracle	*ecb_byte_at_a_time_oracle14_new(
+		    const struct bytes *prefix,
+		    const struct bytes *message,
+		    const struct bytes *key);
+
 /*
  * ECB Decryption Oracle as described by Set 2 / Challenge 14.
  *
+ * The message is recovered using a single oracle call per byte, see
+ * ecb_byte_at_a_time_breaker() implementation.
+ *
  * Returns a pointer to a newly allocated bytes struct that should passed to
  * bytes_free(), or NULL if malloc(3) failed or if any given parameter is NULL.
+ *
+ * If stats_p is not NULL, it is set to the statistics of the run on success.
  */
 struct bytes	*ecb_byte_at_a_time_breaker14(
 		    const void *prefix,
 		    const void *message,
-		    const void *key);
+		    const void *key,
+		    struct ecb_byte_at_a_time_stats *stats_p);
+
+/*
+ * Generic byte-at-a-time ECB breaker, recovering the message appended by the
+ * given oracle to the payload before encryption as in Set 2 / Challenge 12 and
+ * 14. The oracle should behave like the ones created by
+ * ecb_byte_at_a_time_oracle14_new().
+ *
+ * Returns a pointer to a newly allocated bytes struct that should passed to
+ * bytes_free(), or NULL if malloc(3) failed or the oracle failed.
+ */
+struct bytes	*ecb_byte_at_a_time_breaker(struct oracle *oracle);
 
 #endif /* ndef BREAK_ECB_H */
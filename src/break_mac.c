@@ -5,235 +5,587 @@
  */
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/time.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "compat.h"
-#include "sha1.h"
-#include "md4.h"
+#include "hash.h"
 #include "mac.h"
 #include "break_mac.h"
 
 
-/* Describe how a 64-bit length value is encoded as bytes */
-enum length_encoding {
-	HIGH_WORD_FIRST_BE,
-	LOW_WORD_FIRST_LE,
+/*
+ * Maximum count of key lengths tried at once by extend_mac_keyed_prefix(). The
+ * forged MACs of a batch are computed by a single multi-buffer hash call and
+ * submitted to the oracle through oracle_find(). The first batch is the size of
+ * the hash SIMD lanes and each miss double the batch size, so that short keys
+ * don't waste queries while long ones are submitted in large batches.
+ */
+#define	MAC_EXTEND_MIN_BATCH	8
+#define	MAC_EXTEND_MAX_BATCH	64
+
+/*
+ * break_timing_leak() tuning. Each MAC byte candidate is sampled at most
+ * TIMING_LEAK_MAX_SAMPLES times. A candidate sampled at least
+ * TIMING_LEAK_MIN_SAMPLES times is chosen when its duration exceeds the
+ * runner-up's by TIMING_LEAK_CONFIDENCE standard errors, the minimum making a
+ * few outliers unable to fake a lead. After TIMING_LEAK_MAX_REJECTS rejected
+ * choices at a position the attack backtracks to the previous one, and gives
+ * up after TIMING_LEAK_MAX_BACKTRACKS backtracks per MAC byte.
+ */
+#define	TIMING_LEAK_MIN_SAMPLES		8
+#define	TIMING_LEAK_MAX_SAMPLES		256
+#define	TIMING_LEAK_CONFIDENCE		4.0
+#define	TIMING_LEAK_MAX_REJECTS		2
+#define	TIMING_LEAK_MAX_BACKTRACKS	4
+
+/* returned by timing_leak_break_byte() when no candidate is left */
+#define	TIMING_LEAK_NONE	(UINT8_MAX + 1)
+
+/*
+ * How long to wait for a timing leaking server response, in milliseconds.
+ */
+#define	TIMING_LEAK_TIMEOUT	30000
+
+/*
+ * timing_leaking_serve() limits: the size of a client request headers, and the
+ * count of events handled by each epoll_wait(2) call.
+ */
+#define	TIMING_SERVE_BUFSIZE	4096
+#define	TIMING_SERVE_EVENTS	64
+
+/* the clock used to time the requests, not subject to NTP adjustments */
+#if defined(CLOCK_MONOTONIC_RAW)
+#define	TIMING_LEAK_CLOCK	CLOCK_MONOTONIC_RAW
+#else
+#define	TIMING_LEAK_CLOCK	CLOCK_MONOTONIC
+#endif
+
+
+/*
+ * opaque struct used by oracles created by mac_keyed_prefix_oracle_new().
+ */
+struct mac_keyed_prefix_oracle_opaque {
+	const struct hash_function *hash;
+	struct bytes *key;
+};
+
+/* struct oracle method members implementations */
+static int	mac_keyed_prefix_oracle_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p);
+static void	mac_keyed_prefix_oracle_free(struct oracle *oracle);
+
+/*
+ * Progress of break_timing_leak() at one MAC byte position.
+ */
+struct timing_leak_position {
+	/* the median duration of all the candidates at this position */
+	uint64_t base;
+	/* the duration of the chosen candidate */
+	uint64_t level;
+	/* count of choices rejected at this position */
+	size_t rejects;
+	/* the candidates ruled out */
+	uint8_t excluded[UINT8_MAX + 1];
+};
+
+/*
+ * Find the byte at position i of mac, see break_timing_leak(). The candidates
+ * set in excluded are not tried. base_p and level_p are set like the struct
+ * timing_leak_position members.
+ *
+ * Returns the chosen byte value, TIMING_LEAK_NONE when every candidate has been
+ * ruled out (or for the last byte, when none was valid), or -1 on error. When
+ * the probe reports a valid MAC found_p is set and mac is the valid MAC.
+ */
+static int	timing_leak_break_byte(timing_probe_func_t *probe,
+		    void *arg, struct bytes *mac, size_t i,
+		    const uint8_t *excluded, uint64_t *base_p,
+		    uint64_t *level_p, int *found_p);
+
+/*
+ * Returns the interquartile mean of the n given values, i.e. the mean of the
+ * values left when the lowest and highest quarters are discarded. scratch
+ * must be able to hold n values.
+ */
+static uint64_t	interquartile_mean(const uint64_t *values, size_t n,
+		    uint64_t *scratch);
+
+/*
+ * Returns the median of the n given values, sorting them.
+ */
+static uint64_t	median(uint64_t *values, size_t n);
+
+/* qsort(3) comparison function for uint64_t values */
+static int	uint64_cmp(const void *a, const void *b);
+
+/*
+ * A keep-alive HTTP connection to a timing leaking server.
+ */
+struct http_conn {
+	/* the connection socket, -1 when closed */
+	int sock;
+	/* count of responses received on this connection */
+	size_t served;
+	/* index of the request in flight, SIZE_MAX when idle */
+	size_t request;
+	/* when the request in flight was sent */
+	uint64_t sent;
+	/* whether the response first byte has been timestamped */
+	int timed;
+	/* the response received so far, NUL-terminated */
+	char *data;
+	size_t len, cap;
 };
 
+/*
+ * Target of the break_timing_leaking_server() probe.
+ */
+struct timing_leaking_server {
+	const struct addrinfo *res;
+	const char *hostname;
+	const char *fmt;
+	/* connection pool, one request in flight on each */
+	size_t nconn;
+	struct http_conn *conns;
+};
+
+/*
+ * timing_probe_func_t implementation querying a timing leaking server, arg
+ * is a struct timing_leaking_server.
+ *
+ * The requests are sent in order, each on the first idle connection, so that
+ * the interleaving of the candidates made by break_timing_leak() spreads the
+ * network jitter across them. A request duration is measured from the request
+ * being sent to the first byte of its response.
+ */
+static int	timing_leaking_server_probe(void *arg, size_t count,
+		    const struct bytes *const *macs, int *statuses,
+		    uint64_t *ns);
+
+/*
+ * Send the HTTP request for the given MAC on the given connection, opening it
+ * first if needed, and mark it as in flight under the given index.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	http_conn_send(struct http_conn *conn,
+		    const struct timing_leaking_server *server, size_t request,
+		    const struct bytes *mac);
+
+/*
+ * Receive available data of the response to the request in flight on the
+ * given connection. The connection is closed when the server doesn't keep it
+ * alive.
+ *
+ * Returns 1 when the response is complete and status_p has been set to its HTTP
+ * status code, 0 when more data is expected, 2 when the server has closed a
+ * reused connection before answering and the request should be sent again, and
+ * -1 on error.
+ */
+static int	http_conn_recv(struct http_conn *conn, int *status_p);
 
 /*
- * Returns the padding bytes for a message of the given length, or NULL on
- * error.
+ * Close the given connection if opened and drop any buffered data.
  */
-static struct bytes	*sha1_padding(size_t len);
-static struct bytes	*md4_padding(size_t len);
-static struct bytes	*padding(size_t len, size_t blocksize,
-		    enum length_encoding le);
+static void	http_conn_close(struct http_conn *conn);
 
 /*
- * Perform a HTTP request to the server and compute request time.
+ * Parse the HTTP response in data. eof is non-zero when the server has closed
+ * the connection after sending it.
  *
- * Returns -1 on error, the HTTP status code otherwise.
+ * Returns 1 when the response is complete, setting status_p to its status code
+ * and keepalive_p to whether the connection may be reused, 0 when more data is
+ * expected, -1 when it is malformed or unsupported.
  */
-static int	request_timing_leaking_server(const struct addrinfo *res,
-		    const char *fmt, const struct bytes *mac,
-		    struct timeval *tdiff_p);
+static int	http_response_parse(const char *data, size_t len, int eof,
+		    int *status_p, int *keepalive_p);
+
+/*
+ * Acknowledge the data received on the given socket right away. A server
+ * writing its response in several parts (e.g. the headers then the body) would
+ * otherwise wait for our delayed ACK between them because of Nagle's
+ * algorithm. This is not sticky: sending data makes the kernel delay the ACKs
+ * again, so it has to be set again after each send(2) and recv(2).
+ */
+static void	tcp_quickack(int sock);
+
+/*
+ * Returns the current time of TIMING_LEAK_CLOCK in nanoseconds.
+ */
+static uint64_t	timing_leak_now(void);
+
+#if defined(__linux__)
+/*
+ * A client connection of timing_leaking_serve(), linked to the other clients of
+ * the same thread.
+ */
+struct timing_serve_client {
+	int sock;
+	struct timing_serve_client *prev, *next;
+	/* the request(s) received so far, NUL-terminated */
+	size_t len;
+	char data[TIMING_SERVE_BUFSIZE + 1];
+};
+
+/*
+ * State shared by the timing_leaking_serve() threads.
+ */
+struct timing_serve_ctx {
+	int listener;
+	const struct bytes *key;
+	uint64_t delay_ns;
+	/* written to by the first thread failing to stop the others */
+	int stop[2];
+};
+
+/*
+ * timing_leaking_serve() thread start routine, arg is a struct
+ * timing_serve_ctx. Serve the clients accepted by this thread until an error
+ * occurs or another thread stops.
+ */
+static void	*timing_serve_worker(void *arg);
+
+/*
+ * Receive available data from the given client and answer its complete
+ * requests.
+ *
+ * Returns 0 when the connection should be kept, -1 when it should be closed.
+ */
+static int	timing_serve_client_recv(const struct timing_serve_ctx *ctx,
+		    struct timing_serve_client *client);
+
+/*
+ * Answer the given request, i.e. its NUL-terminated request line and headers.
+ *
+ * Returns 0 when the connection should be kept, -1 when it should be closed.
+ */
+static int	timing_serve_request(const struct timing_serve_ctx *ctx,
+		    int sock, char *request);
+
+/*
+ * Compare the known and unknown hex strings ignoring the case one character at
+ * a time like the Python server, busy-waiting delay_ns nanoseconds after each
+ * matching character.
+ *
+ * Returns 1 when they match, 0 otherwise.
+ */
+static int	insecure_compare(const char *known, const char *unknown,
+		    uint64_t delay_ns);
+
+/*
+ * Decode the given URL query component in place, i.e. "+" and %XX escapes.
+ *
+ * Returns 0 on success, -1 when it is malformed.
+ */
+static int	url_decode(char *s);
+
+/*
+ * Returns the content of the file at the given path, or NULL on error.
+ */
+static struct bytes	*file_read(const char *path);
+#endif /* defined(__linux__) */
+
+
+struct oracle *
+sha1_mac_keyed_prefix_oracle_new(const struct bytes *key)
+{
+	return (mac_keyed_prefix_oracle_new(&hash_sha1, key));
+}
+
+
+struct oracle *
+md4_mac_keyed_prefix_oracle_new(const struct bytes *key)
+{
+	return (mac_keyed_prefix_oracle_new(&hash_md4, key));
+}
 
 
 int
-extend_sha1_mac_keyed_prefix(const void *key,
+extend_sha1_mac_keyed_prefix(struct oracle *oracle,
 		    const struct bytes *msg, const struct bytes *mac,
 		    struct bytes **msg_p, struct bytes **mac_p)
-#define oracle(m, c)	sha1_mac_keyed_prefix_verify(key, (m), (c))
 {
-	struct bytes *extension = NULL, *admin = NULL, *digest = NULL;
-	struct sha1_ctx ctx;
-	const size_t scount = sizeof(ctx.state) / sizeof(ctx.state[0]);
-	uint32_t *h = NULL;
-	size_t hcount = 0;
+	return (extend_mac_keyed_prefix(&hash_sha1, oracle,
+		    0, MAC_KEYED_PREFIX_MAX_KEYLEN, msg, mac, msg_p, mac_p));
+}
+
+
+int
+extend_md4_mac_keyed_prefix(struct oracle *oracle,
+		    const struct bytes *msg, const struct bytes *mac,
+		    struct bytes **msg_p, struct bytes **mac_p)
+{
+	return (extend_mac_keyed_prefix(&hash_md4, oracle,
+		    0, MAC_KEYED_PREFIX_MAX_KEYLEN, msg, mac, msg_p, mac_p));
+}
+
+
+int
+extend_mac_keyed_prefix(const struct hash_function *hash,
+		    struct oracle *oracle, size_t minkeylen, size_t maxkeylen,
+		    const struct bytes *msg, const struct bytes *mac,
+		    struct bytes **msg_p, struct bytes **mac_p)
+{
+	/* the candidates of the current batch, one per key length */
+	union hash_ctx ctxs[MAC_EXTEND_MAX_BATCH];
+	const union hash_ctx *pctxs[MAC_EXTEND_MAX_BATCH];
+	const struct bytes *extensions[MAC_EXTEND_MAX_BATCH];
+	struct bytes *admins[MAC_EXTEND_MAX_BATCH] = { NULL };
+	struct bytes *digests[MAC_EXTEND_MAX_BATCH] = { NULL };
+	struct bytes *queries[MAC_EXTEND_MAX_BATCH] = { NULL };
+	struct bytes *extension = NULL;
+	size_t batch = MAC_EXTEND_MIN_BATCH, found = MAC_EXTEND_MAX_BATCH;
 	int success = 0;
 
-	if (msg == NULL || mac == NULL)
+	/* sanity checks */
+	if (hash == NULL || oracle == NULL || msg == NULL || mac == NULL)
+		goto cleanup;
+	if (mac->len != hash->hashlength() || minkeylen > maxkeylen)
 		goto cleanup;
-	/* We'll try to break up to a keylength of 128 bytes. */
-	if (msg->len >= ((UINT64_MAX - 128) / 8))
+	/* the forged messages bit length must fit in 64 bits */
+	if (maxkeylen > UINT64_MAX / 32 || msg->len > UINT64_MAX / 32)
 		goto cleanup;
 
-	/* the extension payload */
+	/* the extension payload, the same for every key length */
 	extension = bytes_from_str(";admin=true;");
 	if (extension == NULL)
 		goto cleanup;
+	for (size_t i = 0; i < MAC_EXTEND_MAX_BATCH; i++) {
+		pctxs[i] = &ctxs[i];
+		extensions[i] = extension;
+	}
 
-	/* "unpack" the message's MAC so that we can use it to setup a SHA-1
-	   Intermediate Hash State */
-	h = bytes_to_uint32_be(mac, &hcount);
-	if (h == NULL || hcount != scount)
-		goto cleanup;
-
-	/* try key length up to 1024-bit long, assume that it is a 8-bit
-	   multiple */
-	for (size_t keylen = 0; keylen <= 128; keylen++) {
-		ctx.len = keylen + msg->len;
-		/* generate the glue padding */
-		struct bytes *glue = sha1_padding(ctx.len);
-		if (glue == NULL)
-			goto cleanup;
-		/* update the length, now that we know the glue padding */
-		ctx.len += glue->len;
-		/* generate the full admin message */
-		admin = bytes_joined(3, msg, glue, extension);
-		bytes_free(glue);
-		if (admin == NULL)
-			goto cleanup;
-		/* reset the SHA-1 Intermediate Hash State */
-		(void)memcpy(ctx.state, h, sizeof(ctx.state));
-		/* extend the SHA-1 Intermediate Hash State */
-		if (sha1_hash_ctx(&ctx, extension) != 0)
-			goto cleanup;
-		digest = bytes_from_uint32_be(ctx.state, scount);
-		if (digest == NULL)
+	/* try the key lengths in order, assume that it is a 8-bit multiple */
+	for (size_t first = minkeylen; first <= maxkeylen; ) {
+		const size_t count = (maxkeylen - first < batch ?
+			    maxkeylen - first + 1 : batch);
+		for (size_t i = 0; i < count; i++) {
+			uint64_t len = first + i + msg->len;
+			/* generate the glue padding */
+			struct bytes *glue = hash->padding(len);
+			if (glue == NULL)
+				goto cleanup;
+			/* update the length, now that we know the glue
+			   padding */
+			len += glue->len;
+			/* generate the full admin message */
+			admins[i] = bytes_joined(3, msg, glue, extension);
+			bytes_free(glue);
+			if (admins[i] == NULL)
+				goto cleanup;
+			/* "unpack" the message's MAC to setup the Intermediate
+			   Hash State, as if key || msg || glue had just been
+			   processed */
+			if (hash->import_state(&ctxs[i], mac->data, len) != 0)
+				goto cleanup;
+		}
+		/* extend all the Intermediate Hash States at once */
+		if (hash->hash_many_ctx(pctxs, extensions, count, digests) != 0)
 			goto cleanup;
-		const int ret = oracle(admin, digest);
+		/* the oracle input is [mac . msg] */
+		for (size_t i = 0; i < count; i++) {
+			queries[i] = bytes_joined(2, digests[i], admins[i]);
+			if (queries[i] == NULL)
+				goto cleanup;
+		}
+		size_t index = 0;
+		const int ret = oracle_find(oracle, count,
+			    (const struct bytes *const *)queries, 0, &index);
 		if (ret == -1) /* error */
 			goto cleanup;
-		if (ret == 0) /* success */
+		if (ret == 0) { /* success */
+			found = index;
+			break;
+		}
+		for (size_t i = 0; i < count; i++) {
+			bytes_free(queries[i]);
+			queries[i] = NULL;
+			bytes_free(digests[i]);
+			digests[i] = NULL;
+			bytes_free(admins[i]);
+			admins[i] = NULL;
+		}
+		if (maxkeylen - first < count)
 			break;
-		bytes_free(admin);
-		admin = NULL;
-		bytes_free(digest);
-		digest = NULL;
+		first += count;
+		if (batch < MAC_EXTEND_MAX_BATCH)
+			batch *= 2;
 	}
-	if (admin == NULL || digest == NULL)
+	if (found == MAC_EXTEND_MAX_BATCH)
 		goto cleanup;
 
 	success = 1;
 
 	if (msg_p != NULL) {
-		*msg_p = admin;
-		admin = NULL;
+		*msg_p = admins[found];
+		admins[found] = NULL;
 	}
 	if (mac_p != NULL) {
-		*mac_p = digest;
-		digest = NULL;
+		*mac_p = digests[found];
+		digests[found] = NULL;
 	}
 
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(admin);
-	bytes_free(digest);
-	freezero(h, hcount * sizeof(uint32_t));
+	for (size_t i = 0; i < MAC_EXTEND_MAX_BATCH; i++) {
+		bytes_free(queries[i]);
+		bytes_free(digests[i]);
+		bytes_free(admins[i]);
+	}
 	bytes_free(extension);
 	return (success ? 0 : -1);
 }
-#undef oracle
 
 
-int
-extend_md4_mac_keyed_prefix(const void *key,
-		    const struct bytes *msg, const struct bytes *mac,
-		    struct bytes **msg_p, struct bytes **mac_p)
-#define oracle(m, c)	md4_mac_keyed_prefix_verify(key, (m), (c))
+struct bytes *
+break_timing_leak(timing_probe_func_t *probe, void *arg, size_t maclen)
 {
-	struct bytes *extension = NULL, *admin = NULL, *digest = NULL;
-	struct md4_ctx ctx;
-	const size_t scount = sizeof(ctx.state) / sizeof(ctx.state[0]);
-	uint32_t *h = NULL;
-	size_t hcount = 0;
+	struct timing_leak_position *positions = NULL;
+	struct bytes *mac = NULL;
+	size_t backtracks = 0;
 	int success = 0;
 
-	if (msg == NULL || mac == NULL)
-		goto cleanup;
-	/* We'll try to break up to a keylength of 128 bytes. */
-	if (msg->len >= ((UINT64_MAX - 128) / 8))
-		goto cleanup;
-
-	/* the extension payload */
-	extension = bytes_from_str(";admin=true;");
-	if (extension == NULL)
+	/* sanity checks */
+	if (probe == NULL || maclen == 0)
 		goto cleanup;
 
-	/* "unpack" the message's MAC so that we can use it to setup a MD4
-	   Intermediate Hash State */
-	h = bytes_to_uint32_le(mac, &hcount);
-	if (h == NULL || hcount != scount)
+	mac = bytes_zeroed(maclen);
+	positions = calloc(maclen, sizeof(struct timing_leak_position));
+	if (mac == NULL || positions == NULL)
 		goto cleanup;
 
-	/* try key length up to 1024-bit long, assume that it is a 8-bit
-	   multiple */
-	for (size_t keylen = 0; keylen <= 128; keylen++) {
-		ctx.len = keylen + msg->len;
-		/* generate the glue padding */
-		struct bytes *glue = md4_padding(ctx.len);
-		if (glue == NULL)
-			goto cleanup;
-		/* update the length, now that we know the glue padding */
-		ctx.len += glue->len;
-		/* generate the full admin message */
-		admin = bytes_joined(3, msg, glue, extension);
-		bytes_free(glue);
-		if (admin == NULL)
-			goto cleanup;
-		/* reset the MD4 Intermediate Hash State */
-		(void)memcpy(ctx.state, h, sizeof(ctx.state));
-		/* extend the MD4 Intermediate Hash State */
-		if (md4_hash_ctx(&ctx, extension) != 0)
+	size_t i = 0;
+	while (i < maclen) {
+		struct timing_leak_position *pos = &positions[i];
+		uint64_t base = 0, level = 0;
+		int found = 0;
+		const int byte = timing_leak_break_byte(probe, arg, mac, i,
+			    pos->excluded, &base, &level, &found);
+		if (byte == -1) /* error */
 			goto cleanup;
-		digest = bytes_from_uint32_le(ctx.state, scount);
-		if (digest == NULL)
-			goto cleanup;
-		const int ret = oracle(admin, digest);
-		if (ret == -1) /* error */
-			goto cleanup;
-		if (ret == 0) /* success */
+		if (found) { /* success */
+			success = 1;
 			break;
-		bytes_free(admin);
-		admin = NULL;
-		bytes_free(digest);
-		digest = NULL;
-	}
-	if (admin == NULL || digest == NULL)
-		goto cleanup;
+		}
 
-	success = 1;
+		int reject = (byte == TIMING_LEAK_NONE);
+		if (!reject && i > 0) {
+			/* the chosen candidate should lead the others by about
+			   as much as the previous choices did. No candidate
+			   leads after a wrong guess, and one matching only its
+			   first hex character leads by half. Both are measured
+			   by the same race, so this holds even when the server
+			   speed drifts. */
+			uint64_t step = 0;
+			for (size_t j = 0; j < i; j++)
+				step += positions[j].level - positions[j].base;
+			step /= i;
+			const uint64_t lead = (level > base ? level - base : 0);
+			if (lead < step / 2)
+				reject = 1;
+		}
+		if (!reject) {
+			mac->data[i] = (uint8_t)byte;
+			pos->base  = base;
+			pos->level = (level > base ? level : base);
+			i++;
+			continue;
+		}
 
-	if (msg_p != NULL) {
-		*msg_p = admin;
-		admin = NULL;
+		/* rule out this choice and try again, unless the previous
+		   byte guess is more likely to be wrong */
+		if (byte != TIMING_LEAK_NONE &&
+			    ++pos->rejects <= TIMING_LEAK_MAX_REJECTS) {
+			pos->excluded[byte] = 1;
+			continue;
+		}
+		backtracks++;
+		if (i == 0 || backtracks > TIMING_LEAK_MAX_BACKTRACKS * maclen)
+			goto cleanup;
+		(void)memset(pos->excluded, 0, sizeof(pos->excluded));
+		pos->rejects = 0;
+		mac->data[i] = 0;
+		i--;
+		positions[i].excluded[mac->data[i]] = 1;
 	}
-	if (mac_p != NULL) {
-		*mac_p = digest;
-		digest = NULL;
+
+	/* FALLTHROUGH */
+cleanup:
+	free(positions);
+	if (!success) {
+		bytes_free(mac);
+		mac = NULL;
 	}
+	return (mac);
+}
+
+
+int
+break_timing_leak_byte(timing_probe_func_t *probe, void *arg,
+		    const struct bytes *mac, size_t i, uint64_t *base_p,
+		    uint64_t *level_p)
+{
+	const uint8_t excluded[UINT8_MAX + 1] = { 0 };
+	struct bytes *guess = NULL;
+	uint64_t base = 0, level = 0;
+	int found = 0, byte = -1;
+
+	/* sanity checks */
+	if (probe == NULL || mac == NULL || i + 1 >= mac->len)
+		goto cleanup;
+
+	guess = bytes_dup(mac);
+	if (guess == NULL)
+		goto cleanup;
+	byte = timing_leak_break_byte(probe, arg, guess, i, excluded, &base,
+		    &level, &found);
+	if (byte == TIMING_LEAK_NONE)
+		byte = -1;
+	if (byte == -1)
+		goto cleanup;
+
+	if (base_p != NULL)
+		*base_p = base;
+	if (level_p != NULL)
+		*level_p = level;
 
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(admin);
-	bytes_free(digest);
-	freezero(h, hcount * sizeof(uint32_t));
-	bytes_free(extension);
-	return (success ? 0 : -1);
+	bytes_free(guess);
+	return (byte);
 }
-#undef oracle
 
 
 struct bytes *
-break_timing_leaking_server(const char *hostname,
-		    const char *port, const char *fmt, size_t maclen)
+break_timing_leaking_server(const char *hostname, const char *port,
+		    const char *fmt, size_t maclen, size_t nconn)
 {
-	struct bytes *mac = NULL;
+	struct timing_leaking_server server = { 0 };
+	struct bytes *mac = NULL, *zero = NULL;
 	struct addrinfo hints;
 	struct addrinfo *res = NULL, *res0 = NULL;
 	int success = 0;
 
 	/* sanity checks */
-	if (hostname == NULL || fmt == NULL)
+	if (hostname == NULL || fmt == NULL || nconn == 0)
 		goto cleanup;
 
 	/* find the addresses for the given hostname (both IPv6 and IPv4).
@@ -258,46 +610,47 @@ break_timing_leaking_server(const char *hostname,
 	if (res == NULL)
 		goto cleanup;
 
-	/* allocate enough space for the MAC we're trying to break */
-	mac = bytes_zeroed(maclen);
-	if (mac == NULL)
+	server.res = res;
+	server.hostname = hostname;
+	server.fmt = fmt;
+	server.conns = calloc(nconn, sizeof(struct http_conn));
+	if (server.conns == NULL)
 		goto cleanup;
+	for (size_t i = 0; i < nconn; i++) {
+		server.conns[i].sock = -1;
+		server.conns[i].request = SIZE_MAX;
+	}
+	server.nconn = nconn;
 
-	/* Perform one request to warm up the server (filesystem cache etc.) */
-	(void)request_timing_leaking_server(res, fmt, mac, NULL);
-
-	/* break one byte MAC byte at a time */
-	for (size_t i = 0; i < mac->len; i++) {
-		/* very naive heuristic, we try each possible byte value
-		   remembering the one where the request took the most time */
-		struct {
-			struct timeval tv;
-			uint8_t byte;
-		} slow;
-		timerclear(&slow.tv);
-		slow.byte = 0;
-		for (uint16_t byte = 0; byte <= UINT8_MAX; byte++) {
-			struct timeval t;
-			mac->data[i] = byte;
-			if (request_timing_leaking_server(res, fmt, mac, &t) == -1)
-				goto cleanup;
-			if (timercmp(&t, &slow.tv, >)) {
-				slow.tv.tv_sec  = t.tv_sec;
-				slow.tv.tv_usec = t.tv_usec;
-				slow.byte = (uint8_t)byte;
-			}
-		}
-		mac->data[i] = slow.byte;
+	/* Perform one request per connection to open them all and warm up the
+	   server (filesystem cache etc.) */
+	zero = bytes_zeroed(maclen);
+	if (zero == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < nconn; i++) {
+		const struct bytes *macs[1] = { zero };
+		int status = 0;
+		uint64_t ns = 0;
+		if (timing_leaking_server_probe(&server, 1, macs, &status,
+			    &ns) != 0)
+			goto cleanup;
 	}
 
-	/* ultimately, verify that our guessed MAC is valid. The server should
-	   respond with a "200 OK" HTTP status if we succeeded. */
-	if (request_timing_leaking_server(res, fmt, mac, NULL) != 200)
+	mac = break_timing_leak(timing_leaking_server_probe, &server, maclen);
+	if (mac == NULL)
 		goto cleanup;
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
+	if (server.conns != NULL) {
+		for (size_t i = 0; i < server.nconn; i++) {
+			http_conn_close(&server.conns[i]);
+			free(server.conns[i].data);
+		}
+		free(server.conns);
+	}
+	bytes_free(zero);
 	freeaddrinfo(res0);
 	if (!success) {
 		bytes_free(mac);
@@ -307,172 +660,1041 @@ cleanup:
 }
 
 
-static struct bytes *
-sha1_padding(size_t len)
+#if defined(__linux__)
+int
+timing_leaking_serve(int listener, const struct bytes *key, uint64_t delay_ns,
+		    size_t nthreads)
+{
+	struct timing_serve_ctx ctx = { .stop = { -1, -1 } };
+	pthread_t *threads = NULL;
+	size_t nstarted = 0;
+
+	/* sanity checks */
+	if (listener == -1 || key == NULL || nthreads == 0)
+		goto cleanup;
+
+	/* the threads race to accept the clients, so the losers must not
+	   block in accept(2) */
+	const int flags = fcntl(listener, F_GETFL);
+	if (flags == -1 || fcntl(listener, F_SETFL, flags | O_NONBLOCK) == -1)
+		goto cleanup;
+	if (pipe(ctx.stop) != 0)
+		goto cleanup;
+	ctx.listener = listener;
+	ctx.key = key;
+	ctx.delay_ns = delay_ns;
+
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (threads == NULL)
+		goto cleanup;
+	for (nstarted = 0; nstarted < nthreads; nstarted++) {
+		if (pthread_create(&threads[nstarted], NULL,
+			    timing_serve_worker, &ctx) != 0)
+			break;
+	}
+	if (nstarted < nthreads) /* stop the started threads */
+		(void)write(ctx.stop[1], "", 1);
+	for (size_t i = 0; i < nstarted; i++)
+		(void)pthread_join(threads[i], NULL);
+
+	/* FALLTHROUGH */
+cleanup:
+	free(threads);
+	if (ctx.stop[0] != -1) {
+		(void)close(ctx.stop[0]);
+		(void)close(ctx.stop[1]);
+	}
+	return (-1);
+}
+#else /* defined(__linux__) */
+int
+timing_leaking_serve(int listener, const struct bytes *key, uint64_t delay_ns,
+		    size_t nthreads)
 {
-	return padding(len, sha1_blocksize(), HIGH_WORD_FIRST_BE);
+	/* epoll(7) is not available */
+	(void)listener;
+	(void)key;
+	(void)delay_ns;
+	(void)nthreads;
+	errno = ENOSYS;
+	return (-1);
 }
+#endif /* defined(__linux__) */
 
 
-static struct bytes *
-md4_padding(size_t len)
+static int
+timing_leak_break_byte(timing_probe_func_t *probe, void *arg,
+		    struct bytes *mac, size_t i, const uint8_t *excluded,
+		    uint64_t *base_p, uint64_t *level_p, int *found_p)
+{
+	const size_t ncandidate = UINT8_MAX + 1;
+	struct bytes *guesses[UINT8_MAX + 1] = { NULL };
+	/* the samples of each candidate, and their count */
+	uint64_t *samples = NULL;
+	size_t nsample[UINT8_MAX + 1] = { 0 };
+	/* the interquartile mean of each candidate samples */
+	uint64_t centers[UINT8_MAX + 1] = { 0 };
+	int alive[UINT8_MAX + 1] = { 0 };
+	const struct bytes **macs = NULL;
+	int *statuses = NULL;
+	uint64_t *ns = NULL, *scratch = NULL;
+	size_t nalive = 0;
+	int byte = -1;
+
+	const size_t maxcount = ncandidate * TIMING_LEAK_MAX_SAMPLES;
+	samples  = calloc(maxcount, sizeof(uint64_t));
+	scratch  = calloc(maxcount, sizeof(uint64_t));
+	macs     = calloc(maxcount, sizeof(struct bytes *));
+	statuses = calloc(maxcount, sizeof(int));
+	ns       = calloc(maxcount, sizeof(uint64_t));
+	if (samples == NULL || scratch == NULL || macs == NULL ||
+		    statuses == NULL || ns == NULL)
+		goto cleanup;
+
+	for (size_t c = 0; c < ncandidate; c++) {
+		if (excluded[c])
+			continue;
+		guesses[c] = bytes_dup(mac);
+		if (guesses[c] == NULL)
+			goto cleanup;
+		guesses[c]->data[i] = (uint8_t)c;
+		alive[c] = 1;
+		nalive++;
+	}
+	if (nalive == 0) {
+		byte = TIMING_LEAK_NONE;
+		goto cleanup;
+	}
+
+	/* successive halving: sample all the candidates in the race, twice as
+	   much as the previous round, and keep the slowest half. */
+	for (size_t per = 1, round = 0; ; per *= 2, round++) {
+		/* interleave the candidates so that the network jitter is
+		   spread among all of them */
+		size_t count = 0;
+		for (size_t k = 0; k < per; k++) {
+			for (size_t c = 0; c < ncandidate; c++) {
+				if (alive[c])
+					macs[count++] = guesses[c];
+			}
+		}
+		if (probe(arg, count, (const struct bytes *const *)macs,
+			    statuses, ns) != 0)
+			goto cleanup;
+		for (size_t k = 0; k < count; k++) {
+			const size_t c = macs[k]->data[i];
+			if (statuses[k] == 200) {
+				/* that's it, we've got a valid MAC */
+				(void)memcpy(mac->data, macs[k]->data,
+					    mac->len);
+				*found_p = 1;
+				byte = (int)c;
+				goto cleanup;
+			}
+			samples[c * TIMING_LEAK_MAX_SAMPLES + nsample[c]++] =
+				    ns[k];
+		}
+		/* the last byte is found by the status alone */
+		if (i == mac->len - 1) {
+			byte = TIMING_LEAK_NONE;
+			goto cleanup;
+		}
+
+		/* rank the candidates, finding the slowest two */
+		size_t first = ncandidate, second = ncandidate;
+		for (size_t c = 0; c < ncandidate; c++) {
+			if (!alive[c])
+				continue;
+			centers[c] = interquartile_mean(samples +
+				    c * TIMING_LEAK_MAX_SAMPLES, nsample[c],
+				    scratch);
+			if (first == ncandidate ||
+				    centers[c] > centers[first]) {
+				second = first;
+				first = c;
+			} else if (second == ncandidate ||
+				    centers[c] > centers[second]) {
+				second = c;
+			}
+		}
+		/* scratch is only free now that every center is computed */
+		size_t ncenter = 0;
+		for (size_t c = 0; c < ncandidate; c++) {
+			if (alive[c])
+				scratch[ncenter++] = centers[c];
+		}
+		if (round == 0)
+			*base_p = median(scratch, ncenter);
+		if (second == ncandidate) {
+			/* a single candidate left */
+			byte = (int)first;
+			*level_p = centers[first];
+			goto cleanup;
+		}
+
+		/* estimate the noise standard deviation of a single sample,
+		   from the median absolute deviation of the samples (or of the
+		   candidates when they have a single sample) */
+		size_t nresidual = 0;
+		for (size_t c = 0; c < ncandidate; c++) {
+			if (!alive[c])
+				continue;
+			const uint64_t *v = samples +
+				    c * TIMING_LEAK_MAX_SAMPLES;
+			const uint64_t ref =
+				    (round == 0 ? *base_p : centers[c]);
+			for (size_t k = 0; k < nsample[c]; k++) {
+				scratch[nresidual++] = (v[k] > ref ?
+					    v[k] - ref : ref - v[k]);
+			}
+		}
+		const double sigma = 1.4826 * median(scratch, nresidual);
+		/* the squared standard error of the two centers difference */
+		const double var = sigma * sigma * (1.0 / nsample[first] +
+			    1.0 / nsample[second]);
+		const double gap = (double)(centers[first] - centers[second]);
+		const double z = TIMING_LEAK_CONFIDENCE;
+		const size_t n = nsample[first];
+		const int confident = (n >= TIMING_LEAK_MIN_SAMPLES &&
+			    gap * gap > z * z * var);
+		if (confident || n + 2 * per > TIMING_LEAK_MAX_SAMPLES) {
+			/* confident enough, or out of samples in which case
+			   backtracking will tell */
+			byte = (int)first;
+			*level_p = centers[first];
+			goto cleanup;
+		}
+
+		/* eliminate the fastest half of the candidates */
+		if (nalive > 2) {
+			ncenter = 0;
+			for (size_t c = 0; c < ncandidate; c++) {
+				if (alive[c])
+					scratch[ncenter++] = centers[c];
+			}
+			const uint64_t cut = median(scratch, ncenter);
+			for (size_t c = 0; c < ncandidate && nalive > 2; c++) {
+				if (alive[c] && centers[c] < cut) {
+					alive[c] = 0;
+					nalive--;
+				}
+			}
+		}
+	}
+
+	/* FALLTHROUGH */
+cleanup:
+	for (size_t c = 0; c < ncandidate; c++)
+		bytes_free(guesses[c]);
+	free(ns);
+	free(statuses);
+	free(macs);
+	free(scratch);
+	free(samples);
+	return (byte);
+}
+
+
+static uint64_t
+interquartile_mean(const uint64_t *values, size_t n, uint64_t *scratch)
+{
+	if (n == 0)
+		return (0);
+
+	(void)memcpy(scratch, values, n * sizeof(uint64_t));
+	qsort(scratch, n, sizeof(uint64_t), uint64_cmp);
+
+	const size_t lo = n / 4, hi = n - n / 4;
+	uint64_t sum = 0;
+	for (size_t k = lo; k < hi; k++)
+		sum += scratch[k];
+	return (sum / (hi - lo));
+}
+
+
+static uint64_t
+median(uint64_t *values, size_t n)
 {
-	return padding(len, md4_blocksize(), LOW_WORD_FIRST_LE);
+	if (n == 0)
+		return (0);
+
+	qsort(values, n, sizeof(uint64_t), uint64_cmp);
+	return (values[n / 2]);
 }
 
 
-static struct bytes *
-padding(size_t len, size_t blocksize, enum length_encoding le)
+static int
+uint64_cmp(const void *a, const void *b)
 {
-	/* max total message length, in bytes */
-	struct bytes *padding = NULL;
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return ((x > y) - (x < y));
+}
+
+
+static int
+timing_leaking_server_probe(void *arg, size_t count,
+		    const struct bytes *const *macs, int *statuses,
+		    uint64_t *ns)
+{
+	struct timing_leaking_server *server = arg;
+	const size_t nconn = server->nconn;
+	struct pollfd *fds = NULL;
+	size_t *owners = NULL;
+	/* next request to send and count of responses received */
+	size_t next = 0, done = 0;
 	int success = 0;
 
-	/* count of message bytes in the padded block */
-	const size_t restlen = len % blocksize;
-	/* count of padding bytes in the padded block */
-	size_t padlen = blocksize - restlen;
-	if (padlen < (1 + 8)) {
-		/* not enough space for the leading 0x80 and total message
-		   length in the last block, add one block. */
-		padlen += blocksize;
-	}
-
-	/* allocate enough space to hold the padding bytes */
-	padding = bytes_zeroed(padlen);
-	if (padding == NULL)
-		goto cleanup;
-
-	/* leading `1' bit */
-	padding->data[0] = 0x80;
-
-	/* set the 64-bits message length (count of bits) in the last 8 bytes of
-	   the padded block */
-	const uint64_t nbits = len * 8;
-	size_t i = padlen - 8;
-	switch (le) {
-	case HIGH_WORD_FIRST_BE:
-		padding->data[i++] = nbits >> 56;
-		padding->data[i++] = nbits >> 48;
-		padding->data[i++] = nbits >> 40;
-		padding->data[i++] = nbits >> 32;
-		padding->data[i++] = nbits >> 24;
-		padding->data[i++] = nbits >> 16;
-		padding->data[i++] = nbits >>  8;
-		padding->data[i++] = nbits >>  0;
-		break;
-	case LOW_WORD_FIRST_LE:
-		padding->data[i++] = nbits >>  0;
-		padding->data[i++] = nbits >>  8;
-		padding->data[i++] = nbits >> 16;
-		padding->data[i++] = nbits >> 24;
-		padding->data[i++] = nbits >> 32;
-		padding->data[i++] = nbits >> 40;
-		padding->data[i++] = nbits >> 48;
-		padding->data[i++] = nbits >> 56;
-		break;
+	fds = calloc(nconn, sizeof(struct pollfd));
+	owners = calloc(nconn, sizeof(size_t));
+	if (fds == NULL || owners == NULL)
+		goto cleanup;
+
+	while (done < count) {
+		/* keep every connection busy */
+		for (size_t c = 0; c < nconn && next < count; c++) {
+			struct http_conn *conn = &server->conns[c];
+			if (conn->request != SIZE_MAX)
+				continue;
+			if (http_conn_send(conn, server, next, macs[next]) != 0)
+				goto cleanup;
+			next++;
+		}
+
+		/* wait for responses */
+		size_t npoll = 0;
+		for (size_t c = 0; c < nconn; c++) {
+			if (server->conns[c].request == SIZE_MAX)
+				continue;
+			fds[npoll].fd = server->conns[c].sock;
+			fds[npoll].events = POLLIN;
+			fds[npoll].revents = 0;
+			owners[npoll] = c;
+			npoll += 1;
+		}
+		if (npoll == 0) /* not expected */
+			goto cleanup;
+		const int nready = poll(fds, npoll, TIMING_LEAK_TIMEOUT);
+		/* the first bytes of the ready responses arrived just now */
+		const uint64_t now = timing_leak_now();
+		if (nready == -1 && errno == EINTR)
+			continue;
+		if (nready <= 0)
+			goto cleanup;
+
+		for (size_t i = 0; i < npoll; i++) {
+			if (fds[i].revents == 0)
+				continue;
+			struct http_conn *conn = &server->conns[owners[i]];
+			const size_t k = conn->request;
+			if (!conn->timed) {
+				ns[k] = now - conn->sent;
+				conn->timed = 1;
+			}
+			int status = 0;
+			switch (http_conn_recv(conn, &status)) {
+			case 0: /* more to come */
+				break;
+			case 1: /* complete */
+				statuses[k] = status;
+				conn->request = SIZE_MAX;
+				done++;
+				break;
+			case 2: /* the server closed the connection */
+				if (http_conn_send(conn, server, k,
+					    macs[k]) != 0)
+					goto cleanup;
+				break;
+			default: /* error */
+				goto cleanup;
+			}
+		}
 	}
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
 	if (!success) {
-		bytes_free(padding);
-		padding = NULL;
+		/* the connections state is inconsistent */
+		for (size_t c = 0; c < nconn; c++) {
+			struct http_conn *conn = &server->conns[c];
+			if (conn->request != SIZE_MAX) {
+				http_conn_close(conn);
+				conn->request = SIZE_MAX;
+			}
+		}
 	}
-	return (padding);
+	free(owners);
+	free(fds);
+	return (success ? 0 : -1);
 }
 
 
 static int
-request_timing_leaking_server(const struct addrinfo *res,
-		    const char *fmt, const struct bytes *mac,
-		    struct timeval *tdiff_p)
+http_conn_send(struct http_conn *conn,
+		    const struct timing_leaking_server *server, size_t request,
+		    const struct bytes *mac)
 {
+	const struct addrinfo *res = server->res;
 	char *hex = NULL, *path = NULL, *req = NULL;
-	int reqlen = 0;
-	struct timeval t1, t2;
-	int s = -1; /* socket */
-	int success = 0, status = 0;
-	/* just enough space to hold the first few bytes including the status
-	   code, i.e "HTTP/1.0 200" */
-	char rsp[12 + 1] = { 0 };
-
-	/* sanity checks */
-	if (res == NULL || fmt == NULL || mac == NULL)
-		goto cleanup;
+	int success = 0;
 
 	/* encode the hex representation of mac and build the path */
 	hex = bytes_to_hex(mac);
 	if (hex == NULL)
 		goto cleanup;
-	if (asprintf(&path, fmt, hex) == -1)
+	if (asprintf(&path, server->fmt, hex) == -1) {
+		path = NULL;
 		goto cleanup;
+	}
 	/* now build the full request */
-	reqlen = asprintf(&req, "GET %s HTTP/1.0\r\n\r\n", path);
-	if (reqlen == -1)
+	const int reqlen = asprintf(&req, "GET %s HTTP/1.1\r\n"
+		    "Host: %s\r\n"
+		    "Connection: keep-alive\r\n"
+		    "\r\n", path, server->hostname);
+	if (reqlen == -1) {
+		req = NULL;
 		goto cleanup;
+	}
+
+	if (conn->sock == -1) {
+		/* initiate the connection to the server, disabling Nagle's
+		   algorithm as our requests are small and latency matters */
+		const int on = 1;
+		conn->sock = socket(res->ai_family, res->ai_socktype,
+			    res->ai_protocol);
+		if (conn->sock == -1)
+			goto cleanup;
+		if (connect(conn->sock, res->ai_addr, res->ai_addrlen) != 0)
+			goto cleanup;
+		if (setsockopt(conn->sock, IPPROTO_TCP, TCP_NODELAY, &on,
+			    sizeof(on)) != 0)
+			goto cleanup;
+	}
+
+	/* send the request and start timing it */
+	conn->sent = timing_leak_now();
+	const char *p = req;
+	size_t remaining = (size_t)reqlen;
+	while (remaining > 0) {
+		const ssize_t n = send(conn->sock, p, remaining, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			goto cleanup;
+		p += n;
+		remaining -= n;
+	}
+	tcp_quickack(conn->sock);
+	conn->request = request;
+	conn->timed = 0;
+	conn->len = 0;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success)
+		http_conn_close(conn);
+	free(req);
+	free(path);
+	free(hex);
+	return (success ? 0 : -1);
+}
+
+
+static int
+http_conn_recv(struct http_conn *conn, int *status_p)
+{
+	/* ensure there is room for at least a chunk and the NUL terminator */
+	const size_t chunk = 4096;
+	if (conn->cap - conn->len < chunk + 1) {
+		const size_t cap = conn->cap + chunk + 1 + conn->cap / 2;
+		char *data = realloc(conn->data, cap);
+		if (data == NULL)
+			return (-1);
+		conn->data = data;
+		conn->cap = cap;
+	}
+
+	ssize_t n;
+	do {
+		n = recv(conn->sock, conn->data + conn->len,
+			    conn->cap - conn->len - 1, /* flags */0);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1)
+		return (-1);
+	if (n > 0)
+		tcp_quickack(conn->sock);
+	if (n == 0 && conn->len == 0 && conn->served > 0) {
+		/* the server closed the idle connection while our request
+		   was on its way */
+		http_conn_close(conn);
+		return (2);
+	}
+	conn->len += n;
+	conn->data[conn->len] = '\0';
+
+	int keepalive = 0;
+	const int ret = http_response_parse(conn->data, conn->len,
+		    /* eof */n == 0, status_p, &keepalive);
+	if (ret == 0 && n == 0) /* truncated */
+		return (-1);
+	if (ret != 1)
+		return (ret);
+
+	conn->served += 1;
+	conn->len = 0;
+	if (!keepalive)
+		http_conn_close(conn);
+	return (1);
+}
+
+
+static void
+http_conn_close(struct http_conn *conn)
+{
+	if (conn->sock != -1)
+		(void)close(conn->sock);
+	conn->sock = -1;
+	conn->served = 0;
+	conn->len = 0;
+}
+
+
+static int
+http_response_parse(const char *data, size_t len, int eof,
+		    int *status_p, int *keepalive_p)
+{
+	/* wait for the complete headers */
+	const char *body = strstr(data, "\r\n\r\n");
+	if (body == NULL)
+		return (0);
+	body += 4;
+
+	/* the status line, i.e. "HTTP/1.1 200 OK" */
+	int keepalive;
+	if (strncmp(data, "HTTP/1.1 ", 9) == 0)
+		keepalive = 1;
+	else if (strncmp(data, "HTTP/1.0 ", 9) == 0)
+		keepalive = 0;
+	else
+		return (-1);
+	const char *p = data + 9;
+	char *ep = NULL;
+	errno = 0;
+	const unsigned long int status = strtoul(p, &ep, /* base */10);
+	if (ep == p || (*ep != ' ' && *ep != '\r') || errno != 0)
+		return (-1);
+	if (status > INT_MAX)
+		return (-1);
+
+	/* the headers we care about */
+	int has_length = 0;
+	unsigned long long length = 0;
+	for (p = strstr(data, "\r\n") + 2; p < body - 2;
+		    p = strstr(p, "\r\n") + 2) {
+		if (strncasecmp(p, "Content-Length:", 15) == 0) {
+			errno = 0;
+			length = strtoull(p + 15, &ep, /* base */10);
+			if (ep == p + 15 || errno != 0)
+				return (-1);
+			has_length = 1;
+		} else if (strncasecmp(p, "Connection:", 11) == 0) {
+			const char *v = p + 11;
+			v += strspn(v, " \t");
+			if (strncasecmp(v, "close", 5) == 0)
+				keepalive = 0;
+			else if (strncasecmp(v, "keep-alive", 10) == 0)
+				keepalive = 1;
+		} else if (strncasecmp(p, "Transfer-Encoding:", 18) == 0) {
+			/* chunked responses are not supported */
+			return (-1);
+		}
+	}
+
+	/* wait for the complete body */
+	const size_t received = len - (size_t)(body - data);
+	if (has_length && received < length)
+		return (eof ? -1 : 0);
+	if (has_length && received > length) /* we don't pipeline requests */
+		return (-1);
+	if (!has_length) {
+		/* the body is delimited by the connection close */
+		if (!eof)
+			return (0);
+		keepalive = 0;
+	}
+
+	*status_p = (int)status;
+	*keepalive_p = (keepalive && !eof);
+	return (1);
+}
+
+
+static void
+tcp_quickack(int sock)
+{
+#if defined(TCP_QUICKACK)
+	const int on = 1;
+
+	(void)setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+#else
+	(void)sock;
+#endif
+}
+
+
+static uint64_t
+timing_leak_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(TIMING_LEAK_CLOCK, &ts) != 0)
+		return (0);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+
+#if defined(__linux__)
+static void *
+timing_serve_worker(void *arg)
+{
+	const struct timing_serve_ctx *ctx = arg;
+	struct epoll_event events[TIMING_SERVE_EVENTS];
+	struct epoll_event ev;
+	struct timing_serve_client *clients = NULL;
+	/* the listener and stop pipe events data, clients use their struct */
+	void *const listener_tag = (void *)&ctx->listener;
+	void *const stop_tag = (void *)&ctx->stop[0];
+	int epfd = -1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		goto cleanup;
+	/* wake up a single thread per incoming client */
+	(void)memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = listener_tag;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, ctx->listener, &ev) != 0)
+		goto cleanup;
+	ev.events = EPOLLIN;
+	ev.data.ptr = stop_tag;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, ctx->stop[0], &ev) != 0)
+		goto cleanup;
+
+	for (;;) {
+		const int nready = epoll_wait(epfd, events,
+			    TIMING_SERVE_EVENTS, /* no timeout */-1);
+		if (nready == -1 && errno == EINTR)
+			continue;
+		if (nready == -1)
+			goto cleanup;
+
+		for (int i = 0; i < nready; i++) {
+			void *const tag = events[i].data.ptr;
+			if (tag == stop_tag)
+				goto cleanup;
+			if (tag != listener_tag) {
+				struct timing_serve_client *client = tag;
+				if (timing_serve_client_recv(ctx, client) == 0)
+					continue;
+				/* drop the client */
+				(void)close(client->sock);
+				if (client->prev != NULL)
+					client->prev->next = client->next;
+				else
+					clients = client->next;
+				if (client->next != NULL)
+					client->next->prev = client->prev;
+				free(client);
+				continue;
+			}
+
+			/* accept a new client, unless another thread did */
+			const int s = accept(ctx->listener, NULL, NULL);
+			if (s == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK ||
+					    errno == EINTR ||
+					    errno == ECONNABORTED)
+					continue;
+				goto cleanup;
+			}
+			const size_t size = sizeof(struct timing_serve_client);
+			struct timing_serve_client *client = calloc(1, size);
+			const int on = 1;
+			const int nodelay = setsockopt(s, IPPROTO_TCP,
+				    TCP_NODELAY, &on, sizeof(on));
+			ev.events = EPOLLIN;
+			ev.data.ptr = client;
+			if (client == NULL || nodelay != 0 || epoll_ctl(epfd,
+				    EPOLL_CTL_ADD, s, &ev) != 0) {
+				(void)close(s);
+				free(client);
+				continue;
+			}
+			client->sock = s;
+			client->next = clients;
+			if (clients != NULL)
+				clients->prev = client;
+			clients = client;
+		}
+	}
+
+	/* NOTREACHED */
+cleanup:
+	/* stop the other threads */
+	(void)write(ctx->stop[1], "", 1);
+	while (clients != NULL) {
+		struct timing_serve_client *next = clients->next;
+		(void)close(clients->sock);
+		free(clients);
+		clients = next;
+	}
+	if (epfd != -1)
+		(void)close(epfd);
+	return (NULL);
+}
+
+
+static int
+timing_serve_client_recv(const struct timing_serve_ctx *ctx,
+		    struct timing_serve_client *client)
+{
+	ssize_t n;
+	do {
+		n = recv(client->sock, client->data + client->len,
+			    TIMING_SERVE_BUFSIZE - client->len, /* flags */0);
+	} while (n == -1 && errno == EINTR);
+	if (n <= 0) /* error or closed by the client */
+		return (-1);
+	client->len += n;
+	client->data[client->len] = '\0';
+
+	/* answer the complete requests, in order */
+	char *end;
+	while ((end = strstr(client->data, "\r\n\r\n")) != NULL) {
+		*end = '\0';
+		if (timing_serve_request(ctx, client->sock, client->data) != 0)
+			return (-1);
+		const size_t consumed = (end + 4) - client->data;
+		client->len -= consumed;
+		(void)memmove(client->data, end + 4, client->len + 1);
+	}
+
+	/* a request too large to fit in the buffer */
+	if (client->len == TIMING_SERVE_BUFSIZE)
+		return (-1);
+
+	return (0);
+}
+
+
+static int
+timing_serve_request(const struct timing_serve_ctx *ctx, int sock,
+		    char *request)
+{
+	struct bytes *content = NULL, *mac = NULL;
+	char *known = NULL, *rsp = NULL;
+	const char *filepath = NULL, *signature = NULL, *reason = NULL;
+	int status = 400, keepalive = 0, success = 0;
+
+	/* the request line, i.e. "GET /test?file=foo&signature=bar HTTP/1.1" */
+	char *headers = strstr(request, "\r\n");
+	if (headers != NULL)
+		*headers++ = '\0';
+	char *target = strchr(request, ' ');
+	if (target == NULL)
+		goto respond;
+	*target++ = '\0';
+	char *version = strchr(target, ' ');
+	if (version == NULL)
+		goto respond;
+	*version++ = '\0';
+	if (strcmp(version, "HTTP/1.1") == 0)
+		keepalive = 1;
+	else if (strcmp(version, "HTTP/1.0") != 0)
+		goto respond;
+
+	/* the headers we care about */
+	for (char *line = headers; line != NULL; ) {
+		char *next = strstr(line, "\r\n");
+		if (next != NULL) {
+			*next = '\0';
+			next += 2;
+		}
+		if (strncasecmp(line, "Connection:", 11) == 0) {
+			const char *v = line + 11 + strspn(line + 11, " \t");
+			if (strncasecmp(v, "close", 5) == 0)
+				keepalive = 0;
+			else if (strncasecmp(v, "keep-alive", 10) == 0)
+				keepalive = 1;
+		}
+		line = next;
+	}
+
+	if (strcmp(request, "GET") != 0)
+		goto respond;
+
+	/* the route and its query parameters */
+	char *query = strchr(target, '?');
+	if (query != NULL)
+		*query++ = '\0';
+	if (strcmp(target, "/test") != 0) {
+		status = 404;
+		goto respond;
+	}
+	for (char *param = query; param != NULL; ) {
+		char *next = strchr(param, '&');
+		if (next != NULL)
+			*next++ = '\0';
+		char *value = strchr(param, '=');
+		if (value != NULL) {
+			*value++ = '\0';
+			if (url_decode(param) != 0 || url_decode(value) != 0)
+				goto respond;
+			if (strcmp(param, "file") == 0)
+				filepath = value;
+			else if (strcmp(param, "signature") == 0)
+				signature = value;
+		}
+		param = next;
+	}
+	if (filepath == NULL || signature == NULL)
+		goto respond;
 
-	/* initiate the connection to the server */
-	s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-	if (s == -1)
+	/* read the requested file */
+	content = file_read(filepath);
+	if (content == NULL) {
+		status = 404;
+		goto respond;
+	}
+
+	/* verify the given signature */
+	mac = hmac(&hash_sha1, ctx->key, content);
+	if (mac == NULL)
 		goto cleanup;
-	if (connect(s, res->ai_addr, res->ai_addrlen) != 0)
+	known = bytes_to_hex(mac);
+	if (known == NULL)
 		goto cleanup;
+	/* like Python's hexdigest() */
+	for (char *p = known; *p != '\0'; p++)
+		*p = (char)tolower((unsigned char)*p);
+	const int match = insecure_compare(known, signature, ctx->delay_ns);
+	/* OK if the signature is good, Internal Server Error otherwise */
+	status = (match ? 200 : 500);
 
-	/* perform the request while timing it */
-	if (gettimeofday(&t1, NULL) != 0)
+	/* FALLTHROUGH */
+respond:
+	reason = "Bad Request";
+	switch (status) {
+	case 200:
+		reason = "OK";
+		break;
+	case 404:
+		reason = "Not Found";
+		break;
+	case 500:
+		reason = "Internal Server Error";
+		break;
+	}
+	const char *body = (known == NULL ? reason : known);
+	/* send the whole response at once */
+	const int rsplen = asprintf(&rsp, "HTTP/1.1 %d %s\r\n"
+		    "Content-Type: text/plain\r\n"
+		    "Content-Length: %zu\r\n"
+		    "%s"
+		    "\r\n"
+		    "%s", status, reason, strlen(body),
+		    (keepalive ? "" : "Connection: close\r\n"), body);
+	if (rsplen == -1) {
+		rsp = NULL;
 		goto cleanup;
-	if (send(s, req, reqlen, /* flags */0) != reqlen)
+	}
+	/* the response is small enough to fit in the socket buffer */
+	if (send(sock, rsp, rsplen, MSG_NOSIGNAL) != rsplen)
 		goto cleanup;
-	/* waste no time in reading the data, we just want to get back as soon
-	   as there is an answer from the server */
-	if (recv(s, rsp, 0, /* flags */0) == -1)
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	free(rsp);
+	free(known);
+	bytes_free(mac);
+	bytes_free(content);
+	return (success && keepalive ? 0 : -1);
+}
+
+
+static int
+insecure_compare(const char *known, const char *unknown, uint64_t delay_ns)
+{
+	if (strlen(known) != strlen(unknown))
+		return (0);
+
+	for (size_t i = 0; known[i] != '\0'; i++) {
+		if (toupper((unsigned char)known[i]) !=
+			    toupper((unsigned char)unknown[i]))
+			return (0);
+		/* busy-wait, sleeping would be far less precise */
+		const uint64_t deadline = timing_leak_now() + delay_ns;
+		while (timing_leak_now() < deadline)
+			continue;
+	}
+
+	return (1);
+}
+
+
+static int
+url_decode(char *s)
+{
+	char *out = s;
+
+	for (const char *in = s; *in != '\0'; in++) {
+		if (*in == '+') {
+			*out++ = ' ';
+		} else if (*in == '%') {
+			if (!isxdigit((unsigned char)in[1]) ||
+				    !isxdigit((unsigned char)in[2]))
+				return (-1);
+			const char hex[3] = { in[1], in[2], '\0' };
+			*out++ = (char)strtoul(hex, NULL, 16);
+			in += 2;
+		} else {
+			*out++ = *in;
+		}
+	}
+	*out = '\0';
+
+	return (0);
+}
+
+
+static struct bytes *
+file_read(const char *path)
+{
+	struct bytes *content = NULL;
+	struct stat st;
+	int fd = -1, success = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
 		goto cleanup;
-	if (gettimeofday(&t2, NULL) != 0)
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
 		goto cleanup;
-	/* now read the data that we're interested in */
-	if (recv(s, rsp, sizeof(rsp) - 1, /* flags */0) == -1)
+	content = bytes_zeroed((size_t)st.st_size);
+	if (content == NULL)
 		goto cleanup;
+	size_t offset = 0;
+	while (offset < content->len) {
+		const ssize_t n = read(fd, content->data + offset,
+			    content->len - offset);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			goto cleanup;
+		offset += n;
+	}
 
-	/*
-	 * Consume all the bytes that were sent by the server. This is needed in
-	 * order to avoid closing the socket too early and exhaust the server
-	 * sending buffer(s)
-	 */
-	char buf[BUFSIZ];
-	while (recv(s, buf, sizeof(buf), /* flags */0) > 0);
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (fd != -1)
+		(void)close(fd);
+	if (!success) {
+		bytes_free(content);
+		content = NULL;
+	}
+	return (content);
+}
+#endif /* defined(__linux__) */
 
-	/* check that the response preamble match what we expect */
-	const char *http_1_0 = "HTTP/1.0 ";
-	if (strncmp(http_1_0, rsp, strlen(http_1_0)) != 0)
+
+struct oracle *
+mac_keyed_prefix_oracle_new(const struct hash_function *hash,
+		    const struct bytes *key)
+{
+	struct oracle *oracle = NULL;
+	int success = 0;
+
+	/* sanity checks */
+	if (hash == NULL || key == NULL)
 		goto cleanup;
 
-	/* parse the HTTP status code */
-	const char *p = rsp + strlen(http_1_0);
-	char *ep = NULL;
-	errno = 0;
-	const unsigned long int ulval = strtoul(p, &ep, /* base */10);
-	if (p[0] == '\0' || *ep != '\0') /* not a number */
+	oracle = calloc(1, sizeof(struct oracle));
+	if (oracle == NULL)
 		goto cleanup;
-	if (errno == ERANGE && ulval == ULONG_MAX) /* out of range */
+
+	oracle->opaque = calloc(1, sizeof(struct mac_keyed_prefix_oracle_opaque));
+	if (oracle->opaque == NULL)
 		goto cleanup;
-	if (ulval > INT_MAX)
+	struct mac_keyed_prefix_oracle_opaque *info = oracle->opaque;
+
+	info->key = bytes_dup(key);
+	if (info->key == NULL)
 		goto cleanup;
-	status = (int)ulval;
+	info->hash = hash;
 
-	success = 1;
+	oracle->query = mac_keyed_prefix_oracle_query;
+	oracle->batch = NULL;
+	oracle->free  = mac_keyed_prefix_oracle_free;
 
-	if (tdiff_p != NULL) {
-		/* the caller want to know how much time the request took */
-		timersub(&t2, &t1, tdiff_p);
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		mac_keyed_prefix_oracle_free(oracle);
+		oracle = NULL;
 	}
+	return (oracle);
+}
+
+
+static int
+mac_keyed_prefix_oracle_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p)
+{
+	struct bytes *mac = NULL, *msg = NULL;
+	int answer = -1;
+
+	if (output_p != NULL)
+		*output_p = NULL;
+
+	/* sanity checks */
+	if (oracle == NULL || oracle->opaque == NULL || input == NULL)
+		goto cleanup;
+	const struct mac_keyed_prefix_oracle_opaque *info = oracle->opaque;
+	const size_t L = info->hash->hashlength();
+	if (input->len < L)
+		goto cleanup;
+
+	/* the input is [mac . msg] */
+	mac = bytes_slice(input, 0, L);
+	msg = bytes_slice(input, L, input->len - L);
+	if (mac == NULL || msg == NULL)
+		goto cleanup;
+
+	answer = mac_keyed_prefix_verify(info->hash, info->key, msg, mac);
 
 	/* FALLTHROUGH */
 cleanup:
-	(void)close(s);
-	free(req);
-	free(path);
-	free(hex);
-	return (success ? status : -1);
+	bytes_free(msg);
+	bytes_free(mac);
+	return (answer);
+}
+
+
+static void
+mac_keyed_prefix_oracle_free(struct oracle *oracle)
+{
+	if (oracle == NULL)
+		return;
+
+	struct mac_keyed_prefix_oracle_opaque *info = oracle->opaque;
+	if (info != NULL) {
+		bytes_free(info->key);
+		freezero(info, sizeof(struct mac_keyed_prefix_oracle_opaque));
+	}
+	freezero(oracle, sizeof(struct oracle));
 }
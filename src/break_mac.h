@@ -4,13 +4,81 @@
  * break_mac.h
  *
  * MAC analysis stuff for cryptopals.com challenges.
+ *
+ * Reentrant; the timing attack queries its server through its own connections.
  */
 #include "bytes.h"
+#include "hash.h"
+#include "oracle.h"
+
+
+/*
+ * Longest key, in bytes, tried by extend_sha1_mac_keyed_prefix() and
+ * extend_md4_mac_keyed_prefix().
+ */
+#define	MAC_KEYED_PREFIX_MAX_KEYLEN	1024
+
+
+/*
+ * Create an oracle verifying keyed MAC using the given hash function under the
+ * given key, see mac_keyed_prefix_verify(). The oracle input is [mac . msg],
+ * i.e. the MAC to verify followed by the message, and it has no output.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure.
+ */
+struct oracle	*mac_keyed_prefix_oracle_new(const struct hash_function *hash,
+		    const struct bytes *key);
+
+/*
+ * Create an oracle verifying SHA-1 keyed MAC under the given key, see
+ * sha1_mac_keyed_prefix_verify(). The oracle input is [mac . msg], i.e. the
+ * MAC to verify followed by the message, and it has no output.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure.
+ */
+struct oracle	*sha1_mac_keyed_prefix_oracle_new(const struct bytes *key);
 
+/*
+ * Create an oracle verifying MD4 keyed MAC under the given key, see
+ * md4_mac_keyed_prefix_verify(). The oracle input is [mac . msg], i.e. the
+ * MAC to verify followed by the message, and it has no output.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure.
+ */
+struct oracle	*md4_mac_keyed_prefix_oracle_new(const struct bytes *key);
+
+/*
+ * Break a Keyed MAC using the given hash function with length extension as
+ * described in Set 4 / Challenge 29 & 30, trying every key length from
+ * minkeylen to maxkeylen bytes.
+ *
+ * The given oracle should behave like the ones created by
+ * mac_keyed_prefix_oracle_new() for the same hash function. The forged MACs
+ * are computed in batches of key lengths using the hash function multi-buffer
+ * routine and each batch is submitted through oracle_find(), stopping at the
+ * first MAC verified.
+ *
+ * Returns 0 on success, -1 on error or failure to extend.
+ *
+ * When 0 is returned and msg_p and mac_p are not NULL, they are set to the
+ * extended message and its MAC respectively. Both are expected to be passed to
+ * bytes_free(3) by the caller.
+ */
+int	extend_mac_keyed_prefix(const struct hash_function *hash,
+		    struct oracle *oracle, size_t minkeylen, size_t maxkeylen,
+		    const struct bytes *msg, const struct bytes *mac,
+		    struct bytes **msg_p, struct bytes **mac_p);
 
 /*
  * Break SHA-1 Keyed MAC using length extension as described in
- * Set 4 / Challenge 29.
+ * Set 4 / Challenge 29, see extend_mac_keyed_prefix(). Key lengths up to
+ * MAC_KEYED_PREFIX_MAX_KEYLEN are tried.
+ *
+ * The given oracle should behave like the ones created by
+ * sha1_mac_keyed_prefix_oracle_new().
  *
  * Returns 0 on success, -1 on error or failure to extend.
  *
@@ -18,13 +86,17 @@
  * extended message and its MAC respectively. Both are expected to be passed to
  * bytes_free(3) by the caller.
  */
-int	extend_sha1_mac_keyed_prefix(const void *key,
+int	extend_sha1_mac_keyed_prefix(struct oracle *oracle,
 		    const struct bytes *msg, const struct bytes *mac,
 		    struct bytes **msg_p, struct bytes **mac_p);
 
 /*
  * Break MD4 Keyed MAC using length extension as described in
- * Set 4 / Challenge 29 & 30.
+ * Set 4 / Challenge 29 & 30, see extend_mac_keyed_prefix(). Key lengths up to
+ * MAC_KEYED_PREFIX_MAX_KEYLEN are tried.
+ *
+ * The given oracle should behave like the ones created by
+ * md4_mac_keyed_prefix_oracle_new().
  *
  * Returns 0 on success, -1 on error or failure to extend.
  *
@@ -32,21 +104,92 @@ int	extend_sha1_mac_keyed_prefix(const void *key,
  * extended message and its MAC respectively. Both are expected to be passed to
  * bytes_free(3) by the caller.
  */
-int	extend_md4_mac_keyed_prefix(const void *key,
+int	extend_md4_mac_keyed_prefix(struct oracle *oracle,
 		    const struct bytes *msg, const struct bytes *mac,
 		    struct bytes **msg_p, struct bytes **mac_p);
 
+/*
+ * Timing probe used by break_timing_leak(): perform count requests to the
+ * target, the ith one with the MAC guess macs[i], setting statuses[i] to the
+ * answer (200 meaning that the MAC is valid) and ns[i] to the request duration
+ * in nanoseconds. The same guess may appear several times in macs.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+typedef int (timing_probe_func_t)(void *arg, size_t count,
+		    const struct bytes *const *macs, int *statuses,
+		    uint64_t *ns);
+
+/*
+ * Break a MAC of maclen bytes verified by a target comparing it byte at a time,
+ * and exiting early at the first mismatch, using the given probe.
+ *
+ * Each MAC byte is found by successive halving: every candidate value still in
+ * the race is sampled, more times in each round, and ranked by the
+ * interquartile mean of its request durations. The slowest half goes on to the
+ * next round until a candidate is significantly slower than the others. A
+ * choice leading the others by less than half as much as the previous ones did
+ * is rejected, and the attack backtracks when a position keeps being rejected.
+ *
+ * Returns the valid MAC on success, NULL on failure.
+ */
+struct bytes	*break_timing_leak(timing_probe_func_t *probe, void *arg,
+		    size_t maclen);
+
+/*
+ * Run the break_timing_leak() race for the byte at position i of mac, the
+ * bytes before it being assumed right. i must not be the last position, where
+ * the byte is found by the probe status alone.
+ *
+ * When not NULL, base_p is set to the median duration of all the candidates in
+ * the first round and level_p to the duration of the chosen one. They are left
+ * untouched when a candidate is accepted by the probe, i.e. when mac is valid
+ * once its byte at position i is replaced.
+ *
+ * Returns the chosen byte value, or -1 on error.
+ */
+int	break_timing_leak_byte(timing_probe_func_t *probe, void *arg,
+		    const struct bytes *mac, size_t i, uint64_t *base_p,
+		    uint64_t *level_p);
+
 /*
  * Break a server verifying HMAC-SHA1 with an artificial timing leak as
- * described in Set 4 / Challenge 31 & 32.
+ * described in Set 4 / Challenge 31 & 32, see break_timing_leak().
  *
  * the fmt argument is the query having exactly one %s replacement pattern that
  * will be replaced by the MAC. Note: this is highly insecure and no escape is
  * performed.
  *
+ * The requests are made through a pool of nconn persistent HTTP/1.1
+ * connections, each having one request in flight. A server closing the
+ * connections after each response still works, the connection setup being
+ * left out of the measured time anyway. A single connection is best when the
+ * server handles one request at a time.
+ *
  * Returns the hacked MAC on success, NULL on failure.
  */
 struct bytes	*break_timing_leaking_server(const char *hostname,
-		    const char *port, const char *fmt, size_t maclen);
+		    const char *port, const char *fmt, size_t maclen,
+		    size_t nconn);
+
+/*
+ * Serve the clients connecting on the given listening socket like
+ * python/hmac_padding_oracle.py, a stand-in for the server attacked by
+ * break_timing_leaking_server().
+ *
+ * GET requests to /test?file=path&signature=hex are answered by the HMAC-SHA1
+ * of the file content under key (hex encoded) with the status code 200 when
+ * the signature matches it, 500 otherwise. The signature is compared one hex
+ * character at a time, busy-waiting delay_ns nanoseconds after each matching
+ * one. Invalid requests are answered with 400, and unreadable files with 404.
+ * HTTP/1.1 connections are kept alive.
+ *
+ * The clients are served by nthreads threads, each waiting for its own clients
+ * through epoll(7). The listening socket is made non-blocking.
+ *
+ * Only returns on error (including on systems without epoll(7)), with -1.
+ */
+int	timing_leaking_serve(int listener, const struct bytes *key,
+		    uint64_t delay_ns, size_t nthreads);
 
 #endif /* ndef BREAK_MAC_H */
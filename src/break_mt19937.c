@@ -3,22 +3,180 @@
  *
  * MT19937 analysis stuff for cryptopals.com challenges.
  */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "compat.h"
+#include "bytes.h"
 #include "xor.h"
 #include "mt19937.h"
+#include "pool.h"
 #include "break_mt19937.h"
 
 
+/*
+ * Count of seeds evaluated at once by mt19937_seed_search().
+ */
+#define	MT19937_SEARCH_BATCH	256
+
+/*
+ * Count of seeds in each chunk searched by the mt19937_recover_seed() tasks.
+ */
+#define	MT19937_RECOVER_CHUNK	(UINT64_C(1) << 16)
+
+/*
+ * Delay between two mt19937_recover_seed() progress reports, in nanoseconds.
+ */
+#define	MT19937_RECOVER_REPORT_NS	UINT64_C(1000000000)
+
+/*
+ * State of a mt19937_recover_seed() search shared by all its tasks.
+ */
+struct mt19937_recover_job {
+	const uint32_t *outputs;
+	size_t count;
+	uint32_t lo;
+	/* count of seeds in the range */
+	uint64_t total;
+	/* count of seeds searched so far */
+	atomic_uint_fast64_t searched;
+	/* offset from lo of the smallest matching seed found, total if none */
+	atomic_uint_fast64_t found;
+	/* progress reporting, only done by the calling thread */
+	pthread_t caller;
+	void (*progress)(const struct mt19937_recover_progress *, void *);
+	void *arg;
+	uint64_t start_ns, last_report_ns;
+};
+
+/*
+ * mt19937_index_build() file format identification.
+ */
+#define	MT19937_INDEX_MAGIC	"MT19937I"
+#define	MT19937_INDEX_VERSION	1
+
+/*
+ * mt19937_index_build() choose the count of buckets so that they hold about
+ * 2^MT19937_INDEX_BUCKET_LOG2 seeds each, using at most
+ * 2^MT19937_INDEX_MAX_BITS buckets.
+ */
+#define	MT19937_INDEX_BUCKET_LOG2	8
+#define	MT19937_INDEX_MAX_BITS		24
+
+/*
+ * Header of a mt19937_index_build() file, followed by the bucket offsets and
+ * the seeds.
+ */
+struct mt19937_index_header {
+	/* MT19937_INDEX_MAGIC, without its NUL terminator */
+	char magic[8];
+	/* MT19937_INDEX_VERSION */
+	uint32_t version;
+	/* the buckets are indexed by the top bits of the first output */
+	uint32_t bits;
+	/* the indexed seeds range (included) */
+	uint32_t lo, hi;
+	/* count of seeds in the range */
+	uint64_t count;
+};
+
+/* index struct definition */
+struct mt19937_index {
+	void *map;
+	size_t maplen;
+	const struct mt19937_index_header *header;
+	/* (1 << bits) + 1 offsets, bucket i being offsets[i] to offsets[i + 1] */
+	const uint64_t *offsets;
+	const uint32_t *seeds;
+};
+
+/*
+ * mt19937_recover_seed() cp_parallel_for() routine, search the chunks from lo
+ * to hi (excluded) of the range, stopping at the first one past an already
+ * found seed. Progress is reported when run by the calling thread.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int	mt19937_recover_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Call the mt19937_recover_seed() progress callback with the job's current
+ * state.
+ */
+static void	mt19937_recover_report(struct mt19937_recover_job *job,
+		    uint64_t now);
+
+/* Returns the current monotonic time in nanoseconds */
+static uint64_t	mt19937_now_ns(void);
+
+/*
+ * Returns the size in bytes of a mt19937_index_build() file, 0 if it would not
+ * fit in memory.
+ */
+static size_t	mt19937_index_size(uint32_t bits, uint64_t count);
+
+/*
+ * Returns the bucket of the given first output in an index using the given
+ * bits.
+ */
+static uint32_t	mt19937_index_bucket(uint32_t output, uint32_t bits);
+
+/*
+ * Compute the first output of the count seeds starting at lo. When cursors is
+ * NULL, count the seeds of each bucket in counts[bucket + 1]. Otherwise store
+ * the seeds in their bucket at seeds[cursors[bucket]], advancing the cursor.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	mt19937_index_scan(uint32_t lo, uint64_t count, uint32_t bits,
+		    uint64_t *counts, uint64_t *cursors, uint32_t *seeds);
+
+/*
+ * Sort by first output the seeds of an index bucket, using pairs as scratch
+ * space for count values.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	mt19937_index_sort(uint32_t *seeds, uint64_t count,
+		    uint64_t *pairs);
+
+/* qsort(3) comparison function for uint64_t values */
+static int	uint64_cmp(const void *a, const void *b);
+
+/* Returns the first output of the generator seeded with the given seed */
+static uint32_t	mt19937_first_output(uint32_t seed);
+
+/*
+ * Search the seeds between lo and hi (included) for one seeding a MT19937
+ * generator that outputs seq after skipping its first skip outputs. Candidate
+ * seeds are filtered by batch using mt19937_first_outputs_batch() on the first
+ * word of seq, only matching seeds are checked against the full sequence.
+ *
+ * Returns 0 and set *seed_p (if not NULL) when found, 1 if not found, -1 on
+ * error.
+ */
+static int	mt19937_seed_search(uint32_t lo, uint32_t hi, size_t skip,
+		    const uint32_t *seq, size_t seqlen, uint32_t *seed_p);
+
+/*
+ * Check if a MT19937 generator seeded with the given seed outputs seq after
+ * skipping its first skip outputs.
+ *
+ * Returns 1 if the outputs match seq, 0 if they don't, -1 on error.
+ */
+static int	mt19937_seed_matches(uint32_t seed, size_t skip,
+		    const uint32_t *seq, size_t seqlen);
+
 /* undo the MT19937 tempering transform */
 static uint32_t	mt19937_untemper(uint32_t x);
-/* undo x >> (x & mask) */
-static uint32_t	unrshiftmaskxor(uint32_t x, uint32_t rshift, uint32_t mask);
-/* undo x << (x & mask) */
-static uint32_t	unlshiftmaskxor(uint32_t x, uint32_t lshift, uint32_t mask);
 
 
 int
@@ -26,14 +184,18 @@ mt19937_time_seeder(struct mt19937_generator *gen,
 		    uint32_t *n_p, uint32_t *now_p, uint32_t *seed_p)
 {
 	uint32_t seed, n = 0;
-	const uint32_t before_delay = 40 + rand() % (1000 - 40);
-	const uint32_t after_delay  = 40 + rand() % (1000 - 40);
+	uint32_t delays[2] = { 0 };
 	int success = 0;
 
 	/* sanitity check */
 	if (gen == NULL)
 		goto cleanup;
 
+	if (bytes_random_fill(delays, sizeof(delays)) != 0)
+		goto cleanup;
+	const uint32_t before_delay = 40 + delays[0] % (1000 - 40);
+	const uint32_t after_delay  = 40 + delays[1] % (1000 - 40);
+
 	/* seed generation */
 	if (now_p != NULL) {
 		seed = *now_p + before_delay;
@@ -72,59 +234,54 @@ int
 mt19937_time_seeder_breaker(uint32_t before, uint32_t after, uint32_t generated,
 		    uint32_t *seed_p)
 {
-	struct mt19937_generator *gen = NULL;
-	uint32_t seed = 0;
-	int found = 0, success = 0;
+	return (mt19937_seed_search(before, after, 0, &generated, 1, seed_p));
+}
 
-	gen = mt19937_init(0);
-	if (gen == NULL)
-		goto cleanup;
 
-	for (seed = before; seed <= after; seed++) {
-		uint32_t n = 0;
-		if (mt19937_seed(gen, seed) != 0)
-			goto cleanup;
-		if (mt19937_next_uint32(gen, &n) != 0)
-			goto cleanup;
-		if (n == generated)
-			break;
-	}
-	found = (seed <= after);
-
-	success = 1;
+struct mt19937_generator *
+mt19937_clone(struct mt19937_generator *gen)
+{
+	uint32_t outputs[624];
+	struct mt19937_generator *clone = NULL;
 
-	if (found && seed_p != NULL)
-		*seed_p = seed;
+	if (mt19937_fill(gen, outputs, 624) == 0)
+		clone = mt19937_clone_from_outputs(outputs, 624);
 
-	/* FALLTHROUGH */
-cleanup:
-	mt19937_free(gen);
-	if (!success)
-		return (-1);
-	return (found ? 0 : 1);
+	explicit_bzero(outputs, sizeof(outputs));
+	return (clone);
 }
 
 
 struct mt19937_generator *
-mt19937_clone(struct mt19937_generator *gen)
+mt19937_clone_from_outputs(const uint32_t *outputs, size_t count)
 {
 	struct mt19937_generator *clone = NULL;
-	uint32_t state[624] = { 0 };
+	uint32_t state[624];
 	int success = 0;
 
-	size_t i;
-	for (i = 0; i < (sizeof(state) / sizeof(*state)); i++) {
-		uint32_t n = 0;
-		if (mt19937_next_uint32(gen, &n) != 0)
+	/* sanitity checks */
+	if (outputs == NULL || count < 624)
+		goto cleanup;
+
+	/* the first 624 outputs are the tempered state after a twist */
+	if (mt19937_untemper_batch(outputs, 624, state) != 0)
+		goto cleanup;
+	clone = mt19937_from_state(state, 624);
+	if (clone == NULL)
+		goto cleanup;
+
+	/* catch up with the outputs following the state */
+	uint32_t discard[624];
+	for (size_t i = 624; i < count; i += 624) {
+		const size_t len = (count - i < 624 ? count - i : 624);
+		if (mt19937_fill(clone, discard, len) != 0)
 			goto cleanup;
-		state[i] = mt19937_untemper(n);
 	}
 
-	clone = mt19937_from_state(state, i + 1);
-
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
+	explicit_bzero(state, sizeof(state));
 	if (!success) {
 		mt19937_free(clone);
 		clone = NULL;
@@ -133,13 +290,51 @@ cleanup:
 }
 
 
+int
+mt19937_unwind_breaker(struct mt19937_generator *gen, size_t maxrounds,
+		    uint32_t *seed_p)
+{
+	uint32_t seed = 0;
+
+	for (size_t i = 0; ; i++) {
+		const int ret = mt19937_state_seed(gen, &seed);
+		if (ret == -1)
+			return (-1);
+		if (ret == 0)
+			break;
+		if (i >= maxrounds)
+			return (1);
+		if (mt19937_untwist(gen) != 0)
+			return (-1);
+	}
+
+	if (seed_p != NULL)
+		*seed_p = seed;
+	return (0);
+}
+
+
+int
+mt19937_untemper_batch(const uint32_t *outputs, size_t count, uint32_t *state)
+{
+	/* sanitity checks */
+	if ((outputs == NULL || state == NULL) && count > 0)
+		return (-1);
+
+	/* branch free, the compiler vectorize this loop */
+	for (size_t i = 0; i < count; i++)
+		state[i] = mt19937_untemper(outputs[i]);
+
+	return (0);
+}
+
+
 int
 mt19937_encryption_breaker(const struct bytes *ciphertext,
 		    const struct bytes *known_plaintext, uint16_t *key_p)
 {
 	uint32_t seed = 0;
 	struct bytes *keystream = NULL, *mask = NULL;
-	struct mt19937_generator *gen = NULL;
 	uint32_t *seq = NULL;
 	size_t seqlen = 0;
 	int success = 0;
@@ -194,30 +389,8 @@ mt19937_encryption_breaker(const struct bytes *ciphertext,
 	/* count of word to be ignored (thoses from the prefix) */
 	const size_t ignoredwords = ignorelen / 4;
 	/* brute-force the 16 bit space since it is practicaly small enough */
-	gen = mt19937_init(0);
-	for (seed = 0; seed <= UINT16_MAX; seed++) {
-		size_t i = 0;
-		/* seed the generator with the value from this iteration */
-		if (mt19937_seed(gen, seed) != 0)
-			goto cleanup;
-		/* skip the words from the prefix */
-		for (i = 0; i < ignoredwords; i++)
-			(void)mt19937_next_uint32(gen, NULL);
-		/* compare the PRNG output with our expected sequence */
-		for (i = 0; i < seqlen; i++) {
-			uint32_t n = 0;
-			if (mt19937_next_uint32(gen, &n) != 0)
-				goto cleanup;
-			if (n != seq[i])
-				break;
-		}
-		if (i == seqlen) {
-			/* here the PRNG output for this iteration's seed
-			   matches our expected sequence */
-			break;
-		}
-	}
-	if (seed > UINT16_MAX)
+	if (mt19937_seed_search(0, UINT16_MAX, ignoredwords, seq, seqlen,
+		    &seed) != 0)
 		goto cleanup;
 
 	success = 1;
@@ -227,7 +400,6 @@ mt19937_encryption_breaker(const struct bytes *ciphertext,
 
 	/* FALLTHROUGH */
 cleanup:
-	mt19937_free(gen);
 	freezero(seq, seqlen);
 	bytes_free(mask);
 	bytes_free(keystream);
@@ -241,65 +413,580 @@ mt19937_token_breaker(const uint32_t *token, size_t tokenlen)
 	int success = 0;
 	int valid = 0;
 	const uint32_t now = time(NULL);
-	struct mt19937_generator *gen = NULL;
 
 	/* sanity check */
 	if (token == NULL)
 		goto cleanup;
 
-	gen = mt19937_init(0);
-	for (uint32_t seed = now - 60 * 60; seed <= now; seed++) {
-		if (mt19937_seed(gen, seed) != 0)
+	const int ret = mt19937_seed_search(now - 60 * 60, now, 0,
+		    token, tokenlen, NULL);
+	if (ret == -1)
+		goto cleanup;
+	valid = (ret == 0);
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success)
+		return (-1);
+	return (valid ? 0 : 1);
+}
+
+
+int
+mt19937_recover_seed(const uint32_t *outputs, size_t count,
+		    uint32_t lo, uint32_t hi, size_t nthreads,
+		    void (*progress)(const struct mt19937_recover_progress *,
+		    void *), void *arg, uint32_t *seed_p)
+{
+	struct mt19937_recover_job job;
+	struct cp_pool *pool = NULL;
+	int success = 0;
+
+	/* sanity checks */
+	if (outputs == NULL || count == 0 || lo > hi)
+		goto cleanup;
+
+	/* setup the job shared by all the tasks */
+	(void)memset(&job, 0, sizeof(struct mt19937_recover_job));
+	job.outputs = outputs;
+	job.count = count;
+	job.lo = lo;
+	job.total = (uint64_t)hi - lo + 1;
+	atomic_init(&job.searched, 0);
+	atomic_init(&job.found, job.total);
+	job.caller = pthread_self();
+	job.progress = progress;
+	job.arg = arg;
+	job.start_ns = job.last_report_ns = mt19937_now_ns();
+
+	/* use the library pool unless a count of threads is requested, no need
+	   for more threads than chunks to search */
+	const size_t nchunks = (job.total + MT19937_RECOVER_CHUNK - 1) /
+		    MT19937_RECOVER_CHUNK;
+	if (nthreads > nchunks)
+		nthreads = nchunks;
+	if (nthreads > 0) {
+		pool = cp_pool_create(nthreads);
+		if (pool == NULL)
 			goto cleanup;
-		size_t i = 0;
-		for (i = 0; i < tokenlen; i++) {
-			uint32_t n = 0;
-			if (mt19937_next_uint32(gen, &n) != 0)
-				goto cleanup;
-			if (token[i] != n)
-				break;
-		}
-		valid = (i == tokenlen);
-		if (valid)
-			break;
 	}
+	/* search one chunk per task */
+	if (cp_parallel_for(pool, nchunks, 1, mt19937_recover_range,
+		    &job) != 0)
+		goto cleanup;
+
+	/* last progress report, now that all the tasks are done */
+	mt19937_recover_report(&job, mt19937_now_ns());
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	mt19937_free(gen);
+	cp_pool_free(pool);
 	if (!success)
 		return (-1);
-	return (valid ? 0 : 1);
+	const uint64_t found = atomic_load(&job.found);
+	if (found == job.total)
+		return (1);
+	if (seed_p != NULL)
+		*seed_p = (uint32_t)(lo + found);
+	return (0);
+}
+
+
+static int
+mt19937_recover_range(size_t lo, size_t hi, void *arg)
+{
+	struct mt19937_recover_job *job = arg;
+	const int reporter = pthread_equal(pthread_self(), job->caller);
+
+	for (size_t chunk = lo; chunk < hi; chunk++) {
+		const uint64_t offset = chunk * MT19937_RECOVER_CHUNK;
+		/* stop when past an already found seed */
+		if (offset >= atomic_load(&job->found))
+			break;
+		uint64_t len = job->total - offset;
+		if (len > MT19937_RECOVER_CHUNK)
+			len = MT19937_RECOVER_CHUNK;
+
+		uint32_t seed = 0;
+		const uint32_t first = (uint32_t)(job->lo + offset);
+		const int ret = mt19937_seed_search(first,
+			    (uint32_t)(first + (len - 1)), 0,
+			    job->outputs, job->count, &seed);
+		if (ret == -1)
+			return (-1);
+		if (ret == 0) {
+			/* keep the smallest matching seed */
+			const uint64_t x = seed - job->lo;
+			uint_fast64_t cur = atomic_load(&job->found);
+			while (x < cur) {
+				if (atomic_compare_exchange_weak(&job->found,
+					    &cur, x))
+					break;
+			}
+		}
+		(void)atomic_fetch_add(&job->searched, len);
+
+		if (reporter) {
+			const uint64_t now = mt19937_now_ns();
+			if (now - job->last_report_ns >=
+				    MT19937_RECOVER_REPORT_NS)
+				mt19937_recover_report(job, now);
+		}
+	}
+
+	return (0);
+}
+
+
+static void
+mt19937_recover_report(struct mt19937_recover_job *job, uint64_t now)
+{
+	struct mt19937_recover_progress progress;
+
+	job->last_report_ns = now;
+	if (job->progress == NULL)
+		return;
+
+	progress.searched = atomic_load(&job->searched);
+	progress.total = job->total;
+	progress.elapsed_ns = now - job->start_ns;
+	progress.seeds_per_second = (progress.elapsed_ns == 0 ? 0 :
+		    (double)progress.searched * 1e9 / progress.elapsed_ns);
+	job->progress(&progress, job->arg);
+}
+
+
+static uint64_t
+mt19937_now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec);
+}
+
+
+int
+mt19937_index_build(const char *path, uint32_t lo, uint32_t hi)
+{
+	struct mt19937_index_header *header = NULL;
+	uint64_t *offsets = NULL, *cursors = NULL, *pairs = NULL;
+	uint32_t *seeds = NULL;
+	void *map = MAP_FAILED;
+	size_t maplen = 0;
+	int fd = -1, success = 0;
+
+	/* sanity checks */
+	if (path == NULL || lo > hi)
+		goto cleanup;
+
+	const uint64_t count = (uint64_t)hi - lo + 1;
+	uint32_t bits = 0;
+	while (bits < MT19937_INDEX_MAX_BITS &&
+		    (count >> (bits + MT19937_INDEX_BUCKET_LOG2 + 1)) > 0)
+		bits += 1;
+	const uint64_t nbuckets = UINT64_C(1) << bits;
+	maplen = mt19937_index_size(bits, count);
+	if (maplen == 0)
+		goto cleanup;
+
+	/* create the file and map it */
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		goto cleanup;
+	if (ftruncate(fd, (off_t)maplen) == -1)
+		goto cleanup;
+	map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto cleanup;
+	header  = map;
+	offsets = (uint64_t *)(header + 1);
+	seeds   = (uint32_t *)(offsets + nbuckets + 1);
+
+	/* first pass, count the seeds of each bucket */
+	if (mt19937_index_scan(lo, count, bits, offsets, NULL, NULL) != 0)
+		goto cleanup;
+	uint64_t maxbucket = 0;
+	for (uint64_t i = 0; i < nbuckets; i++) {
+		if (offsets[i + 1] > maxbucket)
+			maxbucket = offsets[i + 1];
+		offsets[i + 1] += offsets[i];
+	}
+
+	/* second pass, store each seed in its bucket */
+	cursors = calloc(nbuckets, sizeof(uint64_t));
+	if (cursors == NULL)
+		goto cleanup;
+	(void)memcpy(cursors, offsets, nbuckets * sizeof(uint64_t));
+	if (mt19937_index_scan(lo, count, bits, NULL, cursors, seeds) != 0)
+		goto cleanup;
+
+	/* third pass, sort each bucket */
+	pairs = calloc(maxbucket, sizeof(uint64_t));
+	if (pairs == NULL && maxbucket > 0)
+		goto cleanup;
+	for (uint64_t i = 0; i < nbuckets; i++) {
+		if (mt19937_index_sort(seeds + offsets[i],
+			    offsets[i + 1] - offsets[i], pairs) != 0)
+			goto cleanup;
+	}
+
+	/* write the header last so that an incomplete file is never valid */
+	header->version = MT19937_INDEX_VERSION;
+	header->bits = bits;
+	header->lo = lo;
+	header->hi = hi;
+	header->count = count;
+	(void)memcpy(header->magic, MT19937_INDEX_MAGIC,
+		    sizeof(header->magic));
+	if (msync(map, maplen, MS_SYNC) == -1)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	free(pairs);
+	free(cursors);
+	if (map != MAP_FAILED)
+		(void)munmap(map, maplen);
+	if (fd != -1) {
+		(void)close(fd);
+		if (!success)
+			(void)unlink(path);
+	}
+	return (success ? 0 : -1);
+}
+
+
+struct mt19937_index *
+mt19937_index_open(const char *path)
+{
+	struct mt19937_index *index = NULL;
+	struct stat st;
+	int fd = -1, success = 0;
+
+	/* sanity check */
+	if (path == NULL)
+		goto cleanup;
+
+	index = calloc(1, sizeof(struct mt19937_index));
+	if (index == NULL)
+		goto cleanup;
+	index->map = MAP_FAILED;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		goto cleanup;
+	if (fstat(fd, &st) == -1)
+		goto cleanup;
+	if (st.st_size < (off_t)sizeof(struct mt19937_index_header))
+		goto cleanup;
+	if ((uintmax_t)st.st_size > SIZE_MAX)
+		goto cleanup;
+	index->maplen = (size_t)st.st_size;
+	index->map = mmap(NULL, index->maplen, PROT_READ, MAP_SHARED, fd, 0);
+	if (index->map == MAP_FAILED)
+		goto cleanup;
+	/* lookups hit a few random pages */
+	(void)madvise(index->map, index->maplen, MADV_RANDOM);
+
+	/* validate the header and the file size */
+	const struct mt19937_index_header *header = index->map;
+	if (memcmp(header->magic, MT19937_INDEX_MAGIC,
+		    sizeof(header->magic)) != 0)
+		goto cleanup;
+	if (header->version != MT19937_INDEX_VERSION)
+		goto cleanup;
+	if (header->bits > MT19937_INDEX_MAX_BITS || header->lo > header->hi)
+		goto cleanup;
+	if (header->count != (uint64_t)header->hi - header->lo + 1)
+		goto cleanup;
+	if (mt19937_index_size(header->bits, header->count) != index->maplen)
+		goto cleanup;
+
+	const uint64_t nbuckets = UINT64_C(1) << header->bits;
+	index->header  = header;
+	index->offsets = (const uint64_t *)(header + 1);
+	index->seeds   = (const uint32_t *)(index->offsets + nbuckets + 1);
+	if (index->offsets[0] != 0 || index->offsets[nbuckets] != header->count)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (fd != -1)
+		(void)close(fd);
+	if (!success) {
+		mt19937_index_close(index);
+		index = NULL;
+	}
+	return (index);
+}
+
+
+int
+mt19937_lookup_seed(const struct mt19937_index *index, uint32_t output,
+		    uint32_t *seeds, size_t nseeds)
+{
+	int found = 0;
+
+	/* sanity checks */
+	if (index == NULL || (seeds == NULL && nseeds > 0))
+		return (-1);
+
+	const uint32_t bucket = mt19937_index_bucket(output,
+		    index->header->bits);
+	const uint64_t end = index->offsets[bucket + 1];
+	uint64_t lo = index->offsets[bucket], hi = end;
+	if (lo > hi || hi > index->header->count)
+		return (-1);
+
+	/* binary search for the first seed with an output not below output */
+	while (lo < hi) {
+		const uint64_t mid = lo + (hi - lo) / 2;
+		if (mt19937_first_output(index->seeds[mid]) < output)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* collect all the seeds yielding output */
+	for (uint64_t i = lo; i < end && found < INT_MAX; i++) {
+		const uint32_t seed = index->seeds[i];
+		if (mt19937_first_output(seed) != output)
+			break;
+		if ((size_t)found < nseeds)
+			seeds[found] = seed;
+		found += 1;
+	}
+
+	return (found);
+}
+
+
+void
+mt19937_index_close(struct mt19937_index *index)
+{
+	if (index == NULL)
+		return;
+	if (index->map != MAP_FAILED)
+		(void)munmap(index->map, index->maplen);
+	free(index);
+}
+
+
+static size_t
+mt19937_index_size(uint32_t bits, uint64_t count)
+{
+	const uint64_t nbuckets = UINT64_C(1) << bits;
+	const uint64_t size = sizeof(struct mt19937_index_header) +
+		    (nbuckets + 1) * sizeof(uint64_t) + count * sizeof(uint32_t);
+
+	if (size > SIZE_MAX)
+		return (0);
+	return ((size_t)size);
 }
 
 
 static uint32_t
-mt19937_untemper(uint32_t x)
+mt19937_index_bucket(uint32_t output, uint32_t bits)
 {
-	x = unrshiftmaskxor(x, 18, 0xffffffff);
-	x = unlshiftmaskxor(x, 15, 0xefc60000);
-	x = unlshiftmaskxor(x,  7, 0x9d2c5680);
-	x = unrshiftmaskxor(x, 11, 0xffffffff);
-	return (x);
+	/* NOTE: shifting an uint32_t by 32 is undefined */
+	return (bits == 0 ? 0 : output >> (32 - bits));
+}
+
+
+static int
+mt19937_index_scan(uint32_t lo, uint64_t count, uint32_t bits,
+		    uint64_t *counts, uint64_t *cursors, uint32_t *seeds)
+{
+	uint32_t batch[MT19937_SEARCH_BATCH], out[MT19937_SEARCH_BATCH];
+
+	for (uint64_t base = 0; base < count; ) {
+		size_t n = 0;
+		while (n < MT19937_SEARCH_BATCH && base + n < count) {
+			batch[n] = (uint32_t)(lo + base + n);
+			n += 1;
+		}
+		if (mt19937_first_outputs_batch(batch, n, 1, out) != 0)
+			return (-1);
+		for (size_t i = 0; i < n; i++) {
+			const uint32_t bucket = mt19937_index_bucket(out[i], bits);
+			if (cursors == NULL)
+				counts[bucket + 1] += 1;
+			else
+				seeds[cursors[bucket]++] = batch[i];
+		}
+		base += n;
+	}
+
+	return (0);
+}
+
+
+static int
+mt19937_index_sort(uint32_t *seeds, uint64_t count, uint64_t *pairs)
+{
+	uint32_t out[MT19937_SEARCH_BATCH];
+
+	/* pair each seed with its output, the output being the sort key */
+	for (uint64_t base = 0; base < count; ) {
+		size_t n = MT19937_SEARCH_BATCH;
+		if (count - base < n)
+			n = count - base;
+		if (mt19937_first_outputs_batch(seeds + base, n, 1, out) != 0)
+			return (-1);
+		for (size_t i = 0; i < n; i++)
+			pairs[base + i] = ((uint64_t)out[i] << 32) | seeds[base + i];
+		base += n;
+	}
+
+	qsort(pairs, count, sizeof(uint64_t), uint64_cmp);
+	for (uint64_t i = 0; i < count; i++)
+		seeds[i] = (uint32_t)pairs[i];
+
+	return (0);
+}
+
+
+static int
+uint64_cmp(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return ((x > y) - (x < y));
 }
 
 
 static uint32_t
-unrshiftmaskxor(uint32_t x, uint32_t rshift, uint32_t mask)
+mt19937_first_output(uint32_t seed)
 {
-	/* naive bit by bit implementation */
-	for (uint32_t i = 0; i < (32 - rshift); i++)
-		x ^= ((x & (1UL << (31 - i))) >> rshift) & mask;
-	return (x);
+	uint32_t output = 0;
+
+	(void)mt19937_first_outputs(seed, 1, &output);
+	return (output);
+}
+
+
+static int
+mt19937_seed_search(uint32_t lo, uint32_t hi, size_t skip,
+		    const uint32_t *seq, size_t seqlen, uint32_t *seed_p)
+{
+	uint32_t seeds[MT19937_SEARCH_BATCH];
+	uint32_t *out = NULL;
+	uint32_t seed = 0;
+	int found = 0, success = 0;
+
+	/* sanity checks */
+	if (seq == NULL && seqlen > 0)
+		goto cleanup;
+	if (lo > hi) {
+		success = 1;
+		goto cleanup;
+	}
+
+	/* slow path, when we can't filter using the first outputs */
+	if (seqlen == 0 || skip >= 624) {
+		for (uint64_t x = lo; x <= hi && !found; x++) {
+			seed = (uint32_t)x;
+			found = mt19937_seed_matches(seed, skip, seq, seqlen);
+			if (found == -1)
+				goto cleanup;
+		}
+		success = 1;
+		goto cleanup;
+	}
+
+	const size_t k = skip + 1;
+	out = calloc(MT19937_SEARCH_BATCH * k, sizeof(uint32_t));
+	if (out == NULL)
+		goto cleanup;
+
+	for (uint64_t base = lo; base <= hi && !found; ) {
+		size_t count = 0;
+		while (count < MT19937_SEARCH_BATCH && base + count <= hi) {
+			seeds[count] = (uint32_t)(base + count);
+			count += 1;
+		}
+		if (mt19937_first_outputs_batch(seeds, count, k, out) != 0)
+			goto cleanup;
+		for (size_t i = 0; i < count && !found; i++) {
+			if (out[i * k + skip] != seq[0])
+				continue;
+			seed = seeds[i];
+			found = mt19937_seed_matches(seed, skip, seq, seqlen);
+			if (found == -1)
+				goto cleanup;
+		}
+		base += count;
+	}
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	free(out);
+	if (!success)
+		return (-1);
+	if (found && seed_p != NULL)
+		*seed_p = seed;
+	return (found ? 0 : 1);
+}
+
+
+static int
+mt19937_seed_matches(uint32_t seed, size_t skip, const uint32_t *seq,
+		    size_t seqlen)
+{
+	struct mt19937_generator *gen = NULL;
+	int matches = 0, success = 0;
+
+	gen = mt19937_init(seed);
+	if (gen == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < skip; i++)
+		(void)mt19937_next_uint32(gen, NULL);
+	size_t i;
+	for (i = 0; i < seqlen; i++) {
+		uint32_t x = 0;
+		if (mt19937_next_uint32(gen, &x) != 0)
+			goto cleanup;
+		if (x != seq[i])
+			break;
+	}
+	matches = (i == seqlen);
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	mt19937_free(gen);
+	if (!success)
+		return (-1);
+	return (matches);
 }
 
 
 static uint32_t
-unlshiftmaskxor(uint32_t x, uint32_t lshift, uint32_t mask)
+mt19937_untemper(uint32_t x)
 {
-	/* naive bit by bit implementation */
-	for (uint32_t i = 0; i < (32 - lshift); i++)
-		x ^= ((x & (1UL << i)) << lshift) & mask;
+	/*
+	 * The tempering is four steps y ^= L(y) with L a shift (and mask), thus
+	 * nilpotent: L^k(y) = 0 as soon as the total shift k * shift reaches
+	 * 32. Over GF(2) each step is undone by I + L + L^2 + ... up to that
+	 * power, the masks of L^k being precomputed below.
+	 */
+	/* y ^= y >> 18 */
+	x ^= x >> 18;
+	/* y ^= (y << 15) & 0xefc60000, where L^2 = 0 */
+	x ^= (x << 15) & 0xefc60000;
+	/* y ^= (y << 7) & 0x9d2c5680, up to L^4 */
+	x ^= ((x <<  7) & 0x9d2c5680) ^
+	     ((x << 14) & 0x94284000) ^
+	     ((x << 21) & 0x14200000) ^
+	     ((x << 28) & 0x10000000);
+	/* y ^= y >> 11, up to L^2 */
+	x ^= (x >> 11) ^ (x >> 22);
 	return (x);
 }
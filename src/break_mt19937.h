@@ -4,10 +4,34 @@
  * break_mt19937.h
  *
  * MT19937 analysis stuff for cryptopals.com challenges.
+ *
+ * The seed search runs on a pool, reporting progress from the calling thread
+ * only.
  */
 #include "mt19937.h"
 
 
+/*
+ * Index mapping the first output of MT19937 generators to their seeds, see
+ * mt19937_index_build().
+ */
+struct mt19937_index;
+
+/*
+ * Progress of a mt19937_recover_seed() search, see there.
+ */
+struct mt19937_recover_progress {
+	/* count of seeds searched so far */
+	uint64_t searched;
+	/* count of seeds in the searched range */
+	uint64_t total;
+	/* time elapsed since the search started, in nanoseconds */
+	uint64_t elapsed_ns;
+	/* search rate since the search started */
+	double seeds_per_second;
+};
+
+
 /*
  * Wait between 40 and 1000 seconds before seeding the given generator with the
  * current UNIX timestamp. Then, wait again between 40 and 1000 seconds before
@@ -50,6 +74,38 @@ int	mt19937_time_seeder_breaker(uint32_t before, uint32_t after,
  */
 struct mt19937_generator	*mt19937_clone(struct mt19937_generator *gen);
 
+/*
+ * Return a generator that should produce the numbers following the given
+ * count outputs of a generator, NULL on error. count must be at least 624, the
+ * first 624 outputs being the generator's numbers following a (re)seed.
+ */
+struct mt19937_generator	*mt19937_clone_from_outputs(
+		    const uint32_t *outputs, size_t count);
+
+/*
+ * Find the seed of the provided generator, e.g. a clone from
+ * mt19937_clone_from_outputs(), by rewinding it using mt19937_untwist() up to
+ * maxrounds times until its state is a seeding one. The generator is left
+ * rewound.
+ *
+ * If seed_p is not NULL, it is set to the seed on success.
+ *
+ * Returns 0 on success, 1 if no seeding state was reached, -1 on error.
+ */
+int	mt19937_unwind_breaker(struct mt19937_generator *gen, size_t maxrounds,
+		    uint32_t *seed_p);
+
+/*
+ * Undo the MT19937 tempering transform of count outputs, storing the
+ * corresponding state words into state (which may be outputs). Each word is
+ * inverted in constant time without branches, allowing the compiler to process
+ * several words per SIMD instruction.
+ *
+ * Returns 0 on success, -1 if outputs or state is NULL while count is not zero.
+ */
+int	mt19937_untemper_batch(const uint32_t *outputs, size_t count,
+		    uint32_t *state);
+
 /*
  * Compute the 16 bits key given a full ciphertext and the known bits of
  * plaintext as described in Set 3 / Challenge 24. Returns 0 on success, -1 on
@@ -69,4 +125,68 @@ int	mt19937_encryption_breaker(const struct bytes *ciphertext,
  */
 int	mt19937_token_breaker(const uint32_t *token, size_t tokenlen);
 
+/*
+ * Recover the seed of a MT19937 generator given its first count outputs and
+ * knowing that the seed is between lo and hi (included), which may cover the
+ * full 32 bits space.
+ *
+ * The range is split in chunks searched by a pool of nthreads threads (0
+ * meaning the library pool from cp_pool_default()). Once a seed is found the
+ * chunks following it are skipped, so that the smallest matching seed is
+ * always the one recovered.
+ *
+ * When progress is not NULL, it is called from the calling thread about once a
+ * second during the search and a last time once done, with arg as its second
+ * argument.
+ *
+ * If seed_p is not NULL, it is set to the recovered seed.
+ *
+ * Returns 0 on success, 1 when no seed in the range matches, -1 on error.
+ */
+int	mt19937_recover_seed(const uint32_t *outputs, size_t count,
+		    uint32_t lo, uint32_t hi, size_t nthreads,
+		    void (*progress)(const struct mt19937_recover_progress *,
+		    void *), void *arg, uint32_t *seed_p);
+
+/*
+ * Build an index file at the given path mapping the first output of the
+ * generators seeded with lo to hi (included) to their seeds. Covering the full
+ * 32 bits space yields a 16 GiB file (4 bytes per seed) plus 128 MiB of bucket
+ * offsets, and requires three passes over all the seeds.
+ *
+ * The file holds a header, the offsets of (1 << bits) + 1 buckets, and the
+ * seeds grouped by the top bits of their first output. Each bucket is sorted
+ * by first output, the outputs themselves are not stored but computed again
+ * when searching the index. The file uses the native byte order.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	mt19937_index_build(const char *path, uint32_t lo, uint32_t hi);
+
+/*
+ * Open the index file at the given path, created by mt19937_index_build(). The
+ * file is mapped in memory rather than read.
+ *
+ * Returns a new mt19937_index struct that must be passed to
+ * mt19937_index_close(), or NULL on error or if the file is not a valid index.
+ */
+struct mt19937_index	*mt19937_index_open(const char *path);
+
+/*
+ * Find the seeds of the given index whose generator first output is the given
+ * one. At most nseeds of them are stored into seeds, smallest first. Every
+ * returned seed is verified, a corrupted index yielding missing seeds rather
+ * than wrong ones.
+ *
+ * Returns the count of matching seeds (that may be greater than nseeds), or -1
+ * on error.
+ */
+int	mt19937_lookup_seed(const struct mt19937_index *index, uint32_t output,
+		    uint32_t *seeds, size_t nseeds);
+
+/*
+ * Unmap the given index and free the resource associated with it, if not NULL.
+ */
+void	mt19937_index_close(struct mt19937_index *index);
+
 #endif /* ndef BREAK_MT19937_H */
@@ -4,6 +4,8 @@
  * break_plaintext.h
  *
  * Plain text analysis stuff for cryptopals.com challenges.
+ *
+ * Reentrant, the frequency tables are constant.
  */
 #include "bytes.h"
 
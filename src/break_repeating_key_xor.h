@@ -4,6 +4,8 @@
  * break_repeating_key_xor.h
  *
  * Breaking Repeating-key XOR "cipher" (aka Vigenère cipher).
+ *
+ * Reentrant.
  */
 #include "bytes.h"
 
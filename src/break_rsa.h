@@ -4,6 +4,8 @@
  * break_rsa.h
  *
  * RSA e=3 broadcast attack stuff.
+ *
+ * Reentrant.
  */
 #include "bytes.h"
 #include "rsa.h"
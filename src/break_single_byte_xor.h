@@ -4,6 +4,8 @@
  * break_single_byte_xor.h
  *
  * Breaking Single-byte XOR "cipher".
+ *
+ * Reentrant.
  */
 #include "bytes.h"
 #include "break_plaintext.h"
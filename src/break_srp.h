@@ -4,6 +4,8 @@
  * break_srp.h
  *
  * Secure Remote Password (SRP) parameters injection stuff.
+ *
+ * Reentrant, the clients created here are owned by the caller.
  */
 #include "srp.h"
 
@@ -5,6 +5,9 @@
  *
  * Simplified Secure Remote Password (SSRP) mitm stuff for cryptopals.com
  * challenges.
+ *
+ * A MITM server is owned by a single thread, as any SSRP endpoint but the local
+ * server.
  */
 #include "bytes.h"
 #include "mpi.h"
@@ -5,7 +5,9 @@
  *
  * About base16 (aka hex) and base64 encoding see RFC 4648.
  */
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,6 +15,32 @@
 #include "bytes.h"
 
 
+/*
+ * The bytes_random_fill() generator state, one per thread. See
+ * https://prng.di.unimi.it/ about xoshiro256**.
+ *
+ * Each thread seeds its state from the shared seed at its first use, and again
+ * after bytes_random_seed() has changed it, taking the next stream: the
+ * generator jumped 2^128 steps once more than the previous thread so that no
+ * two threads draw the same values.
+ */
+struct bytes_random_state {
+	uint64_t s[4];
+	/* the seed generation this state is drawn from, 0 when unseeded */
+	uint64_t generation;
+};
+
+static _Thread_local struct bytes_random_state	bytes_random_state;
+
+/* the shared seed, like rand(3) it is 1 until bytes_random_seed() is called */
+static pthread_mutex_t		bytes_random_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t			bytes_random_shared_seed = 1;
+static uint64_t			bytes_random_streams = 0;
+/* the state the last stream taken starts from, each new one jumping once */
+static uint64_t			bytes_random_stream_s[4];
+static atomic_uint_fast64_t	bytes_random_generation = 1;
+
+
 /* see https://lemire.me/blog/2016/05/23/the-surprising-cleverness-of-modern-compilers/ */
 static inline int
 popcnt(uint64_t x)
@@ -51,6 +79,93 @@ b64decode(char c)
 }
 
 
+static inline uint64_t
+rotl64(uint64_t x, int k)
+{
+	return ((x << k) | (x >> (64 - k)));
+}
+
+
+/* Returns the next output of the xoshiro256** generator of the given state */
+static inline uint64_t
+xoshiro256ss_next(uint64_t *s)
+{
+	const uint64_t result = rotl64(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+
+	return (result);
+}
+
+
+/*
+ * Advance the xoshiro256** generator of the given state by 2^128 steps, i.e.
+ * to the start of the next non-overlapping stream.
+ */
+static void
+xoshiro256ss_jump(uint64_t *s)
+{
+	static const uint64_t jump[] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL,
+	};
+	uint64_t t[4] = { 0 };
+
+	for (size_t i = 0; i < sizeof(jump) / sizeof(*jump); i++) {
+		for (int b = 0; b < 64; b++) {
+			if (jump[i] & (UINT64_C(1) << b)) {
+				t[0] ^= s[0];
+				t[1] ^= s[1];
+				t[2] ^= s[2];
+				t[3] ^= s[3];
+			}
+			(void)xoshiro256ss_next(s);
+		}
+	}
+	(void)memcpy(s, t, sizeof(t));
+}
+
+
+/*
+ * Returns the calling thread generator state, (re)seeding it from the shared
+ * seed when needed.
+ */
+static struct bytes_random_state *
+bytes_random_state_get(void)
+{
+	struct bytes_random_state *state = &bytes_random_state;
+
+	if (state->generation == atomic_load(&bytes_random_generation))
+		return (state);
+
+	(void)pthread_mutex_lock(&bytes_random_mutex);
+	if (bytes_random_streams == 0) {
+		/* expand the seed by SplitMix64 as recommended for xoshiro */
+		uint64_t x = bytes_random_shared_seed;
+		for (size_t i = 0; i < 4; i++) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			bytes_random_stream_s[i] = z ^ (z >> 31);
+		}
+	} else {
+		xoshiro256ss_jump(bytes_random_stream_s);
+	}
+	bytes_random_streams++;
+	(void)memcpy(state->s, bytes_random_stream_s, sizeof(state->s));
+	state->generation = atomic_load(&bytes_random_generation);
+	(void)pthread_mutex_unlock(&bytes_random_mutex);
+
+	return (state);
+}
+
+
 /*
  * malloc(3) a bytes struct and set the len member. Note that the data member
  * content is not set and must be filled by the caller.
@@ -346,13 +461,47 @@ bytes_randomized(size_t len)
 	if (buf == NULL)
 		return (NULL);
 
-	for (size_t i = 0; i < len; i++)
-		buf->data[i] = rand() & 0xff;
+	(void)bytes_random_fill(buf->data, len);
 
 	return (buf);
 }
 
 
+void
+bytes_random_seed(uint64_t seed)
+{
+	(void)pthread_mutex_lock(&bytes_random_mutex);
+	bytes_random_shared_seed = seed;
+	/* the next stream taken is expanded from the new seed */
+	bytes_random_streams = 0;
+	(void)atomic_fetch_add(&bytes_random_generation, 1);
+	(void)pthread_mutex_unlock(&bytes_random_mutex);
+}
+
+
+int
+bytes_random_fill(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+
+	/* sanity check */
+	if (buf == NULL && len > 0)
+		return (-1);
+
+	struct bytes_random_state *state = bytes_random_state_get();
+	/* whole words at a time, the last one possibly truncated */
+	while (len > 0) {
+		const uint64_t word = xoshiro256ss_next(state->s);
+		const size_t n = (len < sizeof(word) ? len : sizeof(word));
+		(void)memcpy(p, &word, n);
+		p += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+
 struct bytes *
 bytes_dup(const struct bytes *src)
 {
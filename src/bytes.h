@@ -4,6 +4,9 @@
  * bytes.h
  *
  * Bytes manipulation stuff for cryptopals.com challenges.
+ *
+ * Bytes structs are not locked: share them read-only or not at all. The random
+ * functions use a generator per thread.
  */
 #include <stdint.h>
 #include <stddef.h>
@@ -102,14 +105,30 @@ struct bytes	*bytes_from_hex(const char *s);
 struct bytes	*bytes_from_base64(const char *s);
 
 /*
- * Create a bytes struct filled with random data. Note that it uses rand(3)
- * *on purpose* and consequently it is *not* very secure.
+ * Create a bytes struct filled with random data from bytes_random_fill(), so
+ * it is *not* very secure *on purpose*.
  *
  * Returns a pointer to a newly allocated bytes struct that should passed to
  * bytes_free(), NULL if malloc(3) failed.
  */
 struct bytes	*bytes_randomized(size_t len);
 
+/*
+ * Seed the bytes_random_fill() generators of all the threads, like srand(3).
+ * Until it is called the seed is 1. A thread drawing random data alone after
+ * this call always gets the same values for a given seed.
+ */
+void	bytes_random_seed(uint64_t seed);
+
+/*
+ * Fill the len bytes at buf with random data from the calling thread
+ * xoshiro256** generator. It is fast and safe to use from many threads at once
+ * but *not* cryptographically secure.
+ *
+ * Returns 0 on success, -1 if buf is NULL while len is not zero.
+ */
+int	bytes_random_fill(void *buf, size_t len);
+
 /*
  * Create a bytes struct from another bytes struct by duplicating it.
  *
@@ -7,8 +7,25 @@
 #include "cbc.h"
 #include "nope.h"
 #include "aes.h"
+#include "pool.h"
 
 
+/*
+ * Count of blocks decrypted by each cbc_decrypt() task, so that only large
+ * inputs are spread over the library pool.
+ */
+#define	CBC_PARALLEL_GRAIN	4096
+
+/*
+ * State shared by the cbc_decrypt() tasks.
+ */
+struct cbc_decrypt_job {
+	const struct block_cipher *impl;
+	const struct bytes *expkey, *iv;
+	const struct bytes *ciphertext;
+	struct bytes *plaintext;
+};
+
 /*
  * Encrypt the given plaintext under the provided key.
  */
@@ -23,6 +40,15 @@ struct bytes	*cbc_decrypt(const struct block_cipher *impl,
 		    const struct bytes *ciphertext, const struct bytes *key,
 		    const struct bytes *iv);
 
+/*
+ * cbc_decrypt() cp_parallel_for() routine, decrypt the blocks from lo to hi
+ * (excluded). Unlike encryption, every block decryption only depends on the
+ * ciphertext.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int	cbc_decrypt_range(size_t lo, size_t hi, void *arg);
+
 
 struct bytes *
 nope_cbc_encrypt(const struct bytes *plaintext, const struct bytes *key,
@@ -124,8 +150,8 @@ struct bytes *
 cbc_decrypt(const struct block_cipher *impl, const struct bytes *ciphertext,
 		    const struct bytes *key, const struct bytes *iv)
 {
-	struct bytes *expkey = NULL, *prevblock = NULL, *plaintext = NULL,
-		     *unpadded = NULL;
+	struct bytes *expkey = NULL, *plaintext = NULL, *unpadded = NULL;
+	struct cbc_decrypt_job job;
 	int success = 0;
 
 	if (impl == NULL || ciphertext == NULL)
@@ -146,27 +172,15 @@ cbc_decrypt(const struct block_cipher *impl, const struct bytes *ciphertext,
 	if (plaintext == NULL)
 		goto cleanup;
 
-	/* main decryption loop, process each block in order. */
-	int err = 0;
-	for (size_t i = 0; i < nblock; i++) {
-		struct bytes *ctblock, *ptblock;
-		const size_t offset = i * blocksize;
-		/* get the current ciphertext block */
-		ctblock = bytes_slice(ciphertext, offset, blocksize);
-		ptblock = bytes_dup(ctblock);
-		/* decrypt it, the result is not the plaintext block yet */
-		err |= impl->decrypt(ptblock, expkey);
-		/* add the previous block (the iv on the first iteration) to
-		   the decrypted one to find the plaintext block */
-		err |= bytes_xor(ptblock, i == 0 ? iv : prevblock);
-		/* save the current ciphertext block for the next iteration */
-		bytes_free(prevblock);
-		prevblock = ctblock;
-		/* populate the padded plaintext */
-		err |= bytes_put(plaintext, offset, ptblock);
-		bytes_free(ptblock);
-	}
-	if (err)
+	/* main decryption loop, processing the blocks concurrently when there
+	   are enough of them. */
+	job.impl = impl;
+	job.expkey = expkey;
+	job.iv = iv;
+	job.ciphertext = ciphertext;
+	job.plaintext = plaintext;
+	if (cp_parallel_for(NULL, nblock, CBC_PARALLEL_GRAIN, cbc_decrypt_range,
+		    &job) != 0)
 		goto cleanup;
 
 	/* remove the padding from the plaintext */
@@ -178,7 +192,6 @@ cbc_decrypt(const struct block_cipher *impl, const struct bytes *ciphertext,
 	/* FALLTHROUGH */
 cleanup:
 	bytes_free(expkey);
-	bytes_free(prevblock);
 	bytes_free(plaintext);
 	if (!success) {
 		bytes_free(unpadded);
@@ -186,3 +199,43 @@ cleanup:
 	}
 	return (unpadded);
 }
+
+
+static int
+cbc_decrypt_range(size_t lo, size_t hi, void *arg)
+{
+	const struct cbc_decrypt_job *job = arg;
+	const size_t blocksize = job->impl->blocksize();
+	struct bytes *prevblock = NULL;
+	int err = 0;
+
+	/* the ciphertext block preceding our first one, if any */
+	if (lo > 0) {
+		prevblock = bytes_slice(job->ciphertext, (lo - 1) * blocksize,
+			    blocksize);
+		if (prevblock == NULL)
+			return (-1);
+	}
+
+	for (size_t i = lo; i < hi; i++) {
+		struct bytes *ctblock, *ptblock;
+		const size_t offset = i * blocksize;
+		/* get the current ciphertext block */
+		ctblock = bytes_slice(job->ciphertext, offset, blocksize);
+		ptblock = bytes_dup(ctblock);
+		/* decrypt it, the result is not the plaintext block yet */
+		err |= job->impl->decrypt(ptblock, job->expkey);
+		/* add the previous block (the iv on the first block) to the
+		   decrypted one to find the plaintext block */
+		err |= bytes_xor(ptblock, i == 0 ? job->iv : prevblock);
+		/* save the current ciphertext block for the next iteration */
+		bytes_free(prevblock);
+		prevblock = ctblock;
+		/* populate the padded plaintext */
+		err |= bytes_put(job->plaintext, offset, ptblock);
+		bytes_free(ptblock);
+	}
+
+	bytes_free(prevblock);
+	return (err ? -1 : 0);
+}
@@ -4,6 +4,9 @@
  * cbc.h
  *
  * Cipher Block Chaining mode of operation.
+ *
+ * Reentrant. Only decryption can run in parallel, encryption chaining every
+ * block on the previous one.
  */
 #include "bytes.h"
 
@@ -4,6 +4,8 @@
  * cookie.h
  *
  * Cookie stuff for Set 2 / Challenge 13.
+ *
+ * Reentrant, the parsing relies on strtok_r(3).
  */
 
 
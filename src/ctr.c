@@ -3,12 +3,30 @@
  *
  * Counter mode of operation.
  */
-#include "xor.h"
 #include "ctr.h"
 #include "nope.h"
 #include "aes.h"
+#include "pool.h"
 
 
+/*
+ * Count of bytes processed by each ctr_xor_keystream() task, so that only
+ * large inputs are spread over the library pool.
+ */
+#define	CTR_PARALLEL_GRAIN	(64 * 1024)
+
+/*
+ * State shared by the ctr_xor_keystream() tasks.
+ */
+struct ctr_job {
+	const struct block_cipher *impl;
+	const struct bytes *expkey;
+	uint64_t nonce;
+	/* the bytes to process and their offset in the keystream */
+	uint8_t *p;
+	size_t offset;
+};
+
 /*
  * Encrypt the given plaintext under the provided key.
  */
@@ -16,6 +34,42 @@ struct bytes	*ctr_crypt(const struct block_cipher *impl,
 		    const struct bytes *input, const struct bytes *key,
 		    uint64_t nonce);
 
+/*
+ * XOR the len bytes at p with the keystream starting at the given offset.
+ * Only the keystream blocks covering the range are generated.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	ctr_xor_keystream(const struct block_cipher *impl,
+		    uint8_t *p, size_t len, const struct bytes *key,
+		    uint64_t nonce, size_t offset);
+
+/*
+ * ctr_xor_keystream() cp_parallel_for() routine, XOR the bytes from lo to hi
+ * (excluded) with the keystream.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	ctr_xor_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Encrypt (or decrypt) in place the len bytes of buf starting at offset, i.e.
+ * XOR them with the keystream at the same offset.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	ctr_crypt_at(const struct block_cipher *impl,
+		    struct bytes *buf, size_t offset, size_t len,
+		    const struct bytes *key, uint64_t nonce);
+
+/*
+ * Return the len bytes of the keystream starting at the given offset, or NULL
+ * on error.
+ */
+static struct bytes	*ctr_keystream(const struct block_cipher *impl,
+		    const struct bytes *key, uint64_t nonce,
+		    size_t offset, size_t len);
+
 /*
  * Helper to create the stream block to be encrypted.
  */
@@ -54,16 +108,78 @@ aes_128_ctr_decrypt(const struct bytes *ciphertext, const struct bytes *key,
 }
 
 
+struct bytes *
+nope_ctr_keystream(const struct bytes *key, uint64_t nonce,
+		    size_t offset, size_t len)
+{
+	return (ctr_keystream(&nope, key, nonce, offset, len));
+}
+
+
+int
+nope_ctr_crypt_at(struct bytes *buf, size_t offset, size_t len,
+		    const struct bytes *key, uint64_t nonce)
+{
+	return (ctr_crypt_at(&nope, buf, offset, len, key, nonce));
+}
+
+
+struct bytes *
+aes_128_ctr_keystream(const struct bytes *key, uint64_t nonce,
+		    size_t offset, size_t len)
+{
+	return (ctr_keystream(&aes_128, key, nonce, offset, len));
+}
+
+
+int
+aes_128_ctr_crypt_at(struct bytes *buf, size_t offset, size_t len,
+		    const struct bytes *key, uint64_t nonce)
+{
+	return (ctr_crypt_at(&aes_128, buf, offset, len, key, nonce));
+}
+
+
 struct bytes *
 ctr_crypt(const struct block_cipher *impl, const struct bytes *input,
 		    const struct bytes *key, uint64_t nonce)
 {
-	struct bytes *expkey = NULL, *stream = NULL, *output = NULL;
+	struct bytes *output = NULL;
 	int success = 0;
 
 	if (impl == NULL || input == NULL)
 		goto cleanup;
 
+	/* create the output buffer and process it in place */
+	output = bytes_dup(input);
+	if (output == NULL)
+		goto cleanup;
+	if (ctr_crypt_at(impl, output, 0, output->len, key, nonce) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		bytes_free(output);
+		output = NULL;
+	}
+	return (output);
+}
+
+
+static int
+ctr_xor_keystream(const struct block_cipher *impl, uint8_t *p, size_t len,
+		    const struct bytes *key, uint64_t nonce, size_t offset)
+{
+	struct bytes *expkey = NULL;
+	struct ctr_job job;
+	int success = 0;
+
+	/* sanity checks */
+	if (impl == NULL || (p == NULL && len > 0))
+		goto cleanup;
+
 	expkey = impl->expand_key(key);
 	if (expkey == NULL)
 		goto cleanup;
@@ -72,62 +188,112 @@ ctr_crypt(const struct block_cipher *impl, const struct bytes *input,
 	if (blocksize != 16)
 		goto cleanup;
 
+	/* the keystream blocks are independent, process them concurrently
+	   when there are enough of them. */
+	job.impl = impl;
+	job.expkey = expkey;
+	job.nonce = nonce;
+	job.p = p;
+	job.offset = offset;
+	if (cp_parallel_for(NULL, len, CTR_PARALLEL_GRAIN, ctr_xor_range,
+		    &job) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	bytes_free(expkey);
+	return (success ? 0 : -1);
+}
+
+
+static int
+ctr_xor_range(size_t lo, size_t hi, void *arg)
+{
+	const struct ctr_job *job = arg;
+	const size_t blocksize = job->impl->blocksize();
+	struct bytes *stream = NULL;
+	uint8_t *p = job->p + lo;
+	size_t len = hi - lo;
+	int success = 0;
+
 	/* the keystream block */
 	stream = bytes_zeroed(blocksize);
 	if (stream == NULL)
 		goto cleanup;
 
-	/* create the plaintext buffer */
-	output = bytes_zeroed(input->len);
-	if (output == NULL)
-		goto cleanup;
+	/* seek to the keystream block containing our first byte */
+	uint64_t counter = (job->offset + lo) / blocksize;
+	size_t skip = (job->offset + lo) % blocksize;
 
-	/* compute the complete block count */
-	const size_t nblock = input->len / blocksize;
-
-	/* main encryption loop, process the input by chunk of blocksize */
-	int err = 0;
-	for (uint64_t i = 0; i <= nblock; i++) {
-		struct bytes *block;
-		const size_t offset = i * blocksize;
-		/* compute the input block length. If we're at the last block it
-		   may be incomplete. */
-		const size_t inlen = (i == nblock ?
-			    input->len % blocksize : blocksize);
-		/* get the current input block */
-		block = bytes_slice(input, offset, inlen);
+	/* main encryption loop, process the range by chunk of at most
+	   blocksize bytes */
+	while (len > 0) {
 		/* generate the current stream block */
-		uint64_to_bytes_le(nonce, stream->data + 0);
-		uint64_to_bytes_le(i,     stream->data + 8);
-		err |= impl->encrypt(stream, expkey);
-		if (stream->len > inlen) {
-			/*
-			 * Use a truncated version of the stream block to match
-			 * the input block length.
-			 */
-			struct bytes *truncated = bytes_slice(stream, 0, inlen);
-			err |= bytes_xor(block, truncated);
-			bytes_free(truncated);
-		} else {
-			err |= bytes_xor(block, stream);
-		}
-		/* populate the output */
-		err |= bytes_put(output, offset, block);
-		bytes_free(block);
+		uint64_to_bytes_le(job->nonce, stream->data + 0);
+		uint64_to_bytes_le(counter,    stream->data + 8);
+		if (job->impl->encrypt(stream, job->expkey) != 0)
+			goto cleanup;
+		/* the first and last chunk may not be block aligned */
+		size_t n = blocksize - skip;
+		if (n > len)
+			n = len;
+		for (size_t i = 0; i < n; i++)
+			p[i] ^= stream->data[skip + i];
+		p += n;
+		len -= n;
+		skip = 0;
+		counter += 1;
 	}
-	if (err)
-		goto cleanup;
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
 	bytes_free(stream);
-	bytes_free(expkey);
+	return (success ? 0 : -1);
+}
+
+
+static int
+ctr_crypt_at(const struct block_cipher *impl, struct bytes *buf,
+		    size_t offset, size_t len, const struct bytes *key,
+		    uint64_t nonce)
+{
+	/* sanity checks */
+	if (buf == NULL)
+		return (-1);
+	if (offset > buf->len || buf->len - offset < len)
+		return (-1);
+
+	return (ctr_xor_keystream(impl, buf->data + offset, len, key, nonce,
+		    offset));
+}
+
+
+static struct bytes *
+ctr_keystream(const struct block_cipher *impl, const struct bytes *key,
+		    uint64_t nonce, size_t offset, size_t len)
+{
+	struct bytes *keystream = NULL;
+	int success = 0;
+
+	/* the keystream is the encryption of zeroes */
+	keystream = bytes_zeroed(len);
+	if (keystream == NULL)
+		goto cleanup;
+
+	if (ctr_xor_keystream(impl, keystream->data, len, key, nonce,
+		    offset) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
 	if (!success) {
-		bytes_free(output);
-		output = NULL;
+		bytes_free(keystream);
+		keystream = NULL;
 	}
-	return (output);
+	return (keystream);
 }
 
 
@@ -4,22 +4,41 @@
  * ctr.h
  *
  * Counter mode of operation.
+ *
+ * Reentrant. Each keystream block depends only on its counter, so long inputs
+ * are processed by the library pool.
  */
 #include "bytes.h"
 
 
-/* per block cipher implementation routines */
+/*
+ * Per block cipher implementation routines.
+ *
+ * The *_ctr_keystream() functions return the len keystream bytes starting at
+ * the given byte offset, the *_ctr_crypt_at() ones encrypt (or decrypt) in
+ * place the len bytes of buf starting at offset. Both only generate the
+ * keystream blocks covering the requested range, so their cost doesn't depend
+ * on the offset.
+ */
 
 /* nope */
 struct bytes	*nope_ctr_encrypt(const struct bytes *plaintext,
 		    const struct bytes *key, uint64_t nonce);
 struct bytes	*nope_ctr_decrypt(const struct bytes *ciphertext,
 		    const struct bytes *key, uint64_t nonce);
+struct bytes	*nope_ctr_keystream(const struct bytes *key, uint64_t nonce,
+		    size_t offset, size_t len);
+int	nope_ctr_crypt_at(struct bytes *buf, size_t offset, size_t len,
+		    const struct bytes *key, uint64_t nonce);
 
 /* AES-128 */
 struct bytes	*aes_128_ctr_encrypt(const struct bytes *plaintext,
 		    const struct bytes *key, uint64_t nonce);
 struct bytes	*aes_128_ctr_decrypt(const struct bytes *ciphertext,
 		    const struct bytes *key, uint64_t nonce);
+struct bytes	*aes_128_ctr_keystream(const struct bytes *key, uint64_t nonce,
+		    size_t offset, size_t len);
+int	aes_128_ctr_crypt_at(struct bytes *buf, size_t offset, size_t len,
+		    const struct bytes *key, uint64_t nonce);
 
 #endif /* ndef CTR_H */
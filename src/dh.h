@@ -4,6 +4,9 @@
  * dh.h
  *
  * Diffie–Hellman–Merkle key exchange stuff.
+ *
+ * An endpoint holds the state of one exchange at a time and must not be shared
+ * between threads.
  */
 #include "bytes.h"
 #include "mpi.h"
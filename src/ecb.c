@@ -6,8 +6,28 @@
 #include "ecb.h"
 #include "nope.h"
 #include "aes.h"
+#include "pool.h"
 
 
+/*
+ * Count of blocks processed by each ecb_encrypt() and ecb_decrypt() task, so
+ * that only large inputs are spread over the library pool.
+ */
+#define	ECB_PARALLEL_GRAIN	4096
+
+/*
+ * State shared by the ecb_encrypt() and ecb_decrypt() tasks.
+ */
+struct ecb_job {
+	const struct block_cipher *impl;
+	const struct bytes *expkey;
+	/* the block cipher encrypt or decrypt routine */
+	int (*crypt)(struct bytes *, const struct bytes *);
+	/* the input and output buffers, of the same length */
+	const struct bytes *input;
+	struct bytes *output;
+};
+
 /*
  * Encrypt the given plaintext under the provided key.
  */
@@ -20,6 +40,14 @@ struct bytes	*ecb_encrypt(const struct block_cipher *impl,
 struct bytes	*ecb_decrypt(const struct block_cipher *impl,
 		    const struct bytes *ciphertext, const struct bytes *key);
 
+/*
+ * ecb_encrypt() and ecb_decrypt() cp_parallel_for() routine, process the
+ * blocks from lo to hi (excluded).
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int	ecb_crypt_range(size_t lo, size_t hi, void *arg);
+
 
 struct bytes *
 nope_ecb_encrypt(const struct bytes *plaintext, const struct bytes *key)
@@ -54,6 +82,7 @@ ecb_encrypt(const struct block_cipher *impl, const struct bytes *plaintext,
 		    const struct bytes *key)
 {
 	struct bytes *expkey = NULL, *padded = NULL, *ciphertext = NULL;
+	struct ecb_job job;
 	int success = 0;
 
 	/* sanity checks */
@@ -76,19 +105,15 @@ ecb_encrypt(const struct block_cipher *impl, const struct bytes *plaintext,
 	if (ciphertext == NULL)
 		goto cleanup;
 
-	/* main encryption loop, process each block in order. */
-	int err = 0;
-	for (size_t i = 0; i < nblock; i++) {
-		const size_t offset = i * blocksize;
-		/* get the current plaintext block */
-		struct bytes *block = bytes_slice(padded, offset, blocksize);
-		/* encrypt it */
-		err |= impl->encrypt(block, expkey);
-		/* add the encrypted block to the ciphertext */
-		err |= bytes_put(ciphertext, offset, block);
-		bytes_free(block);
-	}
-	if (err)
+	/* main encryption loop, the blocks are independent and processed
+	   concurrently when there are enough of them. */
+	job.impl = impl;
+	job.expkey = expkey;
+	job.crypt = impl->encrypt;
+	job.input = padded;
+	job.output = ciphertext;
+	if (cp_parallel_for(NULL, nblock, ECB_PARALLEL_GRAIN, ecb_crypt_range,
+		    &job) != 0)
 		goto cleanup;
 
 	success = 1;
@@ -109,6 +134,7 @@ ecb_decrypt(const struct block_cipher *impl, const struct bytes *ciphertext,
 		    const struct bytes *key)
 {
 	struct bytes *expkey = NULL, *plaintext = NULL, *unpadded = NULL;
+	struct ecb_job job;
 	int success = 0;
 
 	/* sanity checks */
@@ -130,20 +156,15 @@ ecb_decrypt(const struct block_cipher *impl, const struct bytes *ciphertext,
 	if (plaintext == NULL)
 		goto cleanup;
 
-	/* main decryption loop, process each block in order. */
-	int err = 0;
-	for (size_t i = 0; i < nblock; i++) {
-		struct bytes *block;
-		const size_t offset = i * blocksize;
-		/* get the current ciphertext block */
-		block = bytes_slice(ciphertext, offset, blocksize);
-		/* decrypt the block */
-		err |= impl->decrypt(block, expkey);
-		/* populate the padded plaintext */
-		err |= bytes_put(plaintext, offset, block);
-		bytes_free(block);
-	}
-	if (err)
+	/* main decryption loop, the blocks are independent and processed
+	   concurrently when there are enough of them. */
+	job.impl = impl;
+	job.expkey = expkey;
+	job.crypt = impl->decrypt;
+	job.input = ciphertext;
+	job.output = plaintext;
+	if (cp_parallel_for(NULL, nblock, ECB_PARALLEL_GRAIN, ecb_crypt_range,
+		    &job) != 0)
 		goto cleanup;
 
 	/* remove the padding from the plaintext */
@@ -162,3 +183,26 @@ cleanup:
 	}
 	return (unpadded);
 }
+
+
+static int
+ecb_crypt_range(size_t lo, size_t hi, void *arg)
+{
+	const struct ecb_job *job = arg;
+	const size_t blocksize = job->impl->blocksize();
+	int err = 0;
+
+	for (size_t i = lo; i < hi; i++) {
+		struct bytes *block;
+		const size_t offset = i * blocksize;
+		/* get the current input block */
+		block = bytes_slice(job->input, offset, blocksize);
+		/* encrypt or decrypt it */
+		err |= job->crypt(block, job->expkey);
+		/* add the processed block to the output */
+		err |= bytes_put(job->output, offset, block);
+		bytes_free(block);
+	}
+
+	return (err ? -1 : 0);
+}
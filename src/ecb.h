@@ -4,6 +4,9 @@
  * ecb.h
  *
  * Electronic Codebook mode of operation.
+ *
+ * Reentrant. Long inputs are split between the threads of the library pool (see
+ * pool.h), all reading the same expanded key.
  */
 #include "bytes.h"
 
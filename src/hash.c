@@ -0,0 +1,524 @@
+/*
+ * hash.c
+ *
+ * Hash function interfaces.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+
+/* Describe how the hash state words and message length are encoded as bytes */
+enum byte_order {
+	BIG_ENDIAN_ORDER,    /* SHA-1 and SHA-256 */
+	LITTLE_ENDIAN_ORDER, /* MD4 */
+};
+
+
+/*
+ * struct hash_function members implementations, see hash.h.
+ */
+static int	hash_sha1_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+static int	hash_sha1_init(union hash_ctx *ctx);
+static int	hash_sha1_update(union hash_ctx *ctx,
+		    const uint8_t *data, size_t len);
+static int	hash_sha1_final(union hash_ctx *ctx, uint8_t *digest);
+static int	hash_sha1_compress(union hash_ctx *ctx,
+		    const uint8_t *blocks, size_t nblock);
+static int	hash_sha1_import_state(union hash_ctx *ctx,
+		    const uint8_t *digest, uint64_t len);
+static int	hash_sha1_export_state(const union hash_ctx *ctx,
+		    uint8_t *digest);
+static struct bytes	*hash_sha1_padding(uint64_t len);
+
+static int	hash_md4_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+static int	hash_md4_init(union hash_ctx *ctx);
+static int	hash_md4_update(union hash_ctx *ctx,
+		    const uint8_t *data, size_t len);
+static int	hash_md4_final(union hash_ctx *ctx, uint8_t *digest);
+static int	hash_md4_compress(union hash_ctx *ctx,
+		    const uint8_t *blocks, size_t nblock);
+static int	hash_md4_import_state(union hash_ctx *ctx,
+		    const uint8_t *digest, uint64_t len);
+static int	hash_md4_export_state(const union hash_ctx *ctx,
+		    uint8_t *digest);
+static struct bytes	*hash_md4_padding(uint64_t len);
+
+static int	hash_sha256_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+static int	hash_sha256_init(union hash_ctx *ctx);
+static int	hash_sha256_update(union hash_ctx *ctx,
+		    const uint8_t *data, size_t len);
+static int	hash_sha256_final(union hash_ctx *ctx, uint8_t *digest);
+static int	hash_sha256_compress(union hash_ctx *ctx,
+		    const uint8_t *blocks, size_t nblock);
+static int	hash_sha256_import_state(union hash_ctx *ctx,
+		    const uint8_t *digest, uint64_t len);
+static int	hash_sha256_export_state(const union hash_ctx *ctx,
+		    uint8_t *digest);
+static struct bytes	*hash_sha256_padding(uint64_t len);
+
+/*
+ * Decode the count words of state from digest, respectively encode them into
+ * digest, using the given byte order.
+ */
+static void	state_decode(uint32_t *state, size_t count,
+		    const uint8_t *digest, enum byte_order order);
+static void	state_encode(const uint32_t *state, size_t count,
+		    uint8_t *digest, enum byte_order order);
+
+/*
+ * Returns the padding bytes for a message of the given length, or NULL on
+ * error.
+ */
+static struct bytes	*padding(uint64_t len, size_t blocksize,
+		    enum byte_order order);
+
+
+const struct hash_function hash_sha1 = {
+	.hashlength    = sha1_hashlength,
+	.blocksize     = sha1_blocksize,
+	.hash          = sha1_hash,
+	.hash_many     = sha1_hash_many,
+	.hash_many_ctx = hash_sha1_many_ctx,
+	.init          = hash_sha1_init,
+	.update        = hash_sha1_update,
+	.final         = hash_sha1_final,
+	.compress      = hash_sha1_compress,
+	.import_state  = hash_sha1_import_state,
+	.export_state  = hash_sha1_export_state,
+	.padding       = hash_sha1_padding,
+};
+
+const struct hash_function hash_md4 = {
+	.hashlength    = md4_hashlength,
+	.blocksize     = md4_blocksize,
+	.hash          = md4_hash,
+	.hash_many     = md4_hash_many,
+	.hash_many_ctx = hash_md4_many_ctx,
+	.init          = hash_md4_init,
+	.update        = hash_md4_update,
+	.final         = hash_md4_final,
+	.compress      = hash_md4_compress,
+	.import_state  = hash_md4_import_state,
+	.export_state  = hash_md4_export_state,
+	.padding       = hash_md4_padding,
+};
+
+const struct hash_function hash_sha256 = {
+	.hashlength    = sha256_hashlength,
+	.blocksize     = sha256_blocksize,
+	.hash          = sha256_hash,
+	.hash_many     = sha256_hash_many,
+	.hash_many_ctx = hash_sha256_many_ctx,
+	.init          = hash_sha256_init,
+	.update        = hash_sha256_update,
+	.final         = hash_sha256_final,
+	.compress      = hash_sha256_compress,
+	.import_state  = hash_sha256_import_state,
+	.export_state  = hash_sha256_export_state,
+	.padding       = hash_sha256_padding,
+};
+
+
+static int
+hash_sha1_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	const struct sha1_ctx **hctxs = NULL;
+	int ret = -1;
+
+	if (ctxs == NULL)
+		return (sha1_hash_many(msgs, n, out));
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	hctxs = calloc(n > 0 ? n : 1, sizeof(*hctxs));
+	if (hctxs == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < n; i++)
+		hctxs[i] = (ctxs[i] == NULL ? NULL : &ctxs[i]->sha1);
+
+	ret = sha1_hash_many_ctx(hctxs, msgs, n, out);
+
+	/* FALLTHROUGH */
+cleanup:
+	free(hctxs);
+	return (ret);
+}
+
+
+static int
+hash_sha1_init(union hash_ctx *ctx)
+{
+	return (ctx == NULL ? -1 : sha1_init(&ctx->sha1));
+}
+
+
+static int
+hash_sha1_update(union hash_ctx *ctx, const uint8_t *data, size_t len)
+{
+	return (ctx == NULL ? -1 : sha1_update(&ctx->sha1, data, len));
+}
+
+
+static int
+hash_sha1_final(union hash_ctx *ctx, uint8_t *digest)
+{
+	return (ctx == NULL ? -1 : sha1_final(&ctx->sha1, digest));
+}
+
+
+static int
+hash_sha1_compress(union hash_ctx *ctx, const uint8_t *blocks,
+		    size_t nblock)
+{
+	const size_t B = sha1_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || (ctx->sha1.len % B) != 0 || nblock > SIZE_MAX / B)
+		return (-1);
+
+	/* with no buffered bytes, sha1_update() compresses the blocks straight
+	   from the input */
+	return (sha1_update(&ctx->sha1, blocks, nblock * B));
+}
+
+
+static int
+hash_sha1_import_state(union hash_ctx *ctx, const uint8_t *digest, uint64_t len)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL || (len % sha1_blocksize()) != 0)
+		return (-1);
+
+	ctx->sha1.len = len;
+	state_decode(ctx->sha1.state, 5, digest, BIG_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static int
+hash_sha1_export_state(const union hash_ctx *ctx, uint8_t *digest)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL)
+		return (-1);
+
+	state_encode(ctx->sha1.state, 5, digest, BIG_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static struct bytes *
+hash_sha1_padding(uint64_t len)
+{
+	return (padding(len, sha1_blocksize(), BIG_ENDIAN_ORDER));
+}
+
+
+static int
+hash_md4_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	const struct md4_ctx **hctxs = NULL;
+	int ret = -1;
+
+	if (ctxs == NULL)
+		return (md4_hash_many(msgs, n, out));
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	hctxs = calloc(n > 0 ? n : 1, sizeof(*hctxs));
+	if (hctxs == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < n; i++)
+		hctxs[i] = (ctxs[i] == NULL ? NULL : &ctxs[i]->md4);
+
+	ret = md4_hash_many_ctx(hctxs, msgs, n, out);
+
+	/* FALLTHROUGH */
+cleanup:
+	free(hctxs);
+	return (ret);
+}
+
+
+static int
+hash_md4_init(union hash_ctx *ctx)
+{
+	return (ctx == NULL ? -1 : md4_init(&ctx->md4));
+}
+
+
+static int
+hash_md4_update(union hash_ctx *ctx, const uint8_t *data, size_t len)
+{
+	return (ctx == NULL ? -1 : md4_update(&ctx->md4, data, len));
+}
+
+
+static int
+hash_md4_final(union hash_ctx *ctx, uint8_t *digest)
+{
+	return (ctx == NULL ? -1 : md4_final(&ctx->md4, digest));
+}
+
+
+static int
+hash_md4_compress(union hash_ctx *ctx, const uint8_t *blocks,
+		    size_t nblock)
+{
+	const size_t B = md4_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || (ctx->md4.len % B) != 0 || nblock > SIZE_MAX / B)
+		return (-1);
+
+	return (md4_update(&ctx->md4, blocks, nblock * B));
+}
+
+
+static int
+hash_md4_import_state(union hash_ctx *ctx, const uint8_t *digest, uint64_t len)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL || (len % md4_blocksize()) != 0)
+		return (-1);
+
+	ctx->md4.len = len;
+	state_decode(ctx->md4.state, 4, digest, LITTLE_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static int
+hash_md4_export_state(const union hash_ctx *ctx, uint8_t *digest)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL)
+		return (-1);
+
+	state_encode(ctx->md4.state, 4, digest, LITTLE_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static struct bytes *
+hash_md4_padding(uint64_t len)
+{
+	return (padding(len, md4_blocksize(), LITTLE_ENDIAN_ORDER));
+}
+
+
+static int
+hash_sha256_many_ctx(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	const struct sha256_ctx **hctxs = NULL;
+	int ret = -1;
+
+	if (ctxs == NULL)
+		return (sha256_hash_many(msgs, n, out));
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	hctxs = calloc(n > 0 ? n : 1, sizeof(*hctxs));
+	if (hctxs == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < n; i++)
+		hctxs[i] = (ctxs[i] == NULL ? NULL : &ctxs[i]->sha256);
+
+	ret = sha256_hash_many_ctx(hctxs, msgs, n, out);
+
+	/* FALLTHROUGH */
+cleanup:
+	free(hctxs);
+	return (ret);
+}
+
+
+static int
+hash_sha256_init(union hash_ctx *ctx)
+{
+	return (ctx == NULL ? -1 : sha256_init(&ctx->sha256));
+}
+
+
+static int
+hash_sha256_update(union hash_ctx *ctx, const uint8_t *data, size_t len)
+{
+	return (ctx == NULL ? -1 : sha256_update(&ctx->sha256, data, len));
+}
+
+
+static int
+hash_sha256_final(union hash_ctx *ctx, uint8_t *digest)
+{
+	return (ctx == NULL ? -1 : sha256_final(&ctx->sha256, digest));
+}
+
+
+static int
+hash_sha256_compress(union hash_ctx *ctx, const uint8_t *blocks,
+		    size_t nblock)
+{
+	const size_t B = sha256_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || (ctx->sha256.len % B) != 0 || nblock > SIZE_MAX / B)
+		return (-1);
+
+	return (sha256_update(&ctx->sha256, blocks, nblock * B));
+}
+
+
+static int
+hash_sha256_import_state(union hash_ctx *ctx, const uint8_t *digest,
+		    uint64_t len)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL || (len % sha256_blocksize()) != 0)
+		return (-1);
+
+	ctx->sha256.len = len;
+	state_decode(ctx->sha256.state, 8, digest, BIG_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static int
+hash_sha256_export_state(const union hash_ctx *ctx, uint8_t *digest)
+{
+	/* sanity checks */
+	if (ctx == NULL || digest == NULL)
+		return (-1);
+
+	state_encode(ctx->sha256.state, 8, digest, BIG_ENDIAN_ORDER);
+	return (0);
+}
+
+
+static struct bytes *
+hash_sha256_padding(uint64_t len)
+{
+	return (padding(len, sha256_blocksize(), BIG_ENDIAN_ORDER));
+}
+
+
+static void
+state_decode(uint32_t *state, size_t count, const uint8_t *digest,
+		    enum byte_order order)
+{
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *p = digest + 4 * i;
+		switch (order) {
+		case BIG_ENDIAN_ORDER:
+			state[i] = (uint32_t)p[0] << 24 |
+			    (uint32_t)p[1] << 16 |
+			    (uint32_t)p[2] <<  8 |
+			    (uint32_t)p[3] <<  0;
+			break;
+		case LITTLE_ENDIAN_ORDER:
+			state[i] = (uint32_t)p[0] <<  0 |
+			    (uint32_t)p[1] <<  8 |
+			    (uint32_t)p[2] << 16 |
+			    (uint32_t)p[3] << 24;
+			break;
+		}
+	}
+}
+
+
+static void
+state_encode(const uint32_t *state, size_t count, uint8_t *digest,
+		    enum byte_order order)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint8_t *p = digest + 4 * i;
+		switch (order) {
+		case BIG_ENDIAN_ORDER:
+			p[0] = state[i] >> 24;
+			p[1] = state[i] >> 16;
+			p[2] = state[i] >>  8;
+			p[3] = state[i] >>  0;
+			break;
+		case LITTLE_ENDIAN_ORDER:
+			p[0] = state[i] >>  0;
+			p[1] = state[i] >>  8;
+			p[2] = state[i] >> 16;
+			p[3] = state[i] >> 24;
+			break;
+		}
+	}
+}
+
+
+static struct bytes *
+padding(uint64_t len, size_t blocksize, enum byte_order order)
+{
+	struct bytes *padding = NULL;
+	int success = 0;
+
+	/* sanity check */
+	if (len > UINT64_MAX / 8)
+		goto cleanup;
+
+	/* count of message bytes in the padded block */
+	const size_t restlen = len % blocksize;
+	/* count of padding bytes in the padded block */
+	size_t padlen = blocksize - restlen;
+	if (padlen < (1 + 8)) {
+		/* not enough space for the leading 0x80 and total message
+		   length in the last block, add one block. */
+		padlen += blocksize;
+	}
+
+	/* allocate enough space to hold the padding bytes */
+	padding = bytes_zeroed(padlen);
+	if (padding == NULL)
+		goto cleanup;
+
+	/* leading `1' bit */
+	padding->data[0] = 0x80;
+
+	/* set the 64-bits message length (count of bits) in the last 8 bytes of
+	   the padded block */
+	const uint64_t nbits = len * 8;
+	uint8_t *p = padding->data + padlen - 8;
+	for (size_t i = 0; i < 8; i++) {
+		const unsigned shift = (order == BIG_ENDIAN_ORDER ?
+			    8 * (7 - i) : 8 * i);
+		p[i] = (uint8_t)(nbits >> shift);
+	}
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		bytes_free(padding);
+		padding = NULL;
+	}
+	return (padding);
+}
@@ -0,0 +1,79 @@
+#ifndef HASH_H
+#define HASH_H
+/*
+ * hash.h
+ *
+ * Hash function interfaces.
+ *
+ * The hash structs are constant and shared; a context must not be used by more
+ * than one thread at a time.
+ */
+#include "bytes.h"
+#include "md4.h"
+#include "sha1.h"
+#include "sha256.h"
+
+
+/* the largest hash function block size and hash length, in bytes */
+#define	HASH_MAX_BLOCKSIZE	64
+#define	HASH_MAX_HASHLENGTH	32
+
+
+/*
+ * A context of any of the hash functions, only the member matching the hash
+ * function using it is meaningful.
+ */
+union hash_ctx {
+	struct sha1_ctx   sha1;
+	struct md4_ctx    md4;
+	struct sha256_ctx sha256;
+};
+
+/*
+ * Define a Merkle-Damgard hash function that can be used by the different MAC
+ * constructions and their attacks.
+ */
+struct hash_function {
+	/* this hash function's result length in bytes */
+	size_t	(*hashlength)(void);
+	/* this hash function's compression block size in bytes */
+	size_t	(*blocksize)(void);
+	/* compute the hash of a message */
+	struct bytes	*(*hash)(const struct bytes *msg);
+	/* compute the hash of many messages, like sha1_hash_many() */
+	int	(*hash_many)(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+	/* compute the hash of many messages each resumed from its own
+	   context, like sha1_hash_many_ctx() */
+	int	(*hash_many_ctx)(const union hash_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+	/* streaming routines, like sha1_init(), sha1_update() and
+	   sha1_final() */
+	int	(*init)(union hash_ctx *ctx);
+	int	(*update)(union hash_ctx *ctx, const uint8_t *data, size_t len);
+	int	(*final)(union hash_ctx *ctx, uint8_t *digest);
+	/* compress nblock complete blocks without any padding, the context
+	   must not have buffered bytes */
+	int	(*compress)(union hash_ctx *ctx, const uint8_t *blocks,
+		    size_t nblock);
+	/* set the context intermediate hash state from a hash result computed
+	   over len bytes (a multiple of the block size) */
+	int	(*import_state)(union hash_ctx *ctx, const uint8_t *digest,
+		    uint64_t len);
+	/* write the context intermediate hash state as a hash result */
+	int	(*export_state)(const union hash_ctx *ctx, uint8_t *digest);
+	/* the padding (and length encoding) appended to a message of len
+	   bytes */
+	struct bytes	*(*padding)(uint64_t len);
+};
+
+
+/*
+ * The SHA-1, MD4 and SHA-256 routines exposed as hash functions.
+ */
+extern const struct hash_function hash_sha1;
+extern const struct hash_function hash_md4;
+extern const struct hash_function hash_sha256;
+
+#endif /* ndef HASH_H */
@@ -3,40 +3,17 @@
  *
  * Message Authentication Code stuff for cryptopals.com challenges.
  */
-#include "sha1.h"
-#include "md4.h"
-#include "sha256.h"
-#include "mac.h"
-
-
-/*
- * Function type to generate a hash.
- */
-typedef struct bytes *(hash_func_t)(const struct bytes *msg);
-
-
-/*
- * Generic HMAC construction function.
- */
-static struct bytes	*hmac(hash_func_t *H, size_t B, size_t L,
-		    const struct bytes *key, const struct bytes *msg);
-
-/*
- * Generic secret-prefix MAC functions.
- */
-static struct bytes	*mac_keyed_prefix(hash_func_t *hash,
-		    const struct bytes *key, const struct bytes *msg);
-
-static int		mac_keyed_prefix_verify(hash_func_t *hash,
-		    const struct bytes *key, const struct bytes *msg,
-		    const struct bytes *mac);
+#include <string.h>
 
+#include "compat.h"
+#include "hash.h"
+#include "mac.h"
 
 
 struct bytes *
 sha1_mac_keyed_prefix(const struct bytes *key, const struct bytes *msg)
 {
-	return (mac_keyed_prefix(&sha1_hash, key, msg));
+	return (mac_keyed_prefix(&hash_sha1, key, msg));
 }
 
 
@@ -44,14 +21,14 @@ int
 sha1_mac_keyed_prefix_verify(const struct bytes *key,
 		    const struct bytes *msg, const struct bytes *mac)
 {
-	return (mac_keyed_prefix_verify(&sha1_hash, key, msg, mac));
+	return (mac_keyed_prefix_verify(&hash_sha1, key, msg, mac));
 }
 
 
 struct bytes *
 md4_mac_keyed_prefix(const struct bytes *key, const struct bytes *msg)
 {
-	return (mac_keyed_prefix(&md4_hash, key, msg));
+	return (mac_keyed_prefix(&hash_md4, key, msg));
 }
 
 
@@ -59,66 +36,44 @@ int
 md4_mac_keyed_prefix_verify(const struct bytes *key,
 		    const struct bytes *msg, const struct bytes *mac)
 {
-	return (mac_keyed_prefix_verify(&md4_hash, key, msg, mac));
-}
-
-
-struct bytes *
-hmac_sha1(const struct bytes *key, const struct bytes *msg)
-{
-	const size_t blocksize  = sha1_blocksize();
-	const size_t hashlength = sha1_hashlength();
-	return (hmac(&sha1_hash, blocksize, hashlength, key, msg));
-}
-
-
-struct bytes *
-hmac_md4(const struct bytes *key, const struct bytes *msg)
-{
-	const size_t blocksize  = md4_blocksize();
-	const size_t hashlength = md4_hashlength();
-	return (hmac(&md4_hash, blocksize, hashlength, key, msg));
-}
-
-
-struct bytes *
-hmac_sha256(const struct bytes *key, const struct bytes *msg)
-{
-	const size_t blocksize  = sha256_blocksize();
-	const size_t hashlength = sha256_hashlength();
-	return (hmac(&sha256_hash, blocksize, hashlength, key, msg));
+	return (mac_keyed_prefix_verify(&hash_md4, key, msg, mac));
 }
 
 
-static struct bytes *
-hmac(hash_func_t *H, size_t B, size_t L,
-		    const struct bytes *key, const struct bytes *msg)
+int
+hmac_ctx_init(struct hmac_ctx *ctx, const struct hash_function *hash,
+		    const struct bytes *key)
 {
-	struct bytes *tk = NULL;
-	struct bytes *k_ipad = NULL, *k_opad = NULL;
-	struct bytes *in = NULL, *hin = NULL, *out = NULL;
-	struct bytes *mac = NULL;
-	size_t tklen = 0;
+	uint8_t k[HASH_MAX_BLOCKSIZE] = { 0 }, pad[HASH_MAX_BLOCKSIZE];
 	int success = 0;
 
 	/* sanity checks */
-	if (H == NULL || key == NULL || msg == NULL)
+	if (ctx == NULL || hash == NULL || key == NULL)
 		goto cleanup;
+	const size_t B = hash->blocksize();
+	const size_t L = hash->hashlength();
+	if (B > HASH_MAX_BLOCKSIZE || L > HASH_MAX_HASHLENGTH || L > B)
+		goto cleanup;
+	ctx->hash = hash;
 
 	if (key->len > B) {
 		/*
-		 * From § 2:
+		 * From RFC 2104 § 2:
 		 * Applications that use keys longer than B bytes will first
 		 * hash the key using H and then use the resultant L byte string
 		 * as the actual key to HMAC.
 		 *
 		 * NOTE: see https://www.rfc-editor.org/errata/eid4809
 		 */
-		tklen = L;
-		tk = H(key);
+		if (hash->init(&ctx->inner) != 0)
+			goto cleanup;
+		if (hash->update(&ctx->inner, key->data, key->len) != 0)
+			goto cleanup;
+		if (hash->final(&ctx->inner, k) != 0)
+			goto cleanup;
 	} else {
 		/*
-		 * from § 3:
+		 * From RFC 2104 § 3:
 		 * The key for HMAC can be of any length (keys longer than B
 		 * bytes are first hashed using H).  However, less than L bytes
 		 * is strongly discouraged as it would decrease the security
@@ -126,47 +81,98 @@ hmac(hash_func_t *H, size_t B, size_t L,
 		 *
 		 * NOTE: We do not enforce this recommendation here.
 		 */
-		tklen = key->len;
-		tk = bytes_dup(key);
+		(void)memcpy(k, key->data, key->len);
 	}
-	if (tk == NULL || tk->len != tklen)
-		goto cleanup;
 
 	/*
-	 * Build ipad and opad; the key followed by zeros, XOR'ed with 0x36,
+	 * Process ipad and opad; the key followed by zeros, XOR'ed with 0x36,
 	 * respectively 0x5c.
 	 */
-	k_ipad = bytes_zeroed(B);
-	if (k_ipad == NULL)
+	for (size_t i = 0; i < B; i++)
+		pad[i] = k[i] ^ 0x36;
+	if (hash->init(&ctx->inner) != 0)
 		goto cleanup;
-	if (bytes_put(k_ipad, 0, tk) != 0)
+	if (hash->update(&ctx->inner, pad, B) != 0)
 		goto cleanup;
-	k_opad = bytes_dup(k_ipad);
-	if (k_opad == NULL)
+	for (size_t i = 0; i < B; i++)
+		pad[i] = k[i] ^ 0x5c;
+	if (hash->init(&ctx->outer) != 0)
+		goto cleanup;
+	if (hash->update(&ctx->outer, pad, B) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(pad, sizeof(pad));
+	explicit_bzero(k, sizeof(k));
+	if (!success && ctx != NULL)
+		explicit_bzero(ctx, sizeof(struct hmac_ctx));
+	return (success ? 0 : -1);
+}
+
+
+int
+hmac_ctx_compute(const struct hmac_ctx *ctx, const struct bytes *msg,
+		    uint8_t *out)
+{
+	union hash_ctx hctx;
+	uint8_t digest[HASH_MAX_HASHLENGTH];
+	int success = 0;
+
+	/* sanity checks */
+	if (ctx == NULL || ctx->hash == NULL || msg == NULL || out == NULL)
+		goto cleanup;
+	const struct hash_function *hash = ctx->hash;
+	const size_t L = hash->hashlength();
+	if (L > HASH_MAX_HASHLENGTH)
 		goto cleanup;
-	for (size_t i = 0; i < B; i++) {
-		k_ipad->data[i] ^= 0x36;
-		k_opad->data[i] ^= 0x5c;
-	}
 
 	/* H(K XOR opad, H(K XOR ipad, text)) */
+	hctx = ctx->inner;
+	if (hash->update(&hctx, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (hash->final(&hctx, digest) != 0)
+		goto cleanup;
+	hctx = ctx->outer;
+	if (hash->update(&hctx, digest, L) != 0)
+		goto cleanup;
+	if (hash->final(&hctx, out) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(digest, sizeof(digest));
+	explicit_bzero(&hctx, sizeof(hctx));
+	return (success ? 0 : -1);
+}
+
+
+struct bytes *
+hmac(const struct hash_function *hash,
+		    const struct bytes *key, const struct bytes *msg)
+{
+	struct hmac_ctx ctx;
+	struct bytes *mac = NULL;
+	int success = 0;
 
-	in = bytes_joined(2, k_ipad, msg);
-	hin = H(in);
-	out = bytes_joined(2, k_opad, hin);
-	mac = H(out);
+	/* sanity checks */
+	if (hash == NULL || key == NULL || msg == NULL)
+		goto cleanup;
+
+	mac = bytes_zeroed(hash->hashlength());
 	if (mac == NULL)
 		goto cleanup;
+	if (hmac_ctx_init(&ctx, hash, key) != 0)
+		goto cleanup;
+	if (hmac_ctx_compute(&ctx, msg, mac->data) != 0)
+		goto cleanup;
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(out);
-	bytes_free(hin);
-	bytes_free(in);
-	bytes_free(k_opad);
-	bytes_free(k_ipad);
-	bytes_free(tk);
+	explicit_bzero(&ctx, sizeof(struct hmac_ctx));
 	if (!success) {
 		bytes_free(mac);
 		mac = NULL;
@@ -175,28 +181,57 @@ cleanup:
 }
 
 
-static struct bytes *
-mac_keyed_prefix(hash_func_t *hash,
+struct bytes *
+hmac_sha1(const struct bytes *key, const struct bytes *msg)
+{
+	return (hmac(&hash_sha1, key, msg));
+}
+
+
+struct bytes *
+hmac_md4(const struct bytes *key, const struct bytes *msg)
+{
+	return (hmac(&hash_md4, key, msg));
+}
+
+
+struct bytes *
+hmac_sha256(const struct bytes *key, const struct bytes *msg)
+{
+	return (hmac(&hash_sha256, key, msg));
+}
+
+
+struct bytes *
+mac_keyed_prefix(const struct hash_function *hash,
 		    const struct bytes *key, const struct bytes *msg)
 {
-	struct bytes *prefixed = NULL, *mac = NULL;
+	union hash_ctx ctx;
+	struct bytes *mac = NULL;
 	int success = 0;
 
+	/* sanity checks */
 	if (hash == NULL || key == NULL || msg == NULL)
 		goto cleanup;
 
-	prefixed = bytes_joined(2, key, msg);
-	if (prefixed == NULL)
+	mac = bytes_zeroed(hash->hashlength());
+	if (mac == NULL)
 		goto cleanup;
 
-	mac = hash(prefixed);
-	if (mac == NULL)
+	/* H(key || message), without joining them */
+	if (hash->init(&ctx) != 0)
+		goto cleanup;
+	if (hash->update(&ctx, key->data, key->len) != 0)
+		goto cleanup;
+	if (hash->update(&ctx, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (hash->final(&ctx, mac->data) != 0)
 		goto cleanup;
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(prefixed);
+	explicit_bzero(&ctx, sizeof(union hash_ctx));
 	if (!success) {
 		bytes_free(mac);
 		mac = NULL;
@@ -205,8 +240,8 @@ cleanup:
 }
 
 
-static int
-mac_keyed_prefix_verify(hash_func_t *hash,
+int
+mac_keyed_prefix_verify(const struct hash_function *hash,
 		    const struct bytes *key, const struct bytes *msg,
 		    const struct bytes *mac)
 {
@@ -214,6 +249,7 @@ mac_keyed_prefix_verify(hash_func_t *hash,
 	int success = 0;
 	int match = 0;
 
+	/* sanity checks */
 	if (hash == NULL || key == NULL || msg == NULL || mac == NULL)
 		goto cleanup;
 
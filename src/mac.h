@@ -4,9 +4,44 @@
  * mac.h
  *
  * Message Authentication Code stuff for cryptopals.com challenges.
+ *
+ * Every function here is reentrant.
  */
 #include "bytes.h"
+#include "hash.h"
+
 
+/*
+ * HMAC context, setup once for a given key by hmac_ctx_init() and used by
+ * hmac_ctx_compute() to authenticate any count of messages.
+ */
+struct hmac_ctx {
+	/* the hash function */
+	const struct hash_function *hash;
+	/* the hash contexts after processing K XOR ipad, resp. K XOR opad */
+	union hash_ctx inner, outer;
+};
+
+
+/*
+ * Authenticate a message using a secret-prefix MAC: H(key || message) where H
+ * is the given hash function.
+ *
+ * Returns the resulting MAC, or NULL on error.
+ */
+struct bytes	*mac_keyed_prefix(const struct hash_function *hash,
+		    const struct bytes *key, const struct bytes *msg);
+
+/*
+ * Verify a message using a secret-prefix MAC: H(key || message) where H is the
+ * given hash function.
+ *
+ * Returns 0 if the MAC is successfully verified, 1 if the MAC fails
+ * verification, -1 on error.
+ */
+int	mac_keyed_prefix_verify(const struct hash_function *hash,
+		    const struct bytes *key, const struct bytes *msg,
+		    const struct bytes *mac);
 
 /*
  * Authenticate a message using a SHA-1 keyed MAC as described in
@@ -54,6 +89,34 @@ struct bytes	*md4_mac_keyed_prefix(const struct bytes *key,
 int	md4_mac_keyed_prefix_verify(const struct bytes *key,
 		    const struct bytes *msg, const struct bytes *mac);
 
+/*
+ * Setup the given HMAC context for the hash function and key, processing the K
+ * XOR ipad and K XOR opad blocks once for all the following hmac_ctx_compute()
+ * calls. The context holds key material and should be explicit_bzero()'d when
+ * not needed anymore.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	hmac_ctx_init(struct hmac_ctx *ctx, const struct hash_function *hash,
+		    const struct bytes *key);
+
+/*
+ * Compute the HMAC of the given message using the given HMAC context and write
+ * it into out, which must be able to hold the hash function hash length. Only
+ * the message and outer hash blocks are compressed, and nothing is allocated.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	hmac_ctx_compute(const struct hmac_ctx *ctx, const struct bytes *msg,
+		    uint8_t *out);
+
+/*
+ * Returns the HMAC of the given message under the provided key using the given
+ * hash function, or NULL on error (any argument is NULL or malloc failed).
+ */
+struct bytes	*hmac(const struct hash_function *hash,
+		    const struct bytes *key, const struct bytes *msg);
+
 /*
  * Returns the HMAC-SHA1 MAC of the given message under the provided key, or
  * NULL on error (either argument is NULL or malloc failed).
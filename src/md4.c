@@ -5,8 +5,46 @@
  *
  * See RFC 1320.
  */
+#include <string.h>
+
 #include "compat.h"
 #include "md4.h"
+#include "pool.h"
+
+
+/*
+ * Count of messages hashed at once by md4_hash_many(). With GCC and Clang we
+ * use vector extensions, the compiler generating the SIMD instructions for the
+ * target. On x86-64 Linux we let GCC build an AVX2 version of the kernel,
+ * choosing it at runtime when supported.
+ */
+#if defined(__GNUC__)
+#define	MD4_LANES	8
+typedef uint32_t md4_vec
+		    __attribute__((vector_size(MD4_LANES * sizeof(uint32_t))));
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__) && \
+	    !defined(__SANITIZE_THREAD__)
+#define	MD4_TARGETS \
+		    __attribute__((target_clones("avx2", "default")))
+#else
+#define	MD4_TARGETS
+#endif
+#endif /* defined(__GNUC__) */
+
+/*
+ * Count of messages hashed by each md4_hash_many_ctx() task, so that only
+ * large batches are spread over the library pool.
+ */
+#define	MD4_PARALLEL_GRAIN	256
+
+/*
+ * State shared by the md4_hash_many_ctx() tasks.
+ */
+struct md4_many_job {
+	const struct md4_ctx *const *ctxs;
+	const struct bytes *const *msgs;
+	struct bytes **out;
+};
 
 
 /* Constants for md4_transform() routine. */
@@ -53,6 +91,55 @@
  */
 static void	md4_transform(uint32_t *state, const uint8_t *block);
 
+/*
+ * Hash the n given messages like md4_hash_many_ctx() from the current
+ * thread, in lanes when supported.
+ */
+static int	md4_hash_many_lanes(const struct md4_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * md4_hash_many_ctx() cp_parallel_for() routine, hash the messages from lo
+ * to hi (excluded).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	md4_hash_many_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Returns the MD4 Hash of msg resumed from a copy of ctx, or from scratch
+ * when ctx is NULL. Used by md4_hash_many_ctx() for the messages not hashed
+ * in lanes.
+ */
+static struct bytes	*md4_hash_resume(const struct md4_ctx *ctx,
+		    const struct bytes *msg);
+
+/*
+ * Write the last (msglen % 64) bytes of the message ending at data followed by
+ * its padding into tail. prefixlen is the count of bytes hashed before the
+ * message, accounted in the encoded length.
+ *
+ * Returns the count of 64 bytes blocks written, either 1 or 2.
+ */
+static size_t	md4_padding_tail(const uint8_t *data, uint64_t msglen,
+		    uint64_t prefixlen, uint8_t *tail);
+
+#if defined(MD4_LANES)
+/*
+ * Process one 512-bits input message block per lane, blocks[i] being the block
+ * of the lane i and state[j][i] the word j of its MD4 State.
+ */
+static void	md4_compress_lanes(uint32_t state[4][MD4_LANES],
+		    const uint8_t *const *blocks);
+#endif
+
+
+/* MD4 initial state (§ 3.3) */
+static const uint32_t md4_iv[4] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+};
+
 
 size_t
 md4_hashlength(void)
@@ -72,27 +159,25 @@ md4_blocksize(void)
 struct bytes *
 md4_hash(const struct bytes *msg)
 {
+	struct md4_ctx ctx;
 	struct bytes *digest = NULL;
 	int success = 0;
 
-	/* default initial MD4 Intermediate Hash State */
-	struct md4_ctx ctx = {
-		.len = 0,
-		.state = {
-			0x67452301,
-			0xEFCDAB89,
-			0x98BADCFE,
-			0x10325476,
-		},
-	};
-
-	if (md4_hash_ctx(&ctx, msg) != 0)
+	/* sanity check */
+	if (msg == NULL)
 		goto cleanup;
 
-	digest = bytes_from_uint32_le(ctx.state, 4);
+	digest = bytes_zeroed(md4_hashlength());
 	if (digest == NULL)
 		goto cleanup;
 
+	if (md4_init(&ctx) != 0)
+		goto cleanup;
+	if (md4_update(&ctx, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (md4_final(&ctx, digest->data) != 0)
+		goto cleanup;
+
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
@@ -106,66 +191,381 @@ cleanup:
 
 
 int
-md4_hash_ctx(struct md4_ctx *ctx, const struct bytes *msg)
+md4_init(struct md4_ctx *ctx)
 {
-	struct bytes *block = NULL;
-	int success = 0;
+	/* sanity check */
+	if (ctx == NULL)
+		return (-1);
+
+	/* default initial MD4 State */
+	ctx->len = 0;
+	(void)memcpy(ctx->state, md4_iv, sizeof(ctx->state));
+
+	return (0);
+}
+
+
+int
+md4_update(struct md4_ctx *ctx, const uint8_t *data, size_t len)
+{
+	/* max total message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+	const size_t blocksize = md4_blocksize();
 
 	/* sanity checks */
-	if (ctx == NULL || msg == NULL)
-		goto cleanup;
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+	if ((data == NULL && len > 0) || len > (maxlen - ctx->len))
+		return (-1);
+
+	/* count of message bytes already in the buffered block */
+	size_t buffered = ctx->len % blocksize;
+	ctx->len += len;
+
+	/* complete the buffered block first, if any */
+	if (buffered > 0) {
+		const size_t fill = blocksize - buffered;
+		if (len < fill) {
+			(void)memcpy(ctx->block + buffered, data, len);
+			return (0);
+		}
+		(void)memcpy(ctx->block + buffered, data, fill);
+		md4_transform(ctx->state, ctx->block);
+		data += fill;
+		len  -= fill;
+	}
 
-	/* process each "complete" message block */
-	const size_t nblock = msg->len / md4_blocksize();
-	for (size_t i = 0; i < nblock; i++)
-		md4_transform(ctx->state, msg->data + md4_blocksize() * i);
-	ctx->len += msg->len;
+	/* process each "complete" message block straight from data */
+	for (; len >= blocksize; data += blocksize, len -= blocksize)
+		md4_transform(ctx->state, data);
+
+	/* buffer what is left for the next call */
+	if (len > 0)
+		(void)memcpy(ctx->block, data, len);
+
+	return (0);
+}
+
+
+int
+md4_final(struct md4_ctx *ctx, uint8_t *digest)
+{
+	/* max total message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+	const size_t blocksize = md4_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+
+	uint32_t *state = ctx->state;
+	uint8_t *block = ctx->block;
 
-	/* the padded block */
-	block = bytes_zeroed(md4_blocksize());
-	if (block == NULL)
-		goto cleanup;
 	/* count of message bytes in the padded block */
-	const size_t restlen = msg->len % md4_blocksize();
-	/* copy what is left of the message to process into the padded block */
-	if (bytes_sput(block, 0, msg, md4_blocksize() * nblock, restlen) != 0)
-		goto cleanup;
+	const size_t restlen = ctx->len % blocksize;
 	/* Add the first padding bytes, a `1' bit followed by zeroes */
-	block->data[restlen] = 0x80;
+	block[restlen] = 0x80;
+	(void)memset(block + restlen + 1, 0, blocksize - restlen - 1);
 	if (restlen >= 56) {
 		/* We don't have enough space in the padding block to fit the
 		   0x80 byte and the 64-bits length, So we process the padded
 		   block as-is (i.e. without the length) */
-		md4_transform(ctx->state, block->data);
+		md4_transform(state, block);
 		/* reset the padding block, the length will be set in the last 8
 		   bytes and it will be processed as the second padding block */
-		bytes_bzero(block);
+		(void)memset(block, 0, blocksize);
 	}
 
 	/* set the 64-bits message length (count of bits) in the last 8 bytes of
 	   the padded block; low-order word first, least significant byte
 	   first */
 	const uint64_t nbits = 8 * ctx->len;
-	block->data[56] = nbits >>  0;
-	block->data[57] = nbits >>  8;
-	block->data[58] = nbits >> 16;
-	block->data[59] = nbits >> 24;
-	block->data[60] = nbits >> 32;
-	block->data[61] = nbits >> 40;
-	block->data[62] = nbits >> 48;
-	block->data[63] = nbits >> 56;
+	block[56] = nbits >>  0;
+	block[57] = nbits >>  8;
+	block[58] = nbits >> 16;
+	block[59] = nbits >> 24;
+	block[60] = nbits >> 32;
+	block[61] = nbits >> 40;
+	block[62] = nbits >> 48;
+	block[63] = nbits >> 56;
 
 	/* process the last padding block */
-	md4_transform(ctx->state, block->data);
+	md4_transform(state, block);
+	explicit_bzero(block, blocksize);
+
+	/* output the hash, least significant byte of each word first */
+	if (digest != NULL) {
+		for (size_t i = 0; i < 4; i++) {
+			digest[4 * i + 0] = state[i] >>  0;
+			digest[4 * i + 1] = state[i] >>  8;
+			digest[4 * i + 2] = state[i] >> 16;
+			digest[4 * i + 3] = state[i] >> 24;
+		}
+	}
+
+	return (0);
+}
+
+
+int
+md4_hash_ctx(struct md4_ctx *ctx, const struct bytes *msg)
+{
+	/* sanity check */
+	if (msg == NULL)
+		return (-1);
+
+	if (md4_update(ctx, msg->data, msg->len) != 0)
+		return (-1);
+	return (md4_final(ctx, NULL));
+}
+
+
+int
+md4_hash_many(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	return (md4_hash_many_ctx(NULL, msgs, n, out));
+}
+
+
+int
+md4_hash_many_ctx(const struct md4_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	struct md4_many_job job;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	/* large batches are hashed concurrently */
+	job.ctxs = ctxs;
+	job.msgs = msgs;
+	job.out = out;
+	if (cp_parallel_for(NULL, n, MD4_PARALLEL_GRAIN,
+		    md4_hash_many_range, &job) != 0) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
+
+static int
+md4_hash_many_range(size_t lo, size_t hi, void *arg)
+{
+	const struct md4_many_job *job = arg;
+
+	return (md4_hash_many_lanes(job->ctxs == NULL ? NULL :
+		    job->ctxs + lo, job->msgs + lo, hi - lo, job->out + lo));
+}
+
+
+static int
+md4_hash_many_lanes(const struct md4_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	/* max message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+#if defined(MD4_LANES)
+	const size_t blocksize = md4_blocksize();
+	/* each lane progress, index being n when the lane is idle */
+	struct {
+		size_t index;
+		size_t block;
+		size_t nblock;
+		size_t ntail;
+		uint8_t tail[2 * 64];
+	} lanes[MD4_LANES];
+	uint32_t state[4][MD4_LANES];
+	const uint8_t *blocks[MD4_LANES];
+	static const uint8_t idle[64] = { 0 };
+	size_t next = 0, active = 0;
+#endif
+	int success = 0;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+	for (size_t i = 0; i < n; i++) {
+		if (msgs[i] == NULL || msgs[i]->len > maxlen)
+			goto cleanup;
+		if (ctxs == NULL)
+			continue;
+		/* resumed contexts must not have buffered bytes */
+		if (ctxs[i] == NULL || (ctxs[i]->len % md4_blocksize()) != 0)
+			goto cleanup;
+		if (ctxs[i]->len > maxlen - msgs[i]->len)
+			goto cleanup;
+	}
+
+#if defined(MD4_LANES)
+	for (size_t lane = 0; lane < MD4_LANES; lane++)
+		lanes[lane].index = n;
+
+	for (;;) {
+		/* start hashing the next messages in the idle lanes */
+		for (size_t lane = 0; lane < MD4_LANES && next < n; lane++) {
+			if (lanes[lane].index != n)
+				continue;
+			const struct bytes *msg = msgs[next];
+			lanes[lane].index = next++;
+			lanes[lane].block = 0;
+			const struct md4_ctx *ctx = (ctxs == NULL ? NULL :
+				    ctxs[lanes[lane].index]);
+			lanes[lane].ntail = md4_padding_tail(msg->data,
+				    msg->len, (ctx == NULL ? 0 : ctx->len),
+				    lanes[lane].tail);
+			lanes[lane].nblock = msg->len / blocksize +
+				    lanes[lane].ntail;
+			for (size_t j = 0; j < 4; j++) {
+				state[j][lane] = (ctx == NULL ? md4_iv[j] :
+					    ctx->state[j]);
+			}
+			active++;
+		}
+		if (active == 0)
+			break;
+
+		/* the next block of each lane, message then padding */
+		for (size_t lane = 0; lane < MD4_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n) {
+				blocks[lane] = idle;
+				continue;
+			}
+			const size_t block = lanes[lane].block;
+			const size_t nfull = lanes[lane].nblock -
+				    lanes[lane].ntail;
+			if (block < nfull) {
+				blocks[lane] = msgs[index]->data +
+					    block * blocksize;
+			} else {
+				blocks[lane] = lanes[lane].tail +
+					    (block - nfull) * blocksize;
+			}
+		}
+		md4_compress_lanes(state, blocks);
+
+		/* output the hash of the messages done */
+		for (size_t lane = 0; lane < MD4_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n)
+				continue;
+			if (++lanes[lane].block < lanes[lane].nblock)
+				continue;
+			struct bytes *digest = bytes_zeroed(md4_hashlength());
+			if (digest == NULL)
+				goto cleanup;
+			for (size_t j = 0; j < 4; j++) {
+				digest->data[4 * j + 0] = state[j][lane] >>  0;
+				digest->data[4 * j + 1] = state[j][lane] >>  8;
+				digest->data[4 * j + 2] = state[j][lane] >> 16;
+				digest->data[4 * j + 3] = state[j][lane] >> 24;
+			}
+			out[index] = digest;
+			lanes[lane].index = n;
+			active--;
+		}
+	}
+#endif
+	/* the messages not hashed in the lanes, one at a time */
+	for (size_t i = 0; i < n; i++) {
+		if (out[i] != NULL)
+			continue;
+		out[i] = md4_hash_resume(ctxs == NULL ? NULL : ctxs[i],
+			    msgs[i]);
+		if (out[i] == NULL)
+			goto cleanup;
+	}
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(block);
+#if defined(MD4_LANES)
+	explicit_bzero(lanes, sizeof(lanes));
+	explicit_bzero(state, sizeof(state));
+#endif
+	if (!success) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+	}
 	return (success ? 0 : -1);
 }
 
 
+/*
+ * The three rounds of md4_transform(), on the a, b, c, d state and x message
+ * words of the caller. Shared by the scalar and SIMD kernels.
+ */
+#define	MD4_ROUNDS() do {					\
+		/* Round 1 */					\
+		FF(a, b, c, d, x[ 0], S11); /* 1 */		\
+		FF(d, a, b, c, x[ 1], S12); /* 2 */		\
+		FF(c, d, a, b, x[ 2], S13); /* 3 */		\
+		FF(b, c, d, a, x[ 3], S14); /* 4 */		\
+		FF(a, b, c, d, x[ 4], S11); /* 5 */		\
+		FF(d, a, b, c, x[ 5], S12); /* 6 */		\
+		FF(c, d, a, b, x[ 6], S13); /* 7 */		\
+		FF(b, c, d, a, x[ 7], S14); /* 8 */		\
+		FF(a, b, c, d, x[ 8], S11); /* 9 */		\
+		FF(d, a, b, c, x[ 9], S12); /* 10 */		\
+		FF(c, d, a, b, x[10], S13); /* 11 */		\
+		FF(b, c, d, a, x[11], S14); /* 12 */		\
+		FF(a, b, c, d, x[12], S11); /* 13 */		\
+		FF(d, a, b, c, x[13], S12); /* 14 */		\
+		FF(c, d, a, b, x[14], S13); /* 15 */		\
+		FF(b, c, d, a, x[15], S14); /* 16 */		\
+								\
+		/* Round 2 */					\
+		GG(a, b, c, d, x[ 0], S21); /* 17 */		\
+		GG(d, a, b, c, x[ 4], S22); /* 18 */		\
+		GG(c, d, a, b, x[ 8], S23); /* 19 */		\
+		GG(b, c, d, a, x[12], S24); /* 20 */		\
+		GG(a, b, c, d, x[ 1], S21); /* 21 */		\
+		GG(d, a, b, c, x[ 5], S22); /* 22 */		\
+		GG(c, d, a, b, x[ 9], S23); /* 23 */		\
+		GG(b, c, d, a, x[13], S24); /* 24 */		\
+		GG(a, b, c, d, x[ 2], S21); /* 25 */		\
+		GG(d, a, b, c, x[ 6], S22); /* 26 */		\
+		GG(c, d, a, b, x[10], S23); /* 27 */		\
+		GG(b, c, d, a, x[14], S24); /* 28 */		\
+		GG(a, b, c, d, x[ 3], S21); /* 29 */		\
+		GG(d, a, b, c, x[ 7], S22); /* 30 */		\
+		GG(c, d, a, b, x[11], S23); /* 31 */		\
+		GG(b, c, d, a, x[15], S24); /* 32 */		\
+								\
+		/* Round 3 */					\
+		HH(a, b, c, d, x[ 0], S31); /* 33 */		\
+		HH(d, a, b, c, x[ 8], S32); /* 34 */		\
+		HH(c, d, a, b, x[ 4], S33); /* 35 */		\
+		HH(b, c, d, a, x[12], S34); /* 36 */		\
+		HH(a, b, c, d, x[ 2], S31); /* 37 */		\
+		HH(d, a, b, c, x[10], S32); /* 38 */		\
+		HH(c, d, a, b, x[ 6], S33); /* 39 */		\
+		HH(b, c, d, a, x[14], S34); /* 40 */		\
+		HH(a, b, c, d, x[ 1], S31); /* 41 */		\
+		HH(d, a, b, c, x[ 9], S32); /* 42 */		\
+		HH(c, d, a, b, x[ 5], S33); /* 43 */		\
+		HH(b, c, d, a, x[13], S34); /* 44 */		\
+		HH(a, b, c, d, x[ 3], S31); /* 45 */		\
+		HH(d, a, b, c, x[11], S32); /* 46 */		\
+		HH(c, d, a, b, x[ 7], S33); /* 47 */		\
+		HH(b, c, d, a, x[15], S34); /* 48 */		\
+	} while (/* CONSTCOND */0)
+
 static void
 md4_transform(uint32_t *state, const uint8_t *block)
 {
@@ -184,59 +584,7 @@ md4_transform(uint32_t *state, const uint8_t *block)
 		x[i] = (hh << 24) | (hl << 16) | (lh << 8) | ll;
 	}
 
-	/* Round 1 */
-	FF(a, b, c, d, x[ 0], S11); /* 1 */
-	FF(d, a, b, c, x[ 1], S12); /* 2 */
-	FF(c, d, a, b, x[ 2], S13); /* 3 */
-	FF(b, c, d, a, x[ 3], S14); /* 4 */
-	FF(a, b, c, d, x[ 4], S11); /* 5 */
-	FF(d, a, b, c, x[ 5], S12); /* 6 */
-	FF(c, d, a, b, x[ 6], S13); /* 7 */
-	FF(b, c, d, a, x[ 7], S14); /* 8 */
-	FF(a, b, c, d, x[ 8], S11); /* 9 */
-	FF(d, a, b, c, x[ 9], S12); /* 10 */
-	FF(c, d, a, b, x[10], S13); /* 11 */
-	FF(b, c, d, a, x[11], S14); /* 12 */
-	FF(a, b, c, d, x[12], S11); /* 13 */
-	FF(d, a, b, c, x[13], S12); /* 14 */
-	FF(c, d, a, b, x[14], S13); /* 15 */
-	FF(b, c, d, a, x[15], S14); /* 16 */
-
-	/* Round 2 */
-	GG(a, b, c, d, x[ 0], S21); /* 17 */
-	GG(d, a, b, c, x[ 4], S22); /* 18 */
-	GG(c, d, a, b, x[ 8], S23); /* 19 */
-	GG(b, c, d, a, x[12], S24); /* 20 */
-	GG(a, b, c, d, x[ 1], S21); /* 21 */
-	GG(d, a, b, c, x[ 5], S22); /* 22 */
-	GG(c, d, a, b, x[ 9], S23); /* 23 */
-	GG(b, c, d, a, x[13], S24); /* 24 */
-	GG(a, b, c, d, x[ 2], S21); /* 25 */
-	GG(d, a, b, c, x[ 6], S22); /* 26 */
-	GG(c, d, a, b, x[10], S23); /* 27 */
-	GG(b, c, d, a, x[14], S24); /* 28 */
-	GG(a, b, c, d, x[ 3], S21); /* 29 */
-	GG(d, a, b, c, x[ 7], S22); /* 30 */
-	GG(c, d, a, b, x[11], S23); /* 31 */
-	GG(b, c, d, a, x[15], S24); /* 32 */
-
-	/* Round 3 */
-	HH(a, b, c, d, x[ 0], S31); /* 33 */
-	HH(d, a, b, c, x[ 8], S32); /* 34 */
-	HH(c, d, a, b, x[ 4], S33); /* 35 */
-	HH(b, c, d, a, x[12], S34); /* 36 */
-	HH(a, b, c, d, x[ 2], S31); /* 37 */
-	HH(d, a, b, c, x[10], S32); /* 38 */
-	HH(c, d, a, b, x[ 6], S33); /* 39 */
-	HH(b, c, d, a, x[14], S34); /* 40 */
-	HH(a, b, c, d, x[ 1], S31); /* 41 */
-	HH(d, a, b, c, x[ 9], S32); /* 42 */
-	HH(c, d, a, b, x[ 5], S33); /* 43 */
-	HH(b, c, d, a, x[13], S34); /* 44 */
-	HH(a, b, c, d, x[ 3], S31); /* 45 */
-	HH(d, a, b, c, x[11], S32); /* 46 */
-	HH(c, d, a, b, x[ 7], S33); /* 47 */
-	HH(b, c, d, a, x[15], S34); /* 48 */
+	MD4_ROUNDS();
 
 	state[0] += a;
 	state[1] += b;
@@ -246,3 +594,96 @@ md4_transform(uint32_t *state, const uint8_t *block)
 	/* Zeroize sensitive information. */
 	explicit_bzero(x, sizeof(x));
 }
+
+
+static struct bytes *
+md4_hash_resume(const struct md4_ctx *ctx, const struct bytes *msg)
+{
+	struct md4_ctx copy;
+	struct bytes *digest = NULL;
+	int success = 0;
+
+	if (ctx == NULL) {
+		if (md4_init(&copy) != 0)
+			goto cleanup;
+	} else {
+		copy = *ctx;
+	}
+
+	digest = bytes_zeroed(md4_hashlength());
+	if (digest == NULL)
+		goto cleanup;
+	if (md4_update(&copy, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (md4_final(&copy, digest->data) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(&copy, sizeof(struct md4_ctx));
+	if (!success) {
+		bytes_free(digest);
+		digest = NULL;
+	}
+	return (digest);
+}
+
+
+static size_t
+md4_padding_tail(const uint8_t *data, uint64_t msglen, uint64_t prefixlen,
+		    uint8_t *tail)
+{
+	const size_t blocksize = md4_blocksize();
+	/* count of message bytes in the padded block */
+	const size_t restlen = msglen % blocksize;
+	const size_t ntail = (restlen >= 56 ? 2 : 1);
+
+	(void)memcpy(tail, data + (msglen - restlen), restlen);
+	/* a `1' bit followed by zeroes, then the 64-bits message length */
+	tail[restlen] = 0x80;
+	(void)memset(tail + restlen + 1, 0, ntail * blocksize - restlen - 1);
+	const uint64_t nbits = 8 * (prefixlen + msglen);
+	uint8_t *length = tail + ntail * blocksize - 8;
+	for (size_t i = 0; i < 8; i++)
+		length[i] = nbits >> (8 * i);
+
+	return (ntail);
+}
+
+#if defined(MD4_LANES)
+MD4_TARGETS
+static void
+md4_compress_lanes(uint32_t state[4][MD4_LANES], const uint8_t *const *blocks)
+{
+	/* see md4_transform(), each lane is a message */
+	md4_vec a, b, c, d, x[16];
+
+	for (size_t i = 0; i < 16; i++) {
+		for (size_t lane = 0; lane < MD4_LANES; lane++) {
+			/* NOTE: little endian, least significant byte first */
+			const uint8_t *word = blocks[lane] + 4 * i;
+			x[i][lane] = ((uint32_t)word[3] << 24) |
+				    ((uint32_t)word[2] << 16) |
+				    ((uint32_t)word[1] <<  8) | word[0];
+		}
+	}
+
+	(void)memcpy(&a, state[0], sizeof(md4_vec));
+	(void)memcpy(&b, state[1], sizeof(md4_vec));
+	(void)memcpy(&c, state[2], sizeof(md4_vec));
+	(void)memcpy(&d, state[3], sizeof(md4_vec));
+
+	MD4_ROUNDS();
+
+	for (size_t lane = 0; lane < MD4_LANES; lane++) {
+		state[0][lane] += a[lane];
+		state[1][lane] += b[lane];
+		state[2][lane] += c[lane];
+		state[3][lane] += d[lane];
+	}
+
+	/* Zeroize sensitive information. */
+	explicit_bzero(x, sizeof(x));
+}
+#endif /* defined(MD4_LANES) */
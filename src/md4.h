@@ -6,6 +6,8 @@
  * MD4 stuff for cryptopals.com challenges.
  *
  * See RFC 1320.
+ *
+ * No global state, a context belongs to its caller.
  */
 #include "bytes.h"
 
@@ -16,6 +18,8 @@ struct md4_ctx {
 	uint64_t len;
 	/* MD4 State */
 	uint32_t state[4];
+	/* buffered message bytes, the last (len % 64) of them */
+	uint8_t block[64];
 };
 
 
@@ -36,15 +40,71 @@ size_t	md4_blocksize(void);
  */
 struct bytes	*md4_hash(const struct bytes *msg);
 
+/*
+ * Compute the MD4 Hash of each of the n given messages, storing the hash of
+ * msgs[i] into out[i] which must be passed to bytes_free() by the caller.
+ *
+ * When the compiler and CPU support it, the messages are hashed in parallel
+ * SIMD lanes (eight with AVX2, two times four with SSE2 on x86-64). This is
+ * faster than n calls to md4_hash() for many short messages.
+ *
+ * Returns 0 on success, -1 on error (out is then set to NULL pointers).
+ */
+int	md4_hash_many(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * Initialize the given MD4 context to hash a new message using
+ * md4_update() and md4_final().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	md4_init(struct md4_ctx *ctx);
+
+/*
+ * Hash the next len bytes of data of the message using the given MD4
+ * context. Complete blocks are processed straight from data and what is left
+ * is buffered into the context, so that this function never allocates.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	md4_update(struct md4_ctx *ctx, const uint8_t *data, size_t len);
+
+/*
+ * Process the padding of the message hashed using the given MD4 context
+ * and write the resulting hash (16 bytes) into digest if it is not NULL.
+ *
+ * ctx->state is left holding the resulting hash and ctx must be initialized
+ * again before hashing another message.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	md4_final(struct md4_ctx *ctx, uint8_t *digest);
+
 /*
  * Compute the MD4 Hash of the given message starting from the given MD4
  * context. Useful to perform MD4 length extension.
  *
  * Unlike the MD4Update() function from the RFC, this function will compute and
- * process the padding of msg.
+ * process the padding of msg: it is md4_update() followed by md4_final(). To
+ * resume from a known hash, set ctx->state to it and ctx->len to the (multiple
+ * of md4_blocksize()) count of bytes it was computed over.
  *
  * Returns 0 on success, -1 on error.
  */
 int	md4_hash_ctx(struct md4_ctx *ctx, const struct bytes *msg);
 
+/*
+ * Like md4_hash_many(), but the hash of msgs[i] is resumed from the MD4
+ * context ctxs[i] instead of starting from scratch: out[i] is what
+ * md4_hash_ctx() would compute from a copy of ctxs[i]. The contexts must not
+ * have buffered bytes, i.e. their len is a multiple of md4_blocksize(), and
+ * are left untouched. Useful to perform many length extensions at once.
+ *
+ * Returns 0 on success, -1 on error (out is then set to NULL pointers).
+ */
+int	md4_hash_many_ctx(const struct md4_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
 #endif /* ndef MD4_H */
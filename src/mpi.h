@@ -6,6 +6,9 @@
  * Big Number manipulation stuff for cryptopals.com challenges.
  *
  * Currently simply wrapping OpenSSL BIGNUM API.
+ *
+ * Like bytes structs, mpi structs are not locked. Every operation uses its own
+ * BN_CTX.
  */
 #include "bytes.h"
 #include <limits.h>
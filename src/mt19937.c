@@ -5,6 +5,7 @@
  *
  * We follow religiously the pseudo-code from Wikipedia.
  */
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,6 +28,63 @@
 #define	LOWEST_W_BITS_MASK	0xffffffff
 #define	LOWER_MASK		0x7fffffff
 #define	UPPER_MASK		0x80000000
+/* multiplicative inverse of f modulo 2^w */
+#define	F_INVERSE		UINT32_C(2520285293)
+
+/*
+ * Degree of the MT19937 characteristic polynomial, i.e. the count of bits of
+ * the state that matter (all of them but the lower r bits of the first word).
+ */
+#define	MT19937_DEGREE	19937
+
+/*
+ * mt19937_jump() polynomials are reduced modulo x times the characteristic
+ * polynomial, see mt19937_psi_init(). Their bits are packed in uint64_t words.
+ */
+#define	MT19937_PSI_DEGREE	(MT19937_DEGREE + 1)
+#define	MT19937_POLY_WORDS	((MT19937_PSI_DEGREE + 64) / 64)
+
+/*
+ * Below this count of outputs, mt19937_jump() simply generates and discard
+ * them.
+ */
+#define	MT19937_JUMP_MIN	(UINT64_C(1) << 26)
+
+/*
+ * Count of generators computed at once by mt19937_first_outputs_batch(). With
+ * GCC and Clang we use vector extensions, the compiler generating the SIMD
+ * instructions for the target. On x86-64 Linux we let GCC build AVX-512 and
+ * AVX2 versions of the kernel, choosing the best one at runtime.
+ */
+#if defined(__GNUC__)
+#define	MT19937_LANES	16
+typedef uint32_t mt19937_vec
+		    __attribute__((vector_size(MT19937_LANES * sizeof(uint32_t))));
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__) && \
+	    !defined(__SANITIZE_THREAD__)
+#define	MT19937_TARGETS \
+		    __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define	MT19937_TARGETS
+#endif
+#endif /* defined(__GNUC__) */
+#if !defined(MT19937_TARGETS)
+#define	MT19937_TARGETS
+#endif
+
+/*
+ * Size in bytes of the keystream chunks generated by mt19937_crypt().
+ */
+#define	MT19937_CRYPT_CHUNK	(n * sizeof(uint32_t))
+
+
+/*
+ * x times the MT19937 characteristic polynomial shifted left by 0 to 63 bits,
+ * computed once by mt19937_psi_init().
+ */
+static uint64_t		mt19937_psi[64][MT19937_POLY_WORDS + 1];
+static int		mt19937_psi_ok = 0;
+static pthread_once_t	mt19937_psi_once = PTHREAD_ONCE_INIT;
 
 
 /* generator struct definition */
@@ -39,6 +97,47 @@ struct mt19937_generator {
 /* Generate the next n values from the series x_i */
 static void		 mt19937_twist(struct mt19937_generator *gen);
 
+/* Compute the state word i after a twist, assuming that the words before i
+   have already been twisted in place */
+static uint32_t		 mt19937_twist_word(const uint32_t *MT, uint32_t i);
+
+/* MT19937 tempering transform */
+static uint32_t		 mt19937_temper(uint32_t y);
+
+/* Temper count words of the state from MT into out */
+static void		 mt19937_temper_words(const uint32_t *MT, uint32_t *out,
+			    size_t count);
+
+#if defined(MT19937_LANES)
+/* mt19937_first_outputs() computing MT19937_LANES generators in parallel */
+static void		 mt19937_first_outputs_lanes(const uint32_t *seeds,
+			    size_t k, uint32_t *out);
+#endif
+
+/* Compute the x times the MT19937 characteristic polynomial into mt19937_psi,
+   see mt19937_jump() */
+static void		 mt19937_psi_init(void);
+
+/* Reduce the given polynomial of nwords words modulo mt19937_psi */
+static void		 mt19937_poly_reduce(uint64_t *poly, size_t nwords);
+
+/* Compute x^k modulo mt19937_psi into poly */
+static void		 mt19937_poly_xpow(uint64_t *poly, uint64_t k);
+
+/* Returns the given 32 bits spread over the even bits of the result, i.e. the
+   square of the given polynomial over GF(2) */
+static uint64_t		 bits_spread32(uint32_t x);
+
+/* Returns the 64 bits of the given bits array (of nwords words) starting at the
+   given bit, bits past the end being zeros */
+static uint64_t		 bits_get64(const uint64_t *bits, size_t nwords,
+			    size_t bit);
+
+/* XOR src (of srcwords words) shifted left by shift bits into dest (of
+   destwords words), dropping the bits shifted past dest */
+static void		 bits_xor_shifted(uint64_t *dest, size_t destwords,
+			    const uint64_t *src, size_t srcwords, size_t shift);
+
 /* XOR the given input with the keystream generated by MT19937 seeded with the
    given key */
 static struct bytes	*mt19937_crypt(const struct bytes *input, uint32_t key);
@@ -97,11 +196,7 @@ mt19937_next_uint32(struct mt19937_generator *gen, uint32_t *n_p)
 	if (gen->index >= n)
 		mt19937_twist(gen);
 
-	uint32_t y = MT[gen->index];
-	y = y ^ ((y >> u) & d);
-	y = y ^ ((y << s) & b);
-	y = y ^ ((y << t) & c);
-	y = y ^ (y >> l);
+	const uint32_t y = mt19937_temper(MT[gen->index]);
 
 	gen->index = gen->index + 1;
 
@@ -111,6 +206,266 @@ mt19937_next_uint32(struct mt19937_generator *gen, uint32_t *n_p)
 }
 
 
+int
+mt19937_fill(struct mt19937_generator *gen, uint32_t *out, size_t count)
+{
+	/* sanitity checks */
+	if (gen == NULL || (out == NULL && count > 0))
+		return (-1);
+
+	while (count > 0) {
+		if (gen->index >= n)
+			mt19937_twist(gen);
+		size_t chunk = n - gen->index;
+		if (chunk > count)
+			chunk = count;
+		mt19937_temper_words(gen->state + gen->index, out, chunk);
+		gen->index += chunk;
+		out += chunk;
+		count -= chunk;
+	}
+
+	return (0);
+}
+
+
+int
+mt19937_fill_bytes(struct mt19937_generator *gen, uint8_t *out, size_t len)
+{
+	uint32_t words[n];
+
+	/* sanitity checks */
+	if (gen == NULL || (out == NULL && len > 0))
+		return (-1);
+
+	while (len > 0) {
+		size_t nbytes = sizeof(words);
+		if (nbytes > len)
+			nbytes = len;
+		(void)mt19937_fill(gen, words, (nbytes + 3) / 4);
+		/* NOTE: LSB first, i.e. the words memory layout on little endian
+		   targets */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		(void)memcpy(out, words, nbytes);
+#else
+		for (size_t i = 0; i < nbytes; i++)
+			out[i] = (words[i / 4] >> (8 * (i % 4))) & 0xff;
+#endif
+		out += nbytes;
+		len -= nbytes;
+	}
+
+	explicit_bzero(words, sizeof(words));
+	return (0);
+}
+
+
+int
+mt19937_jump(struct mt19937_generator *gen, uint64_t k)
+{
+	uint64_t poly[MT19937_POLY_WORDS];
+	uint32_t window[n], ring[n];
+	int success = 0;
+
+	/* sanitity check */
+	if (gen == NULL)
+		goto cleanup;
+
+	/* small jumps are faster done the naive way */
+	if (k < MT19937_JUMP_MIN) {
+		while (k > 0) {
+			const size_t len = (k < n ? k : n);
+			(void)mt19937_fill(gen, window, len);
+			k -= len;
+		}
+		success = 1;
+		goto cleanup;
+	}
+
+	if (pthread_once(&mt19937_psi_once, mt19937_psi_init) != 0)
+		goto cleanup;
+	if (!mt19937_psi_ok)
+		goto cleanup;
+
+	/*
+	 * Consider the window of the n state words starting with the word of
+	 * the next output, which is also the state of a generator at index n
+	 * yielding the output n words ahead. Here we compute the words of the
+	 * window following the current state by twisting them in a copy.
+	 */
+	(void)memcpy(window, gen->state, sizeof(window));
+	for (uint32_t i = 0; i < gen->index; i++)
+		window[i] = mt19937_twist_word(window, i);
+	if (gen->index < n) {
+		(void)memcpy(ring, window, sizeof(ring));
+		for (uint32_t i = 0; i < n; i++)
+			window[i] = ring[(gen->index + i) % n];
+	}
+
+	/*
+	 * Let T be the (linear) step from a window to the next one. Since
+	 * psi(T) = 0, T^j = p(T) with p = x^j modulo psi. We compute p(T) of
+	 * the window using Horner's rule, the stepped window being stored in
+	 * ring starting at the word head.
+	 */
+	mt19937_poly_xpow(poly, k - n);
+	uint32_t head = 0;
+	explicit_bzero(ring, sizeof(ring));
+	for (size_t bit = MT19937_PSI_DEGREE; bit-- > 0; ) {
+		/* step */
+		const uint32_t x = (ring[head] & UPPER_MASK) +
+			    (ring[(head + 1) % n] & LOWER_MASK);
+		ring[head] = ring[(head + m) % n] ^ (x >> 1) ^ (-(x & 1) & a);
+		head = (head + 1) % n;
+		/* add the window */
+		if ((poly[bit / 64] >> (bit % 64)) & 1) {
+			for (uint32_t i = 0; i < n - head; i++)
+				ring[head + i] ^= window[i];
+			for (uint32_t i = n - head; i < n; i++)
+				ring[head + i - n] ^= window[i];
+		}
+	}
+
+	for (uint32_t i = 0; i < n; i++)
+		gen->state[i] = ring[(head + i) % n];
+	gen->index = n;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(window, sizeof(window));
+	explicit_bzero(ring, sizeof(ring));
+	return (success ? 0 : -1);
+}
+
+
+int
+mt19937_untwist(struct mt19937_generator *gen)
+{
+	/* sanitity check */
+	if (gen == NULL)
+		return (-1);
+	uint32_t *MT = gen->state;
+
+	/*
+	 * The twist computes MT[i] = MT[i + m] ^ yA, where y has the upper bit
+	 * of the old MT[i] and the lower bits of the old MT[i + 1] (MT[0] for
+	 * the last word, already twisted). Going backward, MT[i + m] is an old
+	 * word already restored (or a twisted one when it wraps) so that y can
+	 * be recovered from MT[i].
+	 *
+	 * The lower bits of the old first word are lost, but the last word
+	 * yields those of the current first word, which may have been guessed
+	 * by a previous mt19937_untwist() call.
+	 */
+	uint32_t next = 0;
+	for (uint32_t i = n; i-- > 0; ) {
+		uint32_t y = MT[i] ^ MT[(i + m) % n];
+		/* the upper bit of yA is set iff y is odd, see the twist */
+		if (y & UPPER_MASK)
+			y = ((y ^ a) << 1) | 1;
+		else
+			y = y << 1;
+		if (i + 1 < n)
+			MT[i + 1] = (next & UPPER_MASK) | (y & LOWER_MASK);
+		else
+			MT[0] = (MT[0] & UPPER_MASK) | (y & LOWER_MASK);
+		next = y;
+	}
+
+	/* guess the lost bits, assuming the state to be a seeding one */
+	uint32_t seed = 0;
+	(void)mt19937_state_seed(gen, &seed);
+	MT[0] = (next & UPPER_MASK) | (seed & LOWER_MASK);
+
+	return (0);
+}
+
+
+int
+mt19937_state_seed(const struct mt19937_generator *gen, uint32_t *seed_p)
+{
+	/* sanitity check */
+	if (gen == NULL)
+		return (-1);
+	const uint32_t *MT = gen->state;
+
+	/* invert MT[1] = f * (seed ^ (seed >> (w - 2))) + 1 */
+	const uint32_t x = LOWEST_W_BITS_MASK & ((MT[1] - 1) * F_INVERSE);
+	const uint32_t seed = x ^ (x >> (w - 2));
+
+	if (seed_p != NULL)
+		*seed_p = seed;
+
+	/* check the upper bit of the first word and the following ones */
+	if ((MT[0] & UPPER_MASK) != (seed & UPPER_MASK))
+		return (1);
+	for (uint32_t i = 2; i < n; i++) {
+		if (MT[i] != (LOWEST_W_BITS_MASK &
+			    (f * (MT[i - 1] ^ (MT[i - 1] >> (w - 2))) + i)))
+			return (1);
+	}
+
+	return (0);
+}
+
+
+int
+mt19937_first_outputs(uint32_t seed, size_t k, uint32_t *out)
+{
+	uint32_t MT[n];
+
+	/* sanitity checks */
+	if (out == NULL || k > n)
+		return (-1);
+
+	/*
+	 * The twisted word i depends on the words i, i + 1 and i + m of the
+	 * initial state (or on the already twisted words when they wrap).
+	 * Since seeding is a recurrence, we compute the initial state up to
+	 * the word k + m (at most the full state).
+	 */
+	const uint32_t limit = (k + m < n ? k + m : n);
+	MT[0] = LOWEST_W_BITS_MASK & seed;
+	for (uint32_t i = 1; i < limit; i++)
+		MT[i] = LOWEST_W_BITS_MASK &
+			    (f * (MT[i - 1] ^ (MT[i - 1] >> (w - 2))) + i);
+
+	/* twist only the words we need, in place */
+	for (uint32_t i = 0; i < k; i++) {
+		MT[i] = mt19937_twist_word(MT, i);
+		out[i] = mt19937_temper(MT[i]);
+	}
+
+	explicit_bzero(MT, sizeof(MT));
+	return (0);
+}
+
+
+int
+mt19937_first_outputs_batch(const uint32_t *seeds, size_t count, size_t k,
+		    uint32_t *out)
+{
+	size_t i = 0;
+
+	/* sanitity checks */
+	if (seeds == NULL || out == NULL || k > n)
+		return (-1);
+
+#if defined(MT19937_LANES)
+	for (; count - i >= MT19937_LANES; i += MT19937_LANES)
+		mt19937_first_outputs_lanes(seeds + i, k, out + i * k);
+#endif
+	/* the remaining seeds, one at a time */
+	for (; i < count; i++) {
+		if (mt19937_first_outputs(seeds[i], k, out + i * k) != 0)
+			return (-1);
+	}
+
+	return (0);
+}
+
+
 struct bytes *
 mt19937_encrypt(const struct bytes *plaintext,  uint32_t key)
 {
@@ -153,26 +508,69 @@ mt19937_from_state(const uint32_t *state, uint32_t index)
 }
 
 
+MT19937_TARGETS
 static void
 mt19937_twist(struct mt19937_generator *gen)
 {
 	uint32_t *MT = gen->state;
-
-	for (uint32_t i = 0; i < n; i++) {
+	uint32_t i;
+
+	/*
+	 * Same as calling mt19937_twist_word() for every word, but the loop is
+	 * split where (i + 1) % n and (i + m) % n wrap so that the compiler may
+	 * vectorize the branch free loop bodies.
+	 */
+	for (i = 0; i < n - m; i++) {
 		const uint32_t x = (MT[i] & UPPER_MASK) +
-			    (MT[(i + 1) % n] & LOWER_MASK);
-		uint32_t xA = x >> 1;
-		if ((x % 2) != 0) /* lowest bit of x is 1 */
-			xA = xA ^ a;
-		MT[i] = MT[(i + m) % n] ^ xA;
+			    (MT[i + 1] & LOWER_MASK);
+		MT[i] = MT[i + m] ^ (x >> 1) ^ (-(x & 1) & a);
+	}
+	for (; i < n - 1; i++) {
+		const uint32_t x = (MT[i] & UPPER_MASK) +
+			    (MT[i + 1] & LOWER_MASK);
+		MT[i] = MT[i + m - n] ^ (x >> 1) ^ (-(x & 1) & a);
 	}
+	MT[n - 1] = mt19937_twist_word(MT, n - 1);
 	gen->index = 0;
 }
 
 
+static uint32_t
+mt19937_twist_word(const uint32_t *MT, uint32_t i)
+{
+	const uint32_t x = (MT[i] & UPPER_MASK) +
+		    (MT[(i + 1) % n] & LOWER_MASK);
+	uint32_t xA = x >> 1;
+	if ((x % 2) != 0) /* lowest bit of x is 1 */
+		xA = xA ^ a;
+	return (MT[(i + m) % n] ^ xA);
+}
+
+
+static uint32_t
+mt19937_temper(uint32_t y)
+{
+	y = y ^ ((y >> u) & d);
+	y = y ^ ((y << s) & b);
+	y = y ^ ((y << t) & c);
+	y = y ^ (y >> l);
+	return (LOWEST_W_BITS_MASK & y);
+}
+
+
+MT19937_TARGETS
+static void
+mt19937_temper_words(const uint32_t *MT, uint32_t *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = mt19937_temper(MT[i]);
+}
+
+
 static struct bytes *
 mt19937_crypt(const struct bytes *input, uint32_t key)
 {
+	uint8_t keystream[MT19937_CRYPT_CHUNK];
 	struct bytes *output = NULL;
 	struct mt19937_generator *gen = NULL;
 	int success = 0;
@@ -189,21 +587,22 @@ mt19937_crypt(const struct bytes *input, uint32_t key)
 	if (gen == NULL)
 		goto cleanup;
 
-	uint32_t keystream = 0;
-	for (size_t i = 0; i < input->len; i++) {
-		const uint32_t shift = 8 * (i % 4);
-		if (shift == 0) {
-			if (mt19937_next_uint32(gen, &keystream) != 0)
-				goto cleanup;
-		}
-		/* get the stream byte for this iteration, LSB first */
-		const uint8_t streambyte = (keystream >> shift) & 0xff;
-		output->data[i] = input->data[i] ^ streambyte;
+	for (size_t off = 0; off < input->len; off += MT19937_CRYPT_CHUNK) {
+		size_t len = input->len - off;
+		if (len > MT19937_CRYPT_CHUNK)
+			len = MT19937_CRYPT_CHUNK;
+		if (mt19937_fill_bytes(gen, keystream, len) != 0)
+			goto cleanup;
+		const uint8_t *src = input->data + off;
+		uint8_t *dest = output->data + off;
+		for (size_t i = 0; i < len; i++)
+			dest[i] = src[i] ^ keystream[i];
 	}
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
+	explicit_bzero(keystream, sizeof(keystream));
 	mt19937_free(gen);
 	if (!success) {
 		bytes_free(output);
@@ -211,3 +610,212 @@ cleanup:
 	}
 	return (output);
 }
+
+
+static void
+mt19937_psi_init(void)
+{
+	struct mt19937_generator gen;
+	/* enough for Berlekamp-Massey to find a degree MT19937_PSI_DEGREE
+	   polynomial */
+	const size_t nbits = 2 * MT19937_PSI_DEGREE;
+	const size_t nwords = (nbits + 63) / 64;
+	uint64_t psi[MT19937_POLY_WORDS];
+	uint64_t *seq = NULL, *conn = NULL, *prev = NULL, *tmp = NULL;
+	size_t deg = 0, shift = 1;
+
+	seq  = calloc(nwords, sizeof(uint64_t));
+	conn = calloc(nwords, sizeof(uint64_t));
+	prev = calloc(nwords, sizeof(uint64_t));
+	tmp  = calloc(nwords, sizeof(uint64_t));
+	if (seq == NULL || conn == NULL || prev == NULL || tmp == NULL)
+		goto cleanup;
+
+	/*
+	 * The lowest bit of the outputs is a linear function of the state,
+	 * its minimal polynomial is thus the characteristic polynomial. The
+	 * sequence is stored reversed so that the discrepancy below is a dot
+	 * product of the connection polynomial and a slice of seq.
+	 */
+	(void)mt19937_seed(&gen, 5489);
+	for (size_t i = 0; i < nbits; i++) {
+		uint32_t x = 0;
+		(void)mt19937_next_uint32(&gen, &x);
+		const size_t j = nbits - 1 - i;
+		seq[j / 64] |= (uint64_t)(x & 1) << (j % 64);
+	}
+
+	/* Berlekamp-Massey */
+	conn[0] = prev[0] = 1;
+	for (size_t i = 0; i < nbits; i++) {
+		uint64_t discrepancy = 0;
+		for (size_t q = 0; q <= deg / 64; q++) {
+			discrepancy ^= conn[q] &
+				    bits_get64(seq, nwords, nbits - 1 - i + 64 * q);
+		}
+		for (size_t half = 32; half > 0; half /= 2)
+			discrepancy ^= discrepancy >> half;
+		if ((discrepancy & 1) == 0) {
+			shift += 1;
+		} else if (2 * deg <= i) {
+			(void)memcpy(tmp, conn, nwords * sizeof(uint64_t));
+			bits_xor_shifted(conn, nwords, prev, nwords, shift);
+			(void)memcpy(prev, tmp, nwords * sizeof(uint64_t));
+			deg = i + 1 - deg;
+			shift = 1;
+		} else {
+			bits_xor_shifted(conn, nwords, prev, nwords, shift);
+			shift += 1;
+		}
+	}
+	if (deg != MT19937_DEGREE)
+		goto cleanup;
+
+	/* psi is x times the reciprocal of the connection polynomial */
+	(void)memset(psi, 0, sizeof(psi));
+	for (size_t i = 0; i <= deg; i++) {
+		const size_t j = deg - i + 1;
+		psi[j / 64] |= ((conn[i / 64] >> (i % 64)) & 1) << (j % 64);
+	}
+	for (size_t i = 0; i < 64; i++) {
+		bits_xor_shifted(mt19937_psi[i], MT19937_POLY_WORDS + 1,
+			    psi, MT19937_POLY_WORDS, i);
+	}
+	mt19937_psi_ok = 1;
+
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(&gen, sizeof(struct mt19937_generator));
+	free(tmp);
+	free(prev);
+	free(conn);
+	free(seq);
+}
+
+
+static void
+mt19937_poly_reduce(uint64_t *poly, size_t nwords)
+{
+	for (size_t bit = nwords * 64; bit-- > MT19937_PSI_DEGREE; ) {
+		if (((poly[bit / 64] >> (bit % 64)) & 1) == 0)
+			continue;
+		/* clear the bit by adding psi shifted up to it */
+		const size_t shift = bit - MT19937_PSI_DEGREE;
+		const uint64_t *psi = mt19937_psi[shift % 64];
+		uint64_t *dest = poly + shift / 64;
+		const size_t len = nwords - shift / 64;
+		for (size_t i = 0; i < len && i <= MT19937_POLY_WORDS; i++)
+			dest[i] ^= psi[i];
+	}
+}
+
+
+static void
+mt19937_poly_xpow(uint64_t *poly, uint64_t k)
+{
+	uint64_t square[2 * MT19937_POLY_WORDS];
+	int started = 0;
+
+	(void)memset(poly, 0, MT19937_POLY_WORDS * sizeof(uint64_t));
+	poly[0] = 1;
+
+	/* left-to-right binary exponentiation */
+	for (size_t i = 64; i-- > 0; ) {
+		if (started) {
+			for (size_t j = 0; j < MT19937_POLY_WORDS; j++) {
+				square[2 * j]     = bits_spread32(poly[j]);
+				square[2 * j + 1] = bits_spread32(poly[j] >> 32);
+			}
+			mt19937_poly_reduce(square, 2 * MT19937_POLY_WORDS);
+			(void)memcpy(poly, square,
+				    MT19937_POLY_WORDS * sizeof(uint64_t));
+		}
+		if (((k >> i) & 1) == 0)
+			continue;
+		started = 1;
+		/* multiply by x */
+		for (size_t j = MT19937_POLY_WORDS; j-- > 1; )
+			poly[j] = (poly[j] << 1) | (poly[j - 1] >> 63);
+		poly[0] <<= 1;
+		const size_t top = MT19937_PSI_DEGREE;
+		if ((poly[top / 64] >> (top % 64)) & 1) {
+			for (size_t j = 0; j < MT19937_POLY_WORDS; j++)
+				poly[j] ^= mt19937_psi[0][j];
+		}
+	}
+}
+
+
+static uint64_t
+bits_spread32(uint32_t x)
+{
+	uint64_t v = x;
+
+	v = (v | (v << 16)) & UINT64_C(0x0000ffff0000ffff);
+	v = (v | (v <<  8)) & UINT64_C(0x00ff00ff00ff00ff);
+	v = (v | (v <<  4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+	v = (v | (v <<  2)) & UINT64_C(0x3333333333333333);
+	v = (v | (v <<  1)) & UINT64_C(0x5555555555555555);
+	return (v);
+}
+
+
+static uint64_t
+bits_get64(const uint64_t *bits, size_t nwords, size_t bit)
+{
+	const size_t q = bit / 64, offset = bit % 64;
+	uint64_t v = 0;
+
+	if (q < nwords)
+		v = bits[q] >> offset;
+	if (offset != 0 && q + 1 < nwords)
+		v |= bits[q + 1] << (64 - offset);
+	return (v);
+}
+
+
+static void
+bits_xor_shifted(uint64_t *dest, size_t destwords, const uint64_t *src,
+		    size_t srcwords, size_t shift)
+{
+	const size_t q = shift / 64, offset = shift % 64;
+
+	for (size_t i = 0; i < srcwords && i + q < destwords; i++) {
+		dest[i + q] ^= src[i] << offset;
+		if (offset != 0 && i + q + 1 < destwords)
+			dest[i + q + 1] ^= src[i] >> (64 - offset);
+	}
+}
+
+
+#if defined(MT19937_LANES)
+MT19937_TARGETS
+static void
+mt19937_first_outputs_lanes(const uint32_t *seeds, size_t k, uint32_t *out)
+{
+	/* see mt19937_first_outputs(), each lane is a generator */
+	mt19937_vec MT[n];
+	const uint32_t limit = (k + m < n ? k + m : n);
+
+	(void)memcpy(&MT[0], seeds, sizeof(mt19937_vec));
+	for (uint32_t i = 1; i < limit; i++)
+		MT[i] = f * (MT[i - 1] ^ (MT[i - 1] >> (w - 2))) + i;
+
+	for (uint32_t i = 0; i < k; i++) {
+		/* twist, computing the xA "odd" mask without branching */
+		const mt19937_vec x = (MT[i] & UPPER_MASK) +
+			    (MT[(i + 1) % n] & LOWER_MASK);
+		MT[i] = MT[(i + m) % n] ^ (x >> 1) ^ (-(x & 1) & a);
+		/* temper */
+		mt19937_vec y = MT[i];
+		y = y ^ ((y >> u) & d);
+		y = y ^ ((y << s) & b);
+		y = y ^ ((y << t) & c);
+		y = y ^ (y >> l);
+		for (size_t lane = 0; lane < MT19937_LANES; lane++)
+			out[lane * k + i] = y[lane];
+	}
+
+	explicit_bzero(MT, limit * sizeof(mt19937_vec));
+}
+#endif /* defined(MT19937_LANES) */
@@ -4,6 +4,9 @@
  * mt19937.h
  *
  * Mersenne Twister PRNG, see https://en.wikipedia.org/wiki/Mersenne_Twister
+ *
+ * A generator must be owned by a single thread. The jump polynomials are
+ * computed once for the whole process.
  */
 #include "bytes.h"
 
@@ -41,6 +44,83 @@ int	mt19937_seed(struct mt19937_generator *gen, uint32_t seed);
  */
 int	mt19937_next_uint32(struct mt19937_generator *gen, uint32_t *n_p);
 
+/*
+ * Generate the provided generator's next count random numbers into out, like
+ * count mt19937_next_uint32() calls but tempering whole runs of the state at
+ * once. Returns 0 on success, -1 if gen is NULL or out is NULL while count is
+ * not zero.
+ */
+int	mt19937_fill(struct mt19937_generator *gen, uint32_t *out,
+		    size_t count);
+
+/*
+ * Fill out with len random bytes from the provided generator, each generated
+ * number yielding four bytes LSB first (i.e. the MT19937 stream cipher
+ * keystream). When len is not a multiple of four, the bytes left of the last
+ * number are discarded. Returns 0 on success, -1 if gen is NULL or out is NULL
+ * while len is not zero.
+ */
+int	mt19937_fill_bytes(struct mt19937_generator *gen, uint8_t *out,
+		    size_t len);
+
+/*
+ * Advance the provided generator by k outputs, as if k numbers were generated
+ * and discarded. Large jumps are computed in O(log k) polynomial operations
+ * using the characteristic polynomial of the MT19937 transition over GF(2),
+ * computed once on the first large jump.
+ *
+ * Returns 0 on success, -1 if gen is NULL or on error.
+ */
+int	mt19937_jump(struct mt19937_generator *gen, uint64_t k);
+
+/*
+ * Rewind the provided generator by 624 outputs, undoing the last twist of its
+ * state. This is only meaningful when the generator has twisted at least once
+ * since it was seeded.
+ *
+ * The lower 31 bits of the first state word cannot be recovered until the next
+ * mt19937_untwist() call. Meanwhile, they are guessed assuming the rewound state
+ * to be a seeding one (see mt19937_state_seed()), thus the first state word
+ * output may be wrong when the generator is rewound to its index 0.
+ *
+ * Returns 0 on success, -1 if gen is NULL.
+ */
+int	mt19937_untwist(struct mt19937_generator *gen);
+
+/*
+ * Check if the state of the provided generator is the one set by seeding it,
+ * regardless of its index. If seed_p is not NULL, it is set to the candidate
+ * seed computed from the state.
+ *
+ * Returns 0 if the state is a seeding one, 1 if not, -1 if gen is NULL.
+ */
+int	mt19937_state_seed(const struct mt19937_generator *gen,
+		    uint32_t *seed_p);
+
+/*
+ * Compute the first k outputs of a MT19937 generator seeded with the given
+ * seed into out, without creating a generator. Only the initial state words
+ * needed by the first k outputs are computed and twisted, which makes it much
+ * cheaper than mt19937_seed() followed by k mt19937_next_uint32() calls when k
+ * is small. k must be at most 624.
+ *
+ * Returns 0 on success, -1 if out is NULL or k is too large.
+ */
+int	mt19937_first_outputs(uint32_t seed, size_t k, uint32_t *out);
+
+/*
+ * Like mt19937_first_outputs() for count seeds at once. The k outputs of the
+ * generator seeded with seeds[i] are stored in out[i * k] to out[i * k + k - 1],
+ * thus out must be able to hold count * k values.
+ *
+ * When the compiler and CPU support it, the generators are computed in
+ * parallel SIMD lanes (AVX-512 or AVX2 on x86-64).
+ *
+ * Returns 0 on success, -1 if seeds or out is NULL or k is too large.
+ */
+int	mt19937_first_outputs_batch(const uint32_t *seeds, size_t count,
+		    size_t k, uint32_t *out);
+
 /*
  * Encryption / Decryption stream cipher routines based on MT19937 as described
  * in Set 3 / Challenge 24.
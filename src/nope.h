@@ -4,6 +4,8 @@
  * nope.h
  *
  * A NULL block cipher, used for testing block cipher mode of operation.
+ *
+ * Stateless, like every block_cipher.
  */
 #include "bytes.h"
 #include "block_cipher.h"
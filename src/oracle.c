@@ -0,0 +1,934 @@
+/*
+ * oracle.c
+ *
+ * Oracle interface used by the breakers for cryptopals.com challenges.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compat.h"
+#include "oracle.h"
+
+
+/*
+ * Count of queries that may be waiting for their answer on each remote oracle
+ * connection.
+ */
+#define	ORACLE_REMOTE_WINDOW	16
+
+/*
+ * How long to wait for an answer from a remote oracle, in milliseconds.
+ */
+#define	ORACLE_REMOTE_TIMEOUT	30000
+
+
+/*
+ * Buffer of the data received on a connection, split into lines.
+ */
+struct line_buffer {
+	char *data;
+	size_t len, cap;
+};
+
+/*
+ * A remote oracle connection.
+ */
+struct oracle_remote_conn {
+	int sock;
+	/* indexes of the queries waiting for their answer, in order */
+	size_t queue[ORACLE_REMOTE_WINDOW];
+	size_t head, pending;
+	/* count of answers to skip, i.e. to the queries cancelled by find() */
+	size_t discard;
+	struct line_buffer in;
+};
+
+/*
+ * opaque struct used by oracles created by oracle_remote_new().
+ */
+struct oracle_remote_opaque {
+	/* serialize the use of the connections */
+	pthread_mutex_t lock;
+	size_t nconn;
+	struct oracle_remote_conn *conns;
+};
+
+/* struct oracle method members implementations */
+static int	oracle_remote_query(struct oracle *oracle,
+		    const struct bytes *input, struct bytes **output_p);
+static int	oracle_remote_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs);
+static int	oracle_remote_find(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int answer,
+		    size_t *index_p, size_t *submitted_p);
+static void	oracle_remote_free(struct oracle *oracle);
+
+/*
+ * Pipeline the given queries on the remote oracle connections. When find is
+ * non-zero, stop submitting queries once one yielded answer and don't wait for
+ * the answers following it.
+ *
+ * Returns 0 on success, -1 on error. On success, when find is non-zero
+ * *index_p is set to the index of the first query yielding answer (or to count
+ * if none did) and *submitted_p is always set to the count of queries
+ * submitted.
+ */
+static int	oracle_remote_submit(struct oracle_remote_opaque *info,
+		    size_t count, const struct bytes *const *inputs,
+		    int *answers, struct bytes **outputs, int find, int answer,
+		    size_t *index_p, size_t *submitted_p);
+
+/*
+ * Connect a TCP socket to the given host and port.
+ *
+ * Returns the socket on success, -1 on error.
+ */
+static int	tcp_connect(const char *hostname, const char *port);
+
+/*
+ * Disable Nagle's algorithm on the given socket, our queries and answers are
+ * small and latency matters.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	tcp_nodelay(int sock);
+
+/*
+ * Send all the given data on the socket.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	send_all(int sock, const char *data, size_t len);
+
+/*
+ * Receive available data on the given socket into the line buffer.
+ *
+ * Returns -1 on error, 0 when the peer has closed the connection, the count of
+ * bytes received otherwise.
+ */
+static ssize_t	line_recv(int sock, struct line_buffer *lb);
+
+/*
+ * Returns the next complete line starting at *offset_p in the line buffer, its
+ * newline replaced by a NUL byte, and advance *offset_p past it. Returns NULL
+ * when there is no complete line.
+ */
+static char	*line_next(struct line_buffer *lb, size_t *offset_p);
+
+/*
+ * Discard the first offset bytes of the line buffer, i.e. the lines consumed
+ * through line_next().
+ */
+static void	line_consume(struct line_buffer *lb, size_t offset);
+
+/*
+ * Returns the given bytes hex encoded followed by a newline as a
+ * NUL-terminated string that should be passed to free(), or NULL on error.
+ */
+static char	*hex_line(const struct bytes *bytes);
+
+/*
+ * Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t	now_ns(void);
+
+/*
+ * Account a call made to the oracle that took the given time.
+ */
+static void	account_latency(struct oracle *oracle, uint64_t ns);
+
+
+int
+oracle_query(struct oracle *oracle, const struct bytes *input,
+		    struct bytes **output_p)
+{
+	struct bytes *output = NULL;
+
+	/* sanity checks */
+	if (oracle == NULL || oracle->query == NULL || input == NULL)
+		return (-1);
+
+	const uint64_t start = now_ns();
+	const int answer = oracle->query(oracle, input,
+		    output_p == NULL ? NULL : &output);
+	account_latency(oracle, now_ns() - start);
+
+	atomic_fetch_add(&oracle->stats.queries, 1);
+	atomic_fetch_add(&oracle->stats.bytes_sent, input->len);
+	if (output != NULL)
+		atomic_fetch_add(&oracle->stats.bytes_received, output->len);
+
+	if (output_p != NULL)
+		*output_p = output;
+	return (answer);
+}
+
+
+int
+oracle_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs)
+{
+	int ret = -1;
+
+	/* sanity checks */
+	if (oracle == NULL || inputs == NULL || answers == NULL)
+		return (-1);
+	for (size_t i = 0; i < count; i++) {
+		if (inputs[i] == NULL)
+			return (-1);
+	}
+
+	if (oracle->batch == NULL) {
+		/* fallback to one query per input */
+		ret = 0;
+		for (size_t i = 0; i < count && ret == 0; i++) {
+			struct bytes **output_p =
+				    (outputs == NULL ? NULL : &outputs[i]);
+			answers[i] = oracle_query(oracle, inputs[i], output_p);
+			if (answers[i] == -1)
+				ret = -1;
+		}
+		return (ret);
+	}
+
+	const uint64_t start = now_ns();
+	ret = oracle->batch(oracle, count, inputs, answers, outputs);
+	account_latency(oracle, now_ns() - start);
+
+	/* NOTE: account_latency() counted one call */
+	uint64_t sent = 0, received = 0;
+	for (size_t i = 0; i < count; i++) {
+		sent += inputs[i]->len;
+		if (outputs != NULL && outputs[i] != NULL)
+			received += outputs[i]->len;
+	}
+	atomic_fetch_add(&oracle->stats.queries, count);
+	atomic_fetch_add(&oracle->stats.bytes_sent, sent);
+	atomic_fetch_add(&oracle->stats.bytes_received, received);
+
+	return (ret == 0 ? 0 : -1);
+}
+
+
+int
+oracle_find(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int answer,
+		    size_t *index_p)
+{
+	int *answers = NULL;
+	size_t index = count;
+	int ret = -1;
+
+	/* sanity checks */
+	if (oracle == NULL || inputs == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < count; i++) {
+		if (inputs[i] == NULL)
+			goto cleanup;
+	}
+
+	if (oracle->find != NULL) {
+		size_t submitted = 0;
+		const uint64_t start = now_ns();
+		ret = oracle->find(oracle, count, inputs, answer, &index,
+			    &submitted);
+		account_latency(oracle, now_ns() - start);
+
+		uint64_t sent = 0;
+		for (size_t i = 0; i < submitted && i < count; i++)
+			sent += inputs[i]->len;
+		atomic_fetch_add(&oracle->stats.queries, submitted);
+		atomic_fetch_add(&oracle->stats.bytes_sent, sent);
+	} else if (oracle->batch != NULL) {
+		/* fallback to a batch of all the queries */
+		answers = calloc(count, sizeof(int));
+		if (count > 0 && answers == NULL)
+			goto cleanup;
+		if (oracle_batch(oracle, count, inputs, answers, NULL) != 0)
+			goto cleanup;
+		for (index = 0; index < count; index++) {
+			if (answers[index] == answer)
+				break;
+		}
+		ret = (index < count ? 0 : 1);
+	} else {
+		/* fallback to one query per input */
+		for (index = 0; index < count; index++) {
+			const int got = oracle_query(oracle, inputs[index], NULL);
+			if (got == -1)
+				goto cleanup;
+			if (got == answer)
+				break;
+		}
+		ret = (index < count ? 0 : 1);
+	}
+
+	if (ret == 0 && index_p != NULL)
+		*index_p = index;
+
+	/* FALLTHROUGH */
+cleanup:
+	free(answers);
+	return (ret);
+}
+
+
+struct oracle *
+oracle_remote_new(const char *hostname, const char *port, size_t nconn)
+{
+	struct oracle *oracle = NULL;
+	int success = 0;
+
+	/* sanity checks */
+	if (hostname == NULL || port == NULL || nconn == 0)
+		goto cleanup;
+
+	oracle = calloc(1, sizeof(struct oracle));
+	if (oracle == NULL)
+		goto cleanup;
+
+	oracle->opaque = calloc(1, sizeof(struct oracle_remote_opaque));
+	if (oracle->opaque == NULL)
+		goto cleanup;
+	struct oracle_remote_opaque *info = oracle->opaque;
+
+	info->conns = calloc(nconn, sizeof(struct oracle_remote_conn));
+	if (info->conns == NULL)
+		goto cleanup;
+	for (size_t i = 0; i < nconn; i++)
+		info->conns[i].sock = -1;
+	info->nconn = nconn;
+
+	if (pthread_mutex_init(&info->lock, NULL) != 0) {
+		/* don't let oracle_remote_free() destroy it */
+		free(info->conns);
+		info->conns = NULL;
+		goto cleanup;
+	}
+
+	oracle->query = oracle_remote_query;
+	oracle->batch = oracle_remote_batch;
+	oracle->find  = oracle_remote_find;
+	oracle->free  = oracle_remote_free;
+
+	/* connect all at once so that we fail early */
+	for (size_t i = 0; i < nconn; i++) {
+		info->conns[i].sock = tcp_connect(hostname, port);
+		if (info->conns[i].sock == -1)
+			goto cleanup;
+	}
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		if (oracle != NULL && oracle->free != NULL) {
+			oracle->free(oracle);
+		} else if (oracle != NULL) {
+			free(oracle->opaque);
+			free(oracle);
+		}
+		oracle = NULL;
+	}
+	return (oracle);
+}
+
+
+int
+oracle_serve(struct oracle *oracle, int listener)
+{
+	struct pollfd *fds = NULL;
+	struct line_buffer *bufs = NULL;
+	size_t nfds = 0;
+	int success = 0;
+
+	/* sanity checks */
+	if (oracle == NULL || listener == -1)
+		goto cleanup;
+
+	/* the first entry is always the listening socket */
+	fds = calloc(1, sizeof(struct pollfd));
+	bufs = calloc(1, sizeof(struct line_buffer));
+	if (fds == NULL || bufs == NULL)
+		goto cleanup;
+	fds[0].fd = listener;
+	fds[0].events = POLLIN;
+	nfds = 1;
+
+	for (;;) {
+		if (poll(fds, nfds, /* no timeout */-1) == -1) {
+			if (errno == EINTR)
+				continue;
+			goto cleanup;
+		}
+
+		/* serve the clients, from the last so that we can remove the
+		   current one by moving the last into its slot */
+		for (size_t i = nfds - 1; i > 0; i--) {
+			if (fds[i].revents == 0)
+				continue;
+			struct line_buffer *lb = &bufs[i];
+			int drop = (line_recv(fds[i].fd, lb) <= 0);
+			size_t offset = 0;
+			char *line;
+			while (!drop && (line = line_next(lb, &offset)) != NULL) {
+				struct bytes *input = NULL, *output = NULL;
+				char *hex = NULL, *rsp = NULL;
+				int rsplen = -1;
+				input = bytes_from_hex(line);
+				if (input == NULL) {
+					/* protocol error */
+					drop = 1;
+					break;
+				}
+				const int answer = oracle_query(oracle, input,
+					    &output);
+				if (output != NULL)
+					hex = bytes_to_hex(output);
+				if (output != NULL && hex == NULL)
+					rsplen = -1;
+				else if (hex != NULL)
+					rsplen = asprintf(&rsp, "%d %s\n",
+						    answer, hex);
+				else
+					rsplen = asprintf(&rsp, "%d\n", answer);
+				if (rsplen == -1 ||
+					    send_all(fds[i].fd, rsp, rsplen) != 0)
+					drop = 1;
+				free(rsp);
+				free(hex);
+				bytes_free(output);
+				bytes_free(input);
+			}
+			line_consume(lb, offset);
+			if (drop) {
+				(void)close(fds[i].fd);
+				free(lb->data);
+				fds[i] = fds[nfds - 1];
+				bufs[i] = bufs[nfds - 1];
+				nfds -= 1;
+			}
+		}
+
+		/* accept a new client */
+		if (fds[0].revents & POLLIN) {
+			const int s = accept(listener, NULL, NULL);
+			if (s == -1) {
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				goto cleanup;
+			}
+			struct pollfd *nfds_p = reallocarray(fds, nfds + 1,
+				    sizeof(struct pollfd));
+			if (nfds_p != NULL)
+				fds = nfds_p;
+			struct line_buffer *nbufs = reallocarray(bufs,
+				    nfds + 1, sizeof(struct line_buffer));
+			if (nbufs != NULL)
+				bufs = nbufs;
+			if (nfds_p == NULL || nbufs == NULL ||
+				    tcp_nodelay(s) != 0) {
+				(void)close(s);
+				continue;
+			}
+			(void)memset(&fds[nfds], 0, sizeof(struct pollfd));
+			fds[nfds].fd = s;
+			fds[nfds].events = POLLIN;
+			(void)memset(&bufs[nfds], 0, sizeof(struct line_buffer));
+			nfds += 1;
+		}
+	}
+
+	/* NOTREACHED */
+	success = 1;
+cleanup:
+	for (size_t i = 1; i < nfds; i++) {
+		(void)close(fds[i].fd);
+		free(bufs[i].data);
+	}
+	free(bufs);
+	free(fds);
+	return (success ? 0 : -1);
+}
+
+
+uint64_t
+oracle_latency_percentile(const struct oracle *oracle, double percentile)
+{
+	/* sanity checks */
+	if (oracle == NULL)
+		return (0);
+	const uint64_t calls = atomic_load(&oracle->stats.calls);
+	if (calls == 0)
+		return (0);
+	if (percentile < 0)
+		percentile = 0;
+	if (percentile > 1)
+		percentile = 1;
+
+	/* the count of calls that should have a latency below the result */
+	const double target = percentile * calls;
+	uint64_t seen = 0;
+	size_t i;
+	for (i = 0; i < ORACLE_LATENCY_BUCKETS - 1; i++) {
+		seen += atomic_load(&oracle->stats.latency[i]);
+		if (seen > 0 && seen >= target)
+			break;
+	}
+
+	/* upper bound of the bucket i */
+	if (i == ORACLE_LATENCY_BUCKETS - 1)
+		return (UINT64_MAX);
+	return ((UINT64_C(1) << (i + 1)) - 1);
+}
+
+
+void
+oracle_stats_reset(struct oracle *oracle)
+{
+	if (oracle == NULL)
+		return;
+
+	struct oracle_stats *stats = &oracle->stats;
+	atomic_store(&stats->queries, 0);
+	atomic_store(&stats->calls, 0);
+	atomic_store(&stats->bytes_sent, 0);
+	atomic_store(&stats->bytes_received, 0);
+	for (size_t i = 0; i < ORACLE_LATENCY_BUCKETS; i++)
+		atomic_store(&stats->latency[i], 0);
+}
+
+
+void
+oracle_free(struct oracle *oracle)
+{
+	if (oracle != NULL && oracle->free != NULL)
+		oracle->free(oracle);
+}
+
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return (0);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+
+static void
+account_latency(struct oracle *oracle, uint64_t ns)
+{
+	/* find the bucket, i.e. floor(log2(ns)) */
+	size_t i = 0;
+	while (ns > 1) {
+		ns >>= 1;
+		i++;
+	}
+
+	atomic_fetch_add(&oracle->stats.latency[i], 1);
+	atomic_fetch_add(&oracle->stats.calls, 1);
+}
+
+
+static int
+oracle_remote_query(struct oracle *oracle, const struct bytes *input,
+		    struct bytes **output_p)
+{
+	const struct bytes *const inputs[1] = { input };
+	struct bytes *outputs[1] = { NULL };
+	int answer = -1;
+
+	if (oracle_remote_batch(oracle, 1, inputs, &answer,
+		    output_p == NULL ? NULL : outputs) != 0)
+		return (-1);
+	if (output_p != NULL)
+		*output_p = outputs[0];
+	return (answer);
+}
+
+
+static int
+oracle_remote_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs)
+{
+	/* sanity checks */
+	if (oracle == NULL || oracle->opaque == NULL)
+		return (-1);
+	struct oracle_remote_opaque *info = oracle->opaque;
+
+	if (pthread_mutex_lock(&info->lock) != 0)
+		return (-1);
+	const int ret = oracle_remote_submit(info, count, inputs, answers,
+		    outputs, /* find */0, 0, NULL, NULL);
+	(void)pthread_mutex_unlock(&info->lock);
+
+	return (ret);
+}
+
+
+static int
+oracle_remote_find(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int answer,
+		    size_t *index_p, size_t *submitted_p)
+{
+	int *answers = NULL;
+	size_t index = count, submitted = 0;
+	int ret = -1;
+
+	/* sanity checks */
+	if (oracle == NULL || oracle->opaque == NULL)
+		goto cleanup;
+	struct oracle_remote_opaque *info = oracle->opaque;
+
+	answers = calloc(count, sizeof(int));
+	if (count > 0 && answers == NULL)
+		goto cleanup;
+
+	if (pthread_mutex_lock(&info->lock) != 0)
+		goto cleanup;
+	ret = oracle_remote_submit(info, count, inputs, answers, NULL,
+		    /* find */1, answer, &index, &submitted);
+	(void)pthread_mutex_unlock(&info->lock);
+	if (ret != 0)
+		goto cleanup;
+
+	ret = (index < count ? 0 : 1);
+	*index_p = index;
+
+	/* FALLTHROUGH */
+cleanup:
+	*submitted_p = submitted;
+	free(answers);
+	return (ret);
+}
+
+
+static void
+oracle_remote_free(struct oracle *oracle)
+{
+	if (oracle == NULL)
+		return;
+
+	struct oracle_remote_opaque *info = oracle->opaque;
+	if (info != NULL && info->conns != NULL) {
+		for (size_t i = 0; i < info->nconn; i++) {
+			struct oracle_remote_conn *conn = &info->conns[i];
+			if (conn->sock != -1)
+				(void)close(conn->sock);
+			free(conn->in.data);
+		}
+		free(info->conns);
+		(void)pthread_mutex_destroy(&info->lock);
+	}
+	freezero(info, sizeof(struct oracle_remote_opaque));
+	freezero(oracle, sizeof(struct oracle));
+}
+
+
+static int
+oracle_remote_submit(struct oracle_remote_opaque *info,
+		    size_t count, const struct bytes *const *inputs,
+		    int *answers, struct bytes **outputs, int find, int answer,
+		    size_t *index_p, size_t *submitted_p)
+{
+	const size_t nconn = info->nconn;
+	struct pollfd *fds = NULL;
+	size_t *owners = NULL;
+	uint8_t *answered = NULL;
+	/* next query to submit, first query not answered yet and first query
+	   yielding the searched answer */
+	size_t next = 0, lowest = 0, found = count;
+	int success = 0;
+
+	if (outputs != NULL) {
+		for (size_t i = 0; i < count; i++)
+			outputs[i] = NULL;
+	}
+
+	fds = calloc(nconn, sizeof(struct pollfd));
+	owners = calloc(nconn, sizeof(size_t));
+	answered = calloc(count, sizeof(uint8_t));
+	if (fds == NULL || owners == NULL || (count > 0 && answered == NULL))
+		goto cleanup;
+
+	for (;;) {
+		/* submit as many queries as the connections windows allow,
+		   spreading them across the connections */
+		int more = (found == count);
+		while (more && next < count) {
+			more = 0;
+			for (size_t c = 0; c < nconn && next < count; c++) {
+				struct oracle_remote_conn *conn = &info->conns[c];
+				if (conn->pending == ORACLE_REMOTE_WINDOW)
+					continue;
+				char *line = hex_line(inputs[next]);
+				if (line == NULL)
+					goto cleanup;
+				const int ret = send_all(conn->sock, line,
+					    strlen(line));
+				free(line);
+				if (ret != 0)
+					goto cleanup;
+				const size_t tail = (conn->head + conn->pending)
+					    % ORACLE_REMOTE_WINDOW;
+				conn->queue[tail] = next++;
+				conn->pending += 1;
+				more = 1;
+			}
+		}
+
+		/* we're done once every query before the one we're looking
+		   for has been answered */
+		if (lowest >= found)
+			break;
+
+		/* wait for answers */
+		size_t npoll = 0;
+		for (size_t c = 0; c < nconn; c++) {
+			if (info->conns[c].pending == 0)
+				continue;
+			fds[npoll].fd = info->conns[c].sock;
+			fds[npoll].events = POLLIN;
+			fds[npoll].revents = 0;
+			owners[npoll] = c;
+			npoll += 1;
+		}
+		if (npoll == 0) /* not expected */
+			goto cleanup;
+		const int nready = poll(fds, npoll, ORACLE_REMOTE_TIMEOUT);
+		if (nready == -1 && errno == EINTR)
+			continue;
+		if (nready <= 0)
+			goto cleanup;
+
+		/* process the answers */
+		for (size_t i = 0; i < npoll; i++) {
+			if (fds[i].revents == 0)
+				continue;
+			struct oracle_remote_conn *conn = &info->conns[owners[i]];
+			if (line_recv(conn->sock, &conn->in) <= 0)
+				goto cleanup;
+			size_t offset = 0;
+			char *line;
+			int bad = 0;
+			while (!bad && (line = line_next(&conn->in,
+				    &offset)) != NULL) {
+				if (conn->discard > 0) {
+					conn->discard -= 1;
+					continue;
+				}
+				if (conn->pending == 0) {
+					/* unexpected answer */
+					bad = 1;
+					continue;
+				}
+				const size_t q = conn->queue[conn->head];
+				conn->head = (conn->head + 1) % ORACLE_REMOTE_WINDOW;
+				conn->pending -= 1;
+				/* parse "answer[ output]" */
+				char *end = NULL;
+				errno = 0;
+				const long got = strtol(line, &end, 10);
+				if (errno != 0 || end == line || got < 0 ||
+					    got > INT32_MAX) {
+					bad = 1;
+					continue;
+				}
+				if (*end == ' ' && outputs != NULL) {
+					outputs[q] = bytes_from_hex(end + 1);
+					bad = (outputs[q] == NULL);
+				} else if (*end != ' ' && *end != '\0') {
+					bad = 1;
+				}
+				if (bad)
+					continue;
+				answers[q] = (int)got;
+				answered[q] = 1;
+				if (find && answers[q] == answer && q < found)
+					found = q;
+			}
+			/* consume the lines parsed so far even on error, so
+			   that the next answers stay in sync with their
+			   queries */
+			line_consume(&conn->in, offset);
+			if (bad)
+				goto cleanup;
+		}
+		while (lowest < count && answered[lowest])
+			lowest += 1;
+	}
+
+	if (index_p != NULL)
+		*index_p = found;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	/* skip the answers to the queries we did not wait for. On error, the
+	   connection state is probably inconsistent anyway. */
+	for (size_t c = 0; c < nconn; c++) {
+		struct oracle_remote_conn *conn = &info->conns[c];
+		conn->discard += conn->pending;
+		conn->head = conn->pending = 0;
+	}
+	if (submitted_p != NULL)
+		*submitted_p = next;
+	if (!success && outputs != NULL) {
+		for (size_t i = 0; i < count; i++) {
+			bytes_free(outputs[i]);
+			outputs[i] = NULL;
+		}
+	}
+	free(answered);
+	free(owners);
+	free(fds);
+	return (success ? 0 : -1);
+}
+
+
+static int
+tcp_connect(const char *hostname, const char *port)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL, *res0 = NULL;
+	int s = -1;
+
+	/* find the addresses for the given hostname (both IPv6 and IPv4) and
+	   open a socket for it. Heavily based on OpenBSD's getaddrinfo(3)
+	   manpage example. */
+	(void)memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(hostname, port, &hints, &res0) != 0)
+		return (-1);
+	for (res = res0; res != NULL; res = res->ai_next) {
+		s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (s == -1)
+			continue;
+		if (connect(s, res->ai_addr, res->ai_addrlen) == 0 &&
+			    tcp_nodelay(s) == 0) {
+			/* ok we got one */
+			break;
+		}
+		(void)close(s);
+		s = -1;
+	}
+
+	freeaddrinfo(res0);
+	return (s);
+}
+
+
+static int
+tcp_nodelay(int sock)
+{
+	const int on = 1;
+
+	if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0)
+		return (-1);
+	return (0);
+}
+
+
+static int
+send_all(int sock, const char *data, size_t len)
+{
+	while (len > 0) {
+		const ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (-1);
+		data += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+
+static ssize_t
+line_recv(int sock, struct line_buffer *lb)
+{
+	/* ensure there is room for at least a chunk and the NUL terminator */
+	const size_t chunk = 4096;
+	if (lb->cap - lb->len < chunk + 1) {
+		const size_t cap = lb->cap + chunk + 1 + lb->cap / 2;
+		char *data = realloc(lb->data, cap);
+		if (data == NULL)
+			return (-1);
+		lb->data = data;
+		lb->cap = cap;
+	}
+
+	ssize_t n;
+	do {
+		n = recv(sock, lb->data + lb->len, lb->cap - lb->len - 1, 0);
+	} while (n == -1 && errno == EINTR);
+	if (n > 0)
+		lb->len += n;
+
+	return (n);
+}
+
+
+static char *
+line_next(struct line_buffer *lb, size_t *offset_p)
+{
+	const size_t offset = *offset_p;
+
+	if (offset >= lb->len)
+		return (NULL);
+
+	char *line = lb->data + offset;
+	char *nl = memchr(line, '\n', lb->len - offset);
+	if (nl == NULL)
+		return (NULL);
+	*nl = '\0';
+	*offset_p = (nl - lb->data) + 1;
+
+	return (line);
+}
+
+
+static void
+line_consume(struct line_buffer *lb, size_t offset)
+{
+	if (offset == 0)
+		return;
+	(void)memmove(lb->data, lb->data + offset, lb->len - offset);
+	lb->len -= offset;
+}
+
+
+static char *
+hex_line(const struct bytes *bytes)
+{
+	char *hex = NULL, *line = NULL;
+
+	hex = bytes_to_hex(bytes);
+	if (hex == NULL)
+		return (NULL);
+	if (asprintf(&line, "%s\n", hex) == -1)
+		line = NULL;
+
+	free(hex);
+	return (line);
+}
@@ -0,0 +1,188 @@
+#ifndef ORACLE_H
+#define ORACLE_H
+/*
+ * oracle.h
+ *
+ * Oracle interface used by the breakers for cryptopals.com challenges.
+ *
+ * An oracle may be queried from several threads at once, which is what the
+ * parallel breakers do. Its statistics are atomic counters and the remote
+ * oracle serializes the use of its connections.
+ */
+#include <stdatomic.h>
+
+#include "bytes.h"
+
+
+/*
+ * Count of buckets of the oracle latency histogram. The bucket i counts the
+ * calls that took between 2^i and 2^(i+1) - 1 nanoseconds, 64 buckets are
+ * enough to hold any uint64_t nanoseconds value.
+ */
+#define	ORACLE_LATENCY_BUCKETS	64
+
+
+/*
+ * Accounting of the oracle usage, maintained by oracle_query() and
+ * oracle_batch(). The counters are atomic so that breakers may query the same
+ * oracle from several threads.
+ */
+struct oracle_stats {
+	/* total count of queries submitted to the oracle */
+	_Atomic uint64_t queries;
+	/* count of calls to the oracle, a batch counting as a single call */
+	_Atomic uint64_t calls;
+	/* total count of input bytes sent to the oracle */
+	_Atomic uint64_t bytes_sent;
+	/* total count of output bytes received from the oracle */
+	_Atomic uint64_t bytes_received;
+	/* latency histogram of the calls, see ORACLE_LATENCY_BUCKETS */
+	_Atomic uint64_t latency[ORACLE_LATENCY_BUCKETS];
+};
+
+/*
+ * Used to interface with an oracle, i.e. anything answering to queries made by
+ * a breaker. What the input, answer and output of a query mean is defined by
+ * each oracle implementation.
+ *
+ * Breakers should not call the function members directly but use
+ * oracle_query() and oracle_batch() so that the oracle usage is accounted.
+ *
+ * The query() and batch() implementations must be safe to call concurrently
+ * from several threads.
+ */
+struct oracle {
+	/*
+	 * Submit a single query to the oracle.
+	 *
+	 * When output_p is not NULL, it is set to the oracle output (if any)
+	 * that must be passed to bytes_free() by the caller.
+	 *
+	 * Returns -1 on error, the non-negative oracle answer otherwise.
+	 */
+	int	(*query)(struct oracle *oracle, const struct bytes *input,
+			    struct bytes **output_p);
+
+	/*
+	 * Submit count queries at once to the oracle, may be NULL when the
+	 * implementation has no better way to do it than calling query()
+	 * repeatedly.
+	 *
+	 * answers must be an array of count int that will be set to the
+	 * answer to each query. When outputs is not NULL it must be an array
+	 * of count pointers, each set like output_p by query().
+	 *
+	 * Returns 0 on success, -1 on error.
+	 */
+	int	(*batch)(struct oracle *oracle, size_t count,
+			    const struct bytes *const *inputs, int *answers,
+			    struct bytes **outputs);
+
+	/*
+	 * Submit the count queries in order until one yields the given
+	 * answer, may be NULL. Implementations may have submitted (but should
+	 * not wait for) the queries following the matching one.
+	 *
+	 * index_p is set to the index of the first query yielding answer and
+	 * submitted_p to the count of queries that were submitted.
+	 *
+	 * Returns 0 when a query yielded answer, 1 when none did, -1 on error.
+	 */
+	int	(*find)(struct oracle *oracle, size_t count,
+			    const struct bytes *const *inputs, int answer,
+			    size_t *index_p, size_t *submitted_p);
+
+	/*
+	 * Free the resource associated with the given oracle struct.
+	 *
+	 * If not NULL, the data will be zero'd before freed.
+	 */
+	void	(*free)(struct oracle *oracle);
+
+	/* accounting of this oracle usage */
+	struct oracle_stats stats;
+
+	/* implementation defined data */
+	void *opaque;
+};
+
+
+/*
+ * Submit a single query to the given oracle, updating its accounting.
+ *
+ * See the query function member of struct oracle.
+ */
+int	oracle_query(struct oracle *oracle, const struct bytes *input,
+		    struct bytes **output_p);
+
+/*
+ * Submit count queries at once to the given oracle, updating its accounting.
+ * Fallback to one query() call per input when the oracle doesn't implement
+ * batch().
+ *
+ * See the batch function member of struct oracle.
+ */
+int	oracle_batch(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int *answers,
+		    struct bytes **outputs);
+
+/*
+ * Submit count queries to the given oracle until one yields answer, updating
+ * its accounting. When the oracle doesn't implement find(), fallback to
+ * batch() or to one query() call per input.
+ *
+ * When 0 is returned and index_p is not NULL, it is set to the index of the
+ * first query yielding answer.
+ *
+ * Returns 0 when a query yielded answer, 1 when none did, -1 on error.
+ */
+int	oracle_find(struct oracle *oracle, size_t count,
+		    const struct bytes *const *inputs, int answer,
+		    size_t *index_p);
+
+/*
+ * Create an oracle forwarding the queries to a remote server, e.g. one running
+ * oracle_serve(), through nconn persistent TCP connections.
+ *
+ * The protocol is line based: each query is sent as its input hex encoded,
+ * followed by a newline. The server answers to the queries in order with a line
+ * holding the answer in decimal, optionally followed by a space and the output
+ * hex encoded. Several queries are pipelined on each connection so that batch()
+ * and find() don't wait a round-trip per query, and find() stops submitting
+ * queries as soon as the searched answer is received.
+ *
+ * Returns a new oracle struct that must be passed to oracle_free(), or NULL on
+ * failure (including failure to connect to the server).
+ */
+struct oracle	*oracle_remote_new(const char *hostname, const char *port,
+		    size_t nconn);
+
+/*
+ * Answer to the queries of the clients connecting on the given listening
+ * socket using the given oracle, speaking the protocol described by
+ * oracle_remote_new(). This is a stand-in for the remote oracles attacked by
+ * the breakers, it serves all its clients from a single thread.
+ *
+ * Only returns on error, with -1.
+ */
+int	oracle_serve(struct oracle *oracle, int listener);
+
+/*
+ * Returns an upper bound of the given percentile (between 0 and 1) of the
+ * oracle calls latency in nanoseconds, precise within a factor of two. Returns
+ * 0 if oracle is NULL or no call has been made yet.
+ */
+uint64_t	oracle_latency_percentile(const struct oracle *oracle,
+		    double percentile);
+
+/*
+ * Reset the accounting of the given oracle.
+ */
+void	oracle_stats_reset(struct oracle *oracle);
+
+/*
+ * Free the resource associated with the given oracle struct if not NULL.
+ */
+void	oracle_free(struct oracle *oracle);
+
+#endif /* ndef ORACLE_H */
@@ -0,0 +1,760 @@
+/*
+ * pool.c
+ *
+ * Work-stealing thread pool used by the library for everything that can run
+ * on more than one core.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compat.h"
+#include "pool.h"
+
+
+/*
+ * Initial capacity of the task deques, they grow as needed.
+ */
+#define	CP_DEQUE_INITIAL_CAPACITY	64
+
+/*
+ * Count of ranges per thread cp_parallel_for() aims at when it choose the
+ * grain, so that threads finishing early find more to steal.
+ */
+#define	CP_PARALLEL_FOR_SPLIT	8
+
+/*
+ * A task spawned in a group.
+ */
+struct cp_task {
+	int (*fn)(void *);
+	void *arg;
+	struct cp_group *group;
+};
+
+/*
+ * A deque of tasks, stored in a ring buffer.
+ */
+struct cp_deque {
+	pthread_mutex_t lock;
+	struct cp_task **tasks;
+	/* index of the top task, count of tasks, and capacity of the buffer */
+	size_t head, len, cap;
+};
+
+/*
+ * A pool worker thread and its deque.
+ */
+struct cp_worker {
+	struct cp_pool *pool;
+	/* index of this worker in its pool */
+	size_t index;
+	struct cp_deque deque;
+	pthread_t thread;
+};
+
+/* pool struct definition */
+struct cp_pool {
+	/* count of threads, including the waiting one */
+	size_t nthreads;
+	/* the nthreads - 1 workers, ninit of them have their deque initialized
+	   (all of them before any thread is started) and nstarted have their
+	   thread running */
+	struct cp_worker *workers;
+	size_t ninit, nstarted;
+	/* the deque of the tasks spawned from outside of the pool */
+	struct cp_deque injected;
+	/* count of tasks in all the deques */
+	atomic_size_t queued;
+	/* lock and condition used by the idle threads to sleep, signaled when a
+	   task is queued or a group is done */
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	/* set when the workers should stop, protected by lock */
+	int shutdown;
+};
+
+/* group struct definition */
+struct cp_group {
+	struct cp_pool *pool;
+	/* count of tasks spawned and not done yet */
+	atomic_size_t remaining;
+	atomic_int cancelled;
+	atomic_int failed;
+};
+
+/*
+ * State shared by the tasks of a cp_parallel_for() call.
+ */
+struct cp_parallel_for_job {
+	int (*fn)(size_t, size_t, void *);
+	void *arg;
+	size_t n, grain;
+	struct cp_group *group;
+	/* one range per grain long chunk, one being spawned on every split */
+	struct cp_parallel_for_range *ranges;
+	atomic_size_t nranges;
+};
+
+/*
+ * A range of chunks processed by a cp_parallel_for() task.
+ */
+struct cp_parallel_for_range {
+	struct cp_parallel_for_job *job;
+	/* the chunks from lo to hi (excluded) */
+	size_t lo, hi;
+};
+
+/*
+ * The worker the current thread is, NULL when it is not a pool worker thread.
+ */
+static _Thread_local struct cp_worker	*cp_pool_self = NULL;
+
+/*
+ * The pool given to cp_pool_use() by the current thread, NULL for the default.
+ */
+static _Thread_local struct cp_pool	*cp_pool_used = NULL;
+
+/* the cp_pool_default() pool and its count of threads */
+static pthread_mutex_t	cp_pool_default_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cp_pool	*cp_pool_default_pool = NULL;
+static size_t		cp_pool_default_count = 0;
+static int		cp_pool_default_count_set = 0;
+
+
+/*
+ * Initialize the given deque.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	cp_deque_init(struct cp_deque *deque);
+
+/*
+ * Free the resources of the given deque, which must be empty.
+ */
+static void	cp_deque_finalize(struct cp_deque *deque);
+
+/*
+ * Push the given task at the bottom of the given deque.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	cp_deque_push(struct cp_deque *deque, struct cp_task *task);
+
+/*
+ * Pop a task from the bottom of the given deque when bottom is non-zero,
+ * from its top otherwise.
+ *
+ * Returns the task, or NULL when the deque is empty.
+ */
+static struct cp_task	*cp_deque_pop(struct cp_deque *deque, int bottom);
+
+/*
+ * Find a task to run in the given pool for the current thread: from the bottom
+ * of its own deque if it is one of the pool worker, then from the injected
+ * deque, and finally stolen from the top of the workers deques.
+ *
+ * Returns the task, or NULL when none was found.
+ */
+static struct cp_task	*cp_pool_take(struct cp_pool *pool);
+
+/*
+ * Run the given task unless its group is cancelled, and free it.
+ */
+static void	cp_task_run(struct cp_task *task);
+
+/*
+ * Mark one of the given group tasks as done.
+ */
+static void	cp_group_done(struct cp_group *group);
+
+/*
+ * Pool worker thread routine, run tasks until the pool shutdown.
+ *
+ * Always returns NULL.
+ */
+static void	*cp_pool_worker(void *arg);
+
+/*
+ * Returns the pool to use for a NULL pool argument: the one given to
+ * cp_pool_use() by the current thread, or else cp_pool_default().
+ */
+static struct cp_pool	*cp_pool_current(void);
+
+/*
+ * Returns the count of online CPU, at least 1.
+ */
+static size_t	cp_pool_ncpu(void);
+
+/*
+ * Returns the count of threads from the CP_POOL_THREADS_ENV environment
+ * variable, 0 when it is not set or not a number.
+ */
+static size_t	cp_pool_env_nthreads(void);
+
+/*
+ * cp_parallel_for() task routine, split its range of chunks in halves
+ * spawning the upper ones until a single chunk is left, which is processed.
+ *
+ * Returns the job function result, or -1 on error.
+ */
+static int	cp_parallel_for_run(void *arg);
+
+
+struct cp_pool *
+cp_pool_create(size_t nthreads)
+{
+	struct cp_pool *pool = NULL;
+	int success = 0;
+
+	if (nthreads == 0)
+		nthreads = cp_pool_ncpu();
+
+	pool = calloc(1, sizeof(struct cp_pool));
+	if (pool == NULL)
+		return (NULL);
+	pool->nthreads = nthreads;
+	atomic_init(&pool->queued, 0);
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		free(pool);
+		return (NULL);
+	}
+	if (pthread_cond_init(&pool->changed, NULL) != 0) {
+		(void)pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return (NULL);
+	}
+	if (cp_deque_init(&pool->injected) != 0) {
+		(void)pthread_cond_destroy(&pool->changed);
+		(void)pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return (NULL);
+	}
+
+	if (nthreads > 1) {
+		pool->workers = calloc(nthreads - 1, sizeof(struct cp_worker));
+		if (pool->workers == NULL)
+			goto cleanup;
+	}
+	for (pool->ninit = 0; pool->ninit < nthreads - 1; pool->ninit++) {
+		struct cp_worker *worker = &pool->workers[pool->ninit];
+		worker->pool = pool;
+		worker->index = pool->ninit;
+		if (cp_deque_init(&worker->deque) != 0)
+			goto cleanup;
+	}
+	/* start the workers once all the deques they may steal from exist */
+	for (pool->nstarted = 0; pool->nstarted < nthreads - 1;
+		    pool->nstarted++) {
+		struct cp_worker *worker = &pool->workers[pool->nstarted];
+		if (pthread_create(&worker->thread, NULL, cp_pool_worker,
+			    worker) != 0)
+			goto cleanup;
+	}
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success) {
+		cp_pool_free(pool);
+		pool = NULL;
+	}
+	return (pool);
+}
+
+
+size_t
+cp_pool_nthreads(const struct cp_pool *pool)
+{
+	return (pool == NULL ? 0 : pool->nthreads);
+}
+
+
+void
+cp_pool_free(struct cp_pool *pool)
+{
+	if (pool == NULL)
+		return;
+
+	/* stop the workers */
+	(void)pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	(void)pthread_cond_broadcast(&pool->changed);
+	(void)pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->nstarted; i++)
+		(void)pthread_join(pool->workers[i].thread, NULL);
+
+	for (size_t i = 0; i < pool->ninit; i++)
+		cp_deque_finalize(&pool->workers[i].deque);
+	free(pool->workers);
+	cp_deque_finalize(&pool->injected);
+	(void)pthread_cond_destroy(&pool->changed);
+	(void)pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+
+struct cp_pool *
+cp_pool_default(void)
+{
+	struct cp_pool *pool;
+
+	(void)pthread_mutex_lock(&cp_pool_default_lock);
+	if (cp_pool_default_pool == NULL) {
+		const size_t nthreads = (cp_pool_default_count_set ?
+			    cp_pool_default_count : cp_pool_env_nthreads());
+		cp_pool_default_pool = cp_pool_create(nthreads);
+	}
+	pool = cp_pool_default_pool;
+	(void)pthread_mutex_unlock(&cp_pool_default_lock);
+
+	return (pool);
+}
+
+
+int
+cp_pool_default_nthreads(size_t nthreads)
+{
+	int ret = -1;
+
+	(void)pthread_mutex_lock(&cp_pool_default_lock);
+	if (cp_pool_default_pool == NULL) {
+		cp_pool_default_count = nthreads;
+		cp_pool_default_count_set = 1;
+		ret = 0;
+	}
+	(void)pthread_mutex_unlock(&cp_pool_default_lock);
+
+	return (ret);
+}
+
+
+struct cp_pool *
+cp_pool_use(struct cp_pool *pool)
+{
+	struct cp_pool *previous = cp_pool_used;
+
+	cp_pool_used = pool;
+	return (previous);
+}
+
+
+struct cp_group *
+cp_group_new(struct cp_pool *pool)
+{
+	struct cp_group *group = NULL;
+
+	if (pool == NULL)
+		pool = cp_pool_current();
+	if (pool == NULL)
+		return (NULL);
+
+	group = calloc(1, sizeof(struct cp_group));
+	if (group == NULL)
+		return (NULL);
+	group->pool = pool;
+	atomic_init(&group->remaining, 0);
+	atomic_init(&group->cancelled, 0);
+	atomic_init(&group->failed, 0);
+
+	return (group);
+}
+
+
+int
+cp_group_spawn(struct cp_group *group, int (*fn)(void *), void *arg)
+{
+	struct cp_task *task = NULL;
+
+	/* sanity checks */
+	if (group == NULL || fn == NULL)
+		return (-1);
+
+	task = malloc(sizeof(struct cp_task));
+	if (task == NULL)
+		return (-1);
+	task->fn = fn;
+	task->arg = arg;
+	task->group = group;
+
+	/* from a worker of the pool go to its own deque */
+	struct cp_pool *pool = group->pool;
+	struct cp_worker *self = cp_pool_self;
+	struct cp_deque *deque = (self != NULL && self->pool == pool ?
+		    &self->deque : &pool->injected);
+
+	/* account for the task before it can be taken and done */
+	(void)atomic_fetch_add(&group->remaining, 1);
+	(void)atomic_fetch_add(&pool->queued, 1);
+	if (cp_deque_push(deque, task) != 0) {
+		(void)atomic_fetch_sub(&pool->queued, 1);
+		cp_group_done(group);
+		free(task);
+		return (-1);
+	}
+
+	/* wake up an idle thread to run it */
+	(void)pthread_mutex_lock(&pool->lock);
+	(void)pthread_cond_signal(&pool->changed);
+	(void)pthread_mutex_unlock(&pool->lock);
+
+	return (0);
+}
+
+
+void
+cp_group_cancel(struct cp_group *group)
+{
+	if (group != NULL)
+		atomic_store(&group->cancelled, 1);
+}
+
+
+int
+cp_group_cancelled(const struct cp_group *group)
+{
+	return (group != NULL && atomic_load(&group->cancelled));
+}
+
+
+int
+cp_group_wait(struct cp_group *group)
+{
+	/* sanity check */
+	if (group == NULL)
+		return (-1);
+
+	struct cp_pool *pool = group->pool;
+	while (atomic_load(&group->remaining) > 0) {
+		/* help running the pool tasks, ours or not */
+		struct cp_task *task = cp_pool_take(pool);
+		if (task != NULL) {
+			cp_task_run(task);
+			continue;
+		}
+		/* our remaining tasks are all running somewhere else */
+		(void)pthread_mutex_lock(&pool->lock);
+		while (atomic_load(&group->remaining) > 0 &&
+			    atomic_load(&pool->queued) == 0)
+			(void)pthread_cond_wait(&pool->changed, &pool->lock);
+		(void)pthread_mutex_unlock(&pool->lock);
+	}
+
+	if (atomic_load(&group->failed))
+		return (-1);
+	return (atomic_load(&group->cancelled) ? 1 : 0);
+}
+
+
+void
+cp_group_free(struct cp_group *group)
+{
+	if (group == NULL)
+		return;
+	(void)cp_group_wait(group);
+	free(group);
+}
+
+
+int
+cp_parallel_for(struct cp_pool *pool, size_t n, size_t grain,
+		    int (*fn)(size_t, size_t, void *), void *arg)
+{
+	struct cp_parallel_for_job job;
+	int failed = 0;
+
+	/* sanity check */
+	if (fn == NULL)
+		return (-1);
+
+	/* not worth the trouble */
+	if (n == 0)
+		return (0);
+	if (grain > 0 && n <= grain)
+		return (fn(0, n, arg));
+
+	if (pool == NULL)
+		pool = cp_pool_current();
+	if (pool == NULL)
+		return (-1);
+	if (grain == 0) {
+		const size_t nthreads = pool->nthreads;
+		if (nthreads == 1)
+			grain = n;
+		else
+			grain = n / (nthreads * CP_PARALLEL_FOR_SPLIT) + 1;
+	}
+	if (n <= grain)
+		return (fn(0, n, arg));
+
+	(void)memset(&job, 0, sizeof(struct cp_parallel_for_job));
+	job.fn = fn;
+	job.arg = arg;
+	job.n = n;
+	job.grain = grain;
+	const size_t nchunks = n / grain + (n % grain != 0);
+	job.ranges = reallocarray(NULL, nchunks,
+		    sizeof(struct cp_parallel_for_range));
+	if (job.ranges == NULL)
+		return (-1);
+	job.group = cp_group_new(pool);
+	if (job.group == NULL) {
+		free(job.ranges);
+		return (-1);
+	}
+
+	/* the calling thread process the first range, then help the others */
+	atomic_init(&job.nranges, 1);
+	job.ranges[0].job = &job;
+	job.ranges[0].lo = 0;
+	job.ranges[0].hi = nchunks;
+	if (cp_parallel_for_run(&job.ranges[0]) != 0) {
+		cp_group_cancel(job.group);
+		failed = 1;
+	}
+	if (cp_group_wait(job.group) != 0)
+		failed = 1;
+
+	cp_group_free(job.group);
+	free(job.ranges);
+	return (failed ? -1 : 0);
+}
+
+
+static int
+cp_deque_init(struct cp_deque *deque)
+{
+	(void)memset(deque, 0, sizeof(struct cp_deque));
+	deque->tasks = reallocarray(NULL, CP_DEQUE_INITIAL_CAPACITY,
+		    sizeof(struct cp_task *));
+	if (deque->tasks == NULL)
+		return (-1);
+	deque->cap = CP_DEQUE_INITIAL_CAPACITY;
+	if (pthread_mutex_init(&deque->lock, NULL) != 0) {
+		free(deque->tasks);
+		deque->tasks = NULL;
+		return (-1);
+	}
+	return (0);
+}
+
+
+static void
+cp_deque_finalize(struct cp_deque *deque)
+{
+	(void)pthread_mutex_destroy(&deque->lock);
+	free(deque->tasks);
+	deque->tasks = NULL;
+}
+
+
+static int
+cp_deque_push(struct cp_deque *deque, struct cp_task *task)
+{
+	int ret = -1;
+
+	(void)pthread_mutex_lock(&deque->lock);
+	if (deque->len == deque->cap) {
+		/* grow the ring buffer, moving the top task at index 0 */
+		const size_t cap = deque->cap * 2;
+		struct cp_task **tasks = reallocarray(NULL, cap,
+			    sizeof(struct cp_task *));
+		if (tasks == NULL)
+			goto cleanup;
+		for (size_t i = 0; i < deque->len; i++)
+			tasks[i] = deque->tasks[(deque->head + i) % deque->cap];
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->head = 0;
+		deque->cap = cap;
+	}
+	deque->tasks[(deque->head + deque->len) % deque->cap] = task;
+	deque->len += 1;
+
+	ret = 0;
+	/* FALLTHROUGH */
+cleanup:
+	(void)pthread_mutex_unlock(&deque->lock);
+	return (ret);
+}
+
+
+static struct cp_task *
+cp_deque_pop(struct cp_deque *deque, int bottom)
+{
+	struct cp_task *task = NULL;
+
+	(void)pthread_mutex_lock(&deque->lock);
+	if (deque->len > 0) {
+		if (bottom) {
+			const size_t i = deque->head + deque->len - 1;
+			task = deque->tasks[i % deque->cap];
+		} else {
+			task = deque->tasks[deque->head];
+			deque->head = (deque->head + 1) % deque->cap;
+		}
+		deque->len -= 1;
+	}
+	(void)pthread_mutex_unlock(&deque->lock);
+
+	return (task);
+}
+
+
+static struct cp_task *
+cp_pool_take(struct cp_pool *pool)
+{
+	struct cp_worker *self = cp_pool_self;
+	struct cp_task *task = NULL;
+	size_t start = 0;
+
+	if (atomic_load(&pool->queued) == 0)
+		return (NULL);
+
+	if (self != NULL && self->pool == pool) {
+		/* our most recent task, then the oldest injected one */
+		task = cp_deque_pop(&self->deque, /* bottom */1);
+		if (task == NULL)
+			task = cp_deque_pop(&pool->injected, /* bottom */0);
+		start = self->index + 1;
+	} else {
+		/* outside threads treat the injected deque as their own */
+		task = cp_deque_pop(&pool->injected, /* bottom */1);
+	}
+
+	/* steal the oldest task of another worker */
+	const size_t nworkers = pool->ninit;
+	for (size_t i = 0; task == NULL && i < nworkers; i++) {
+		struct cp_worker *victim;
+		victim = &pool->workers[(start + i) % nworkers];
+		if (victim != self)
+			task = cp_deque_pop(&victim->deque, /* bottom */0);
+	}
+
+	if (task != NULL)
+		(void)atomic_fetch_sub(&pool->queued, 1);
+	return (task);
+}
+
+
+static void
+cp_task_run(struct cp_task *task)
+{
+	struct cp_group *group = task->group;
+
+	if (!atomic_load(&group->cancelled)) {
+		if (task->fn(task->arg) != 0) {
+			atomic_store(&group->failed, 1);
+			atomic_store(&group->cancelled, 1);
+		}
+	}
+	free(task);
+	cp_group_done(group);
+}
+
+
+static void
+cp_group_done(struct cp_group *group)
+{
+	/* the group may be freed as soon as its last task is done */
+	struct cp_pool *pool = group->pool;
+
+	if (atomic_fetch_sub(&group->remaining, 1) != 1)
+		return;
+
+	/* wake up the group waiter */
+	(void)pthread_mutex_lock(&pool->lock);
+	(void)pthread_cond_broadcast(&pool->changed);
+	(void)pthread_mutex_unlock(&pool->lock);
+}
+
+
+static void *
+cp_pool_worker(void *arg)
+{
+	struct cp_worker *self = arg;
+	struct cp_pool *pool = self->pool;
+	int shutdown = 0;
+
+	cp_pool_self = self;
+	while (!shutdown) {
+		struct cp_task *task = cp_pool_take(pool);
+		if (task != NULL) {
+			cp_task_run(task);
+			continue;
+		}
+		(void)pthread_mutex_lock(&pool->lock);
+		while (atomic_load(&pool->queued) == 0 && !pool->shutdown)
+			(void)pthread_cond_wait(&pool->changed, &pool->lock);
+		shutdown = pool->shutdown;
+		(void)pthread_mutex_unlock(&pool->lock);
+	}
+
+	return (NULL);
+}
+
+
+static struct cp_pool *
+cp_pool_current(void)
+{
+	return (cp_pool_used != NULL ? cp_pool_used : cp_pool_default());
+}
+
+
+static size_t
+cp_pool_ncpu(void)
+{
+	const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	return (ncpu > 0 ? (size_t)ncpu : 1);
+}
+
+
+static size_t
+cp_pool_env_nthreads(void)
+{
+	const char *s = getenv(CP_POOL_THREADS_ENV);
+	char *end = NULL;
+
+	if (s == NULL || *s < '0' || *s > '9')
+		return (0);
+	errno = 0;
+	const unsigned long x = strtoul(s, &end, 10);
+	if (errno != 0 || *end != '\0')
+		return (0);
+	return ((size_t)x);
+}
+
+
+static int
+cp_parallel_for_run(void *arg)
+{
+	struct cp_parallel_for_range *range = arg;
+	struct cp_parallel_for_job *job = range->job;
+	size_t lo = range->lo, hi = range->hi;
+
+	/* spawn the upper halves, so that thieves take the largest ranges */
+	while (hi - lo > 1) {
+		if (cp_group_cancelled(job->group))
+			return (0);
+		const size_t mid = lo + (hi - lo) / 2;
+		const size_t i = atomic_fetch_add(&job->nranges, 1);
+		struct cp_parallel_for_range *upper = &job->ranges[i];
+		upper->job = job;
+		upper->lo = mid;
+		upper->hi = hi;
+		if (cp_group_spawn(job->group, cp_parallel_for_run, upper) != 0)
+			return (-1);
+		hi = mid;
+	}
+
+	/* process our single chunk, the last one may be shorter */
+	const size_t first = lo * job->grain;
+	size_t len = job->n - first;
+	if (len > job->grain)
+		len = job->grain;
+	return (job->fn(first, first + len, job->arg));
+}
@@ -0,0 +1,149 @@
+#ifndef POOL_H
+#define POOL_H
+/*
+ * pool.h
+ *
+ * Work-stealing thread pool used by the library for everything that can run
+ * on more than one core.
+ *
+ * Pools and groups may be used from any thread, tasks spawning more tasks
+ * included.
+ */
+#include <stddef.h>
+
+
+/*
+ * Environment variable read by cp_pool_default() for its count of threads,
+ * unless cp_pool_default_nthreads() was called first.
+ */
+#define	CP_POOL_THREADS_ENV	"CRYPTOPALS_THREADS"
+
+/*
+ * A pool of threads running tasks. Each worker thread has its own deque of
+ * tasks: the tasks spawned from a worker are pushed to and popped from the
+ * bottom of its deque, while idle workers steal the oldest tasks at the top of
+ * the other deques. Tasks spawned from outside of the pool go to a shared
+ * injection deque.
+ */
+struct cp_pool;
+
+/*
+ * A group of tasks spawned in a pool that can be waited for or cancelled as a
+ * whole.
+ */
+struct cp_group;
+
+
+/*
+ * Create a new pool of nthreads threads. nthreads - 1 worker threads are
+ * started, the last thread being the one waiting on a group (see
+ * cp_group_wait()). Thus, a pool of one thread has no worker at all: every task
+ * is run by the waiting thread in a deterministic order. When nthreads is 0,
+ * one thread per online CPU is used.
+ *
+ * Returns a pointer to a newly allocated pool struct that should be passed to
+ * cp_pool_free(), or NULL on error.
+ */
+struct cp_pool	*cp_pool_create(size_t nthreads);
+
+/*
+ * Returns the count of threads of the given pool, including the waiting
+ * thread, or 0 if pool is NULL.
+ */
+size_t	cp_pool_nthreads(const struct cp_pool *pool);
+
+/*
+ * Stop the worker threads and free the given pool. The pool must not have any
+ * group left.
+ */
+void	cp_pool_free(struct cp_pool *pool);
+
+/*
+ * Returns the pool shared by the whole library, created on the first call. Its
+ * count of threads is the one given to cp_pool_default_nthreads() or else the
+ * one from the CP_POOL_THREADS_ENV environment variable, one per online CPU
+ * when neither is set.
+ *
+ * Returns NULL if the pool could not be created.
+ */
+struct cp_pool	*cp_pool_default(void);
+
+/*
+ * Set the count of threads of the pool returned by cp_pool_default(), 0 meaning
+ * one per online CPU. 1 gives a deterministic single threaded library.
+ *
+ * Returns 0 on success, -1 if the default pool has already been created.
+ */
+int	cp_pool_default_nthreads(size_t nthreads);
+
+/*
+ * Make the calling thread use the given pool wherever the library would use
+ * cp_pool_default(), i.e. for the NULL pool arguments, until it is called
+ * again. NULL restores the default pool. The other threads, the pool workers
+ * included, are not affected.
+ *
+ * Returns the pool previously used by the calling thread, NULL for the default
+ * pool, so that it can be restored.
+ */
+struct cp_pool	*cp_pool_use(struct cp_pool *pool);
+
+/*
+ * Create a new group of tasks in the given pool, the default pool (or the one
+ * given to cp_pool_use()) when NULL.
+ *
+ * Returns a pointer to a newly allocated group struct that should be passed to
+ * cp_group_free(), or NULL on error.
+ */
+struct cp_group	*cp_group_new(struct cp_pool *pool);
+
+/*
+ * Spawn a task calling fn(arg) in the given group. fn may spawn more tasks in
+ * the group (or in any other one), and should return 0 on success or -1 on
+ * error. Failing tasks cancel their group.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	cp_group_spawn(struct cp_group *group, int (*fn)(void *), void *arg);
+
+/*
+ * Cancel the given group: its tasks not yet started will not be run. Tasks
+ * already running are not interrupted but may poll cp_group_cancelled().
+ */
+void	cp_group_cancel(struct cp_group *group);
+
+/*
+ * Returns 1 if the given group has been cancelled, 0 otherwise.
+ */
+int	cp_group_cancelled(const struct cp_group *group);
+
+/*
+ * Wait until every task of the given group is done. The calling thread runs
+ * pending tasks of the pool while waiting.
+ *
+ * Returns 0 when every task succeeded, 1 when the group was cancelled, -1 when
+ * any task failed or on error.
+ */
+int	cp_group_wait(struct cp_group *group);
+
+/*
+ * Free the given group, waiting for its tasks first if needed.
+ */
+void	cp_group_free(struct cp_group *group);
+
+/*
+ * Call fn(lo, hi, arg) on ranges covering [0, n) in the given pool, the
+ * default pool (or the one given to cp_pool_use()) when NULL. The range is
+ * split in halves until they are at most grain long, grain 0 letting
+ * cp_parallel_for() choose a grain from n and the count of threads. When n is
+ * at most grain fn is called directly from the current thread. fn should
+ * return 0 on success or -1 on error, a failed call preventing the remaining
+ * ranges to be processed.
+ *
+ * In a pool of one thread the ranges are processed in ascending order.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	cp_parallel_for(struct cp_pool *pool, size_t n, size_t grain,
+		    int (*fn)(size_t, size_t, void *), void *arg);
+
+#endif /* ndef POOL_H */
@@ -4,6 +4,8 @@
  * rsa.h
  *
  * RSA stuff for cryptopals.com challenges.
+ *
+ * Keys are never modified once generated and may be shared read-only.
  */
 #include <stddef.h>
 #include "bytes.h"
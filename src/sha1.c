@@ -5,15 +5,144 @@
  *
  * See RFC 3174.
  */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #include "compat.h"
 #include "sha1.h"
+#include "pool.h"
+
+
+/*
+ * On x86-64 with GCC and Clang, we provide a compression kernel using the
+ * Intel SHA extensions, used when the CPU supports them.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define	SHA1_SHANI	1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/*
+ * Count of messages hashed at once by sha1_hash_many(). With GCC and Clang we
+ * use vector extensions, the compiler generating the SIMD instructions for the
+ * target. On x86-64 Linux we let GCC build an AVX2 version of the kernel,
+ * choosing it at runtime when supported.
+ */
+#if defined(__GNUC__)
+#define	SHA1_LANES	8
+typedef uint32_t sha1_vec
+		    __attribute__((vector_size(SHA1_LANES * sizeof(uint32_t))));
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__) && \
+	    !defined(__SANITIZE_THREAD__)
+#define	SHA1_TARGETS \
+		    __attribute__((target_clones("avx2", "default")))
+#else
+#define	SHA1_TARGETS
+#endif
+#endif /* defined(__GNUC__) */
+
+/*
+ * Count of messages hashed by each sha1_hash_many_ctx() task, so that only
+ * large batches are spread over the library pool.
+ */
+#define	SHA1_PARALLEL_GRAIN	256
+
+/*
+ * State shared by the sha1_hash_many_ctx() tasks.
+ */
+struct sha1_many_job {
+	const struct sha1_ctx *const *ctxs;
+	const struct bytes *const *msgs;
+	struct bytes **out;
+};
+
+/* Circular left shift operation (§ 3) */
+#define	S(n, word)	(((word) << (n)) | ((word) >> (32 - (n))))
+
+
+/*
+ * Helper processing nblock consecutive 512-bits input message blocks into the
+ * given SHA-1 Intermediate Hash State, dispatching to the fastest compression
+ * kernel available.
+ */
+static void	sha1_process_message_blocks(const uint8_t *blocks,
+		    size_t nblock, uint32_t *H);
+
+/*
+ * Portable compression kernel, see sha1_process_message_blocks().
+ */
+static void	sha1_compress_generic(const uint8_t *blocks, size_t nblock,
+		    uint32_t *H);
+
+/*
+ * Hash the n given messages like sha1_hash_many_ctx() from the current
+ * thread, in lanes when supported.
+ */
+static int	sha1_hash_many_lanes(const struct sha1_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * sha1_hash_many_ctx() cp_parallel_for() routine, hash the messages from lo
+ * to hi (excluded).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	sha1_hash_many_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Returns the SHA-1 Hash of msg resumed from a copy of ctx, or from scratch
+ * when ctx is NULL. Used by sha1_hash_many_ctx() for the messages not hashed
+ * in lanes.
+ */
+static struct bytes	*sha1_hash_resume(const struct sha1_ctx *ctx,
+		    const struct bytes *msg);
 
+/*
+ * Write the last (msglen % 64) bytes of the message ending at data followed by
+ * its padding into tail. prefixlen is the count of bytes hashed before the
+ * message, accounted in the encoded length.
+ *
+ * Returns the count of 64 bytes blocks written, either 1 or 2.
+ */
+static size_t	sha1_padding_tail(const uint8_t *data, uint64_t msglen,
+		    uint64_t prefixlen, uint8_t *tail);
 
+#if defined(SHA1_LANES)
 /*
- * Helper processing one 512-bits input message block into the given SHA-1
- * Intermediate Hash State.
+ * Process one 512-bits input message block per lane, blocks[i] being the block
+ * of the lane i and state[j][i] the word j of its Intermediate Hash State.
  */
-static void	sha1_process_message_block(const uint8_t *block, uint32_t *H);
+static void	sha1_compress_lanes(uint32_t state[5][SHA1_LANES],
+		    const uint8_t *const *blocks);
+#endif
+
+#if defined(SHA1_SHANI)
+/*
+ * Set sha1_shani when the CPU supports the SHA extensions.
+ */
+static void	sha1_shani_detect(void);
+
+/*
+ * SHA extensions compression kernel, see sha1_process_message_blocks().
+ */
+static void	sha1_compress_shani(const uint8_t *blocks, size_t nblock,
+		    uint32_t *H);
+
+static int		sha1_shani = 0;
+static pthread_once_t	sha1_shani_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* set by sha1_force_generic() */
+static atomic_int	sha1_generic = 0;
+
+
+/* SHA-1 initial Intermediate Hash State (§ 6.1) */
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+};
 
 
 size_t
@@ -34,28 +163,25 @@ sha1_blocksize(void)
 struct bytes *
 sha1_hash(const struct bytes *msg)
 {
+	struct sha1_ctx ctx;
 	struct bytes *digest = NULL;
 	int success = 0;
 
-	/* default initial SHA-1 Intermediate Hash State */
-	struct sha1_ctx ctx = {
-		.len = 0,
-		.state = {
-			0x67452301,
-			0xEFCDAB89,
-			0x98BADCFE,
-			0x10325476,
-			0xC3D2E1F0,
-		},
-	};
-
-	if (sha1_hash_ctx(&ctx, msg) != 0)
+	/* sanity check */
+	if (msg == NULL)
 		goto cleanup;
 
-	digest = bytes_from_uint32_be(ctx.state, 5);
+	digest = bytes_zeroed(sha1_hashlength());
 	if (digest == NULL)
 		goto cleanup;
 
+	if (sha1_init(&ctx) != 0)
+		goto cleanup;
+	if (sha1_update(&ctx, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (sha1_final(&ctx, digest->data) != 0)
+		goto cleanup;
+
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
@@ -69,146 +195,634 @@ cleanup:
 
 
 int
-sha1_hash_ctx(struct sha1_ctx *ctx, const struct bytes *msg)
+sha1_init(struct sha1_ctx *ctx)
+{
+	/* sanity check */
+	if (ctx == NULL)
+		return (-1);
+
+	/* default initial SHA-1 Intermediate Hash State */
+	ctx->len = 0;
+	(void)memcpy(ctx->state, sha1_iv, sizeof(ctx->state));
+
+	return (0);
+}
+
+
+int
+sha1_update(struct sha1_ctx *ctx, const uint8_t *data, size_t len)
 {
 	/* max total message length, in byte */
 	const uint64_t maxlen = UINT64_MAX / 8;
 	const size_t blocksize = sha1_blocksize();
-	struct bytes *block = NULL;
-	int success = 0;
 
 	/* sanity checks */
-	if (ctx == NULL)
-		goto cleanup;
-	if (ctx->len > maxlen)
-		goto cleanup;
-	if (msg == NULL || msg->len > (maxlen - ctx->len))
-		goto cleanup;
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+	if ((data == NULL && len > 0) || len > (maxlen - ctx->len))
+		return (-1);
 
-	uint32_t *H = ctx->state;
+	/* count of message bytes already in the buffered block */
+	size_t buffered = ctx->len % blocksize;
+	ctx->len += len;
 
-	/* process each "complete" message block */
-	const size_t nblock = msg->len / blocksize;
-	for (size_t i = 0; i < nblock; i++)
-		sha1_process_message_block(msg->data + blocksize * i, H);
-	ctx->len += msg->len;
+	/* complete the buffered block first, if any */
+	if (buffered > 0) {
+		const size_t fill = blocksize - buffered;
+		if (len < fill) {
+			(void)memcpy(ctx->block + buffered, data, len);
+			return (0);
+		}
+		(void)memcpy(ctx->block + buffered, data, fill);
+		sha1_process_message_blocks(ctx->block, 1, ctx->state);
+		data += fill;
+		len  -= fill;
+	}
+
+	/* process each "complete" message block straight from data */
+	const size_t nblock = len / blocksize;
+	if (nblock > 0) {
+		sha1_process_message_blocks(data, nblock, ctx->state);
+		data += nblock * blocksize;
+		len  -= nblock * blocksize;
+	}
+
+	/* buffer what is left for the next call */
+	if (len > 0)
+		(void)memcpy(ctx->block, data, len);
+
+	return (0);
+}
+
+
+int
+sha1_final(struct sha1_ctx *ctx, uint8_t *digest)
+{
+	/* max total message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+	const size_t blocksize = sha1_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+
+	uint32_t *H = ctx->state;
+	uint8_t *block = ctx->block;
 
-	/* the padded block */
-	block = bytes_zeroed(blocksize);
-	if (block == NULL)
-		goto cleanup;
 	/* count of message bytes in the padded block */
-	const size_t restlen = msg->len % blocksize;
-	/* copy what is left of the message to process into the padded block */
-	if (bytes_sput(block, 0, msg, blocksize * nblock, restlen) != 0)
-		goto cleanup;
+	const size_t restlen = ctx->len % blocksize;
 	/* Add the first padding bytes, a `1' bit followed by zeroes */
-	block->data[restlen] = 0x80;
+	block[restlen] = 0x80;
+	(void)memset(block + restlen + 1, 0, blocksize - restlen - 1);
 	if (restlen >= 56) {
 		/* We don't have enough space in the padding block to fit the
 		   0x80 byte and the 64-bits length, So we process the padded
 		   block as-is (i.e. without the length) */
-		sha1_process_message_block(block->data, H);
+		sha1_process_message_blocks(block, 1, H);
 		/* reset the padding block, the length will be set in the last 8
 		   bytes and it will be processed as the second padding block */
-		bytes_bzero(block);
+		(void)memset(block, 0, blocksize);
 	}
 
 	/* set the 64-bits message length (count of bits) in the last 8 bytes of
 	   the padded block, most significant byte first */
 	const uint64_t nbits = 8 * ctx->len;
-	block->data[56] = nbits >> 56;
-	block->data[57] = nbits >> 48;
-	block->data[58] = nbits >> 40;
-	block->data[59] = nbits >> 32;
-	block->data[60] = nbits >> 24;
-	block->data[61] = nbits >> 16;
-	block->data[62] = nbits >>  8;
-	block->data[63] = nbits >>  0;
+	block[56] = nbits >> 56;
+	block[57] = nbits >> 48;
+	block[58] = nbits >> 40;
+	block[59] = nbits >> 32;
+	block[60] = nbits >> 24;
+	block[61] = nbits >> 16;
+	block[62] = nbits >>  8;
+	block[63] = nbits >>  0;
 
 	/* process the last padding block */
-	sha1_process_message_block(block->data, H);
+	sha1_process_message_blocks(block, 1, H);
+	explicit_bzero(block, blocksize);
+
+	/* output the hash, most significant byte of each word first */
+	if (digest != NULL) {
+		for (size_t i = 0; i < 5; i++) {
+			digest[4 * i + 0] = H[i] >> 24;
+			digest[4 * i + 1] = H[i] >> 16;
+			digest[4 * i + 2] = H[i] >>  8;
+			digest[4 * i + 3] = H[i] >>  0;
+		}
+	}
+
+	return (0);
+}
+
+
+int
+sha1_hash_ctx(struct sha1_ctx *ctx, const struct bytes *msg)
+{
+	/* sanity check */
+	if (msg == NULL)
+		return (-1);
+
+	if (sha1_update(ctx, msg->data, msg->len) != 0)
+		return (-1);
+	return (sha1_final(ctx, NULL));
+}
+
+
+int
+sha1_hash_many(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	return (sha1_hash_many_ctx(NULL, msgs, n, out));
+}
+
+
+int
+sha1_hash_many_ctx(const struct sha1_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	struct sha1_many_job job;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	/* large batches are hashed concurrently */
+	job.ctxs = ctxs;
+	job.msgs = msgs;
+	job.out = out;
+	if (cp_parallel_for(NULL, n, SHA1_PARALLEL_GRAIN,
+		    sha1_hash_many_range, &job) != 0) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
+
+static int
+sha1_hash_many_range(size_t lo, size_t hi, void *arg)
+{
+	const struct sha1_many_job *job = arg;
+
+	return (sha1_hash_many_lanes(job->ctxs == NULL ? NULL :
+		    job->ctxs + lo, job->msgs + lo, hi - lo, job->out + lo));
+}
+
+
+static int
+sha1_hash_many_lanes(const struct sha1_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	/* max message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+#if defined(SHA1_LANES)
+	const size_t blocksize = sha1_blocksize();
+	/* each lane progress, index being n when the lane is idle */
+	struct {
+		size_t index;
+		size_t block;
+		size_t nblock;
+		size_t ntail;
+		uint8_t tail[2 * 64];
+	} lanes[SHA1_LANES];
+	uint32_t state[5][SHA1_LANES];
+	const uint8_t *blocks[SHA1_LANES];
+	static const uint8_t idle[64] = { 0 };
+	size_t next = 0, active = 0;
+#endif
+	int success = 0;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+	for (size_t i = 0; i < n; i++) {
+		if (msgs[i] == NULL || msgs[i]->len > maxlen)
+			goto cleanup;
+		if (ctxs == NULL)
+			continue;
+		/* resumed contexts must not have buffered bytes */
+		if (ctxs[i] == NULL || (ctxs[i]->len % sha1_blocksize()) != 0)
+			goto cleanup;
+		if (ctxs[i]->len > maxlen - msgs[i]->len)
+			goto cleanup;
+	}
+
+#if defined(SHA1_LANES)
+	for (size_t lane = 0; lane < SHA1_LANES; lane++)
+		lanes[lane].index = n;
+
+	for (;;) {
+		/* start hashing the next messages in the idle lanes */
+		for (size_t lane = 0; lane < SHA1_LANES && next < n; lane++) {
+			if (lanes[lane].index != n)
+				continue;
+			const struct bytes *msg = msgs[next];
+			lanes[lane].index = next++;
+			lanes[lane].block = 0;
+			const struct sha1_ctx *ctx = (ctxs == NULL ? NULL :
+				    ctxs[lanes[lane].index]);
+			lanes[lane].ntail = sha1_padding_tail(msg->data,
+				    msg->len, (ctx == NULL ? 0 : ctx->len),
+				    lanes[lane].tail);
+			lanes[lane].nblock = msg->len / blocksize +
+				    lanes[lane].ntail;
+			for (size_t j = 0; j < 5; j++) {
+				state[j][lane] = (ctx == NULL ? sha1_iv[j] :
+					    ctx->state[j]);
+			}
+			active++;
+		}
+		if (active == 0)
+			break;
+
+		/* the next block of each lane, message then padding */
+		for (size_t lane = 0; lane < SHA1_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n) {
+				blocks[lane] = idle;
+				continue;
+			}
+			const size_t block = lanes[lane].block;
+			const size_t nfull = lanes[lane].nblock -
+				    lanes[lane].ntail;
+			if (block < nfull) {
+				blocks[lane] = msgs[index]->data +
+					    block * blocksize;
+			} else {
+				blocks[lane] = lanes[lane].tail +
+					    (block - nfull) * blocksize;
+			}
+		}
+		sha1_compress_lanes(state, blocks);
+
+		/* output the hash of the messages done */
+		for (size_t lane = 0; lane < SHA1_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n)
+				continue;
+			if (++lanes[lane].block < lanes[lane].nblock)
+				continue;
+			struct bytes *digest = bytes_zeroed(sha1_hashlength());
+			if (digest == NULL)
+				goto cleanup;
+			for (size_t j = 0; j < 5; j++) {
+				digest->data[4 * j + 0] = state[j][lane] >> 24;
+				digest->data[4 * j + 1] = state[j][lane] >> 16;
+				digest->data[4 * j + 2] = state[j][lane] >>  8;
+				digest->data[4 * j + 3] = state[j][lane] >>  0;
+			}
+			out[index] = digest;
+			lanes[lane].index = n;
+			active--;
+		}
+	}
+#endif
+	/* the messages not hashed in the lanes, one at a time */
+	for (size_t i = 0; i < n; i++) {
+		if (out[i] != NULL)
+			continue;
+		out[i] = sha1_hash_resume(ctxs == NULL ? NULL : ctxs[i],
+			    msgs[i]);
+		if (out[i] == NULL)
+			goto cleanup;
+	}
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(block);
+#if defined(SHA1_LANES)
+	explicit_bzero(lanes, sizeof(lanes));
+	explicit_bzero(state, sizeof(state));
+#endif
+	if (!success) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+	}
 	return (success ? 0 : -1);
 }
 
 
+int
+sha1_force_generic(int force)
+{
+	return (atomic_exchange(&sha1_generic, force != 0));
+}
+
+
 static void
-sha1_process_message_block(const uint8_t *block, uint32_t *H)
-#define	S(n, word)	(((word) << (n)) | ((word) >> (32 - (n))))
+sha1_process_message_blocks(const uint8_t *blocks, size_t nblock, uint32_t *H)
+{
+#if defined(SHA1_SHANI)
+	(void)pthread_once(&sha1_shani_once, sha1_shani_detect);
+	if (sha1_shani && !atomic_load(&sha1_generic)) {
+		sha1_compress_shani(blocks, nblock, H);
+		return;
+	}
+#endif
+	sha1_compress_generic(blocks, nblock, H);
+}
+
+
+/* f(t;B,C,D) for each 20 rounds step (§ 5), in their branch-free forms */
+#define	F0(b, c, d)	((d) ^ ((b) & ((c) ^ (d))))
+#define	F1(b, c, d)	((b) ^ (c) ^ (d))
+#define	F2(b, c, d)	(((b) & (c)) | ((d) & ((b) | (c))))
+#define	F3(b, c, d)	F1(b, c, d)
+
+/* K(t) for each 20 rounds step (§ 5) */
+#define	K0	0x5A827999
+#define	K1	0x6ED9EBA1
+#define	K2	0x8F1BBCDC
+#define	K3	0xCA62C1D6
+
+/*
+ * One round (§ 6.1 d.), the variables are renamed by the caller instead of
+ * being moved around.
+ */
+#define	ROUND(f, k, a, b, c, d, e, w) do {			\
+		(e) += S(5, (a)) + f((b), (c), (d)) + (w) + (k); \
+		(b)  = S(30, (b));				\
+	} while (/* CONSTCOND */0)
+
+/* Five rounds starting at t, after which the variables are back in place. */
+#define	ROUND5(f, k, t) do {					\
+		ROUND(f, k, A, B, C, D, E, W[(t) + 0]);		\
+		ROUND(f, k, E, A, B, C, D, W[(t) + 1]);		\
+		ROUND(f, k, D, E, A, B, C, W[(t) + 2]);		\
+		ROUND(f, k, C, D, E, A, B, W[(t) + 3]);		\
+		ROUND(f, k, B, C, D, E, A, W[(t) + 4]);		\
+	} while (/* CONSTCOND */0)
+
+static void
+sha1_compress_generic(const uint8_t *blocks, size_t nblock, uint32_t *H)
 {
 	uint32_t W[80];
 
-	/*
-	 * a. Divide M(i) into 16 words W(0), W(1), ... , W(15), where W(0) is
-	 * the left-most word.
-	 */
-	for (size_t t = 0, i = 0; t < 16; t++, i += 4) {
-		const uint32_t hh = block[i + 0];
-		const uint32_t hl = block[i + 1];
-		const uint32_t lh = block[i + 2];
-		const uint32_t ll = block[i + 3];
-		W[t] = (hh << 24) | (hl << 16) | (lh << 8) | ll;
-	}
-
-	/*
-	 * b. For t = 16 to 79 let
-	 *        W(t) = S^1(W(t-3) XOR W(t-8) XOR W(t-14) XOR W(t-16)).
-	 */
+	for (; nblock > 0; nblock--, blocks += 64) {
+		/*
+		 * a. Divide M(i) into 16 words W(0), W(1), ... , W(15), where
+		 * W(0) is the left-most word.
+		 */
+		for (size_t t = 0, i = 0; t < 16; t++, i += 4) {
+			const uint32_t hh = blocks[i + 0];
+			const uint32_t hl = blocks[i + 1];
+			const uint32_t lh = blocks[i + 2];
+			const uint32_t ll = blocks[i + 3];
+			W[t] = (hh << 24) | (hl << 16) | (lh << 8) | ll;
+		}
+
+		/*
+		 * b. For t = 16 to 79 let
+		 *        W(t) = S^1(W(t-3) XOR W(t-8) XOR W(t-14) XOR W(t-16)).
+		 */
+		for (size_t t = 16; t < 80; t++) {
+			W[t] = S(1, W[t - 3] ^ W[t - 8] ^ W[t - 14] ^
+				    W[t - 16]);
+		}
+
+		/*
+		 * c. Let A = H0, B = H1, C = H2, D = H3, E = H4.
+		 */
+		uint32_t A = H[0];
+		uint32_t B = H[1];
+		uint32_t C = H[2];
+		uint32_t D = H[3];
+		uint32_t E = H[4];
+
+		/*
+		 * d. For t = 0 to 79 do
+		 *        TEMP = S^5(A) + f(t;B,C,D) + E + W(t) + K(t);
+		 *        E = D;  D = C;  C = S^30(B);  B = A; A = TEMP;
+		 */
+		ROUND5(F0, K0,  0); ROUND5(F0, K0,  5);
+		ROUND5(F0, K0, 10); ROUND5(F0, K0, 15);
+		ROUND5(F1, K1, 20); ROUND5(F1, K1, 25);
+		ROUND5(F1, K1, 30); ROUND5(F1, K1, 35);
+		ROUND5(F2, K2, 40); ROUND5(F2, K2, 45);
+		ROUND5(F2, K2, 50); ROUND5(F2, K2, 55);
+		ROUND5(F3, K3, 60); ROUND5(F3, K3, 65);
+		ROUND5(F3, K3, 70); ROUND5(F3, K3, 75);
+
+		/*
+		 * e. Let H0 = H0 + A, H1 = H1 + B, H2 = H2 + C, H3 = H3 + D,
+		 *    H4 = H4 + E.
+		 */
+		H[0] += A;
+		H[1] += B;
+		H[2] += C;
+		H[3] += D;
+		H[4] += E;
+	}
+
+	explicit_bzero(W, sizeof(W));
+}
+
+
+static struct bytes *
+sha1_hash_resume(const struct sha1_ctx *ctx, const struct bytes *msg)
+{
+	struct sha1_ctx copy;
+	struct bytes *digest = NULL;
+	int success = 0;
+
+	if (ctx == NULL) {
+		if (sha1_init(&copy) != 0)
+			goto cleanup;
+	} else {
+		copy = *ctx;
+	}
+
+	digest = bytes_zeroed(sha1_hashlength());
+	if (digest == NULL)
+		goto cleanup;
+	if (sha1_update(&copy, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (sha1_final(&copy, digest->data) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(&copy, sizeof(struct sha1_ctx));
+	if (!success) {
+		bytes_free(digest);
+		digest = NULL;
+	}
+	return (digest);
+}
+
+
+static size_t
+sha1_padding_tail(const uint8_t *data, uint64_t msglen, uint64_t prefixlen,
+		    uint8_t *tail)
+{
+	const size_t blocksize = sha1_blocksize();
+	/* count of message bytes in the padded block */
+	const size_t restlen = msglen % blocksize;
+	const size_t ntail = (restlen >= 56 ? 2 : 1);
+
+	(void)memcpy(tail, data + (msglen - restlen), restlen);
+	/* a `1' bit followed by zeroes, then the 64-bits message length */
+	tail[restlen] = 0x80;
+	(void)memset(tail + restlen + 1, 0, ntail * blocksize - restlen - 1);
+	const uint64_t nbits = 8 * (prefixlen + msglen);
+	uint8_t *length = tail + ntail * blocksize - 8;
+	for (size_t i = 0; i < 8; i++)
+		length[i] = nbits >> (56 - 8 * i);
+
+	return (ntail);
+}
+
+#if defined(SHA1_LANES)
+SHA1_TARGETS
+static void
+sha1_compress_lanes(uint32_t state[5][SHA1_LANES], const uint8_t *const *blocks)
+{
+	/* see sha1_compress_generic(), each lane is a message */
+	sha1_vec W[80];
+	sha1_vec A, B, C, D, E;
+
+	for (size_t t = 0; t < 16; t++) {
+		for (size_t lane = 0; lane < SHA1_LANES; lane++) {
+			const uint8_t *word = blocks[lane] + 4 * t;
+			W[t][lane] = ((uint32_t)word[0] << 24) |
+				    ((uint32_t)word[1] << 16) |
+				    ((uint32_t)word[2] <<  8) | word[3];
+		}
+	}
 	for (size_t t = 16; t < 80; t++)
 		W[t] = S(1, W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16]);
 
-	/*
-	 * c. Let A = H0, B = H1, C = H2, D = H3, E = H4.
-	 */
-	uint32_t A = H[0];
-	uint32_t B = H[1];
-	uint32_t C = H[2];
-	uint32_t D = H[3];
-	uint32_t E = H[4];
-
-	/*
-	 * d. For t = 0 to 79 do
-	 *        TEMP = S^5(A) + f(t;B,C,D) + E + W(t) + K(t);
-	 *        E = D;  D = C;  C = S^30(B);  B = A; A = TEMP;
-	 */
-	for (size_t t = 0; t < 80; t++) {
-		uint32_t f, k;
-		if (t < 20) {
-			f = ((B & C) | ((~B) & D));
-			k = 0x5A827999;
-		} else if (t < 40) {
-			f = (B ^ C ^ D);
-			k = 0x6ED9EBA1;
-		} else if (t < 60) {
-			f = ((B & C) | (B & D) | (C & D));
-			k = 0x8F1BBCDC;
-		} else {
-			f = (B ^ C ^ D);
-			k = 0xCA62C1D6;
-		}
-		uint32_t temp = S(5, A) + f + E + W[t] + k;
-		E = D;
-		D = C;
-		C = S(30, B);
-		B = A;
-		A = temp;
-	}
-
-	/*
-	 * e. Let H0 = H0 + A, H1 = H1 + B, H2 = H2 + C, H3 = H3 + D, H4 = H4
-	 *    + E.
-	 */
-	H[0] += A;
-	H[1] += B;
-	H[2] += C;
-	H[3] += D;
-	H[4] += E;
+	(void)memcpy(&A, state[0], sizeof(sha1_vec));
+	(void)memcpy(&B, state[1], sizeof(sha1_vec));
+	(void)memcpy(&C, state[2], sizeof(sha1_vec));
+	(void)memcpy(&D, state[3], sizeof(sha1_vec));
+	(void)memcpy(&E, state[4], sizeof(sha1_vec));
+
+	ROUND5(F0, K0,  0); ROUND5(F0, K0,  5);
+	ROUND5(F0, K0, 10); ROUND5(F0, K0, 15);
+	ROUND5(F1, K1, 20); ROUND5(F1, K1, 25);
+	ROUND5(F1, K1, 30); ROUND5(F1, K1, 35);
+	ROUND5(F2, K2, 40); ROUND5(F2, K2, 45);
+	ROUND5(F2, K2, 50); ROUND5(F2, K2, 55);
+	ROUND5(F3, K3, 60); ROUND5(F3, K3, 65);
+	ROUND5(F3, K3, 70); ROUND5(F3, K3, 75);
+
+	for (size_t lane = 0; lane < SHA1_LANES; lane++) {
+		state[0][lane] += A[lane];
+		state[1][lane] += B[lane];
+		state[2][lane] += C[lane];
+		state[3][lane] += D[lane];
+		state[4][lane] += E[lane];
+	}
 
 	explicit_bzero(W, sizeof(W));
 }
-#undef	S
+#endif /* defined(SHA1_LANES) */
+
+
+#if defined(SHA1_SHANI)
+static void
+sha1_shani_detect(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* the kernel needs SSSE3 and SSE4.1 along the SHA extensions */
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+		return;
+	if ((ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+		return;
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+		return;
+	sha1_shani = ((ebx & bit_SHA) != 0);
+}
+
+
+/*
+ * Rounds 4g to 4g+3, where m0 holds W(4g) to W(4g+3) and m1, m2, m3 the
+ * following message words being scheduled. ea is the E value (i.e. the
+ * previous A rotated) for these rounds, eb saves A for the next ones.
+ */
+#define	SHANI_ROUND4(g, ea, eb, m0, m1, m2, m3) do {		\
+		(ea) = _mm_sha1nexte_epu32((ea), (m0));		\
+		(eb) = ABCD;					\
+		if ((g) >= 3 && (g) <= 18)			\
+			(m1) = _mm_sha1msg2_epu32((m1), (m0));	\
+		ABCD = _mm_sha1rnds4_epu32(ABCD, (ea), (g) / 5); \
+		if ((g) >= 1 && (g) <= 16)			\
+			(m3) = _mm_sha1msg1_epu32((m3), (m0));	\
+		if ((g) >= 2 && (g) <= 17)			\
+			(m2) = _mm_xor_si128((m2), (m0));	\
+	} while (/* CONSTCOND */0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha1_compress_shani(const uint8_t *blocks, size_t nblock, uint32_t *H)
+{
+	/* reverse the bytes order of the message, SHA-1 being big-endian */
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+		    0x08090a0b0c0d0e0fULL);
+	__m128i ABCD, E0, E1, M0, M1, M2, M3;
+
+	ABCD = _mm_loadu_si128((const __m128i *)H);
+	ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+	E0 = _mm_set_epi32((int)H[4], 0, 0, 0);
+
+	for (; nblock > 0; nblock--, blocks += 64) {
+		const __m128i ABCD_SAVE = ABCD, E0_SAVE = E0;
+
+		M0 = _mm_loadu_si128((const __m128i *)(blocks +  0));
+		M1 = _mm_loadu_si128((const __m128i *)(blocks + 16));
+		M2 = _mm_loadu_si128((const __m128i *)(blocks + 32));
+		M3 = _mm_loadu_si128((const __m128i *)(blocks + 48));
+		M0 = _mm_shuffle_epi8(M0, mask);
+		M1 = _mm_shuffle_epi8(M1, mask);
+		M2 = _mm_shuffle_epi8(M2, mask);
+		M3 = _mm_shuffle_epi8(M3, mask);
+
+		/* rounds 0 to 3, E is added to the message words directly */
+		E0 = _mm_add_epi32(E0, M0);
+		E1 = ABCD;
+		ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+		SHANI_ROUND4( 1, E1, E0, M1, M2, M3, M0);
+		SHANI_ROUND4( 2, E0, E1, M2, M3, M0, M1);
+		SHANI_ROUND4( 3, E1, E0, M3, M0, M1, M2);
+		SHANI_ROUND4( 4, E0, E1, M0, M1, M2, M3);
+		SHANI_ROUND4( 5, E1, E0, M1, M2, M3, M0);
+		SHANI_ROUND4( 6, E0, E1, M2, M3, M0, M1);
+		SHANI_ROUND4( 7, E1, E0, M3, M0, M1, M2);
+		SHANI_ROUND4( 8, E0, E1, M0, M1, M2, M3);
+		SHANI_ROUND4( 9, E1, E0, M1, M2, M3, M0);
+		SHANI_ROUND4(10, E0, E1, M2, M3, M0, M1);
+		SHANI_ROUND4(11, E1, E0, M3, M0, M1, M2);
+		SHANI_ROUND4(12, E0, E1, M0, M1, M2, M3);
+		SHANI_ROUND4(13, E1, E0, M1, M2, M3, M0);
+		SHANI_ROUND4(14, E0, E1, M2, M3, M0, M1);
+		SHANI_ROUND4(15, E1, E0, M3, M0, M1, M2);
+		SHANI_ROUND4(16, E0, E1, M0, M1, M2, M3);
+		SHANI_ROUND4(17, E1, E0, M1, M2, M3, M0);
+		SHANI_ROUND4(18, E0, E1, M2, M3, M0, M1);
+		SHANI_ROUND4(19, E1, E0, M3, M0, M1, M2);
+
+		/* add the saved state, E being derived from the last A */
+		E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+		ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+	}
+
+	ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+	_mm_storeu_si128((__m128i *)H, ABCD);
+	H[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+}
+#endif /* defined(SHA1_SHANI) */
@@ -6,6 +6,9 @@
  * SHA-1 stuff for cryptopals.com challenges.
  *
  * See RFC 3174.
+ *
+ * The SHA-NI support is detected once per process under pthread_once(3). A
+ * context belongs to its caller.
  */
 #include "bytes.h"
 
@@ -16,6 +19,8 @@ struct sha1_ctx {
 	uint64_t len;
 	/* SHA-1 Intermediate Hash State */
 	uint32_t state[5];
+	/* buffered message bytes, the last (len % 64) of them */
+	uint8_t block[64];
 };
 
 
@@ -36,15 +41,81 @@ size_t	sha1_blocksize(void);
  */
 struct bytes	*sha1_hash(const struct bytes *msg);
 
+/*
+ * Compute the SHA-1 Hash of each of the n given messages, storing the hash of
+ * msgs[i] into out[i] which must be passed to bytes_free() by the caller.
+ *
+ * When the compiler and CPU support it, the messages are hashed in parallel
+ * SIMD lanes (eight with AVX2, two times four with SSE2 on x86-64). This is
+ * faster than n calls to sha1_hash() for many short messages, even when the
+ * CPU has the SHA extensions.
+ *
+ * Returns 0 on success, -1 on error (out is then set to NULL pointers).
+ */
+int	sha1_hash_many(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * Initialize the given SHA-1 context to hash a new message using
+ * sha1_update() and sha1_final().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	sha1_init(struct sha1_ctx *ctx);
+
+/*
+ * Hash the next len bytes of data of the message using the given SHA-1
+ * context. Complete blocks are processed straight from data and what is left
+ * is buffered into the context, so that this function never allocates.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	sha1_update(struct sha1_ctx *ctx, const uint8_t *data, size_t len);
+
+/*
+ * Process the padding of the message hashed using the given SHA-1 context
+ * and write the resulting hash (20 bytes) into digest if it is not NULL.
+ *
+ * ctx->state is left holding the resulting hash and ctx must be initialized
+ * again before hashing another message.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int	sha1_final(struct sha1_ctx *ctx, uint8_t *digest);
+
 /*
  * Compute the SHA-1 Hash of the given message starting from the given SHA-1
  * context. Useful to perform SHA-1 length extension.
  *
  * Unlike the SHA1Input() function from the RFC, this function will compute and
- * process the padding of msg.
+ * process the padding of msg: it is sha1_update() followed by sha1_final().
+ * To resume from a known hash, set ctx->state to it and ctx->len to the
+ * (multiple of sha1_blocksize()) count of bytes it was computed over.
  *
  * Returns 0 on success, -1 on error.
  */
 int	sha1_hash_ctx(struct sha1_ctx *ctx, const struct bytes *msg);
 
+/*
+ * Like sha1_hash_many(), but the hash of msgs[i] is resumed from the SHA-1
+ * context ctxs[i] instead of starting from scratch: out[i] is what
+ * sha1_hash_ctx() would compute from a copy of ctxs[i]. The contexts must not
+ * have buffered bytes, i.e. their len is a multiple of sha1_blocksize(), and
+ * are left untouched. Useful to perform many length extensions at once.
+ *
+ * Returns 0 on success, -1 on error (out is then set to NULL pointers).
+ */
+int	sha1_hash_many_ctx(const struct sha1_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * Make the SHA-1 functions use the portable compression kernel even when the
+ * CPU has the SHA extensions if force is non-zero, or the fastest kernel
+ * available again otherwise. Useful to test both kernels on the same machine.
+ *
+ * Returns the previous setting.
+ */
+int	sha1_force_generic(int force);
+
 #endif /* ndef SHA1_H */
@@ -5,8 +5,65 @@
  *
  * See RFC 6234.
  */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #include "compat.h"
 #include "sha256.h"
+#include "pool.h"
+
+
+/*
+ * On x86-64 with GCC and Clang, we provide a compression kernel using the
+ * Intel SHA extensions, used when the CPU supports them.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define	SHA256_SHANI	1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/*
+ * Count of messages hashed at once by sha256_hash_many(). With GCC and Clang
+ * we use vector extensions, the compiler generating the SIMD instructions for
+ * the target. On x86-64 Linux we let GCC build an AVX2 version of the kernel,
+ * choosing it at runtime when supported.
+ */
+#if defined(__GNUC__)
+#define	SHA256_LANES	8
+#define	SHA256_VECSIZE	(SHA256_LANES * sizeof(uint32_t))
+typedef uint32_t sha256_vec __attribute__((vector_size(SHA256_VECSIZE)));
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__) && \
+	    !defined(__SANITIZE_THREAD__)
+#define	SHA256_TARGETS \
+		    __attribute__((target_clones("avx2", "default")))
+#else
+#define	SHA256_TARGETS
+#endif
+#endif /* defined(__GNUC__) */
+
+/*
+ * Count of messages hashed by each sha256_hash_many_ctx() task, so that only
+ * large batches are spread over the library pool.
+ */
+#define	SHA256_PARALLEL_GRAIN	256
+
+/*
+ * State shared by the sha256_hash_many_ctx() tasks.
+ */
+struct sha256_many_job {
+	const struct sha256_ctx *const *ctxs;
+	const struct bytes *const *msgs;
+	struct bytes **out;
+};
+
+/*
+ * The SHA extensions kernel beats the SIMD lanes for messages needing more than
+ * two blocks, so when it is available sha256_hash_many() leaves the longer
+ * messages to sha256_hash().
+ */
+#define	SHA256_SHANI_LANES_MAXLEN	(2 * 64 - 9)
 
 
 /* Rotate right and rotate left  operations (§ 3) */
@@ -23,11 +80,87 @@
 
 
 /*
- * Helper processing one 512-bits input message block into the given SHA-256
- * Intermediate Hash State.
+ * Helper processing nblock consecutive 512-bits input message blocks into the
+ * given SHA-256 Intermediate Hash State, dispatching to the fastest
+ * compression kernel available.
+ */
+static void	sha256_process_message_blocks(const uint8_t *blocks,
+		    size_t nblock, uint32_t *H);
+
+/*
+ * Portable compression kernel, see sha256_process_message_blocks().
  */
-static void	sha256_process_message_block(const uint8_t *block, uint32_t *H);
+static void	sha256_compress_generic(const uint8_t *blocks, size_t nblock,
+		    uint32_t *H);
 
+/*
+ * Hash the n given messages like sha256_hash_many_ctx() from the current
+ * thread, in lanes when supported.
+ */
+static int	sha256_hash_many_lanes(const struct sha256_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out);
+
+/*
+ * sha256_hash_many_ctx() cp_parallel_for() routine, hash the messages from lo
+ * to hi (excluded).
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	sha256_hash_many_range(size_t lo, size_t hi, void *arg);
+
+/*
+ * Returns the SHA-256 Hash of msg resumed from a copy of ctx, or from scratch
+ * when ctx is NULL. Used by sha256_hash_many_ctx() for the messages not hashed
+ * in lanes.
+ */
+static struct bytes	*sha256_hash_resume(const struct sha256_ctx *ctx,
+		    const struct bytes *msg);
+
+/*
+ * Write the last (msglen % 64) bytes of the message ending at data followed by
+ * its padding into tail. prefixlen is the count of bytes hashed before the
+ * message, accounted in the encoded length.
+ *
+ * Returns the count of 64 bytes blocks written, either 1 or 2.
+ */
+static size_t	sha256_padding_tail(const uint8_t *data, uint64_t msglen,
+		    uint64_t prefixlen, uint8_t *tail);
+
+#if defined(SHA256_LANES)
+/*
+ * Process one 512-bits input message block per lane, blocks[i] being the block
+ * of the lane i and state[j][i] the word j of its Intermediate Hash State.
+ */
+static void	sha256_compress_lanes(uint32_t state[8][SHA256_LANES],
+		    const uint8_t *const *blocks);
+#endif
+
+#if defined(SHA256_SHANI)
+/*
+ * Set sha256_shani when the CPU supports the SHA extensions.
+ */
+static void	sha256_shani_detect(void);
+
+/*
+ * SHA extensions compression kernel, see sha256_process_message_blocks().
+ */
+static void	sha256_compress_shani(const uint8_t *blocks, size_t nblock,
+		    uint32_t *H);
+
+static int		sha256_shani = 0;
+static pthread_once_t	sha256_shani_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* set by sha256_force_generic() */
+static atomic_int	sha256_generic = 0;
+
+
+/* SHA-256 initial hash value (§ 6.1) */
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
 
 /* SHA-256 K constants (§ 5.1) */
 static const uint32_t k[64] = {
@@ -68,31 +201,25 @@ sha256_blocksize(void)
 struct bytes *
 sha256_hash(const struct bytes *msg)
 {
+	struct sha256_ctx ctx;
 	struct bytes *digest = NULL;
 	int success = 0;
 
-	/* default initial SHA-256 Intermediate Hash State */
-	struct sha256_ctx ctx = {
-		.len = 0,
-		.state = {
-			0x6a09e667,
-			0xbb67ae85,
-			0x3c6ef372,
-			0xa54ff53a,
-			0x510e527f,
-			0x9b05688c,
-			0x1f83d9ab,
-			0x5be0cd19,
-		},
-	};
-
-	if (sha256_hash_ctx(&ctx, msg) != 0)
+	/* sanity check */
+	if (msg == NULL)
 		goto cleanup;
 
-	digest = bytes_from_uint32_be(ctx.state, 8);
+	digest = bytes_zeroed(sha256_hashlength());
 	if (digest == NULL)
 		goto cleanup;
 
+	if (sha256_init(&ctx) != 0)
+		goto cleanup;
+	if (sha256_update(&ctx, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (sha256_final(&ctx, digest->data) != 0)
+		goto cleanup;
+
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
@@ -106,125 +233,624 @@ cleanup:
 
 
 int
-sha256_hash_ctx(struct sha256_ctx *ctx, const struct bytes *msg)
+sha256_init(struct sha256_ctx *ctx)
+{
+	/* sanity check */
+	if (ctx == NULL)
+		return (-1);
+
+	/* default initial SHA-256 Intermediate Hash State */
+	ctx->len = 0;
+	(void)memcpy(ctx->state, sha256_iv, sizeof(ctx->state));
+
+	return (0);
+}
+
+
+int
+sha256_update(struct sha256_ctx *ctx, const uint8_t *data, size_t len)
 {
 	/* max total message length, in byte */
 	const uint64_t maxlen = UINT64_MAX / 8;
 	const size_t blocksize = sha256_blocksize();
-	struct bytes *block = NULL;
-	int success = 0;
 
 	/* sanity checks */
-	if (ctx == NULL)
-		goto cleanup;
-	if (ctx->len > maxlen)
-		goto cleanup;
-	if (msg == NULL || msg->len > (maxlen - ctx->len))
-		goto cleanup;
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+	if ((data == NULL && len > 0) || len > (maxlen - ctx->len))
+		return (-1);
+
+	/* count of message bytes already in the buffered block */
+	size_t buffered = ctx->len % blocksize;
+	ctx->len += len;
+
+	/* complete the buffered block first, if any */
+	if (buffered > 0) {
+		const size_t fill = blocksize - buffered;
+		if (len < fill) {
+			(void)memcpy(ctx->block + buffered, data, len);
+			return (0);
+		}
+		(void)memcpy(ctx->block + buffered, data, fill);
+		sha256_process_message_blocks(ctx->block, 1, ctx->state);
+		data += fill;
+		len  -= fill;
+	}
 
-	uint32_t *H = ctx->state;
+	/* process each "complete" message block straight from data */
+	const size_t nblock = len / blocksize;
+	if (nblock > 0) {
+		sha256_process_message_blocks(data, nblock, ctx->state);
+		data += nblock * blocksize;
+		len  -= nblock * blocksize;
+	}
 
-	/* process each "complete" message block */
-	const size_t nblock = msg->len / blocksize;
-	for (size_t i = 0; i < nblock; i++)
-		sha256_process_message_block(msg->data + blocksize * i, H);
-	ctx->len += msg->len;
+	/* buffer what is left for the next call */
+	if (len > 0)
+		(void)memcpy(ctx->block, data, len);
+
+	return (0);
+}
+
+
+int
+sha256_final(struct sha256_ctx *ctx, uint8_t *digest)
+{
+	/* max total message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+	const size_t blocksize = sha256_blocksize();
+
+	/* sanity checks */
+	if (ctx == NULL || ctx->len > maxlen)
+		return (-1);
+
+	uint32_t *H = ctx->state;
+	uint8_t *block = ctx->block;
 
-	/* the padded block */
-	block = bytes_zeroed(blocksize);
-	if (block == NULL)
-		goto cleanup;
 	/* count of message bytes in the padded block */
-	const size_t restlen = msg->len % blocksize;
-	/* copy what is left of the message to process into the padded block */
-	if (bytes_sput(block, 0, msg, blocksize * nblock, restlen) != 0)
-		goto cleanup;
+	const size_t restlen = ctx->len % blocksize;
 	/* Add the first padding bytes, a `1' bit followed by zeroes */
-	block->data[restlen] = 0x80;
+	block[restlen] = 0x80;
+	(void)memset(block + restlen + 1, 0, blocksize - restlen - 1);
 	if (restlen >= 56) {
 		/* We don't have enough space in the padding block to fit the
 		   0x80 byte and the 64-bits length, So we process the padded
 		   block as-is (i.e. without the length) */
-		sha256_process_message_block(block->data, H);
+		sha256_process_message_blocks(block, 1, H);
 		/* reset the padding block, the length will be set in the last 8
 		   bytes and it will be processed as the second padding block */
-		bytes_bzero(block);
+		(void)memset(block, 0, blocksize);
 	}
 
 	/* set the 64-bits message length (count of bits) in the last 8 bytes of
 	   the padded block, most significant byte first */
 	const uint64_t nbits = 8 * ctx->len;
-	block->data[56] = nbits >> 56;
-	block->data[57] = nbits >> 48;
-	block->data[58] = nbits >> 40;
-	block->data[59] = nbits >> 32;
-	block->data[60] = nbits >> 24;
-	block->data[61] = nbits >> 16;
-	block->data[62] = nbits >>  8;
-	block->data[63] = nbits >>  0;
+	block[56] = nbits >> 56;
+	block[57] = nbits >> 48;
+	block[58] = nbits >> 40;
+	block[59] = nbits >> 32;
+	block[60] = nbits >> 24;
+	block[61] = nbits >> 16;
+	block[62] = nbits >>  8;
+	block[63] = nbits >>  0;
 
 	/* process the last padding block */
-	sha256_process_message_block(block->data, H);
+	sha256_process_message_blocks(block, 1, H);
+	explicit_bzero(block, blocksize);
+
+	/* output the hash, most significant byte of each word first */
+	if (digest != NULL) {
+		for (size_t i = 0; i < 8; i++) {
+			digest[4 * i + 0] = H[i] >> 24;
+			digest[4 * i + 1] = H[i] >> 16;
+			digest[4 * i + 2] = H[i] >>  8;
+			digest[4 * i + 3] = H[i] >>  0;
+		}
+	}
+
+	return (0);
+}
+
+
+int
+sha256_hash_ctx(struct sha256_ctx *ctx, const struct bytes *msg)
+{
+	/* sanity check */
+	if (msg == NULL)
+		return (-1);
+
+	if (sha256_update(ctx, msg->data, msg->len) != 0)
+		return (-1);
+	return (sha256_final(ctx, NULL));
+}
+
+
+int
+sha256_hash_many(const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	return (sha256_hash_many_ctx(NULL, msgs, n, out));
+}
+
+
+int
+sha256_hash_many_ctx(const struct sha256_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	struct sha256_many_job job;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+
+	/* large batches are hashed concurrently */
+	job.ctxs = ctxs;
+	job.msgs = msgs;
+	job.out = out;
+	if (cp_parallel_for(NULL, n, SHA256_PARALLEL_GRAIN,
+		    sha256_hash_many_range, &job) != 0) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+		return (-1);
+	}
+
+	return (0);
+}
+
+
+static int
+sha256_hash_many_range(size_t lo, size_t hi, void *arg)
+{
+	const struct sha256_many_job *job = arg;
+
+	return (sha256_hash_many_lanes(job->ctxs == NULL ? NULL :
+		    job->ctxs + lo, job->msgs + lo, hi - lo, job->out + lo));
+}
+
+
+static int
+sha256_hash_many_lanes(const struct sha256_ctx *const *ctxs,
+		    const struct bytes *const *msgs, size_t n,
+		    struct bytes **out)
+{
+	/* max message length, in byte */
+	const uint64_t maxlen = UINT64_MAX / 8;
+#if defined(SHA256_LANES)
+	const size_t blocksize = sha256_blocksize();
+	/* each lane progress, index being n when the lane is idle */
+	struct {
+		size_t index;
+		size_t block;
+		size_t nblock;
+		size_t ntail;
+		uint8_t tail[2 * 64];
+	} lanes[SHA256_LANES];
+	uint32_t state[8][SHA256_LANES];
+	const uint8_t *blocks[SHA256_LANES];
+	static const uint8_t idle[64] = { 0 };
+	size_t next = 0, active = 0;
+	/* longest message hashed in the lanes */
+	uint64_t lanes_maxlen = maxlen;
+#endif
+	int success = 0;
+
+	/* sanity checks */
+	if (n > 0 && (msgs == NULL || out == NULL))
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		out[i] = NULL;
+	for (size_t i = 0; i < n; i++) {
+		if (msgs[i] == NULL || msgs[i]->len > maxlen)
+			goto cleanup;
+		if (ctxs == NULL)
+			continue;
+		/* resumed contexts must not have buffered bytes */
+		if (ctxs[i] == NULL || (ctxs[i]->len % sha256_blocksize()) != 0)
+			goto cleanup;
+		if (ctxs[i]->len > maxlen - msgs[i]->len)
+			goto cleanup;
+	}
+
+#if defined(SHA256_LANES)
+#if defined(SHA256_SHANI)
+	(void)pthread_once(&sha256_shani_once, sha256_shani_detect);
+	if (sha256_shani && !atomic_load(&sha256_generic))
+		lanes_maxlen = SHA256_SHANI_LANES_MAXLEN;
+#endif
+	for (size_t lane = 0; lane < SHA256_LANES; lane++)
+		lanes[lane].index = n;
+
+	for (;;) {
+		/* start hashing the next messages in the idle lanes */
+		for (size_t lane = 0; lane < SHA256_LANES; lane++) {
+			while (next < n && msgs[next]->len > lanes_maxlen)
+				next++;
+			if (next == n)
+				break;
+			if (lanes[lane].index != n)
+				continue;
+			const struct bytes *msg = msgs[next];
+			lanes[lane].index = next++;
+			lanes[lane].block = 0;
+			const struct sha256_ctx *ctx = (ctxs == NULL ? NULL :
+				    ctxs[lanes[lane].index]);
+			lanes[lane].ntail = sha256_padding_tail(msg->data,
+				    msg->len, (ctx == NULL ? 0 : ctx->len),
+				    lanes[lane].tail);
+			lanes[lane].nblock = msg->len / blocksize +
+				    lanes[lane].ntail;
+			for (size_t j = 0; j < 8; j++) {
+				state[j][lane] = (ctx == NULL ? sha256_iv[j] :
+					    ctx->state[j]);
+			}
+			active++;
+		}
+		if (active == 0)
+			break;
+
+		/* the next block of each lane, message then padding */
+		for (size_t lane = 0; lane < SHA256_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n) {
+				blocks[lane] = idle;
+				continue;
+			}
+			const size_t block = lanes[lane].block;
+			const size_t nfull = lanes[lane].nblock -
+				    lanes[lane].ntail;
+			if (block < nfull) {
+				blocks[lane] = msgs[index]->data +
+					    block * blocksize;
+			} else {
+				blocks[lane] = lanes[lane].tail +
+					    (block - nfull) * blocksize;
+			}
+		}
+		sha256_compress_lanes(state, blocks);
+
+		/* output the hash of the messages done */
+		for (size_t lane = 0; lane < SHA256_LANES; lane++) {
+			const size_t index = lanes[lane].index;
+			if (index == n)
+				continue;
+			if (++lanes[lane].block < lanes[lane].nblock)
+				continue;
+			struct bytes *digest =
+				    bytes_zeroed(sha256_hashlength());
+			if (digest == NULL)
+				goto cleanup;
+			for (size_t j = 0; j < 8; j++) {
+				digest->data[4 * j + 0] = state[j][lane] >> 24;
+				digest->data[4 * j + 1] = state[j][lane] >> 16;
+				digest->data[4 * j + 2] = state[j][lane] >>  8;
+				digest->data[4 * j + 3] = state[j][lane] >>  0;
+			}
+			out[index] = digest;
+			lanes[lane].index = n;
+			active--;
+		}
+	}
+#endif
+	/* the messages not hashed in the lanes, one at a time */
+	for (size_t i = 0; i < n; i++) {
+		if (out[i] != NULL)
+			continue;
+		out[i] = sha256_hash_resume(ctxs == NULL ? NULL : ctxs[i],
+			    msgs[i]);
+		if (out[i] == NULL)
+			goto cleanup;
+	}
 
 	success = 1;
 	/* FALLTHROUGH */
 cleanup:
-	bytes_free(block);
+#if defined(SHA256_LANES)
+	explicit_bzero(lanes, sizeof(lanes));
+	explicit_bzero(state, sizeof(state));
+#endif
+	if (!success) {
+		for (size_t i = 0; i < n; i++) {
+			bytes_free(out[i]);
+			out[i] = NULL;
+		}
+	}
 	return (success ? 0 : -1);
 }
 
 
+int
+sha256_force_generic(int force)
+{
+	return (atomic_exchange(&sha256_generic, force != 0));
+}
+
+
+static void
+sha256_process_message_blocks(const uint8_t *blocks, size_t nblock,
+		    uint32_t *H)
+{
+#if defined(SHA256_SHANI)
+	(void)pthread_once(&sha256_shani_once, sha256_shani_detect);
+	if (sha256_shani && !atomic_load(&sha256_generic)) {
+		sha256_compress_shani(blocks, nblock, H);
+		return;
+	}
+#endif
+	sha256_compress_generic(blocks, nblock, H);
+}
+
+
+/*
+ * One round of the main hash computation (§ 6.2 3.), the working variables
+ * are renamed by the caller instead of being moved around. The caller provides
+ * tmp1, so that the same rounds are used by the scalar and SIMD kernels.
+ */
+#define	ROUND(a, b, c, d, e, f, g, h, t) do {				\
+		tmp1 = (h) + BSIG1(e) + CH((e), (f), (g)) + k[(t)] + W[(t)]; \
+		(d) += tmp1;						\
+		(h)  = tmp1 + BSIG0(a) + MAJ((a), (b), (c));		\
+	} while (/* CONSTCOND */0)
+
+/* Eight rounds starting at t, after which the variables are back in place. */
+#define	ROUND8(t) do {							\
+		ROUND(a, b, c, d, e, f, g, h, (t) + 0);			\
+		ROUND(h, a, b, c, d, e, f, g, (t) + 1);			\
+		ROUND(g, h, a, b, c, d, e, f, (t) + 2);			\
+		ROUND(f, g, h, a, b, c, d, e, (t) + 3);			\
+		ROUND(e, f, g, h, a, b, c, d, (t) + 4);			\
+		ROUND(d, e, f, g, h, a, b, c, (t) + 5);			\
+		ROUND(c, d, e, f, g, h, a, b, (t) + 6);			\
+		ROUND(b, c, d, e, f, g, h, a, (t) + 7);			\
+	} while (/* CONSTCOND */0)
+
 static void
-sha256_process_message_block(const uint8_t *block, uint32_t *H)
+sha256_compress_generic(const uint8_t *blocks, size_t nblock, uint32_t *H)
 {
 	uint32_t W[64];
-	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t a, b, c, d, e, f, g, h, tmp1;
+
+	for (; nblock > 0; nblock--, blocks += 64) {
+		/* 1. Prepare the message schedule W */
+		for (size_t t = 0, i = 0; t < 16; t++, i += 4) {
+			const uint32_t hh = blocks[i + 0];
+			const uint32_t hl = blocks[i + 1];
+			const uint32_t lh = blocks[i + 2];
+			const uint32_t ll = blocks[i + 3];
+			W[t] = (hh << 24) | (hl << 16) | (lh << 8) | ll;
+		}
+		for (size_t t = 16; t < 64; t++) {
+			W[t] = SSIG1(W[t - 2]) + W[t - 7] + SSIG0(W[t - 15]) +
+				    W[t - 16];
+		}
+
+		/* 2. Initialize the working variables */
+		a = H[0];
+		b = H[1];
+		c = H[2];
+		d = H[3];
+		e = H[4];
+		f = H[5];
+		g = H[6];
+		h = H[7];
+
+		/* 3. Perform the main hash computation */
+		ROUND8( 0); ROUND8( 8); ROUND8(16); ROUND8(24);
+		ROUND8(32); ROUND8(40); ROUND8(48); ROUND8(56);
+
+		/* 4. Compute the intermediate hash value H(i) */
+		H[0] += a;
+		H[1] += b;
+		H[2] += c;
+		H[3] += d;
+		H[4] += e;
+		H[5] += f;
+		H[6] += g;
+		H[7] += h;
+	}
+
+	explicit_bzero(W, sizeof(W));
+}
 
-	/* 1. Prepare the message schedule W */
-	for (size_t t = 0, i = 0; t < 16; t++, i += 4) {
-		const uint32_t hh = block[i + 0];
-		const uint32_t hl = block[i + 1];
-		const uint32_t lh = block[i + 2];
-		const uint32_t ll = block[i + 3];
-		W[t] = (hh << 24) | (hl << 16) | (lh << 8) | ll;
+
+static struct bytes *
+sha256_hash_resume(const struct sha256_ctx *ctx, const struct bytes *msg)
+{
+	struct sha256_ctx copy;
+	struct bytes *digest = NULL;
+	int success = 0;
+
+	if (ctx == NULL) {
+		if (sha256_init(&copy) != 0)
+			goto cleanup;
+	} else {
+		copy = *ctx;
+	}
+
+	digest = bytes_zeroed(sha256_hashlength());
+	if (digest == NULL)
+		goto cleanup;
+	if (sha256_update(&copy, msg->data, msg->len) != 0)
+		goto cleanup;
+	if (sha256_final(&copy, digest->data) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	explicit_bzero(&copy, sizeof(struct sha256_ctx));
+	if (!success) {
+		bytes_free(digest);
+		digest = NULL;
+	}
+	return (digest);
+}
+
+
+static size_t
+sha256_padding_tail(const uint8_t *data, uint64_t msglen, uint64_t prefixlen,
+		    uint8_t *tail)
+{
+	const size_t blocksize = sha256_blocksize();
+	/* count of message bytes in the padded block */
+	const size_t restlen = msglen % blocksize;
+	const size_t ntail = (restlen >= 56 ? 2 : 1);
+
+	(void)memcpy(tail, data + (msglen - restlen), restlen);
+	/* a `1' bit followed by zeroes, then the 64-bits message length */
+	tail[restlen] = 0x80;
+	(void)memset(tail + restlen + 1, 0, ntail * blocksize - restlen - 1);
+	const uint64_t nbits = 8 * (prefixlen + msglen);
+	uint8_t *length = tail + ntail * blocksize - 8;
+	for (size_t i = 0; i < 8; i++)
+		length[i] = nbits >> (56 - 8 * i);
+
+	return (ntail);
+}
+
+
+#if defined(SHA256_LANES)
+SHA256_TARGETS
+static void
+sha256_compress_lanes(uint32_t state[8][SHA256_LANES],
+		    const uint8_t *const *blocks)
+{
+	/* see sha256_compress_generic(), each lane is a message */
+	sha256_vec W[64];
+	sha256_vec a, b, c, d, e, f, g, h, tmp1;
+
+	for (size_t t = 0; t < 16; t++) {
+		for (size_t lane = 0; lane < SHA256_LANES; lane++) {
+			const uint8_t *word = blocks[lane] + 4 * t;
+			W[t][lane] = ((uint32_t)word[0] << 24) |
+				    ((uint32_t)word[1] << 16) |
+				    ((uint32_t)word[2] <<  8) | word[3];
+		}
 	}
 	for (size_t t = 16; t < 64; t++) {
-		W[t] = SSIG1(W[t - 2]) + W[t - 7] + SSIG0(W[t - 15]) + W[t - 16];
-	}
-
-	/* 2. Initialize the working variables */
-	a = H[0];
-	b = H[1];
-	c = H[2];
-	d = H[3];
-	e = H[4];
-	f = H[5];
-	g = H[6];
-	h = H[7];
-
-	/* 3. Perform the main hash computation */
-	for (size_t t = 0; t < 64; t++) {
-		uint32_t tmp1 = h + BSIG1(e) + CH(e, f, g) + k[t] + W[t];
-		uint32_t tmp2 = BSIG0(a) + MAJ(a, b, c);
-		h = g;
-		g = f;
-		f = e;
-		e = d + tmp1;
-		d = c;
-		c = b;
-		b = a;
-		a = tmp1 + tmp2;
-	}
-
-	/* 4. Compute the intermediate hash value H(i) */
-	H[0] += a;
-	H[1] += b;
-	H[2] += c;
-	H[3] += d;
-	H[4] += e;
-	H[5] += f;
-	H[6] += g;
-	H[7] += h;
+		W[t] = SSIG1(W[t - 2]) + W[t - 7] + SSIG0(W[t - 15]) +
+			    W[t - 16];
+	}
+
+	(void)memcpy(&a, state[0], sizeof(sha256_vec));
+	(void)memcpy(&b, state[1], sizeof(sha256_vec));
+	(void)memcpy(&c, state[2], sizeof(sha256_vec));
+	(void)memcpy(&d, state[3], sizeof(sha256_vec));
+	(void)memcpy(&e, state[4], sizeof(sha256_vec));
+	(void)memcpy(&f, state[5], sizeof(sha256_vec));
+	(void)memcpy(&g, state[6], sizeof(sha256_vec));
+	(void)memcpy(&h, state[7], sizeof(sha256_vec));
+
+	ROUND8( 0); ROUND8( 8); ROUND8(16); ROUND8(24);
+	ROUND8(32); ROUND8(40); ROUND8(48); ROUND8(56);
+
+	const sha256_vec abcdefgh[8] = { a, b, c, d, e, f, g, h };
+	for (size_t j = 0; j < 8; j++) {
+		for (size_t lane = 0; lane < SHA256_LANES; lane++)
+			state[j][lane] += abcdefgh[j][lane];
+	}
 
 	explicit_bzero(W, sizeof(W));
 }
+#endif /* defined(SHA256_LANES) */
+
+
+#if defined(SHA256_SHANI)
+static void
+sha256_shani_detect(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	/* the kernel needs SSSE3 and SSE4.1 along the SHA extensions */
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+		return;
+	if ((ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+		return;
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+		return;
+	sha256_shani = ((ebx & bit_SHA) != 0);
+}
+
+
+/*
+ * Rounds 4g to 4g+3, where m0 holds W(4g) to W(4g+3) and m1, m3 the message
+ * words being scheduled for the rounds 4(g+1) and 4(g+3).
+ */
+#define	SHANI_ROUND4(g, m0, m1, m3) do {				\
+		__m128i msg, tmp;					\
+		msg = _mm_add_epi32((m0),				\
+			    _mm_loadu_si128((const __m128i *)(k + 4 * (g)))); \
+		STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, msg);	\
+		if ((g) >= 3 && (g) <= 14) {				\
+			tmp  = _mm_alignr_epi8((m0), (m3), 4);		\
+			(m1) = _mm_add_epi32((m1), tmp);		\
+			(m1) = _mm_sha256msg2_epu32((m1), (m0));	\
+		}							\
+		msg = _mm_shuffle_epi32(msg, 0x0E);			\
+		STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, msg);	\
+		if ((g) >= 1 && (g) <= 12)				\
+			(m3) = _mm_sha256msg1_epu32((m3), (m0));	\
+	} while (/* CONSTCOND */0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha256_compress_shani(const uint8_t *blocks, size_t nblock, uint32_t *H)
+{
+	/* reverse the bytes order of each word, SHA-256 being big-endian */
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+		    0x0405060700010203ULL);
+	__m128i STATE0, STATE1, M0, M1, M2, M3, tmp;
+
+	/* the instructions work on the ABEF and CDGH words */
+	tmp    = _mm_loadu_si128((const __m128i *)(H + 0));
+	STATE1 = _mm_loadu_si128((const __m128i *)(H + 4));
+	tmp    = _mm_shuffle_epi32(tmp, 0xB1);		/* CDAB */
+	STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);	/* EFGH */
+	STATE0 = _mm_alignr_epi8(tmp, STATE1, 8);	/* ABEF */
+	STATE1 = _mm_blend_epi16(STATE1, tmp, 0xF0);	/* CDGH */
+
+	for (; nblock > 0; nblock--, blocks += 64) {
+		const __m128i ABEF_SAVE = STATE0, CDGH_SAVE = STATE1;
+
+		M0 = _mm_loadu_si128((const __m128i *)(blocks +  0));
+		M1 = _mm_loadu_si128((const __m128i *)(blocks + 16));
+		M2 = _mm_loadu_si128((const __m128i *)(blocks + 32));
+		M3 = _mm_loadu_si128((const __m128i *)(blocks + 48));
+		M0 = _mm_shuffle_epi8(M0, mask);
+		M1 = _mm_shuffle_epi8(M1, mask);
+		M2 = _mm_shuffle_epi8(M2, mask);
+		M3 = _mm_shuffle_epi8(M3, mask);
+
+		SHANI_ROUND4( 0, M0, M1, M3);
+		SHANI_ROUND4( 1, M1, M2, M0);
+		SHANI_ROUND4( 2, M2, M3, M1);
+		SHANI_ROUND4( 3, M3, M0, M2);
+		SHANI_ROUND4( 4, M0, M1, M3);
+		SHANI_ROUND4( 5, M1, M2, M0);
+		SHANI_ROUND4( 6, M2, M3, M1);
+		SHANI_ROUND4( 7, M3, M0, M2);
+		SHANI_ROUND4( 8, M0, M1, M3);
+		SHANI_ROUND4( 9, M1, M2, M0);
+		SHANI_ROUND4(10, M2, M3, M1);
+		SHANI_ROUND4(11, M3, M0, M2);
+		SHANI_ROUND4(12, M0, M1, M3);
+		SHANI_ROUND4(13, M1, M2, M0);
+		SHANI_ROUND4(14, M2, M3, M1);
+		SHANI_ROUND4(15, M3, M0, M2);
+
+		STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+		STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+	}
+
+	tmp    = _mm_shuffle_epi32(STATE0, 0x1B);	/* FEBA */
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);	/* DCHG */
+	STATE0 = _mm_blend_epi16(tmp, STATE1, 0xF0);	/* DCBA */
+	STATE1 = _mm_alignr_epi8(STATE1, tmp, 8);	/* HGFE */
+	_mm_storeu_si128((__m128i *)(H + 0), STATE0);
+	_mm_storeu_si128((__m128i *)(H + 4), STATE1);
+}
+#endif /* defined(SHA256_SHANI) */
@@ -4,8 +4,13 @@
  * srp.h
  *
  * Secure Remote Password (SRP) stuff for cryptopals.com challenges.
+ *
+ * The local server may be shared by clients running on different threads,
+ * finalize() then checks the token of the latest start(). The other endpoints
+ * belong to a single thread.
  */
 #include <sys/types.h>
+#include <pthread.h>
 
 #include "mpi.h"
 #include "bytes.h"
@@ -86,6 +91,12 @@ struct srp_local_server_opaque {
 	 * finalize().
 	 */
 	struct bytes *token;
+
+	/*
+	 * Protect key and token, so that clients on different threads may
+	 * share the server.
+	 */
+	pthread_mutex_t lock;
 };
 
 /*
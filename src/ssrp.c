@@ -45,6 +45,13 @@ ssrp_local_server_new(const struct bytes *I, const struct bytes *P)
 		goto cleanup;
 	struct ssrp_local_server_opaque *srvinfo = server->opaque;
 
+	if (pthread_mutex_init(&srvinfo->lock, NULL) != 0) {
+		/* don't let ssrp_local_server_free() destroy it */
+		free(server->opaque);
+		server->opaque = NULL;
+		goto cleanup;
+	}
+
 	srvinfo->I = bytes_dup(I);
 	srvinfo->P = bytes_dup(P);
 	if (srvinfo->I == NULL || srvinfo->P == NULL)
@@ -183,15 +190,18 @@ ssrp_local_server_start(struct ssrp_server *server,
 	if (token == NULL)
 		goto cleanup;
 
-	success = 1;
-
 	/* save what we need for finalize() in the server */
+	if (pthread_mutex_lock(&srvinfo->lock) != 0)
+		goto cleanup;
 	bytes_free(srvinfo->key);
 	srvinfo->key = K;
 	K = NULL;
 	bytes_free(srvinfo->token);
 	srvinfo->token = token;
 	token = NULL;
+	(void)pthread_mutex_unlock(&srvinfo->lock);
+
+	success = 1;
 
 	/* set "return" values for the caller */
 	*salt_p = salt;
@@ -230,8 +240,10 @@ ssrp_local_server_finalize(struct ssrp_server *server, const struct bytes *token
 		goto cleanup;
 
 	struct ssrp_local_server_opaque *srvinfo = server->opaque;
-	if (srvinfo->token == NULL || srvinfo->key == NULL)
+	if (pthread_mutex_lock(&srvinfo->lock) != 0)
 		goto cleanup;
+	if (srvinfo->token == NULL || srvinfo->key == NULL)
+		goto unlock;
 
 	/* compare the given token to the one we have */
 	success = (bytes_timingsafe_bcmp(srvinfo->token, token) == 0);
@@ -246,6 +258,9 @@ ssrp_local_server_finalize(struct ssrp_server *server, const struct bytes *token
 		srvinfo->key = NULL;
 	}
 
+	/* FALLTHROUGH */
+unlock:
+	(void)pthread_mutex_unlock(&srvinfo->lock);
 	/* FALLTHROUGH */
 cleanup:
 	return (success ? 0 : -1);
@@ -264,6 +279,7 @@ ssrp_local_server_free(struct ssrp_server *server)
 		bytes_free(srvinfo->token);
 		bytes_free(srvinfo->P);
 		bytes_free(srvinfo->I);
+		(void)pthread_mutex_destroy(&srvinfo->lock);
 		freezero(srvinfo, sizeof(struct ssrp_local_server_opaque));
 	}
 	freezero(server, sizeof(struct ssrp_server));
@@ -4,7 +4,12 @@
  * ssrp.h
  *
  * Simplified Secure Remote Password (SSRP) stuff for cryptopals.com challenges.
+ *
+ * As in srp.h, the local server may be shared by clients running on different
+ * threads while the other endpoints belong to a single thread.
  */
+#include <pthread.h>
+
 #include "mpi.h"
 #include "bytes.h"
 
@@ -77,6 +82,12 @@ struct ssrp_local_server_opaque {
 	 * finalize().
 	 */
 	struct bytes *token;
+
+	/*
+	 * Protect key and token, so that clients on different threads may
+	 * share the server.
+	 */
+	pthread_mutex_t lock;
 };
 
 /*
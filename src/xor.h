@@ -4,6 +4,8 @@
  * xor.h
  *
  * XOR "cipher" stuff for cryptopals.com challenges.
+ *
+ * Pure functions, reentrant.
  */
 #include "bytes.h"
 
@@ -4,10 +4,15 @@
  * Some testing help stuff.
  */
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netdb.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 
@@ -33,7 +38,7 @@ void *
 srand_reset(const MunitParameter *params, void *user_data)
 {
 	init_seed();
-	srand(seed);
+	bytes_random_seed(seed);
 	return (NULL);
 }
 
@@ -84,3 +89,45 @@ cleanup:
 	}
 	return (content);
 }
+
+
+int
+loopback_listen(char *port)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int s = -1, success = 0;
+
+	if (port == NULL)
+		goto cleanup;
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == -1)
+		goto cleanup;
+
+	/* let the kernel choose the port */
+	(void)memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(0);
+	if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		goto cleanup;
+	if (listen(s, SOMAXCONN) != 0)
+		goto cleanup;
+
+	/* find out which one */
+	if (getsockname(s, (struct sockaddr *)&sin, &len) != 0)
+		goto cleanup;
+	if (getnameinfo((struct sockaddr *)&sin, len, NULL, 0,
+		    port, NI_MAXSERV, NI_NUMERICSERV) != 0)
+		goto cleanup;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (!success && s != -1) {
+		(void)close(s);
+		s = -1;
+	}
+	return (s);
+}
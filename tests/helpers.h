@@ -15,7 +15,8 @@
 void	init_seed(void);
 
 /*
- * Call srand(3) with the seed that has been setup by init_seed().
+ * Call bytes_random_seed() with the seed that has been setup by init_seed(),
+ * the srand(3) of bytes_randomized().
  */
 void	*srand_reset(const MunitParameter *params, void *user_data);
 
@@ -29,4 +30,13 @@ uint64_t	rand_uint64(void);
  */
 struct bytes	*fs_read(const char *path);
 
+/*
+ * Create a TCP socket listening on an ephemeral port of the IPv4 loopback
+ * address. port must be able to hold at least NI_MAXSERV characters, it is set
+ * to the NUL-terminated port number.
+ *
+ * Returns the listening socket, or -1 on error.
+ */
+int	loopback_listen(char *port);
+
 #endif /* ndef HELPERS_H */
@@ -3,11 +3,15 @@
  *
  * Implement the main() function that call munit_suite_main().
  */
+#include <stdlib.h>
+
 #include "munit.h"
+#include "pool.h"
 
 
 /* stuff from other test files */
 extern MunitTest test_bytes_suite_tests[];
+extern MunitTest test_pool_suite_tests[];
 extern MunitTest test_mpi_suite_tests[];
 extern MunitTest test_cookie_suite_tests[];
 extern MunitTest test_xor_suite_tests[];
@@ -23,6 +27,7 @@ extern MunitTest test_mt19937_suite_tests[];
 extern MunitTest test_sha1_suite_tests[];
 extern MunitTest test_sha256_suite_tests[];
 extern MunitTest test_md4_suite_tests[];
+extern MunitTest test_hash_suite_tests[];
 extern MunitTest test_mac_suite_tests[];
 extern MunitTest test_dh_suite_tests[];
 extern MunitTest test_srp_suite_tests[];
@@ -37,9 +42,11 @@ extern MunitTest test_break_dh_suite_tests[];
 extern MunitTest test_break_srp_suite_tests[];
 extern MunitTest test_break_ssrp_suite_tests[];
 extern MunitTest test_break_rsa_suite_tests[];
+extern MunitTest test_threads_suite_tests[];
 
 static MunitSuite all_test_suites[] = {
 	{ "bytes/",      test_bytes_suite_tests,                   NULL, 1, MUNIT_SUITE_OPTION_NONE },
+	{ "pool/",       test_pool_suite_tests,                    NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "mpi/",        test_mpi_suite_tests,                     NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "cookie/",     test_cookie_suite_tests,                  NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "xor/",        test_xor_suite_tests,                     NULL, 1, MUNIT_SUITE_OPTION_NONE },
@@ -55,6 +62,7 @@ static MunitSuite all_test_suites[] = {
 	{ "sha1/",       test_sha1_suite_tests,                    NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "sha256/",     test_sha256_suite_tests,                  NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "md4/",        test_md4_suite_tests,                     NULL, 1, MUNIT_SUITE_OPTION_NONE },
+	{ "hash/",       test_hash_suite_tests,                    NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "mac/",        test_mac_suite_tests,                     NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "dh/",         test_dh_suite_tests,                      NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "srp/",        test_srp_suite_tests,                     NULL, 1, MUNIT_SUITE_OPTION_NONE },
@@ -69,6 +77,7 @@ static MunitSuite all_test_suites[] = {
 	{ "break-srp/",  test_break_srp_suite_tests,               NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "break-ssrp/", test_break_ssrp_suite_tests,              NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{ "break-rsa/",  test_break_rsa_suite_tests,               NULL, 1, MUNIT_SUITE_OPTION_NONE },
+	{ "threads/",    test_threads_suite_tests,                 NULL, 1, MUNIT_SUITE_OPTION_NONE },
 	{
 		.prefix     = NULL,
 		.tests      = NULL,
@@ -91,6 +100,12 @@ static const MunitSuite test_suite = {
 int
 main(int argc, char **argv)
 {
+	/* The library pool runs everything from the waiting thread in a
+	 * deterministic order, unless a count of threads is set in the
+	 * environment. */
+	if (getenv(CP_POOL_THREADS_ENV) == NULL)
+		(void)cp_pool_default_nthreads(1);
+
 	/* Finally, we'll actually run our test suite!  That second argument
 	 * is the user_data parameter which will be passed either to the
 	 * test or (if provided) the fixture setup function. */
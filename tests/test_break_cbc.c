@@ -1,6 +1,15 @@
 /*
  * test_break_cbc.c
  */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "munit.h"
 #include "helpers.h"
 #include "aes.h"
@@ -108,12 +117,26 @@ test_cbc_padding(const MunitParameter *params, void *data)
 		if (ciphertext == NULL)
 			munit_error("aes_128_cbc_encrypt");
 
-		cracked = cbc_padding_breaker(ciphertext, key, iv);
+		struct oracle *oracle = cbc_padding_oracle_new(key);
+		if (oracle == NULL)
+			munit_error("cbc_padding_oracle_new");
+
+		/* use from zero (i.e. one per CPU) to three workers */
+		const size_t nthreads = i % 4;
+		cracked = cbc_padding_breaker(ciphertext, oracle, iv, nthreads);
 		munit_assert_not_null(cracked);
 		munit_assert_size(cracked->len, ==, plaintext->len);
 		munit_assert_memory_equal(cracked->len,
 			    cracked->data, plaintext->data);
-
+		/* guessing the likely bytes first should need far less than
+		   the 256 queries per byte of an exhaustive search */
+		munit_assert_uint64(oracle->stats.queries, >, 0);
+		munit_assert_uint64(oracle->stats.queries, <=,
+			    48 * ciphertext->len);
+		munit_assert_uint64(oracle->stats.bytes_sent, ==,
+			    oracle->stats.queries * 2 * aes_128_blocksize());
+
+		oracle_free(oracle);
 		bytes_free(cracked);
 		bytes_free(ciphertext);
 		bytes_free(iv);
@@ -125,6 +148,229 @@ test_cbc_padding(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_cbc_padding_random(const MunitParameter *params, void *data)
+{
+	/* random plaintext, defeating the guesses ordering */
+	struct bytes *plaintext = bytes_randomized(munit_rand_int_range(1, 128));
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	struct bytes *iv  = bytes_randomized(aes_128_blocksize());
+	if (plaintext == NULL || key == NULL || iv == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *ciphertext = aes_128_cbc_encrypt(plaintext, key, iv);
+	if (ciphertext == NULL)
+		munit_error("aes_128_cbc_encrypt");
+	struct oracle *oracle = cbc_padding_oracle_new(key);
+	if (oracle == NULL)
+		munit_error("cbc_padding_oracle_new");
+
+	struct bytes *cracked = cbc_padding_breaker(ciphertext, oracle, iv, 2);
+	munit_assert_not_null(cracked);
+	munit_assert_size(cracked->len, ==, plaintext->len);
+	munit_assert_memory_equal(cracked->len, cracked->data, plaintext->data);
+	/* at most 256 queries per byte, plus the confirmation queries */
+	munit_assert_uint64(oracle->stats.queries, <=, 257 * ciphertext->len);
+
+	oracle_free(oracle);
+	bytes_free(cracked);
+	bytes_free(ciphertext);
+	bytes_free(iv);
+	bytes_free(key);
+	bytes_free(plaintext);
+	return (MUNIT_OK);
+}
+
+
+/*
+ * A stand-in oracle server running in a child process.
+ */
+struct oracle_server {
+	pid_t pid;
+	char port[NI_MAXSERV];
+	/* the key of the padding oracle, NULL for the garbage server */
+	struct bytes *key;
+};
+
+
+/*
+ * Listen on the loopback and fork a child calling serve(listener, key).
+ *
+ * Returns a pointer to a struct oracle_server (provided as data to the test and
+ * tear down function).
+ */
+static struct oracle_server *
+oracle_server_start(void (*serve)(int, const struct bytes *),
+		    struct bytes *key)
+{
+	struct oracle_server *server = munit_malloc(sizeof(*server));
+	server->key = key;
+
+	const int listener = loopback_listen(server->port);
+	if (listener == -1)
+		munit_error("loopback_listen");
+	server->pid = fork();
+	switch (server->pid) {
+	case -1: /* error */
+		munit_error("fork");
+		/* NOTREACHED */
+	case 0: /* child process */
+		serve(listener, key);
+		_exit(EXIT_FAILURE);
+		/* NOTREACHED */
+	default: /* parent process */
+		(void)close(listener);
+		return (server);
+	}
+}
+
+
+/*
+ * oracle_server_start() routine, serve a CBC padding oracle.
+ */
+static void
+padding_serve(int listener, const struct bytes *key)
+{
+	struct oracle *local = cbc_padding_oracle_new(key);
+	if (local == NULL)
+		return;
+	(void)oracle_serve(local, listener);
+}
+
+
+/*
+ * oracle_server_start() routine, answer garbage to the first query and 1 to
+ * the following ones.
+ */
+static void
+garbage_serve(int listener, const struct bytes *key)
+{
+	const int sock = accept(listener, NULL, NULL);
+	if (sock == -1)
+		return;
+	size_t nquery = 0;
+	char c;
+	while (read(sock, &c, 1) == 1) {
+		if (c != '\n')
+			continue;
+		const char *answer = (nquery++ == 0 ? "garbage\n" : "1\n");
+		if (write(sock, answer, strlen(answer)) == -1)
+			return;
+	}
+}
+
+
+/*
+ * Create a random key and start a padding oracle server using it.
+ */
+static void *
+padding_server_setup(const MunitParameter *params, void *user_data)
+{
+	(void)srand_reset(params, user_data);
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	if (key == NULL)
+		munit_error("bytes_randomized");
+	return (oracle_server_start(padding_serve, key));
+}
+
+
+/*
+ * Start a server answering garbage to the first query.
+ */
+static void *
+garbage_server_setup(const MunitParameter *params, void *user_data)
+{
+	(void)srand_reset(params, user_data);
+	return (oracle_server_start(garbage_serve, NULL));
+}
+
+
+/*
+ * Kill the server started by one of the setup functions, whatever the test
+ * outcome, and free the associated resources.
+ */
+static void
+oracle_server_tear_down(void *data)
+{
+	struct oracle_server *server = data;
+
+	if (server == NULL)
+		return;
+
+	if (kill(server->pid, SIGTERM) == 0) {
+		if (waitpid(server->pid, NULL, 0) != server->pid)
+			munit_error("waitpid");
+	}
+	bytes_free(server->key);
+	free(server);
+}
+
+
+static MunitResult
+test_cbc_padding_remote(const MunitParameter *params, void *data)
+{
+	const struct oracle_server *server = data;
+	struct bytes *plaintext = bytes_from_base64(s3c17_data[0]);
+	if (plaintext == NULL)
+		munit_error("bytes_from_base64");
+	struct bytes *iv = bytes_randomized(aes_128_blocksize());
+	if (iv == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *ciphertext = aes_128_cbc_encrypt(plaintext, server->key,
+		    iv);
+	if (ciphertext == NULL)
+		munit_error("aes_128_cbc_encrypt");
+
+	struct oracle *remote = oracle_remote_new("127.0.0.1", server->port, 4);
+	if (remote == NULL)
+		munit_error("oracle_remote_new");
+
+	struct bytes *cracked = cbc_padding_breaker(ciphertext, remote, iv, 2);
+	munit_assert_not_null(cracked);
+	munit_assert_size(cracked->len, ==, plaintext->len);
+	munit_assert_memory_equal(cracked->len, cracked->data, plaintext->data);
+	/* the guesses are pipelined, so we expect less calls than queries */
+	munit_assert_uint64(remote->stats.calls, <, remote->stats.queries);
+
+	/* the connections are still usable after cancelled queries */
+	struct bytes *query = bytes_joined(2, iv, ciphertext);
+	if (query == NULL)
+		munit_error("bytes_joined");
+	munit_assert_int(oracle_query(remote, query, NULL), ==, 0);
+	query->data[query->len - 1] ^= 0xff;
+	munit_assert_int(oracle_query(remote, query, NULL), ==, 1);
+
+	oracle_free(remote);
+	bytes_free(query);
+	bytes_free(cracked);
+	bytes_free(ciphertext);
+	bytes_free(iv);
+	bytes_free(plaintext);
+	return (MUNIT_OK);
+}
+
+
+/* a malformed answer fails its query but not the next ones */
+static MunitResult
+test_cbc_padding_garbage(const MunitParameter *params, void *data)
+{
+	const struct oracle_server *server = data;
+	struct bytes *query = bytes_randomized(2 * aes_128_blocksize());
+	if (query == NULL)
+		munit_error("bytes_randomized");
+
+	struct oracle *remote = oracle_remote_new("127.0.0.1", server->port, 1);
+	if (remote == NULL)
+		munit_error("oracle_remote_new");
+	munit_assert_int(oracle_query(remote, query, NULL), ==, -1);
+	munit_assert_int(oracle_query(remote, query, NULL), ==, 1);
+	munit_assert_int(oracle_query(remote, query, NULL), ==, 1);
+
+	oracle_free(remote);
+	bytes_free(query);
+	return (MUNIT_OK);
+}
+
+
 static MunitResult
 test_cbc_high_ascii(const MunitParameter *params, void *data)
 {
@@ -209,6 +455,9 @@ MunitTest test_break_cbc_suite_tests[] = {
 	{ "cbc_bitflipping-0",      test_cbc_bitflipping_0,      srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "cbc_bitflipping-1",      test_cbc_bitflipping_1,      srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "cbc_padding",            test_cbc_padding,            srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cbc_padding-random",     test_cbc_padding_random,     srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cbc_padding-remote",     test_cbc_padding_remote,     padding_server_setup, oracle_server_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cbc_padding-garbage",    test_cbc_padding_garbage,    garbage_server_setup, oracle_server_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "cbc_high_ascii",         test_cbc_high_ascii,         srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "cbc_key_as_iv",          test_cbc_key_as_iv,          srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
@@ -179,6 +179,55 @@ test_ctr_fixed_nonce_2(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_aes_128_ctr_edit_oracle(const MunitParameter *params, void *data)
+{
+	struct bytes *plaintext = bytes_from_str(s4c25_plaintext);
+	if (plaintext == NULL)
+		munit_error("bytes_from_str");
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	if (key == NULL)
+		munit_error("bytes_randomized");
+	const uint64_t nonce = rand_uint64();
+	struct bytes *ciphertext = aes_128_ctr_encrypt(plaintext, key, nonce);
+	if (ciphertext == NULL)
+		munit_error("aes_128_ctr_encrypt");
+
+	/* edit a random range */
+	const size_t offset = munit_rand_int_range(0, plaintext->len);
+	const size_t len = munit_rand_int_range(0, plaintext->len - offset);
+	struct bytes *replacement = bytes_randomized(len);
+	if (replacement == NULL)
+		munit_error("bytes_randomized");
+	int ret = aes_128_ctr_edit_oracle(ciphertext, key, nonce, offset,
+		    replacement);
+	munit_assert_int(ret, ==, 0);
+
+	/* it should match the encryption of the edited plaintext */
+	if (bytes_put(plaintext, offset, replacement) != 0)
+		munit_error("bytes_put");
+	struct bytes *expected = aes_128_ctr_encrypt(plaintext, key, nonce);
+	if (expected == NULL)
+		munit_error("aes_128_ctr_encrypt");
+	munit_assert_size(ciphertext->len, ==, expected->len);
+	munit_assert_memory_equal(ciphertext->len, ciphertext->data,
+		    expected->data);
+
+	/* a replacement going past the end should fail */
+	ret = aes_128_ctr_edit_oracle(ciphertext, key, nonce,
+		    plaintext->len - len + 1, replacement);
+	if (len > 0)
+		munit_assert_int(ret, ==, -1);
+
+	bytes_free(expected);
+	bytes_free(replacement);
+	bytes_free(ciphertext);
+	bytes_free(key);
+	bytes_free(plaintext);
+	return (MUNIT_OK);
+}
+
+
 /* Set 4 / Challenge 25 */
 static MunitResult
 test_aes_128_ctr_edit_breaker(const MunitParameter *params, void *data)
@@ -260,6 +309,7 @@ test_ctr_bitflipping_1(const MunitParameter *params, void *data)
 MunitTest test_break_ctr_suite_tests[] = {
 	{ "ctr_fixed_nonce-1",    test_ctr_fixed_nonce_1,        srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ctr_fixed_nonce-2",    test_ctr_fixed_nonce_2,        srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "ctr_edit_oracle",      test_aes_128_ctr_edit_oracle,  srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ctr_random_access_rw", test_aes_128_ctr_edit_breaker, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ctr_bitflipping-0",    test_ctr_bitflipping_0,        srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ctr_bitflipping-1",    test_ctr_bitflipping_1,        srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -100,10 +100,13 @@ test_ecb_baat_breaker12(const MunitParameter *params, void *data)
 	if (message == NULL)
 		munit_error("bytes_from_base64");
 
-	recovered = ecb_byte_at_a_time_breaker12(message, key);
+	struct ecb_byte_at_a_time_stats stats = { 0 };
+	recovered = ecb_byte_at_a_time_breaker12(message, key, &stats);
 	munit_assert_not_null(recovered);
 	munit_assert_size(recovered->len, ==, message->len);
 	munit_assert_memory_equal(message->len, message->data, recovered->data);
+	/* one query per message byte, plus the blocksize and ECB detection */
+	munit_assert_size(stats.queries, <=, message->len + 64);
 
 	bytes_free(recovered);
 	bytes_free(message);
@@ -191,10 +194,14 @@ test_ecb_baat_breaker14(const MunitParameter *params, void *data)
 	if (message == NULL)
 		munit_error("bytes_from_base64");
 
-	recovered = ecb_byte_at_a_time_breaker14(prefix, message, key);
+	struct ecb_byte_at_a_time_stats stats = { 0 };
+	recovered = ecb_byte_at_a_time_breaker14(prefix, message, key, &stats);
 	munit_assert_not_null(recovered);
 	munit_assert_size(recovered->len, ==, message->len);
 	munit_assert_memory_equal(message->len, message->data, recovered->data);
+	/* one query per message byte, plus the blocksize, ECB and prefix
+	   length detection */
+	munit_assert_size(stats.queries, <=, message->len + 64);
 
 	bytes_free(recovered);
 	bytes_free(message);
@@ -204,6 +211,51 @@ test_ecb_baat_breaker14(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_ecb_baat_oracle(const MunitParameter *params, void *data)
+{
+	struct bytes *recovered = NULL;
+	struct bytes *key = bytes_randomized(16);
+	struct bytes *prefix = bytes_randomized(munit_rand_int_range(0, 16 * 4));
+	if (key == NULL || prefix == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *message = bytes_from_base64(s2c12_message_base64);
+	if (message == NULL)
+		munit_error("bytes_from_base64");
+	struct oracle *oracle =
+		    ecb_byte_at_a_time_oracle14_new(prefix, message, key);
+	if (oracle == NULL)
+		munit_error("ecb_byte_at_a_time_oracle14_new");
+
+	recovered = ecb_byte_at_a_time_breaker(oracle);
+	munit_assert_not_null(recovered);
+	munit_assert_size(recovered->len, ==, message->len);
+	munit_assert_memory_equal(message->len, message->data, recovered->data);
+
+	/* the oracle accounting */
+	const struct oracle_stats *stats = &oracle->stats;
+	munit_assert_uint64(stats->queries, >, message->len);
+	munit_assert_uint64(stats->calls, <=, stats->queries);
+	munit_assert_uint64(stats->bytes_sent, >, 0);
+	munit_assert_uint64(stats->bytes_received, >, stats->bytes_sent);
+	const uint64_t p50 = oracle_latency_percentile(oracle, 0.5);
+	const uint64_t p99 = oracle_latency_percentile(oracle, 0.99);
+	munit_assert_uint64(p50, >, 0);
+	munit_assert_uint64(p50, <=, p99);
+
+	oracle_stats_reset(oracle);
+	munit_assert_uint64(stats->queries, ==, 0);
+	munit_assert_uint64(oracle_latency_percentile(oracle, 0.5), ==, 0);
+
+	oracle_free(oracle);
+	bytes_free(recovered);
+	bytes_free(message);
+	bytes_free(prefix);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_break_ecb_suite_tests[] = {
 	{ "ecb_detect-0",              test_ecb_detect_0,       NULL,        NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -214,6 +266,7 @@ MunitTest test_break_ecb_suite_tests[] = {
 	{ "ecb_cut_and_paste-0",       test_ecb_cnp_oracle,     srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ecb_cut_and_paste-1",       test_ecb_cnp_breaker,    srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "ecb_byte_at_a_time-harder", test_ecb_baat_breaker14, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "ecb_byte_at_a_time-oracle", test_ecb_baat_oracle,    srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
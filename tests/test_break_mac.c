@@ -2,9 +2,15 @@
  * test_break_mac.c
  */
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <ctype.h>
+#include <netdb.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "munit.h"
@@ -12,6 +18,7 @@
 
 #include "compat.h"
 #include "sha1.h"
+#include "hash.h"
 #include "mac.h"
 #include "break_mac.h"
 
@@ -37,6 +44,8 @@ static char *port_params[]      = { "9000", NULL };
 /* A delay of 50 takes like 90 minutes to complete, 5 takes about 9 minutes. The
    default (2) is the minimum that is still working and take about 3 minutes. */
 static char *delay_params[] = { "2", NULL };
+/* the Python server handles one request at a time */
+static char *nconn_params[] = { "1", NULL };
 /* all the server parameters */
 static MunitParameterEnum test_timing_leaking_server_params[] = {
 	{ "mac_server",   py_server_params },
@@ -44,6 +53,7 @@ static MunitParameterEnum test_timing_leaking_server_params[] = {
 	{ "mac_hostname", hostname_params },
 	{ "mac_port",     port_params },
 	{ "mac_delay",    delay_params },
+	{ "mac_nconn",    nconn_params },
 	{ NULL, NULL },
 };
 
@@ -136,6 +146,101 @@ py_server_tear_down(void *data)
 }
 
 
+/*
+ * The timing_leaking_serve() stand-in server, its key and the file it signs.
+ */
+struct native_server_settings {
+	pid_t pid;
+	char port[NI_MAXSERV];
+	char path[sizeof("/tmp/cryptopals-timing-leak-XXXXXX")];
+	/* the delay per matching character, in nanoseconds */
+	uint64_t delay;
+	struct bytes *key;
+	struct bytes *content;
+};
+
+
+/*
+ * Create a random key and file, and fork the timing_leaking_serve() server.
+ *
+ * Returns a pointer to a struct native_server_settings (provided as user_data
+ * to the test and tear down function).
+ */
+static void *
+native_server_setup(const MunitParameter *params, void *user_data)
+{
+	(void)srand_reset(params, user_data);
+
+	struct native_server_settings *server = NULL;
+	server = munit_malloc(sizeof(struct native_server_settings));
+	server->pid = -1;
+	/* 100µs per matching character */
+	server->delay = 100000;
+	server->key = bytes_randomized(sha1_hashlength());
+	server->content = bytes_randomized(munit_rand_int_range(0, 1024));
+	if (server->key == NULL || server->content == NULL)
+		munit_error("bytes_randomized");
+
+	/* the file to sign */
+	(void)strlcpy(server->path, "/tmp/cryptopals-timing-leak-XXXXXX",
+		    sizeof(server->path));
+	const int fd = mkstemp(server->path);
+	if (fd == -1)
+		munit_error("mkstemp");
+	const ssize_t n = write(fd, server->content->data,
+		    server->content->len);
+	(void)close(fd);
+	if (n != (ssize_t)server->content->len) {
+		(void)unlink(server->path);
+		munit_error("write");
+	}
+
+	const int listener = loopback_listen(server->port);
+	if (listener == -1) {
+		(void)unlink(server->path);
+		munit_error("loopback_listen");
+	}
+	server->pid = fork();
+	switch (server->pid) {
+	case -1: /* error */
+		(void)unlink(server->path);
+		munit_error("fork");
+		/* NOTREACHED */
+	case 0: /* child process */
+		(void)timing_leaking_serve(listener, server->key,
+			    server->delay, 2);
+		_exit(EXIT_FAILURE);
+		/* NOTREACHED */
+	default: /* parent process */
+		(void)close(listener);
+		return (server);
+	}
+}
+
+
+/*
+ * Kill the server started by native_server_setup(), whatever the test outcome,
+ * remove its file and free the associated resources.
+ */
+static void
+native_server_tear_down(void *data)
+{
+	struct native_server_settings *server = data;
+
+	if (server == NULL)
+		return;
+
+	if (server->pid > 0 && kill(server->pid, SIGTERM) == 0) {
+		if (waitpid(server->pid, NULL, 0) != server->pid)
+			munit_error("waitpid");
+	}
+	(void)unlink(server->path);
+	bytes_free(server->content);
+	bytes_free(server->key);
+	free(server);
+}
+
+
 /* Set 4 / Challenge 29 */
 static MunitResult
 test_extend_sha1_mac_keyed_prefix(const MunitParameter *params, void *data)
@@ -155,12 +260,18 @@ test_extend_sha1_mac_keyed_prefix(const MunitParameter *params, void *data)
 	munit_assert_int(ret, ==, 0);
 
 	/* perform the message extension */
+	struct oracle *oracle = sha1_mac_keyed_prefix_oracle_new(key);
+	if (oracle == NULL)
+		munit_error("sha1_mac_keyed_prefix_oracle_new");
 	struct bytes *ext_msg = NULL, *ext_mac = NULL;
-	ret = extend_sha1_mac_keyed_prefix(key, msg, mac,
+	ret = extend_sha1_mac_keyed_prefix(oracle, msg, mac,
 		    &ext_msg, &ext_mac);
 	munit_assert_int(ret, ==, 0);
 	munit_assert_not_null(ext_msg);
 	munit_assert_not_null(ext_mac);
+	/* one query per key length tried */
+	munit_assert_uint64(oracle->stats.queries, ==, key->len + 1);
+	munit_assert_uint64(oracle->stats.calls, ==, oracle->stats.queries);
 
 	/* ensure that the extension has injected the admin=true payload */
 	struct bytes *admin = bytes_from_str(";admin=true;");
@@ -173,6 +284,7 @@ test_extend_sha1_mac_keyed_prefix(const MunitParameter *params, void *data)
 	ret = sha1_mac_keyed_prefix_verify(key, ext_msg, ext_mac);
 	munit_assert_int(ret, ==, 0);
 
+	oracle_free(oracle);
 	bytes_free(admin);
 	bytes_free(ext_mac);
 	bytes_free(ext_msg);
@@ -202,12 +314,18 @@ test_extend_md4_mac_keyed_prefix(const MunitParameter *params, void *data)
 	munit_assert_int(ret, ==, 0);
 
 	/* perform the message extension */
+	struct oracle *oracle = md4_mac_keyed_prefix_oracle_new(key);
+	if (oracle == NULL)
+		munit_error("md4_mac_keyed_prefix_oracle_new");
 	struct bytes *ext_msg = NULL, *ext_mac = NULL;
-	ret = extend_md4_mac_keyed_prefix(key, msg, mac,
+	ret = extend_md4_mac_keyed_prefix(oracle, msg, mac,
 		    &ext_msg, &ext_mac);
 	munit_assert_int(ret, ==, 0);
 	munit_assert_not_null(ext_msg);
 	munit_assert_not_null(ext_mac);
+	/* one query per key length tried */
+	munit_assert_uint64(oracle->stats.queries, ==, key->len + 1);
+	munit_assert_uint64(oracle->stats.calls, ==, oracle->stats.queries);
 
 	/* ensure that the extension has injected the admin=true payload */
 	struct bytes *admin = bytes_from_str(";admin=true;");
@@ -220,6 +338,7 @@ test_extend_md4_mac_keyed_prefix(const MunitParameter *params, void *data)
 	ret = md4_mac_keyed_prefix_verify(key, ext_msg, ext_mac);
 	munit_assert_int(ret, ==, 0);
 
+	oracle_free(oracle);
 	bytes_free(admin);
 	bytes_free(ext_mac);
 	bytes_free(ext_msg);
@@ -230,6 +349,414 @@ test_extend_md4_mac_keyed_prefix(const MunitParameter *params, void *data)
 }
 
 
+/* Set 4 / Challenge 29 & 30, using the generic interface with SHA-256 */
+static MunitResult
+test_extend_sha256_mac_keyed_prefix(const MunitParameter *params, void *data)
+{
+	/* longer keys than the SHA-1 and MD4 tests */
+	struct bytes *key = bytes_randomized(munit_rand_int_range(0, 300));
+	if (key == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *msg = bytes_from_str("comment1=cooking%20MCs;userdata=foo;comment2=%20like%20a%20pound%20of%20bacon");
+	if (msg == NULL)
+		munit_error("bytes_from_str");
+	struct bytes *mac = mac_keyed_prefix(&hash_sha256, key, msg);
+	if (mac == NULL)
+		munit_error("mac_keyed_prefix");
+	munit_assert_size(mac->len, ==, sha256_hashlength());
+
+	/* perform the message extension */
+	struct oracle *oracle = mac_keyed_prefix_oracle_new(&hash_sha256, key);
+	if (oracle == NULL)
+		munit_error("mac_keyed_prefix_oracle_new");
+	struct bytes *ext_msg = NULL, *ext_mac = NULL;
+	int ret = extend_mac_keyed_prefix(&hash_sha256, oracle,
+		    0, MAC_KEYED_PREFIX_MAX_KEYLEN, msg, mac,
+		    &ext_msg, &ext_mac);
+	munit_assert_int(ret, ==, 0);
+	munit_assert_not_null(ext_msg);
+	munit_assert_not_null(ext_mac);
+	/* one query per key length tried, none after the successful one */
+	munit_assert_uint64(oracle->stats.queries, ==, key->len + 1);
+
+	/* verify the extended message against its forged MAC */
+	ret = mac_keyed_prefix_verify(&hash_sha256, key, ext_msg, ext_mac);
+	munit_assert_int(ret, ==, 0);
+
+	/* a range holding only the key length needs a single query */
+	oracle_stats_reset(oracle);
+	ret = extend_mac_keyed_prefix(&hash_sha256, oracle,
+		    key->len, key->len, msg, mac, NULL, NULL);
+	munit_assert_int(ret, ==, 0);
+	munit_assert_uint64(oracle->stats.queries, ==, 1);
+
+	/* a range not holding the key length fails after trying it all */
+	oracle_stats_reset(oracle);
+	ret = extend_mac_keyed_prefix(&hash_sha256, oracle,
+		    key->len + 1, key->len + 100, msg, mac, NULL, NULL);
+	munit_assert_int(ret, ==, -1);
+	munit_assert_uint64(oracle->stats.queries, ==, 100);
+
+	/* a MAC of the wrong length can't be extended */
+	struct bytes *short_mac = bytes_slice(mac, 0, mac->len - 1);
+	if (short_mac == NULL)
+		munit_error("bytes_slice");
+	ret = extend_mac_keyed_prefix(&hash_sha256, oracle,
+		    0, MAC_KEYED_PREFIX_MAX_KEYLEN, msg, short_mac, NULL, NULL);
+	munit_assert_int(ret, ==, -1);
+
+	/* when an empty range or NULL is given */
+	ret = extend_mac_keyed_prefix(&hash_sha256, oracle, 1, 0, msg, mac,
+		    NULL, NULL);
+	munit_assert_int(ret, ==, -1);
+	ret = extend_mac_keyed_prefix(NULL, oracle, 0, 0, msg, mac,
+		    NULL, NULL);
+	munit_assert_int(ret, ==, -1);
+	munit_assert_null(mac_keyed_prefix_oracle_new(NULL, key));
+
+	bytes_free(short_mac);
+	oracle_free(oracle);
+	bytes_free(ext_mac);
+	bytes_free(ext_msg);
+	bytes_free(mac);
+	bytes_free(msg);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
+/*
+ * A simulated timing leaking server, comparing the MAC hex representations
+ * character by character and sleeping delay nanoseconds for each matching one
+ * like the Python server.
+ */
+struct simulated_server {
+	const struct bytes *mac;
+	uint64_t delay;
+	uint64_t requests;
+	/* when set, the durations have no noise at all */
+	int quiet;
+};
+
+
+static int
+simulated_server_probe(void *arg, size_t count,
+		    const struct bytes *const *macs, int *statuses,
+		    uint64_t *ns)
+{
+	struct simulated_server *server = arg;
+	const struct bytes *mac = server->mac;
+
+	for (size_t k = 0; k < count; k++) {
+		const struct bytes *guess = macs[k];
+		if (guess->len != mac->len)
+			return (-1);
+		size_t matching = 0;
+		for (size_t i = 0; i < mac->len; i++) {
+			if ((guess->data[i] >> 4) != (mac->data[i] >> 4))
+				break;
+			matching++;
+			if ((guess->data[i] & 0xf) != (mac->data[i] & 0xf))
+				break;
+			matching++;
+		}
+		statuses[k] = (matching == 2 * mac->len ? 200 : 500);
+		/* a noise larger than a byte leak and a few large outliers */
+		uint64_t noise = 0;
+		if (!server->quiet) {
+			noise = munit_rand_int_range(0, 3 * server->delay);
+			if (munit_rand_int_range(0, 49) == 0)
+				noise += 50 * server->delay;
+		}
+		ns[k] = 100000 + matching * server->delay + noise;
+		server->requests++;
+	}
+
+	return (0);
+}
+
+
+static int
+failing_probe(void *arg, size_t count, const struct bytes *const *macs,
+		    int *statuses, uint64_t *ns)
+{
+	return (-1);
+}
+
+
+/* Set 4 / Challenge 31 & 32, against a simulated server */
+static MunitResult
+test_timing_leak(const MunitParameter *params, void *data)
+{
+	struct bytes *mac = bytes_randomized(sha1_hashlength());
+	if (mac == NULL)
+		munit_error("bytes_randomized");
+	struct simulated_server server = {
+		.mac = mac,
+		.delay = 1000,
+		.requests = 0,
+	};
+
+	struct bytes *guess = break_timing_leak(simulated_server_probe,
+		    &server, mac->len);
+	munit_assert_not_null(guess);
+	munit_assert_size(guess->len, ==, mac->len);
+	munit_assert_memory_equal(guess->len, guess->data, mac->data);
+	/* far less than the TIMING_LEAK_MAX_SAMPLES requests per candidate
+	   that a fixed sample count would need */
+	munit_assert_uint64(server.requests, <, 16 * 256 * mac->len);
+
+	/* when the probe fails */
+	munit_assert_null(break_timing_leak(failing_probe, NULL, mac->len));
+
+	/* when NULL or an empty length is given */
+	munit_assert_null(break_timing_leak(NULL, &server, mac->len));
+	munit_assert_null(break_timing_leak(simulated_server_probe, &server,
+		    0));
+
+	bytes_free(guess);
+	bytes_free(mac);
+	return (MUNIT_OK);
+}
+
+
+/* the durations measured for a single MAC byte */
+static MunitResult
+test_timing_leak_byte(const MunitParameter *params, void *data)
+{
+	struct bytes *mac = bytes_randomized(sha1_hashlength());
+	if (mac == NULL)
+		munit_error("bytes_randomized");
+	const uint64_t delay = 1000;
+	struct simulated_server server = {
+		.mac = mac,
+		.delay = delay,
+		.requests = 0,
+		.quiet = 1,
+	};
+	const size_t positions[] = { 0, 1, 7, sha1_hashlength() - 2 };
+	uint64_t base = 0, level = 0;
+	struct bytes *guess = bytes_dup(mac);
+	if (guess == NULL)
+		munit_error("bytes_dup");
+
+	for (size_t k = 0; k < sizeof(positions) / sizeof(*positions); k++) {
+		const size_t i = positions[k];
+		/* the prefix is right and the first hex character after the
+		   raced byte is wrong */
+		(void)memcpy(guess->data, mac->data, mac->len);
+		for (size_t j = i + 1; j < guess->len; j++)
+			guess->data[j] ^= 0xf0;
+		/* the candidates with a wrong first hex character match 2 * i
+		   characters, the right one 2 * i + 2 */
+		const uint64_t wrong = 100000 + 2 * i * delay;
+		const uint64_t right = wrong + 2 * delay;
+
+		server.quiet = 1;
+		int byte = break_timing_leak_byte(simulated_server_probe,
+			    &server, guess, i, &base, &level);
+		munit_assert_int(byte, ==, mac->data[i]);
+		munit_assert_uint64(base, ==, wrong);
+		munit_assert_uint64(level, ==, right);
+
+		/* the noise adds up to 3 * delay */
+		server.quiet = 0;
+		byte = break_timing_leak_byte(simulated_server_probe,
+			    &server, guess, i, &base, &level);
+		munit_assert_int(byte, ==, mac->data[i]);
+		munit_assert_uint64(base, >=, wrong);
+		munit_assert_uint64(base, <=, wrong + 3 * delay);
+		munit_assert_uint64(level, >=, right);
+		munit_assert_uint64(level, <=, right + 3 * delay);
+	}
+
+	/* the last byte can't be raced, and NULL checks */
+	munit_assert_int(break_timing_leak_byte(simulated_server_probe,
+		    &server, mac, mac->len - 1, NULL, NULL), ==, -1);
+	munit_assert_int(break_timing_leak_byte(NULL, &server, mac, 0, NULL,
+		    NULL), ==, -1);
+	munit_assert_int(break_timing_leak_byte(failing_probe, NULL, mac, 0,
+		    NULL, NULL), ==, -1);
+
+	bytes_free(guess);
+	bytes_free(mac);
+	return (MUNIT_OK);
+}
+
+
+/*
+ * Send a HTTP/1.0 GET request for target to the server listening on the given
+ * port of the IPv4 loopback address and read its response.
+ *
+ * Returns the NUL-terminated response, or NULL on error. ns_p is set to the
+ * request duration in nanoseconds.
+ */
+static char *
+http_get(const char *port, const char *target, uint64_t *ns_p)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	struct timespec start, end;
+	char *request = NULL, *rsp = NULL;
+	size_t len = 0, cap = 0;
+	int s = -1, success = 0;
+
+	(void)memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo("127.0.0.1", port, &hints, &res) != 0)
+		goto cleanup;
+	s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (s == -1 || connect(s, res->ai_addr, res->ai_addrlen) != 0)
+		goto cleanup;
+	const int reqlen = asprintf(&request, "GET %s HTTP/1.0\r\n\r\n",
+		    target);
+	if (reqlen == -1)
+		goto cleanup;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &start) != 0)
+		goto cleanup;
+	if (write(s, request, reqlen) != reqlen)
+		goto cleanup;
+	/* HTTP/1.0, the server closes the connection after its response */
+	for (;;) {
+		if (cap - len < 512) {
+			char *p = realloc(rsp, cap + 4096);
+			if (p == NULL)
+				goto cleanup;
+			rsp = p;
+			cap += 4096;
+		}
+		const ssize_t n = read(s, rsp + len, cap - len - 1);
+		if (n == -1)
+			goto cleanup;
+		if (n == 0)
+			break;
+		len += n;
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &end) != 0)
+		goto cleanup;
+	rsp[len] = '\0';
+	*ns_p = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+		    end.tv_nsec - start.tv_nsec;
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (s != -1)
+		(void)close(s);
+	if (res != NULL)
+		freeaddrinfo(res);
+	free(request);
+	if (!success) {
+		free(rsp);
+		rsp = NULL;
+	}
+	return (rsp);
+}
+
+
+/* Set 4 / Challenge 31 & 32, the C stand-in server */
+static MunitResult
+test_timing_leaking_serve(const MunitParameter *params, void *data)
+{
+	const struct native_server_settings *server = data;
+	const char *port = server->port, *path = server->path;
+	const uint64_t delay = server->delay;
+	struct bytes *key = server->key;
+	struct bytes *mac = hmac(&hash_sha1, key, server->content);
+	if (mac == NULL)
+		munit_error("hmac");
+	char *hex = bytes_to_hex(mac);
+	if (hex == NULL)
+		munit_error("bytes_to_hex");
+	const size_t hexlen = strlen(hex);
+	for (size_t i = 0; i < hexlen; i++)
+		hex[i] = (char)tolower((unsigned char)hex[i]);
+
+	/* a signature matching on its first characters leaks their count,
+	   the valid one is compared ignoring the case. The body is always the
+	   valid signature in lowercase, like Python's hexdigest(). */
+	const struct {
+		size_t matching;
+		int upper;
+		int status;
+	} vectors[] = {
+		{ .matching = hexlen, .upper = 1, .status = 200 },
+		{ .matching = hexlen, .upper = 0, .status = 200 },
+		{ .matching = 0,      .upper = 0, .status = 500 },
+		{ .matching = 1,      .upper = 0, .status = 500 },
+		{ .matching = 16,     .upper = 0, .status = 500 },
+		{ .matching = 39,     .upper = 0, .status = 500 },
+	};
+	const size_t nvectors = sizeof(vectors) / sizeof(*vectors);
+	for (size_t i = 0; i < nvectors; i++) {
+		const size_t matching = vectors[i].matching;
+		char signature[2 * HASH_MAX_HASHLENGTH + 1];
+		(void)strlcpy(signature, hex, sizeof(signature));
+		/* change the first non-matching character */
+		if (matching < hexlen) {
+			const char c = hex[matching];
+			signature[matching] = (c == '0' ? '1' : '0');
+		}
+		for (size_t j = 0; vectors[i].upper && j < hexlen; j++) {
+			const unsigned char c = signature[j];
+			signature[j] = (char)toupper(c);
+		}
+		char *target = NULL;
+		if (asprintf(&target, "/test?file=%s&signature=%s", path,
+			    signature) == -1)
+			munit_error("asprintf");
+		uint64_t ns = 0;
+		char *rsp = http_get(port, target, &ns);
+		munit_assert_not_null(rsp);
+		int status = 0;
+		munit_assert_int(sscanf(rsp, "HTTP/1.1 %d", &status), ==, 1);
+		munit_assert_int(status, ==, vectors[i].status);
+		munit_assert_uint64(ns, >=, matching * delay);
+		const char *body = strstr(rsp, "\r\n\r\n");
+		munit_assert_not_null(body);
+		munit_assert_string_equal(body + 4, hex);
+		free(rsp);
+		free(target);
+	}
+
+	/* bad requests */
+	const struct {
+		const char *fmt;
+		int status;
+	} bad[] = {
+		{ .fmt = "/test?file=%s",                    .status = 400 },
+		{ .fmt = "/test?file=%s-missing&signature=", .status = 404 },
+		{ .fmt = "/nope?file=%s&signature=",         .status = 404 },
+		{ .fmt = "/test?file=%s&signature=00",       .status = 500 },
+	};
+	const size_t nbad = sizeof(bad) / sizeof(*bad);
+	for (size_t i = 0; i < nbad; i++) {
+		char *target = NULL;
+		if (asprintf(&target, bad[i].fmt, path) == -1)
+			munit_error("asprintf");
+		uint64_t ns = 0;
+		char *rsp = http_get(port, target, &ns);
+		munit_assert_not_null(rsp);
+		int status = 0;
+		munit_assert_int(sscanf(rsp, "HTTP/1.1 %d", &status), ==, 1);
+		munit_assert_int(status, ==, bad[i].status);
+		free(rsp);
+		free(target);
+	}
+
+	/* when NULL or no thread is given */
+	munit_assert_int(timing_leaking_serve(-1, key, 0, 1), ==, -1);
+	munit_assert_int(timing_leaking_serve(0, NULL, 0, 1), ==, -1);
+	munit_assert_int(timing_leaking_serve(0, key, 0, 0), ==, -1);
+
+	free(hex);
+	bytes_free(mac);
+	return (MUNIT_OK);
+}
+
+
 /* Set 4 / Challenge 31 & 32 */
 static MunitResult
 test_timing_leaking_server(const MunitParameter *params, void *data)
@@ -250,7 +777,8 @@ test_timing_leaking_server(const MunitParameter *params, void *data)
 
 	const char *hostname = munit_parameters_get(params, "mac_hostname");
 	const char *port     = munit_parameters_get(params, "mac_port");
-	if (hostname == NULL || port == NULL)
+	const char *nconn    = munit_parameters_get(params, "mac_nconn");
+	if (hostname == NULL || port == NULL || nconn == NULL)
 		return (MUNIT_ERROR);
 
 	struct bytes *content = fs_read(filepath);
@@ -262,7 +790,7 @@ test_timing_leaking_server(const MunitParameter *params, void *data)
 		munit_error("asprintf");
 
 	struct bytes *guess = break_timing_leaking_server(hostname, port, query,
-		    sha1_hashlength());
+		    sha1_hashlength(), strtoul(nconn, NULL, 10));
 
 	munit_assert_not_null(guess);
 	munit_assert_size(guess->len, ==, sha1_hashlength());
@@ -284,8 +812,12 @@ test_timing_leaking_server(const MunitParameter *params, void *data)
 
 /* The test suite. */
 MunitTest test_break_mac_suite_tests[] = {
-	{ "sha1_length_extension", test_extend_sha1_mac_keyed_prefix, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
-	{ "md4_length_extension",  test_extend_md4_mac_keyed_prefix,  srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_length_extension",   test_extend_sha1_mac_keyed_prefix,   srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "md4_length_extension",    test_extend_md4_mac_keyed_prefix,    srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_length_extension", test_extend_sha256_mac_keyed_prefix, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "timing_leak",             test_timing_leak,                    srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "timing_leak_byte",        test_timing_leak_byte,               srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "timing_leaking_serve",    test_timing_leaking_serve,           native_server_setup, native_server_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = "timing_leaking_server",
 		.test       = test_timing_leaking_server,
@@ -1,7 +1,10 @@
 /*
  * test_break_mt19937.c
  */
+#include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "munit.h"
 #include "helpers.h"
@@ -59,6 +62,43 @@ test_mt19937_clone(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_mt19937_clone_from_outputs(const MunitParameter *params, void *data)
+{
+	const uint32_t seed  = munit_rand_uint32();
+	const size_t count = 624 + munit_rand_int_range(0, 2048);
+	const size_t next = 1024;
+	uint32_t *outputs = munit_calloc(count + next, sizeof(uint32_t));
+	uint32_t *cloned  = munit_calloc(next, sizeof(uint32_t));
+
+	/* error conditions */
+	munit_assert_null(mt19937_clone_from_outputs(NULL, 624));
+	munit_assert_null(mt19937_clone_from_outputs(outputs, 623));
+	munit_assert_int(mt19937_untemper_batch(NULL, 1, cloned), ==, -1);
+	munit_assert_int(mt19937_untemper_batch(outputs, 1, NULL), ==, -1);
+
+	struct mt19937_generator *gen = mt19937_init(seed);
+	if (gen == NULL)
+		munit_error("mt19937_init");
+	if (mt19937_fill(gen, outputs, count + next) != 0)
+		munit_error("mt19937_fill");
+
+	/* the clone should predict the outputs following the given ones */
+	struct mt19937_generator *clone =
+		    mt19937_clone_from_outputs(outputs, count);
+	munit_assert_not_null(clone);
+	munit_assert_int(mt19937_fill(clone, cloned, next), ==, 0);
+	munit_assert_memory_equal(next * sizeof(uint32_t), cloned,
+		    outputs + count);
+
+	mt19937_free(clone);
+	mt19937_free(gen);
+	free(cloned);
+	free(outputs);
+	return (MUNIT_OK);
+}
+
+
 /* Set 3 / Challenge 24 */
 static MunitResult
 test_mt19937_encryption_breaker(const MunitParameter *params, void *data)
@@ -127,12 +167,165 @@ test_mt19937_token_breaker(const MunitParameter *params, void *data)
 }
 
 
+/* mt19937_recover_seed() progress callback, checking the reported values */
+static void
+recover_progress(const struct mt19937_recover_progress *progress, void *arg)
+{
+	size_t *calls = arg;
+
+	munit_assert_uint64(progress->searched, <=, progress->total);
+	munit_assert_double(progress->seeds_per_second, >=, 0);
+	*calls += 1;
+}
+
+
+static MunitResult
+test_mt19937_recover_seed(const MunitParameter *params, void *data)
+{
+	const uint32_t range = 1 << 18;
+	uint32_t outputs[2];
+
+	for (size_t i = 0; i < 4; i++) {
+		const uint32_t lo = munit_rand_uint32() % (UINT32_MAX - 2 * range);
+		const uint32_t seed = lo + munit_rand_int_range(0, range - 1);
+		if (mt19937_first_outputs(seed, 2, outputs) != 0)
+			munit_error("mt19937_first_outputs");
+
+		/* nthreads = 0 is one per online CPU */
+		uint32_t recovered = 0;
+		size_t calls = 0;
+		int ret = mt19937_recover_seed(outputs, 2, lo, lo + range - 1,
+			    i, recover_progress, &calls, &recovered);
+		munit_assert_int(ret, ==, 0);
+		munit_assert_uint32(recovered, ==, seed);
+		munit_assert_size(calls, >=, 1);
+
+		/* search a range not including the seed */
+		ret = mt19937_recover_seed(outputs, 2, seed + 1,
+			    seed + 4096, i, NULL, NULL, NULL);
+		munit_assert_int(ret, ==, 1);
+	}
+
+	/* error conditions */
+	munit_assert_int(mt19937_recover_seed(NULL, 2, 0, 1, 1, NULL, NULL,
+		    NULL), ==, -1);
+	munit_assert_int(mt19937_recover_seed(outputs, 0, 0, 1, 1, NULL, NULL,
+		    NULL), ==, -1);
+	munit_assert_int(mt19937_recover_seed(outputs, 2, 1, 0, 1, NULL, NULL,
+		    NULL), ==, -1);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_mt19937_unwind_breaker(const MunitParameter *params, void *data)
+{
+	const uint32_t seed = munit_rand_uint32();
+	const size_t rounds = munit_rand_int_range(0, 16);
+	uint32_t outputs[624];
+
+	/* error conditions */
+	munit_assert_int(mt19937_unwind_breaker(NULL, 1, NULL), ==, -1);
+
+	/* clone the generator somewhere in its stream */
+	struct mt19937_generator *gen = mt19937_init(seed);
+	if (gen == NULL)
+		munit_error("mt19937_init");
+	if (mt19937_jump(gen, rounds * 624) != 0)
+		munit_error("mt19937_jump");
+	if (mt19937_fill(gen, outputs, 624) != 0)
+		munit_error("mt19937_fill");
+	struct mt19937_generator *clone =
+		    mt19937_clone_from_outputs(outputs, 624);
+	if (clone == NULL)
+		munit_error("mt19937_clone_from_outputs");
+
+	uint32_t found = 0;
+	int ret = mt19937_unwind_breaker(clone, rounds, &found);
+	munit_assert_int(ret, ==, 1);
+	ret = mt19937_unwind_breaker(clone, 1, &found);
+	munit_assert_int(ret, ==, 0);
+	munit_assert_uint32(found, ==, seed);
+
+	mt19937_free(clone);
+	mt19937_free(gen);
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_mt19937_lookup_seed(const MunitParameter *params, void *data)
+{
+	const uint32_t range = 1 << 14;
+	const uint32_t lo = munit_rand_uint32() % (UINT32_MAX - range);
+	const uint32_t hi = lo + range - 1;
+	char path[] = "/tmp/cryptopals-mt19937-index-XXXXXX";
+	uint32_t seeds[4];
+
+	const int fd = mkstemp(path);
+	if (fd == -1)
+		munit_error("mkstemp");
+	(void)close(fd);
+
+	/* error conditions */
+	munit_assert_int(mt19937_index_build(NULL, lo, hi), ==, -1);
+	munit_assert_int(mt19937_index_build(path, hi, lo), ==, -1);
+	munit_assert_null(mt19937_index_open(NULL));
+	munit_assert_int(mt19937_lookup_seed(NULL, 0, seeds, 4), ==, -1);
+	/* not an index */
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL)
+		munit_error("fopen");
+	(void)fprintf(fp, "not an index, surely.\n");
+	(void)fclose(fp);
+	munit_assert_null(mt19937_index_open(path));
+
+	int ret = mt19937_index_build(path, lo, hi);
+	munit_assert_int(ret, ==, 0);
+	struct mt19937_index *index = mt19937_index_open(path);
+	munit_assert_not_null(index);
+
+	for (size_t i = 0; i < 64; i++) {
+		const uint32_t seed = lo + munit_rand_int_range(0, range - 1);
+		uint32_t output = 0;
+		if (mt19937_first_outputs(seed, 1, &output) != 0)
+			munit_error("mt19937_first_outputs");
+		const int found = mt19937_lookup_seed(index, output, seeds, 4);
+		munit_assert_int(found, >=, 1);
+		int seen = 0;
+		for (int j = 0; j < found && j < 4; j++)
+			seen |= (seeds[j] == seed);
+		munit_assert_true(seen);
+	}
+
+	/* the generator seeded with hi + 1 should not be found */
+	if (hi < UINT32_MAX) {
+		uint32_t output = 0;
+		if (mt19937_first_outputs(hi + 1, 1, &output) != 0)
+			munit_error("mt19937_first_outputs");
+		const int found = mt19937_lookup_seed(index, output, seeds, 4);
+		munit_assert_int(found, >=, 0);
+		for (int j = 0; j < found && j < 4; j++)
+			munit_assert_uint32(seeds[j], !=, hi + 1);
+	}
+
+	mt19937_index_close(index);
+	(void)unlink(path);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_break_mt19937_suite_tests[] = {
 	{ "time_seeder", test_mt19937_time_seeder_breaker, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "clone",       test_mt19937_clone,               srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "clone_from_outputs", test_mt19937_clone_from_outputs, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "encrypt",     test_mt19937_encryption_breaker,  srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "token",       test_mt19937_token_breaker,       srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "recover_seed", test_mt19937_recover_seed,       srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "unwind",      test_mt19937_unwind_breaker,      srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "lookup_seed", test_mt19937_lookup_seed,         srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -1,6 +1,8 @@
 /*
  * test_bytes.c
  */
+#include <pthread.h>
+
 #include "munit.h"
 #include "helpers.h"
 #include "bytes.h"
@@ -1184,6 +1186,77 @@ test_bytes_bzero(const MunitParameter *params, void *data)
 }
 
 
+/* fill the 64 bytes at arg from another thread */
+static void *
+random_fill_thread(void *arg)
+{
+	return (bytes_random_fill(arg, 64) == 0 ? arg : NULL);
+}
+
+
+static MunitResult
+test_bytes_random_fill(const MunitParameter *params, void *data)
+{
+	uint8_t a[103], b[103], threads[4][64];
+	const uint64_t seed = rand_uint64();
+
+	/* the same seed yields the same data, whatever the chunks */
+	bytes_random_seed(seed);
+	munit_assert_int(bytes_random_fill(a, sizeof(a)), ==, 0);
+	bytes_random_seed(seed);
+	munit_assert_int(bytes_random_fill(b, 16), ==, 0);
+	munit_assert_int(bytes_random_fill(b + 16, sizeof(b) - 16), ==, 0);
+	munit_assert_memory_equal(sizeof(a), a, b);
+	/* but not another seed */
+	bytes_random_seed(seed + 1);
+	munit_assert_int(bytes_random_fill(b, sizeof(b)), ==, 0);
+	munit_assert_memory_not_equal(sizeof(a), a, b);
+
+	/* about half of the bits are set */
+	struct bytes *buf = bytes_zeroed(1 << 16);
+	if (buf == NULL)
+		munit_error("bytes_zeroed");
+	munit_assert_int(bytes_random_fill(buf->data, buf->len), ==, 0);
+	size_t ones = 0;
+	for (size_t i = 0; i < buf->len; i++) {
+		for (uint8_t x = buf->data[i]; x != 0; x &= x - 1)
+			ones++;
+	}
+	/* the expected count is 262144 with a standard deviation of 362 */
+	munit_assert_size(ones, >, 262144 - 4000);
+	munit_assert_size(ones, <, 262144 + 4000);
+
+	/* each thread draws its own values */
+	bytes_random_seed(seed);
+	pthread_t tids[4];
+	const size_t nthreads = sizeof(tids) / sizeof(*tids);
+	for (size_t i = 0; i < nthreads; i++) {
+		if (pthread_create(&tids[i], NULL, random_fill_thread,
+			    threads[i]) != 0)
+			munit_error("pthread_create");
+	}
+	for (size_t i = 0; i < nthreads; i++) {
+		void *ret = NULL;
+		if (pthread_join(tids[i], &ret) != 0)
+			munit_error("pthread_join");
+		munit_assert_ptr(ret, ==, threads[i]);
+	}
+	for (size_t i = 0; i < nthreads; i++) {
+		for (size_t j = i + 1; j < nthreads; j++) {
+			munit_assert_memory_not_equal(sizeof(threads[i]),
+				    threads[i], threads[j]);
+		}
+	}
+
+	/* when NULL is given */
+	munit_assert_int(bytes_random_fill(NULL, 0), ==, 0);
+	munit_assert_int(bytes_random_fill(NULL, 1), ==, -1);
+
+	bytes_free(buf);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_bytes_suite_tests[] = {
 	{ "bytes_zeroed",           test_bytes_zeroed,           NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -1215,6 +1288,7 @@ MunitTest test_bytes_suite_tests[] = {
 	{ "bytes_to_base64",        test_bytes_to_base64,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "bytes_hex_to_base64",    test_bytes_hex_to_base64,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "bytes_bzero",            test_bytes_bzero,            srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "bytes_random_fill",      test_bytes_random_fill,      srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -4,6 +4,7 @@
 #include "munit.h"
 #include "helpers.h"
 #include "nope.h"
+#include "aes.h"
 #include "ctr.h"
 #include "test_ctr.h"
 
@@ -108,12 +109,68 @@ test_aes_128_ctr_decrypt_1(const MunitParameter *params, void *data)
 }
 
 
+/* keystream seeking */
+static MunitResult
+test_aes_128_ctr_keystream(const MunitParameter *params, void *data)
+{
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	if (key == NULL)
+		munit_error("bytes_randomized");
+	const uint64_t nonce = rand_uint64();
+	const size_t total = munit_rand_int_range(0, 256);
+
+	/* the full keystream is the encryption of zeroes */
+	struct bytes *zeroes = bytes_zeroed(total);
+	if (zeroes == NULL)
+		munit_error("bytes_zeroed");
+	struct bytes *full = aes_128_ctr_encrypt(zeroes, key, nonce);
+	if (full == NULL)
+		munit_error("aes_128_ctr_encrypt");
+
+	for (size_t offset = 0; offset <= total; offset++) {
+		const size_t len = munit_rand_int_range(0, total - offset);
+		struct bytes *keystream =
+			    aes_128_ctr_keystream(key, nonce, offset, len);
+		munit_assert_not_null(keystream);
+		munit_assert_size(keystream->len, ==, len);
+		munit_assert_memory_equal(len, keystream->data,
+			    full->data + offset);
+		bytes_free(keystream);
+
+		/* decrypting a range in place of the full keystream leaves
+		   zeroes in it */
+		struct bytes *buf = bytes_dup(full);
+		if (buf == NULL)
+			munit_error("bytes_dup");
+		int ret = aes_128_ctr_crypt_at(buf, offset, len, key, nonce);
+		munit_assert_int(ret, ==, 0);
+		munit_assert_memory_equal(offset, buf->data, full->data);
+		munit_assert_memory_equal(len, buf->data + offset,
+			    zeroes->data);
+		munit_assert_memory_equal(total - offset - len,
+			    buf->data + offset + len,
+			    full->data + offset + len);
+		/* out of bounds */
+		ret = aes_128_ctr_crypt_at(buf, offset, total - offset + 1,
+			    key, nonce);
+		munit_assert_int(ret, ==, -1);
+		bytes_free(buf);
+	}
+
+	bytes_free(full);
+	bytes_free(zeroes);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_ctr_suite_tests[] = {
 	{ "aes_128_ctr_encrypt-0", test_aes_128_ctr_encrypt_0, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "aes_128_ctr_encrypt-1", test_aes_128_ctr_encrypt_1, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "aes_128_ctr_decrypt-0", test_aes_128_ctr_decrypt_0, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "aes_128_ctr_decrypt-1", test_aes_128_ctr_decrypt_1, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "aes_128_ctr_keystream", test_aes_128_ctr_keystream, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
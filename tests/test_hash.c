@@ -0,0 +1,320 @@
+/*
+ * test_hash.c
+ */
+#include "munit.h"
+#include "helpers.h"
+#include "hash.h"
+
+
+/* the hash functions under test along their expected sizes */
+static const struct {
+	const struct hash_function *hash;
+	size_t hashlength;
+	size_t blocksize;
+} hash_functions[] = {
+	{ .hash = &hash_sha1,   .hashlength = 20, .blocksize = 64 },
+	{ .hash = &hash_md4,    .hashlength = 16, .blocksize = 64 },
+	{ .hash = &hash_sha256, .hashlength = 32, .blocksize = 64 },
+};
+static const size_t nhash_functions =
+	    sizeof(hash_functions) / sizeof(*hash_functions);
+
+
+static MunitResult
+test_hash_sizes(const MunitParameter *params, void *data)
+{
+	for (size_t i = 0; i < nhash_functions; i++) {
+		const struct hash_function *hash = hash_functions[i].hash;
+		munit_assert_size(hash->hashlength(), ==,
+			    hash_functions[i].hashlength);
+		munit_assert_size(hash->blocksize(), ==,
+			    hash_functions[i].blocksize);
+		munit_assert_size(hash->hashlength(), <=, HASH_MAX_HASHLENGTH);
+		munit_assert_size(hash->blocksize(), <=, HASH_MAX_BLOCKSIZE);
+	}
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_hash_stream(const MunitParameter *params, void *data)
+{
+	uint8_t digest[HASH_MAX_HASHLENGTH];
+	union hash_ctx ctx;
+
+	for (size_t i = 0; i < nhash_functions; i++) {
+		const struct hash_function *hash = hash_functions[i].hash;
+		struct bytes *msgs[8] = { NULL }, *out[8] = { NULL };
+		const size_t count = sizeof(msgs) / sizeof(*msgs);
+
+		for (size_t j = 0; j < count; j++) {
+			const size_t len = munit_rand_int_range(0, 300);
+			msgs[j] = bytes_randomized(len);
+			if (msgs[j] == NULL)
+				munit_error("bytes_randomized");
+		}
+		int ret = hash->hash_many((const struct bytes *const *)msgs,
+			    count, out);
+		munit_assert_int(ret, ==, 0);
+
+		for (size_t j = 0; j < count; j++) {
+			struct bytes *expected = hash->hash(msgs[j]);
+			if (expected == NULL)
+				munit_error("hash");
+			munit_assert_size(expected->len, ==,
+				    hash->hashlength());
+			/* hash_many() */
+			munit_assert_not_null(out[j]);
+			munit_assert_size(out[j]->len, ==, expected->len);
+			munit_assert_memory_equal(expected->len,
+				    out[j]->data, expected->data);
+			/* init(), update() by random chunks and final() */
+			munit_assert_int(hash->init(&ctx), ==, 0);
+			size_t offset = 0;
+			while (offset < msgs[j]->len) {
+				size_t chunk = munit_rand_int_range(0, 100);
+				if (chunk > msgs[j]->len - offset)
+					chunk = msgs[j]->len - offset;
+				ret = hash->update(&ctx,
+					    msgs[j]->data + offset, chunk);
+				munit_assert_int(ret, ==, 0);
+				offset += chunk;
+			}
+			munit_assert_int(hash->final(&ctx, digest), ==, 0);
+			munit_assert_memory_equal(expected->len, digest,
+				    expected->data);
+			bytes_free(expected);
+		}
+
+		/* when NULL is given */
+		munit_assert_int(hash->init(NULL), ==, -1);
+		munit_assert_int(hash->update(NULL, digest, 0), ==, -1);
+		munit_assert_int(hash->final(NULL, digest), ==, -1);
+
+		for (size_t j = 0; j < count; j++) {
+			bytes_free(out[j]);
+			bytes_free(msgs[j]);
+		}
+	}
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_hash_padding(const MunitParameter *params, void *data)
+{
+	uint8_t digest[HASH_MAX_HASHLENGTH];
+	union hash_ctx ctx;
+
+	for (size_t i = 0; i < nhash_functions; i++) {
+		const struct hash_function *hash = hash_functions[i].hash;
+		const size_t B = hash->blocksize();
+
+		/* around the length where the padding needs an extra block */
+		for (size_t len = 0; len < 3 * B; len++) {
+			struct bytes *msg = bytes_randomized(len);
+			if (msg == NULL)
+				munit_error("bytes_randomized");
+			struct bytes *expected = hash->hash(msg);
+			if (expected == NULL)
+				munit_error("hash");
+			struct bytes *padding = hash->padding(msg->len);
+			munit_assert_not_null(padding);
+			munit_assert_size(padding->len, >=, 1 + 8);
+			munit_assert_size(padding->len, <=, B + 8);
+			munit_assert_uint8(padding->data[0], ==, 0x80);
+			struct bytes *padded = bytes_joined(2, msg, padding);
+			if (padded == NULL)
+				munit_error("bytes_joined");
+			munit_assert_size(padded->len % B, ==, 0);
+
+			/* compressing the padded message yields the hash */
+			munit_assert_int(hash->init(&ctx), ==, 0);
+			const int ret = hash->compress(&ctx, padded->data,
+				    padded->len / B);
+			munit_assert_int(ret, ==, 0);
+			munit_assert_int(hash->export_state(&ctx, digest),
+				    ==, 0);
+			munit_assert_memory_equal(expected->len, digest,
+				    expected->data);
+
+			bytes_free(padded);
+			bytes_free(padding);
+			bytes_free(expected);
+			bytes_free(msg);
+		}
+
+		/* compress() refuses a context with buffered bytes */
+		munit_assert_int(hash->init(&ctx), ==, 0);
+		munit_assert_int(hash->update(&ctx, digest, 1), ==, 0);
+		munit_assert_int(hash->compress(&ctx, digest, 0), ==, -1);
+
+		/* when NULL is given */
+		munit_assert_int(hash->compress(NULL, digest, 0), ==, -1);
+		munit_assert_int(hash->export_state(NULL, digest), ==, -1);
+		munit_assert_int(hash->export_state(&ctx, NULL), ==, -1);
+	}
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_hash_import_state(const MunitParameter *params, void *data)
+{
+	uint8_t digest[HASH_MAX_HASHLENGTH];
+	union hash_ctx ctx;
+
+	for (size_t i = 0; i < nhash_functions; i++) {
+		const struct hash_function *hash = hash_functions[i].hash;
+		struct bytes *prefix =
+			    bytes_randomized(munit_rand_int_range(0, 200));
+		struct bytes *suffix =
+			    bytes_randomized(munit_rand_int_range(0, 200));
+		if (prefix == NULL || suffix == NULL)
+			munit_error("bytes_randomized");
+		struct bytes *padding = hash->padding(prefix->len);
+		if (padding == NULL)
+			munit_error("padding");
+		struct bytes *full = bytes_joined(3, prefix, padding, suffix);
+		if (full == NULL)
+			munit_error("bytes_joined");
+		struct bytes *mac = hash->hash(prefix);
+		struct bytes *expected = hash->hash(full);
+		if (mac == NULL || expected == NULL)
+			munit_error("hash");
+
+		/* resuming from the prefix hash is length extension */
+		const uint64_t len = prefix->len + padding->len;
+		munit_assert_int(hash->import_state(&ctx, mac->data, len), ==,
+			    0);
+		munit_assert_int(hash->export_state(&ctx, digest), ==, 0);
+		munit_assert_memory_equal(mac->len, digest, mac->data);
+		int ret = hash->update(&ctx, suffix->data, suffix->len);
+		munit_assert_int(ret, ==, 0);
+		munit_assert_int(hash->final(&ctx, digest), ==, 0);
+		munit_assert_memory_equal(expected->len, digest,
+			    expected->data);
+
+		/* the length must be a multiple of the block size */
+		ret = hash->import_state(&ctx, mac->data, len + 1);
+		munit_assert_int(ret, ==, -1);
+
+		/* when NULL is given */
+		munit_assert_int(hash->import_state(NULL, mac->data, 0), ==,
+			    -1);
+		munit_assert_int(hash->import_state(&ctx, NULL, 0), ==, -1);
+
+		bytes_free(expected);
+		bytes_free(mac);
+		bytes_free(full);
+		bytes_free(padding);
+		bytes_free(suffix);
+		bytes_free(prefix);
+	}
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_hash_many_ctx(const MunitParameter *params, void *data)
+{
+	union hash_ctx ctxs[37], copy;
+	const union hash_ctx *pctxs[37];
+	struct bytes *msgs[37] = { NULL }, *out[37] = { NULL };
+	const size_t count = sizeof(msgs) / sizeof(*msgs);
+	uint8_t digest[HASH_MAX_HASHLENGTH];
+
+	for (size_t i = 0; i < nhash_functions; i++) {
+		const struct hash_function *hash = hash_functions[i].hash;
+		const size_t B = hash->blocksize();
+
+		/* contexts that have processed some random blocks */
+		for (size_t j = 0; j < count; j++) {
+			const size_t nblock = munit_rand_int_range(0, 3);
+			const size_t msglen = munit_rand_int_range(0, 300);
+			struct bytes *prefix = bytes_randomized(nblock * B);
+			msgs[j] = bytes_randomized(msglen);
+			if (prefix == NULL || msgs[j] == NULL)
+				munit_error("bytes_randomized");
+			munit_assert_int(hash->init(&ctxs[j]), ==, 0);
+			const int ret = hash->compress(&ctxs[j], prefix->data,
+				    nblock);
+			munit_assert_int(ret, ==, 0);
+			pctxs[j] = &ctxs[j];
+			bytes_free(prefix);
+		}
+
+		int ret = hash->hash_many_ctx(pctxs,
+			    (const struct bytes *const *)msgs, count, out);
+		munit_assert_int(ret, ==, 0);
+		for (size_t j = 0; j < count; j++) {
+			/* the contexts are left untouched */
+			copy = ctxs[j];
+			ret = hash->update(&copy, msgs[j]->data, msgs[j]->len);
+			munit_assert_int(ret, ==, 0);
+			munit_assert_int(hash->final(&copy, digest), ==, 0);
+			munit_assert_not_null(out[j]);
+			munit_assert_size(out[j]->len, ==, hash->hashlength());
+			munit_assert_memory_equal(out[j]->len, out[j]->data,
+				    digest);
+			bytes_free(out[j]);
+			out[j] = NULL;
+		}
+
+		/* NULL contexts hash from scratch */
+		ret = hash->hash_many_ctx(NULL,
+			    (const struct bytes *const *)msgs, count, out);
+		munit_assert_int(ret, ==, 0);
+		for (size_t j = 0; j < count; j++) {
+			struct bytes *expected = hash->hash(msgs[j]);
+			if (expected == NULL)
+				munit_error("hash");
+			munit_assert_memory_equal(expected->len, out[j]->data,
+				    expected->data);
+			bytes_free(expected);
+			bytes_free(out[j]);
+			out[j] = NULL;
+		}
+
+		/* a context with buffered bytes or a NULL one is an error */
+		munit_assert_int(hash->update(&ctxs[1], digest, 1), ==, 0);
+		ret = hash->hash_many_ctx(pctxs,
+			    (const struct bytes *const *)msgs, count, out);
+		munit_assert_int(ret, ==, -1);
+		for (size_t j = 0; j < count; j++)
+			munit_assert_null(out[j]);
+		pctxs[1] = NULL;
+		ret = hash->hash_many_ctx(pctxs,
+			    (const struct bytes *const *)msgs, count, out);
+		munit_assert_int(ret, ==, -1);
+
+		for (size_t j = 0; j < count; j++) {
+			bytes_free(msgs[j]);
+			msgs[j] = NULL;
+		}
+	}
+
+	return (MUNIT_OK);
+}
+
+
+/* The test suite. */
+MunitTest test_hash_suite_tests[] = {
+	{ "sizes",        test_hash_sizes,        NULL,        NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "stream",       test_hash_stream,       srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "padding",      test_hash_padding,      srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "import_state", test_hash_import_state, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "many_ctx",     test_hash_many_ctx,     srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{
+		.name       = NULL,
+		.test       = NULL,
+		.setup      = NULL,
+		.tear_down  = NULL,
+		.options    = MUNIT_TEST_OPTION_NONE,
+		.parameters = NULL,
+	},
+};
@@ -478,6 +478,64 @@ test_hmac_sha256(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_hmac_ctx(const MunitParameter *params, void *data)
+{
+	const struct {
+		const struct hash_function *hash;
+		struct bytes *(*hmac)(const struct bytes *key,
+			    const struct bytes *msg);
+	} vectors[] = {
+		{ .hash = &hash_sha1,   .hmac = hmac_sha1   },
+		{ .hash = &hash_md4,    .hmac = hmac_md4    },
+		{ .hash = &hash_sha256, .hmac = hmac_sha256 },
+	};
+	struct hmac_ctx ctx;
+	uint8_t out[32];
+
+	for (size_t i = 0; i < (sizeof(vectors) / sizeof(*vectors)); i++) {
+		/* short, block size and longer than block size keys */
+		const size_t keylen = munit_rand_int_range(0, 150);
+		struct bytes *key = bytes_randomized(keylen);
+		if (key == NULL)
+			munit_error("bytes_randomized");
+		const int ret = hmac_ctx_init(&ctx, vectors[i].hash, key);
+		munit_assert_int(ret, ==, 0);
+
+		/* the context is reused for several messages */
+		for (size_t j = 0; j < 8; j++) {
+			const size_t msglen = munit_rand_int_range(0, 200);
+			struct bytes *msg = bytes_randomized(msglen);
+			if (msg == NULL)
+				munit_error("bytes_randomized");
+			struct bytes *expected = vectors[i].hmac(key, msg);
+			if (expected == NULL)
+				munit_error("hmac");
+			const int ret = hmac_ctx_compute(&ctx, msg, out);
+			munit_assert_int(ret, ==, 0);
+			munit_assert_memory_equal(expected->len, out,
+				    expected->data);
+			bytes_free(expected);
+			bytes_free(msg);
+		}
+
+		/* when NULL is given */
+		munit_assert_int(hmac_ctx_init(NULL, vectors[i].hash, key),
+			    ==, -1);
+		munit_assert_int(hmac_ctx_init(&ctx, vectors[i].hash, NULL),
+			    ==, -1);
+		munit_assert_int(hmac_ctx_init(&ctx, NULL, key), ==, -1);
+		munit_assert_int(hmac_ctx_compute(NULL, key, out), ==, -1);
+		munit_assert_int(hmac_ctx_compute(&ctx, NULL, out), ==, -1);
+		munit_assert_int(hmac_ctx_compute(&ctx, key, NULL), ==, -1);
+
+		bytes_free(key);
+	}
+
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_mac_suite_tests[] = {
 	{ "sha1_mac_keyed_prefix",        test_sha1_mac_keyed_prefix,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
@@ -487,6 +545,7 @@ MunitTest test_mac_suite_tests[] = {
 	{ "hmac_sha1",   test_hmac_sha1,   NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "hmac_md4",    test_hmac_md4,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "hmac_sha256", test_hmac_sha256, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "hmac_ctx",    test_hmac_ctx,    NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -80,11 +80,114 @@ test_md4_hash(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_md4_stream(const MunitParameter *params, void *data)
+{
+	struct md4_ctx ctx;
+	uint8_t digest[16];
+
+	for (size_t i = 0; i < 32; i++) {
+		const size_t len = munit_rand_int_range(0, 1024);
+		struct bytes *message = bytes_randomized(len);
+		if (message == NULL)
+			munit_error("bytes_randomized");
+		struct bytes *expected = md4_hash(message);
+		if (expected == NULL)
+			munit_error("md4_hash");
+
+		/* feed the message in random sized chunks */
+		munit_assert_int(md4_init(&ctx), ==, 0);
+		size_t offset = 0;
+		while (offset < len) {
+			size_t chunk = munit_rand_int_range(0, 130);
+			if (chunk > len - offset)
+				chunk = len - offset;
+			const int ret = md4_update(&ctx,
+				    message->data + offset, chunk);
+			munit_assert_int(ret, ==, 0);
+			offset += chunk;
+		}
+		munit_assert_uint64(ctx.len, ==, len);
+		munit_assert_int(md4_final(&ctx, digest), ==, 0);
+		munit_assert_size(expected->len, ==, sizeof(digest));
+		munit_assert_memory_equal(sizeof(digest), digest,
+			    expected->data);
+
+		bytes_free(expected);
+		bytes_free(message);
+	}
+
+	/* when NULL is given */
+	munit_assert_int(md4_init(NULL), ==, -1);
+	munit_assert_int(md4_update(NULL, digest, 1), ==, -1);
+	munit_assert_int(md4_init(&ctx), ==, 0);
+	munit_assert_int(md4_update(&ctx, NULL, 1), ==, -1);
+	munit_assert_int(md4_update(&ctx, NULL, 0), ==, 0);
+	munit_assert_int(md4_final(NULL, digest), ==, -1);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_md4_hash_many(const MunitParameter *params, void *data)
+{
+	struct bytes *msgs[37] = { NULL };
+	struct bytes *out[37] = { NULL };
+	const size_t count = sizeof(msgs) / sizeof(*msgs);
+
+	/* messages of various lengths, around the padding boundaries too */
+	for (size_t i = 0; i < count; i++) {
+		size_t len = 52 + i;
+		if (i >= 8)
+			len = munit_rand_int_range(0, 300);
+		msgs[i] = bytes_randomized(len);
+		if (msgs[i] == NULL)
+			munit_error("bytes_randomized");
+	}
+
+	const int ret = md4_hash_many((const struct bytes *const *)msgs,
+		    count, out);
+	munit_assert_int(ret, ==, 0);
+	for (size_t i = 0; i < count; i++) {
+		struct bytes *expected = md4_hash(msgs[i]);
+		if (expected == NULL)
+			munit_error("md4_hash");
+		munit_assert_not_null(out[i]);
+		munit_assert_size(out[i]->len, ==, expected->len);
+		munit_assert_memory_equal(expected->len, out[i]->data,
+			    expected->data);
+		bytes_free(expected);
+		bytes_free(out[i]);
+	}
+
+	/* when no message is given */
+	munit_assert_int(md4_hash_many(NULL, 0, NULL), ==, 0);
+	/* when NULL is given */
+	munit_assert_int(md4_hash_many(NULL, 1, out), ==, -1);
+	munit_assert_int(md4_hash_many((const struct bytes *const *)msgs,
+		    1, NULL), ==, -1);
+	struct bytes *tmp = msgs[1];
+	msgs[1] = NULL;
+	munit_assert_int(md4_hash_many((const struct bytes *const *)msgs,
+		    count, out), ==, -1);
+	for (size_t i = 0; i < count; i++)
+		munit_assert_null(out[i]);
+	msgs[1] = tmp;
+
+	for (size_t i = 0; i < count; i++)
+		bytes_free(msgs[i]);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_md4_suite_tests[] = {
 	{ "md4_hashlength", test_md4_hashlength, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "md4_blocksize",  test_md4_blocksize,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "md4_hash",       test_md4_hash,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "md4_stream",     test_md4_stream,     NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "md4_hash_many",  test_md4_hash_many,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -106,11 +106,263 @@ test_mt19937_encryption(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_mt19937_fill(const MunitParameter *params, void *data)
+{
+	const uint32_t seed = munit_rand_uint32();
+	const size_t count = 624 * 5 + munit_rand_int_range(0, 624);
+	uint32_t *words = munit_calloc(count, sizeof(uint32_t));
+	uint8_t  *bytes = munit_calloc(count, 4);
+
+	/* error conditions */
+	munit_assert_int(mt19937_fill(NULL, words, 1), ==, -1);
+	munit_assert_int(mt19937_fill_bytes(NULL, bytes, 1), ==, -1);
+
+	struct mt19937_generator *gen = mt19937_init(seed);
+	struct mt19937_generator *ref = mt19937_init(seed);
+	if (gen == NULL || ref == NULL)
+		munit_error("mt19937_init");
+	munit_assert_int(mt19937_fill(gen, NULL, 0), ==, 0);
+	munit_assert_int(mt19937_fill(gen, NULL, 1), ==, -1);
+
+	/* fill in random sized runs, crossing twist boundaries */
+	for (size_t i = 0; i < count; ) {
+		size_t run = munit_rand_int_range(1, 1024);
+		if (run > count - i)
+			run = count - i;
+		munit_assert_int(mt19937_fill(gen, words + i, run), ==, 0);
+		i += run;
+	}
+	for (size_t i = 0; i < count; i++) {
+		uint32_t x = 0;
+		if (mt19937_next_uint32(ref, &x) != 0)
+			munit_error("mt19937_next_uint32");
+		munit_assert_uint32(words[i], ==, x);
+	}
+
+	/* the bytes of each number LSB first, the last partial one dropped */
+	const size_t len = count * 4 - munit_rand_int_range(1, 3);
+	munit_assert_int(mt19937_seed(gen, seed), ==, 0);
+	munit_assert_int(mt19937_fill_bytes(gen, bytes, len), ==, 0);
+	for (size_t i = 0; i < len; i++) {
+		const uint8_t expected = (words[i / 4] >> (8 * (i % 4))) & 0xff;
+		munit_assert_uint8(bytes[i], ==, expected);
+	}
+	uint32_t next = 0, expected = 0;
+	munit_assert_int(mt19937_fill(gen, &next, 1), ==, 0);
+	if (mt19937_next_uint32(ref, &expected) != 0)
+		munit_error("mt19937_next_uint32");
+	munit_assert_uint32(next, ==, expected);
+
+	/* the stream cipher keystream is mt19937_fill_bytes() */
+	struct bytes *zeros = bytes_zeroed(len);
+	if (zeros == NULL)
+		munit_error("bytes_zeroed");
+	struct bytes *keystream = mt19937_encrypt(zeros, seed);
+	munit_assert_not_null(keystream);
+	munit_assert_size(keystream->len, ==, len);
+	munit_assert_memory_equal(len, keystream->data, bytes);
+
+	bytes_free(keystream);
+	bytes_free(zeros);
+	mt19937_free(ref);
+	mt19937_free(gen);
+	free(bytes);
+	free(words);
+	return (MUNIT_OK);
+}
+
+
+/* advance the given generator by count outputs the naive way */
+static void
+mt19937_skip(struct mt19937_generator *gen, uint64_t count)
+{
+	uint32_t discard[624];
+
+	while (count > 0) {
+		const size_t len = (count < 624 ? count : 624);
+		if (mt19937_fill(gen, discard, len) != 0)
+			munit_error("mt19937_fill");
+		count -= len;
+	}
+}
+
+
+static MunitResult
+test_mt19937_jump(const MunitParameter *params, void *data)
+{
+	const uint32_t seed = munit_rand_uint32();
+	uint32_t expected[64], jumped[64];
+
+	/* error conditions */
+	munit_assert_int(mt19937_jump(NULL, 1), ==, -1);
+
+	struct mt19937_generator *gen = mt19937_init(seed);
+	struct mt19937_generator *ref = mt19937_init(seed);
+	if (gen == NULL || ref == NULL)
+		munit_error("mt19937_init");
+
+	/* small and large jumps, from any index */
+	const uint64_t jumps[] = {
+		0, munit_rand_int_range(1, 4096),
+		(UINT64_C(1) << 26) + munit_rand_int_range(0, 4096),
+	};
+	for (size_t i = 0; i < sizeof(jumps) / sizeof(*jumps); i++) {
+		const uint64_t k = jumps[i];
+		const size_t pre = munit_rand_int_range(0, 624);
+		mt19937_skip(gen, pre);
+		mt19937_skip(ref, pre);
+		munit_assert_int(mt19937_jump(gen, k), ==, 0);
+		mt19937_skip(ref, k);
+		munit_assert_int(mt19937_fill(gen, jumped, 64), ==, 0);
+		munit_assert_int(mt19937_fill(ref, expected, 64), ==, 0);
+		munit_assert_memory_equal(sizeof(expected), jumped, expected);
+	}
+
+	/* jumps too large to check naively should compose */
+	const uint64_t j1 = (UINT64_C(1) << 40) + munit_rand_uint32();
+	const uint64_t j2 = (UINT64_C(1) << 50) + munit_rand_uint32();
+	munit_assert_int(mt19937_seed(gen, seed), ==, 0);
+	munit_assert_int(mt19937_seed(ref, seed), ==, 0);
+	munit_assert_int(mt19937_jump(gen, j1), ==, 0);
+	munit_assert_int(mt19937_jump(gen, j2), ==, 0);
+	munit_assert_int(mt19937_jump(ref, j1 + j2), ==, 0);
+	munit_assert_int(mt19937_fill(gen, jumped, 64), ==, 0);
+	munit_assert_int(mt19937_fill(ref, expected, 64), ==, 0);
+	munit_assert_memory_equal(sizeof(expected), jumped, expected);
+
+	mt19937_free(ref);
+	mt19937_free(gen);
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_mt19937_untwist(const MunitParameter *params, void *data)
+{
+	const uint32_t seed = munit_rand_uint32();
+	const size_t rounds = munit_rand_int_range(2, 8);
+	const size_t index  = munit_rand_int_range(1, 623);
+	uint32_t expected[1024], rewound[1024];
+
+	/* error conditions */
+	munit_assert_int(mt19937_untwist(NULL), ==, -1);
+	munit_assert_int(mt19937_state_seed(NULL, NULL), ==, -1);
+
+	struct mt19937_generator *gen = mt19937_init(seed);
+	struct mt19937_generator *ref = mt19937_init(seed);
+	if (gen == NULL || ref == NULL)
+		munit_error("mt19937_init");
+	uint32_t found = 0;
+	munit_assert_int(mt19937_state_seed(gen, &found), ==, 0);
+	munit_assert_uint32(found, ==, seed);
+
+	/* rewind once and compare with the reference */
+	mt19937_skip(gen, rounds * 624 + index);
+	munit_assert_int(mt19937_state_seed(gen, NULL), ==, 1);
+	munit_assert_int(mt19937_untwist(gen), ==, 0);
+	mt19937_skip(ref, (rounds - 1) * 624 + index);
+	munit_assert_int(mt19937_fill(gen, rewound, 1024), ==, 0);
+	munit_assert_int(mt19937_fill(ref, expected, 1024), ==, 0);
+	munit_assert_memory_equal(sizeof(expected), rewound, expected);
+
+	/* rewind back to the seeding state, the 1024 outputs above twisted
+	   once or twice */
+	size_t untwisted = 0;
+	while (untwisted < rounds + 2 && mt19937_state_seed(gen, NULL) != 0) {
+		munit_assert_int(mt19937_untwist(gen), ==, 0);
+		untwisted += 1;
+	}
+	munit_assert_size(untwisted, >=, rounds + 1);
+	found = 0;
+	munit_assert_int(mt19937_state_seed(gen, &found), ==, 0);
+	munit_assert_uint32(found, ==, seed);
+
+	mt19937_free(ref);
+	mt19937_free(gen);
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_mt19937_first_outputs(const MunitParameter *params, void *data)
+{
+	uint32_t out[624 + 1];
+
+	/* error conditions */
+	munit_assert_int(mt19937_first_outputs(0, 1, NULL), ==, -1);
+	munit_assert_int(mt19937_first_outputs(0, 624 + 1, out), ==, -1);
+
+	for (size_t iter = 0; iter < 16; iter++) {
+		const uint32_t seed = munit_rand_uint32();
+		const size_t k = (iter == 0 ? 624 : munit_rand_int_range(0, 624));
+		int ret = mt19937_first_outputs(seed, k, out);
+		munit_assert_int(ret, ==, 0);
+
+		struct mt19937_generator *gen = mt19937_init(seed);
+		if (gen == NULL)
+			munit_error("mt19937_init");
+		for (size_t i = 0; i < k; i++) {
+			uint32_t x = 0;
+			if (mt19937_next_uint32(gen, &x) != 0)
+				munit_error("mt19937_next_uint32");
+			munit_assert_uint32(out[i], ==, x);
+		}
+		mt19937_free(gen);
+	}
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_mt19937_first_outputs_batch(const MunitParameter *params, void *data)
+{
+	uint32_t seeds[64 + 3];
+	uint32_t expected[624];
+	const size_t maxcount = sizeof(seeds) / sizeof(*seeds);
+
+	uint32_t *out = calloc(maxcount * 624, sizeof(uint32_t));
+	if (out == NULL)
+		munit_error("calloc");
+
+	/* error conditions */
+	munit_assert_int(mt19937_first_outputs_batch(NULL, 1, 1, out), ==, -1);
+	munit_assert_int(mt19937_first_outputs_batch(seeds, 1, 1, NULL), ==, -1);
+	munit_assert_int(mt19937_first_outputs_batch(seeds, 1, 624 + 1, out),
+		    ==, -1);
+
+	for (size_t iter = 0; iter < 8; iter++) {
+		const size_t count = munit_rand_int_range(0, maxcount);
+		const size_t k = (iter == 0 ? 624 : munit_rand_int_range(0, 624));
+		for (size_t i = 0; i < count; i++)
+			seeds[i] = munit_rand_uint32();
+		int ret = mt19937_first_outputs_batch(seeds, count, k, out);
+		munit_assert_int(ret, ==, 0);
+
+		for (size_t i = 0; i < count; i++) {
+			if (mt19937_first_outputs(seeds[i], k, expected) != 0)
+				munit_error("mt19937_first_outputs");
+			munit_assert_memory_equal(k * sizeof(uint32_t),
+				    out + i * k, expected);
+		}
+	}
+
+	free(out);
+	return (MUNIT_OK);
+}
+
+
 /* The test suite. */
 MunitTest test_mt19937_suite_tests[] = {
 	{ "mt19937-0",          test_mt19937_0,          NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "mt19937-1",          test_mt19937_1,          NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{ "mt19937_encryption", test_mt19937_encryption, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "fill",               test_mt19937_fill,       srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "jump",               test_mt19937_jump,       srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "untwist",            test_mt19937_untwist,    srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "first_outputs",      test_mt19937_first_outputs, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "first_outputs_batch", test_mt19937_first_outputs_batch, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
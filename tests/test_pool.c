@@ -0,0 +1,441 @@
+/*
+ * test_pool.c
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "munit.h"
+#include "helpers.h"
+#include "aes.h"
+#include "ecb.h"
+#include "cbc.h"
+#include "ctr.h"
+#include "hash.h"
+#include "pool.h"
+
+
+/* cp_parallel_for() routine counting the visits of each index */
+static int
+count_range(size_t lo, size_t hi, void *arg)
+{
+	atomic_size_t *visits = arg;
+
+	munit_assert_size(lo, <, hi);
+	for (size_t i = lo; i < hi; i++)
+		(void)atomic_fetch_add(&visits[i], 1);
+	return (0);
+}
+
+
+/* cp_parallel_for() state recording the order of the ranges */
+struct order {
+	size_t *indexes;
+	size_t count;
+};
+
+static int
+order_range(size_t lo, size_t hi, void *arg)
+{
+	struct order *order = arg;
+
+	for (size_t i = lo; i < hi; i++)
+		order->indexes[order->count++] = i;
+	return (0);
+}
+
+
+/* cp_parallel_for() routine failing on the range holding index 42 */
+static int
+fail_range(size_t lo, size_t hi, void *arg)
+{
+	atomic_size_t *count = arg;
+
+	(void)atomic_fetch_add(count, hi - lo);
+	return (lo <= 42 && 42 < hi ? -1 : 0);
+}
+
+
+/* cp_group_spawn() routine state */
+struct counter {
+	struct cp_group *group;
+	atomic_size_t count;
+	/* count of tasks left to spawn from the tasks */
+	atomic_int nested;
+	/* when non-zero the tasks fail */
+	int fail;
+};
+
+static int
+counter_task(void *arg)
+{
+	struct counter *counter = arg;
+
+	(void)atomic_fetch_add(&counter->count, 1);
+	if (atomic_fetch_sub(&counter->nested, 1) > 0) {
+		if (cp_group_spawn(counter->group, counter_task, counter) != 0)
+			return (-1);
+		if (cp_group_spawn(counter->group, counter_task, counter) != 0)
+			return (-1);
+	}
+	return (counter->fail ? -1 : 0);
+}
+
+
+static MunitResult
+test_cp_pool_create(const MunitParameter *params, void *data)
+{
+	const size_t counts[] = { 1, 2, 4 };
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+		struct cp_pool *pool = cp_pool_create(counts[i]);
+		munit_assert_not_null(pool);
+		munit_assert_size(cp_pool_nthreads(pool), ==, counts[i]);
+		cp_pool_free(pool);
+	}
+
+	/* one thread per CPU */
+	struct cp_pool *pool = cp_pool_create(0);
+	munit_assert_not_null(pool);
+	munit_assert_size(cp_pool_nthreads(pool), >, 0);
+	cp_pool_free(pool);
+
+	/* when NULL is given */
+	munit_assert_size(cp_pool_nthreads(NULL), ==, 0);
+	cp_pool_free(NULL);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_cp_pool_default(const MunitParameter *params, void *data)
+{
+	struct cp_pool *pool = cp_pool_default();
+	munit_assert_not_null(pool);
+	munit_assert_ptr(cp_pool_default(), ==, pool);
+	/* the test suite is single threaded unless asked otherwise */
+	if (getenv(CP_POOL_THREADS_ENV) == NULL)
+		munit_assert_size(cp_pool_nthreads(pool), ==, 1);
+	/* too late now */
+	munit_assert_int(cp_pool_default_nthreads(2), ==, -1);
+
+	/* another pool may be used instead by the current thread */
+	struct cp_pool *other = cp_pool_create(2);
+	if (other == NULL)
+		munit_error("cp_pool_create");
+	munit_assert_null(cp_pool_use(other));
+	munit_assert_ptr(cp_pool_use(NULL), ==, other);
+	munit_assert_null(cp_pool_use(NULL));
+	cp_pool_free(other);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_cp_parallel_for(const MunitParameter *params, void *data)
+{
+	const size_t counts[] = { 1, 2, 4 };
+	const size_t sizes[] = { 0, 1, 7, 64, 1000 };
+	const size_t grains[] = { 0, 1, 3, 64 };
+	atomic_size_t visits[1000];
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+		struct cp_pool *pool = cp_pool_create(counts[i]);
+		if (pool == NULL)
+			munit_error("cp_pool_create");
+		for (size_t j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+			const size_t n = sizes[j];
+			for (size_t k = 0; k < sizeof(grains) / sizeof(*grains);
+				    k++) {
+				for (size_t x = 0; x < n; x++)
+					atomic_init(&visits[x], 0);
+				const int ret = cp_parallel_for(pool, n,
+					    grains[k], count_range, visits);
+				munit_assert_int(ret, ==, 0);
+				/* every index exactly once */
+				for (size_t x = 0; x < n; x++) {
+					munit_assert_size(
+						    atomic_load(&visits[x]),
+						    ==, 1);
+				}
+			}
+		}
+
+		/* a failing range is reported */
+		atomic_size_t count;
+		atomic_init(&count, 0);
+		int ret = cp_parallel_for(pool, 1000, 1, fail_range, &count);
+		munit_assert_int(ret, ==, -1);
+		munit_assert_size(atomic_load(&count), <=, 1000);
+		/* in a single thread pool the ranges after it are skipped */
+		if (counts[i] == 1)
+			munit_assert_size(atomic_load(&count), ==, 43);
+
+		cp_pool_free(pool);
+	}
+
+	/* when NULL is given */
+	munit_assert_int(cp_parallel_for(NULL, 1, 0, NULL, NULL), ==, -1);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_cp_parallel_for_order(const MunitParameter *params, void *data)
+{
+	const size_t n = 1000;
+	struct order order = { .indexes = NULL, .count = 0 };
+
+	order.indexes = calloc(n, sizeof(size_t));
+	if (order.indexes == NULL)
+		munit_error("calloc");
+	struct cp_pool *pool = cp_pool_create(1);
+	if (pool == NULL)
+		munit_error("cp_pool_create");
+
+	/* a single thread pool process the ranges in ascending order */
+	const size_t grains[] = { 0, 1, 3, 64 };
+	for (size_t i = 0; i < sizeof(grains) / sizeof(*grains); i++) {
+		order.count = 0;
+		const int ret = cp_parallel_for(pool, n, grains[i],
+			    order_range, &order);
+		munit_assert_int(ret, ==, 0);
+		munit_assert_size(order.count, ==, n);
+		for (size_t x = 0; x < n; x++)
+			munit_assert_size(order.indexes[x], ==, x);
+	}
+
+	cp_pool_free(pool);
+	free(order.indexes);
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_cp_group(const MunitParameter *params, void *data)
+{
+	const size_t counts[] = { 1, 2, 4 };
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+		struct counter counter;
+		struct cp_pool *pool = cp_pool_create(counts[i]);
+		if (pool == NULL)
+			munit_error("cp_pool_create");
+
+		/* tasks spawning more tasks in their group */
+		counter.group = cp_group_new(pool);
+		munit_assert_not_null(counter.group);
+		atomic_init(&counter.count, 0);
+		atomic_init(&counter.nested, 100);
+		counter.fail = 0;
+		for (size_t j = 0; j < 10; j++) {
+			const int ret = cp_group_spawn(counter.group,
+				    counter_task, &counter);
+			munit_assert_int(ret, ==, 0);
+		}
+		munit_assert_int(cp_group_wait(counter.group), ==, 0);
+		/* 10 tasks, 100 of them spawning two more */
+		munit_assert_size(atomic_load(&counter.count), ==, 210);
+		munit_assert_int(cp_group_cancelled(counter.group), ==, 0);
+		cp_group_free(counter.group);
+
+		/* failing tasks */
+		counter.group = cp_group_new(pool);
+		munit_assert_not_null(counter.group);
+		atomic_init(&counter.count, 0);
+		atomic_init(&counter.nested, 0);
+		counter.fail = 1;
+		for (size_t j = 0; j < 10; j++) {
+			const int ret = cp_group_spawn(counter.group,
+				    counter_task, &counter);
+			munit_assert_int(ret, ==, 0);
+		}
+		munit_assert_int(cp_group_wait(counter.group), ==, -1);
+		munit_assert_size(atomic_load(&counter.count), >, 0);
+		munit_assert_int(cp_group_cancelled(counter.group), ==, 1);
+		cp_group_free(counter.group);
+
+		/* cancelled group */
+		counter.group = cp_group_new(pool);
+		munit_assert_not_null(counter.group);
+		atomic_init(&counter.count, 0);
+		atomic_init(&counter.nested, 0);
+		counter.fail = 0;
+		cp_group_cancel(counter.group);
+		for (size_t j = 0; j < 10; j++) {
+			const int ret = cp_group_spawn(counter.group,
+				    counter_task, &counter);
+			munit_assert_int(ret, ==, 0);
+		}
+		munit_assert_int(cp_group_wait(counter.group), ==, 1);
+		munit_assert_size(atomic_load(&counter.count), ==, 0);
+		cp_group_free(counter.group);
+
+		cp_pool_free(pool);
+	}
+
+	/* when NULL is given */
+	munit_assert_int(cp_group_spawn(NULL, counter_task, NULL), ==, -1);
+	munit_assert_int(cp_group_wait(NULL), ==, -1);
+	munit_assert_int(cp_group_cancelled(NULL), ==, 0);
+	cp_group_cancel(NULL);
+	cp_group_free(NULL);
+
+	return (MUNIT_OK);
+}
+
+
+/* the bulk modes split large inputs over the pool in use */
+static MunitResult
+test_cp_pool_bulk(const MunitParameter *params, void *data)
+{
+	const size_t blocksize = aes_128_blocksize();
+	/* a bit more than three times the modes grain */
+	const size_t len = 3 * 4096 * blocksize + 5;
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	struct bytes *iv = bytes_randomized(blocksize);
+	struct bytes *plaintext = bytes_randomized(len);
+	if (key == NULL || iv == NULL || plaintext == NULL)
+		munit_error("bytes_randomized");
+	const uint64_t nonce = rand_uint64();
+
+	/* the default pool of the test suite is single threaded, so the modes
+	   run in a pool of four threads and are compared with a pool of one */
+	struct cp_pool *serial = cp_pool_create(1);
+	struct cp_pool *parallel = cp_pool_create(4);
+	if (serial == NULL || parallel == NULL)
+		munit_error("cp_pool_create");
+
+	struct cp_pool *previous = cp_pool_use(serial);
+	struct bytes *ecb = aes_128_ecb_encrypt(plaintext, key);
+	struct bytes *cbc = aes_128_cbc_encrypt(plaintext, key, iv);
+	struct bytes *ctr = aes_128_ctr_encrypt(plaintext, key, nonce);
+	if (ecb == NULL || cbc == NULL || ctr == NULL)
+		munit_error("serial encryption");
+	(void)cp_pool_use(parallel);
+
+	/* ECB, every block encrypted on its own */
+	struct bytes *ciphertext = aes_128_ecb_encrypt(plaintext, key);
+	munit_assert_not_null(ciphertext);
+	munit_assert_size(ciphertext->len, ==, ecb->len);
+	munit_assert_memory_equal(ecb->len, ciphertext->data, ecb->data);
+	const size_t nblock = ciphertext->len / blocksize;
+	const size_t blocks[] = { 0, 4095, 4096, 8192, nblock - 2 };
+	for (size_t i = 0; i < sizeof(blocks) / sizeof(*blocks); i++) {
+		const size_t offset = blocks[i] * blocksize;
+		struct bytes *block = bytes_slice(plaintext, offset, blocksize);
+		if (block == NULL)
+			munit_error("bytes_slice");
+		struct bytes *expected = aes_128_ecb_encrypt(block, key);
+		if (expected == NULL)
+			munit_error("aes_128_ecb_encrypt");
+		munit_assert_memory_equal(blocksize, expected->data,
+			    ciphertext->data + offset);
+		bytes_free(expected);
+		bytes_free(block);
+	}
+	struct bytes *decrypted = aes_128_ecb_decrypt(ciphertext, key);
+	munit_assert_not_null(decrypted);
+	munit_assert_size(decrypted->len, ==, len);
+	munit_assert_memory_equal(len, decrypted->data, plaintext->data);
+	bytes_free(decrypted);
+	bytes_free(ciphertext);
+
+	/* CBC, the encryption is serial by nature but not the decryption */
+	ciphertext = aes_128_cbc_encrypt(plaintext, key, iv);
+	munit_assert_not_null(ciphertext);
+	munit_assert_size(ciphertext->len, ==, cbc->len);
+	munit_assert_memory_equal(cbc->len, ciphertext->data, cbc->data);
+	decrypted = aes_128_cbc_decrypt(ciphertext, key, iv);
+	munit_assert_not_null(decrypted);
+	munit_assert_size(decrypted->len, ==, len);
+	munit_assert_memory_equal(len, decrypted->data, plaintext->data);
+	bytes_free(decrypted);
+	bytes_free(ciphertext);
+
+	/* CTR, against the keystream generated at the chunks boundaries */
+	ciphertext = aes_128_ctr_encrypt(plaintext, key, nonce);
+	munit_assert_not_null(ciphertext);
+	munit_assert_size(ciphertext->len, ==, len);
+	munit_assert_memory_equal(len, ciphertext->data, ctr->data);
+	const size_t offsets[] = { 0, 65535, 65536, 131073, len - 17 };
+	for (size_t i = 0; i < sizeof(offsets) / sizeof(*offsets); i++) {
+		struct bytes *keystream = aes_128_ctr_keystream(key, nonce,
+			    offsets[i], 17);
+		if (keystream == NULL)
+			munit_error("aes_128_ctr_keystream");
+		for (size_t j = 0; j < keystream->len; j++) {
+			const size_t x = offsets[i] + j;
+			munit_assert_uint8(ciphertext->data[x], ==,
+				    plaintext->data[x] ^ keystream->data[j]);
+		}
+		bytes_free(keystream);
+	}
+	decrypted = aes_128_ctr_decrypt(ciphertext, key, nonce);
+	munit_assert_not_null(decrypted);
+	munit_assert_memory_equal(len, decrypted->data, plaintext->data);
+	bytes_free(decrypted);
+	bytes_free(ciphertext);
+
+	/* hash many messages, against hashing them one by one */
+	const struct hash_function *hashes[] = {
+		&hash_sha1, &hash_sha256, &hash_md4,
+	};
+	struct bytes *msgs[1000], *out[1000];
+	const size_t count = sizeof(msgs) / sizeof(*msgs);
+	for (size_t i = 0; i < count; i++) {
+		msgs[i] = bytes_slice(plaintext, i, i % 150);
+		if (msgs[i] == NULL)
+			munit_error("bytes_slice");
+	}
+	for (size_t i = 0; i < sizeof(hashes) / sizeof(*hashes); i++) {
+		const int ret = hashes[i]->hash_many(
+			    (const struct bytes *const *)msgs, count, out);
+		munit_assert_int(ret, ==, 0);
+		for (size_t j = 0; j < count; j++) {
+			struct bytes *expected = hashes[i]->hash(msgs[j]);
+			if (expected == NULL)
+				munit_error("hash");
+			munit_assert_not_null(out[j]);
+			munit_assert_size(out[j]->len, ==, expected->len);
+			munit_assert_memory_equal(expected->len, out[j]->data,
+				    expected->data);
+			bytes_free(expected);
+			bytes_free(out[j]);
+		}
+	}
+	for (size_t i = 0; i < count; i++)
+		bytes_free(msgs[i]);
+
+	munit_assert_ptr(cp_pool_use(previous), ==, parallel);
+	cp_pool_free(parallel);
+	cp_pool_free(serial);
+	bytes_free(ctr);
+	bytes_free(cbc);
+	bytes_free(ecb);
+	bytes_free(plaintext);
+	bytes_free(iv);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
+/* The test suite. */
+MunitTest test_pool_suite_tests[] = {
+	{ "cp_pool_create",         test_cp_pool_create,         NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cp_pool_default",        test_cp_pool_default,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cp_parallel_for",        test_cp_parallel_for,        NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cp_parallel_for-order",  test_cp_parallel_for_order,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cp_group",               test_cp_group,               NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "bulk",                   test_cp_pool_bulk,           srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{
+		.name       = NULL,
+		.test       = NULL,
+		.setup      = NULL,
+		.tear_down  = NULL,
+		.options    = MUNIT_TEST_OPTION_NONE,
+		.parameters = NULL,
+	},
+};
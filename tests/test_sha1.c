@@ -81,11 +81,133 @@ test_sha1_hash(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_sha1_stream(const MunitParameter *params, void *data)
+{
+	struct sha1_ctx ctx;
+	uint8_t digest[20];
+
+	for (size_t i = 0; i < 32; i++) {
+		const size_t len = munit_rand_int_range(0, 1024);
+		struct bytes *message = bytes_randomized(len);
+		if (message == NULL)
+			munit_error("bytes_randomized");
+		struct bytes *expected = sha1_hash(message);
+		if (expected == NULL)
+			munit_error("sha1_hash");
+
+		/* feed the message in random sized chunks */
+		munit_assert_int(sha1_init(&ctx), ==, 0);
+		size_t offset = 0;
+		while (offset < len) {
+			size_t chunk = munit_rand_int_range(0, 130);
+			if (chunk > len - offset)
+				chunk = len - offset;
+			const int ret = sha1_update(&ctx,
+				    message->data + offset, chunk);
+			munit_assert_int(ret, ==, 0);
+			offset += chunk;
+		}
+		munit_assert_uint64(ctx.len, ==, len);
+		munit_assert_int(sha1_final(&ctx, digest), ==, 0);
+		munit_assert_size(expected->len, ==, sizeof(digest));
+		munit_assert_memory_equal(sizeof(digest), digest,
+			    expected->data);
+
+		bytes_free(expected);
+		bytes_free(message);
+	}
+
+	/* when NULL is given */
+	munit_assert_int(sha1_init(NULL), ==, -1);
+	munit_assert_int(sha1_update(NULL, digest, 1), ==, -1);
+	munit_assert_int(sha1_init(&ctx), ==, 0);
+	munit_assert_int(sha1_update(&ctx, NULL, 1), ==, -1);
+	munit_assert_int(sha1_update(&ctx, NULL, 0), ==, 0);
+	munit_assert_int(sha1_final(NULL, digest), ==, -1);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_sha1_hash_many(const MunitParameter *params, void *data)
+{
+	struct bytes *msgs[37] = { NULL };
+	struct bytes *out[37] = { NULL };
+	const size_t count = sizeof(msgs) / sizeof(*msgs);
+
+	/* messages of various lengths, around the padding boundaries too */
+	for (size_t i = 0; i < count; i++) {
+		size_t len = 52 + i;
+		if (i >= 8)
+			len = munit_rand_int_range(0, 300);
+		msgs[i] = bytes_randomized(len);
+		if (msgs[i] == NULL)
+			munit_error("bytes_randomized");
+	}
+
+	const int ret = sha1_hash_many((const struct bytes *const *)msgs,
+		    count, out);
+	munit_assert_int(ret, ==, 0);
+	for (size_t i = 0; i < count; i++) {
+		struct bytes *expected = sha1_hash(msgs[i]);
+		if (expected == NULL)
+			munit_error("sha1_hash");
+		munit_assert_not_null(out[i]);
+		munit_assert_size(out[i]->len, ==, expected->len);
+		munit_assert_memory_equal(expected->len, out[i]->data,
+			    expected->data);
+		bytes_free(expected);
+		bytes_free(out[i]);
+	}
+
+	/* when no message is given */
+	munit_assert_int(sha1_hash_many(NULL, 0, NULL), ==, 0);
+	/* when NULL is given */
+	munit_assert_int(sha1_hash_many(NULL, 1, out), ==, -1);
+	munit_assert_int(sha1_hash_many((const struct bytes *const *)msgs,
+		    1, NULL), ==, -1);
+	struct bytes *tmp = msgs[1];
+	msgs[1] = NULL;
+	munit_assert_int(sha1_hash_many((const struct bytes *const *)msgs,
+		    count, out), ==, -1);
+	for (size_t i = 0; i < count; i++)
+		munit_assert_null(out[i]);
+	msgs[1] = tmp;
+
+	for (size_t i = 0; i < count; i++)
+		bytes_free(msgs[i]);
+	return (MUNIT_OK);
+}
+
+
+/* run a test with the portable kernel, whatever the CPU supports */
+static void *
+generic_setup(const MunitParameter *params, void *user_data)
+{
+	(void)sha1_force_generic(1);
+	return (NULL);
+}
+
+
+static void
+generic_tear_down(void *data)
+{
+	(void)sha1_force_generic(0);
+}
+
+
 /* The test suite. */
 MunitTest test_sha1_suite_tests[] = {
-	{ "sha1_hashlength", test_sha1_hashlength, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
-	{ "sha1_blocksize",  test_sha1_blocksize,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
-	{ "sha1_hash",       test_sha1_hash,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_hashlength",        test_sha1_hashlength, NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_blocksize",         test_sha1_blocksize,  NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_hash",              test_sha1_hash,       NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_hash-generic",      test_sha1_hash,       generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_stream",            test_sha1_stream,     NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_stream-generic",    test_sha1_stream,     generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_hash_many",         test_sha1_hash_many,  NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha1_hash_many-generic", test_sha1_hash_many,  generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -116,11 +116,133 @@ test_sha256_hash(const MunitParameter *params, void *data)
 }
 
 
+static MunitResult
+test_sha256_stream(const MunitParameter *params, void *data)
+{
+	struct sha256_ctx ctx;
+	uint8_t digest[32];
+
+	for (size_t i = 0; i < 32; i++) {
+		const size_t len = munit_rand_int_range(0, 1024);
+		struct bytes *message = bytes_randomized(len);
+		if (message == NULL)
+			munit_error("bytes_randomized");
+		struct bytes *expected = sha256_hash(message);
+		if (expected == NULL)
+			munit_error("sha256_hash");
+
+		/* feed the message in random sized chunks */
+		munit_assert_int(sha256_init(&ctx), ==, 0);
+		size_t offset = 0;
+		while (offset < len) {
+			size_t chunk = munit_rand_int_range(0, 130);
+			if (chunk > len - offset)
+				chunk = len - offset;
+			const int ret = sha256_update(&ctx,
+				    message->data + offset, chunk);
+			munit_assert_int(ret, ==, 0);
+			offset += chunk;
+		}
+		munit_assert_uint64(ctx.len, ==, len);
+		munit_assert_int(sha256_final(&ctx, digest), ==, 0);
+		munit_assert_size(expected->len, ==, sizeof(digest));
+		munit_assert_memory_equal(sizeof(digest), digest,
+			    expected->data);
+
+		bytes_free(expected);
+		bytes_free(message);
+	}
+
+	/* when NULL is given */
+	munit_assert_int(sha256_init(NULL), ==, -1);
+	munit_assert_int(sha256_update(NULL, digest, 1), ==, -1);
+	munit_assert_int(sha256_init(&ctx), ==, 0);
+	munit_assert_int(sha256_update(&ctx, NULL, 1), ==, -1);
+	munit_assert_int(sha256_update(&ctx, NULL, 0), ==, 0);
+	munit_assert_int(sha256_final(NULL, digest), ==, -1);
+
+	return (MUNIT_OK);
+}
+
+
+static MunitResult
+test_sha256_hash_many(const MunitParameter *params, void *data)
+{
+	struct bytes *msgs[37] = { NULL };
+	struct bytes *out[37] = { NULL };
+	const size_t count = sizeof(msgs) / sizeof(*msgs);
+
+	/* messages of various lengths, around the padding boundaries too */
+	for (size_t i = 0; i < count; i++) {
+		size_t len = 52 + i;
+		if (i >= 8)
+			len = munit_rand_int_range(0, 300);
+		msgs[i] = bytes_randomized(len);
+		if (msgs[i] == NULL)
+			munit_error("bytes_randomized");
+	}
+
+	const int ret = sha256_hash_many((const struct bytes *const *)msgs,
+		    count, out);
+	munit_assert_int(ret, ==, 0);
+	for (size_t i = 0; i < count; i++) {
+		struct bytes *expected = sha256_hash(msgs[i]);
+		if (expected == NULL)
+			munit_error("sha256_hash");
+		munit_assert_not_null(out[i]);
+		munit_assert_size(out[i]->len, ==, expected->len);
+		munit_assert_memory_equal(expected->len, out[i]->data,
+			    expected->data);
+		bytes_free(expected);
+		bytes_free(out[i]);
+	}
+
+	/* when no message is given */
+	munit_assert_int(sha256_hash_many(NULL, 0, NULL), ==, 0);
+	/* when NULL is given */
+	munit_assert_int(sha256_hash_many(NULL, 1, out), ==, -1);
+	munit_assert_int(sha256_hash_many((const struct bytes *const *)msgs,
+		    1, NULL), ==, -1);
+	struct bytes *tmp = msgs[1];
+	msgs[1] = NULL;
+	munit_assert_int(sha256_hash_many((const struct bytes *const *)msgs,
+		    count, out), ==, -1);
+	for (size_t i = 0; i < count; i++)
+		munit_assert_null(out[i]);
+	msgs[1] = tmp;
+
+	for (size_t i = 0; i < count; i++)
+		bytes_free(msgs[i]);
+	return (MUNIT_OK);
+}
+
+
+/* run a test with the portable kernel, whatever the CPU supports */
+static void *
+generic_setup(const MunitParameter *params, void *user_data)
+{
+	(void)sha256_force_generic(1);
+	return (NULL);
+}
+
+
+static void
+generic_tear_down(void *data)
+{
+	(void)sha256_force_generic(0);
+}
+
+
 /* The test suite. */
 MunitTest test_sha256_suite_tests[] = {
-	{ "sha256_hashlength", test_sha256_hashlength, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
-	{ "sha256_blocksize",  test_sha256_blocksize,  NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
-	{ "sha256_hash",       test_sha256_hash,       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_hashlength",        test_sha256_hashlength, NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_blocksize",         test_sha256_blocksize,  NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_hash",              test_sha256_hash,       NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_hash-generic",      test_sha256_hash,       generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_stream",            test_sha256_stream,     NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_stream-generic",    test_sha256_stream,     generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_hash_many",         test_sha256_hash_many,  NULL,          NULL,              MUNIT_TEST_OPTION_NONE, NULL },
+	{ "sha256_hash_many-generic", test_sha256_hash_many,  generic_setup, generic_tear_down, MUNIT_TEST_OPTION_NONE, NULL },
 	{
 		.name       = NULL,
 		.test       = NULL,
@@ -0,0 +1,575 @@
+/*
+ * test_threads.c
+ *
+ * Stress the library from several threads at once. These are mostly useful in
+ * a TSAN build (see CMakeLists.txt).
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "munit.h"
+#include "helpers.h"
+#include "aes.h"
+#include "ecb.h"
+#include "cbc.h"
+#include "ctr.h"
+#include "hash.h"
+#include "mac.h"
+#include "mt19937.h"
+#include "oracle.h"
+#include "pool.h"
+#include "dh.h"
+#include "srp.h"
+#include "ssrp.h"
+#include "break_cbc.h"
+#include "test_dh.h"
+#include "test_srp.h"
+
+
+/* count of threads started by each test */
+#define	NTHREADS	4
+
+
+/*
+ * Start NTHREADS threads calling fn(arg) and wait for all of them.
+ */
+static void
+run_threads(void *(*fn)(void *), void *arg)
+{
+	pthread_t threads[NTHREADS];
+
+	for (size_t i = 0; i < NTHREADS; i++) {
+		if (pthread_create(&threads[i], NULL, fn, arg) != 0)
+			munit_error("pthread_create");
+	}
+	for (size_t i = 0; i < NTHREADS; i++) {
+		if (pthread_join(threads[i], NULL) != 0)
+			munit_error("pthread_join");
+	}
+}
+
+
+/* state shared by the threads querying a single padding oracle */
+struct oracle_job {
+	struct oracle *oracle;
+	const struct bytes *valid, *invalid;
+	size_t rounds;
+	atomic_size_t failures;
+};
+
+static void *
+oracle_thread(void *arg)
+{
+	struct oracle_job *job = arg;
+
+	for (size_t i = 0; i < job->rounds; i++) {
+		if (oracle_query(job->oracle, job->valid, NULL) != 0)
+			(void)atomic_fetch_add(&job->failures, 1);
+		if (oracle_query(job->oracle, job->invalid, NULL) != 1)
+			(void)atomic_fetch_add(&job->failures, 1);
+	}
+	return (NULL);
+}
+
+static MunitResult
+test_threads_oracle(const MunitParameter *params, void *data)
+{
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	struct bytes *iv = bytes_randomized(aes_128_blocksize());
+	struct bytes *plaintext = bytes_from_str("YELLOW SUBMARINE, the sequel");
+	if (key == NULL || iv == NULL || plaintext == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *ciphertext = aes_128_cbc_encrypt(plaintext, key, iv);
+	if (ciphertext == NULL)
+		munit_error("aes_128_cbc_encrypt");
+	struct bytes *valid = bytes_joined(2, iv, ciphertext);
+	if (valid == NULL)
+		munit_error("bytes_joined");
+	/* flipping the last byte of the IV before the last block breaks the
+	   padding */
+	struct bytes *invalid = bytes_dup(valid);
+	if (invalid == NULL)
+		munit_error("bytes_dup");
+	invalid->data[invalid->len - aes_128_blocksize() - 1] ^= 0x42;
+
+	struct oracle_job job = {
+		.oracle  = cbc_padding_oracle_new(key),
+		.valid   = valid,
+		.invalid = invalid,
+		.rounds  = 256,
+	};
+	if (job.oracle == NULL)
+		munit_error("cbc_padding_oracle_new");
+	atomic_init(&job.failures, 0);
+
+	run_threads(oracle_thread, &job);
+	munit_assert_size(atomic_load(&job.failures), ==, 0);
+	/* no update of the statistics may be lost */
+	munit_assert_uint64(job.oracle->stats.queries, ==,
+		    NTHREADS * job.rounds * 2);
+	munit_assert_uint64(job.oracle->stats.bytes_sent, ==,
+		    NTHREADS * job.rounds * (valid->len + invalid->len));
+
+	oracle_free(job.oracle);
+	bytes_free(invalid);
+	bytes_free(valid);
+	bytes_free(ciphertext);
+	bytes_free(plaintext);
+	bytes_free(iv);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads drawing random data */
+struct random_job {
+	uint8_t buf[NTHREADS][64];
+	atomic_size_t next;
+	atomic_size_t failures;
+};
+
+static void *
+random_thread(void *arg)
+{
+	struct random_job *job = arg;
+	const size_t i = atomic_fetch_add(&job->next, 1);
+	uint8_t scratch[4096];
+
+	for (size_t round = 0; round < 64; round++) {
+		if (bytes_random_fill(scratch, sizeof(scratch)) != 0)
+			(void)atomic_fetch_add(&job->failures, 1);
+		if (round == 32)
+			bytes_random_seed(i);
+	}
+	if (bytes_random_fill(job->buf[i], sizeof(job->buf[i])) != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_bytes_random(const MunitParameter *params, void *data)
+{
+	struct random_job *job = munit_malloc(sizeof(struct random_job));
+	atomic_init(&job->next, 0);
+	atomic_init(&job->failures, 0);
+
+	run_threads(random_thread, job);
+	munit_assert_size(atomic_load(&job->failures), ==, 0);
+	/* each thread has its own stream */
+	for (size_t i = 0; i < NTHREADS; i++) {
+		for (size_t j = i + 1; j < NTHREADS; j++) {
+			munit_assert_memory_not_equal(sizeof(job->buf[i]),
+				    job->buf[i], job->buf[j]);
+		}
+	}
+
+	free(job);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads computing the bulk modes and hashes */
+struct bulk_job {
+	const struct bytes *key, *iv, *plaintext;
+	const struct bytes *ecb, *cbc, *ctr, *hmac;
+	struct bytes *msgs[64], *digests[64];
+	atomic_size_t failures;
+};
+
+/* Returns 0 when got is expected, -1 otherwise. got is freed. */
+static int
+check_result(struct bytes *got, const struct bytes *expected)
+{
+	const int ret = (got != NULL && bytes_bcmp(got, expected) == 0);
+
+	bytes_free(got);
+	return (ret ? 0 : -1);
+}
+
+static void *
+bulk_thread(void *arg)
+{
+	struct bulk_job *job = arg;
+	const size_t count = sizeof(job->msgs) / sizeof(*job->msgs);
+	struct bytes *out[sizeof(job->msgs) / sizeof(*job->msgs)];
+	int ret = 0;
+
+	ret |= check_result(aes_128_ecb_encrypt(job->plaintext, job->key),
+		    job->ecb);
+	ret |= check_result(aes_128_cbc_encrypt(job->plaintext, job->key,
+		    job->iv), job->cbc);
+	ret |= check_result(aes_128_cbc_decrypt(job->cbc, job->key, job->iv),
+		    job->plaintext);
+	ret |= check_result(aes_128_ctr_encrypt(job->plaintext, job->key, 7),
+		    job->ctr);
+	ret |= check_result(hmac_sha256(job->key, job->plaintext), job->hmac);
+
+	if (hash_sha1.hash_many((const struct bytes *const *)job->msgs,
+		    count, out) != 0) {
+		ret = -1;
+	} else {
+		for (size_t i = 0; i < count; i++)
+			ret |= check_result(out[i], job->digests[i]);
+	}
+
+	if (ret != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_bulk(const MunitParameter *params, void *data)
+{
+	struct bulk_job *job = munit_malloc(sizeof(struct bulk_job));
+	const size_t count = sizeof(job->msgs) / sizeof(*job->msgs);
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	struct bytes *iv = bytes_randomized(aes_128_blocksize());
+	/* large enough to be split between the threads of the pool */
+	struct bytes *plaintext = bytes_randomized(256 * 1024 + 5);
+	if (key == NULL || iv == NULL || plaintext == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *ecb = aes_128_ecb_encrypt(plaintext, key);
+	struct bytes *cbc = aes_128_cbc_encrypt(plaintext, key, iv);
+	struct bytes *ctr = aes_128_ctr_encrypt(plaintext, key, 7);
+	struct bytes *mac = hmac_sha256(key, plaintext);
+	if (ecb == NULL || cbc == NULL || ctr == NULL || mac == NULL)
+		munit_error("expected results");
+	for (size_t i = 0; i < count; i++) {
+		job->msgs[i] = bytes_slice(plaintext, i, 3 * i);
+		if (job->msgs[i] == NULL)
+			munit_error("bytes_slice");
+		job->digests[i] = hash_sha1.hash(job->msgs[i]);
+		if (job->digests[i] == NULL)
+			munit_error("hash_sha1.hash");
+	}
+	job->key = key;
+	job->iv = iv;
+	job->plaintext = plaintext;
+	job->ecb = ecb;
+	job->cbc = cbc;
+	job->ctr = ctr;
+	job->hmac = mac;
+	atomic_init(&job->failures, 0);
+
+	run_threads(bulk_thread, job);
+	munit_assert_size(atomic_load(&job->failures), ==, 0);
+
+	for (size_t i = 0; i < count; i++) {
+		bytes_free(job->digests[i]);
+		bytes_free(job->msgs[i]);
+	}
+	bytes_free(mac);
+	bytes_free(ctr);
+	bytes_free(cbc);
+	bytes_free(ecb);
+	bytes_free(plaintext);
+	bytes_free(iv);
+	bytes_free(key);
+	free(job);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads using the same pool */
+struct pool_job {
+	struct cp_pool *pool;
+	atomic_size_t visits[4096];
+	atomic_size_t failures;
+};
+
+/* cp_parallel_for() routine counting the visits of each index */
+static int
+visit_range(size_t lo, size_t hi, void *arg)
+{
+	struct pool_job *job = arg;
+
+	for (size_t i = lo; i < hi; i++)
+		(void)atomic_fetch_add(&job->visits[i], 1);
+	return (0);
+}
+
+static void *
+pool_thread(void *arg)
+{
+	struct pool_job *job = arg;
+	const size_t n = sizeof(job->visits) / sizeof(*job->visits);
+
+	if (cp_parallel_for(job->pool, n, 16, visit_range, job) != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_pool(const MunitParameter *params, void *data)
+{
+	struct pool_job *job = munit_malloc(sizeof(struct pool_job));
+	const size_t n = sizeof(job->visits) / sizeof(*job->visits);
+
+	job->pool = cp_pool_create(NTHREADS);
+	if (job->pool == NULL)
+		munit_error("cp_pool_create");
+	for (size_t i = 0; i < n; i++)
+		atomic_init(&job->visits[i], 0);
+	atomic_init(&job->failures, 0);
+
+	/* every thread waits on its own group of the same pool */
+	run_threads(pool_thread, job);
+	munit_assert_size(atomic_load(&job->failures), ==, 0);
+	for (size_t i = 0; i < n; i++)
+		munit_assert_size(atomic_load(&job->visits[i]), ==, NTHREADS);
+
+	cp_pool_free(job->pool);
+	free(job);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads breaking the same padding oracle */
+struct breaker_job {
+	struct oracle *oracle;
+	const struct bytes *plaintext, *ciphertext, *iv;
+	atomic_size_t failures;
+};
+
+static void *
+breaker_thread(void *arg)
+{
+	struct breaker_job *job = arg;
+
+	struct bytes *cracked = cbc_padding_breaker(job->ciphertext,
+		    job->oracle, job->iv, 0);
+	if (check_result(cracked, job->plaintext) != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_cbc_padding_breaker(const MunitParameter *params, void *data)
+{
+	struct bytes *key = bytes_randomized(aes_128_keylength());
+	struct bytes *iv = bytes_randomized(aes_128_blocksize());
+	struct bytes *plaintext = bytes_from_str(
+		    "Now that the party is jumping, with the bass kicked in");
+	if (key == NULL || iv == NULL || plaintext == NULL)
+		munit_error("bytes_randomized");
+	struct bytes *ciphertext = aes_128_cbc_encrypt(plaintext, key, iv);
+	if (ciphertext == NULL)
+		munit_error("aes_128_cbc_encrypt");
+
+	struct breaker_job job = {
+		.oracle     = cbc_padding_oracle_new(key),
+		.plaintext  = plaintext,
+		.ciphertext = ciphertext,
+		.iv         = iv,
+	};
+	if (job.oracle == NULL)
+		munit_error("cbc_padding_oracle_new");
+	atomic_init(&job.failures, 0);
+
+	run_threads(breaker_thread, &job);
+	munit_assert_size(atomic_load(&job.failures), ==, 0);
+
+	oracle_free(job.oracle);
+	bytes_free(ciphertext);
+	bytes_free(plaintext);
+	bytes_free(iv);
+	bytes_free(key);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads running key exchanges */
+struct exchange_job {
+	const struct bytes *I, *P;
+	const struct mpi *p, *g;
+	/* the SRP server shared by every thread */
+	struct srp_server *shared;
+	atomic_size_t failures;
+};
+
+/* Returns 0 when a DH exchange between two new endpoints succeeds. */
+static int
+dh_session(const struct exchange_job *job)
+{
+	struct dh *alice = dh_new();
+	struct dh *bob = dh_new();
+	int ret = -1;
+
+	if (alice != NULL && bob != NULL &&
+		    alice->exchange(alice, bob, job->p, job->g) == 0)
+		ret = bytes_bcmp(alice->key, bob->key);
+	if (bob != NULL)
+		bob->free(bob);
+	if (alice != NULL)
+		alice->free(alice);
+	return (ret);
+}
+
+/* Returns 0 when a SRP authentication to a new local server succeeds. */
+static int
+srp_session(const struct exchange_job *job)
+{
+	struct srp_server *server = srp_local_server_new(job->I, job->P);
+	struct srp_client *client = srp_client_new(job->I, job->P);
+	int ret = -1;
+
+	if (server != NULL && client != NULL)
+		ret = client->authenticate(client, server);
+	if (client != NULL)
+		client->free(client);
+	if (server != NULL)
+		server->free(server);
+	return (ret);
+}
+
+/* Returns 0 when a SSRP authentication to a new local server succeeds. */
+static int
+ssrp_session(const struct exchange_job *job)
+{
+	struct ssrp_server *server = ssrp_local_server_new(job->I, job->P);
+	struct ssrp_client *client = ssrp_client_new(job->I, job->P);
+	int ret = -1;
+
+	if (server != NULL && client != NULL)
+		ret = client->authenticate(client, server);
+	if (client != NULL)
+		client->free(client);
+	if (server != NULL)
+		server->free(server);
+	return (ret);
+}
+
+static void *
+exchange_thread(void *arg)
+{
+	struct exchange_job *job = arg;
+
+	if (dh_session(job) != 0 || srp_session(job) != 0 ||
+		    ssrp_session(job) != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+
+	/* concurrent sessions on the same server may fail one another, but
+	   must not race */
+	struct srp_client *client = srp_client_new(job->I, job->P);
+	if (client == NULL) {
+		(void)atomic_fetch_add(&job->failures, 1);
+		return (NULL);
+	}
+	for (size_t i = 0; i < 4; i++)
+		(void)client->authenticate(client, job->shared);
+	client->free(client);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_exchanges(const MunitParameter *params, void *data)
+{
+	struct bytes *I = bytes_from_str(srp_email);
+	struct bytes *P = bytes_from_str(srp_password);
+	struct mpi *p = mpi_from_hex(nist_p_hex);
+	struct mpi *g = mpi_from_hex(nist_g_hex);
+	if (I == NULL || P == NULL || p == NULL || g == NULL)
+		munit_error("exchange parameters");
+
+	struct exchange_job job = {
+		.I      = I,
+		.P      = P,
+		.p      = p,
+		.g      = g,
+		.shared = srp_local_server_new(I, P),
+	};
+	if (job.shared == NULL)
+		munit_error("srp_local_server_new");
+	atomic_init(&job.failures, 0);
+
+	run_threads(exchange_thread, &job);
+	munit_assert_size(atomic_load(&job.failures), ==, 0);
+
+	/* the shared server is still usable once alone */
+	struct srp_client *client = srp_client_new(I, P);
+	if (client == NULL)
+		munit_error("srp_client_new");
+	munit_assert_int(client->authenticate(client, job.shared), ==, 0);
+
+	client->free(client);
+	job.shared->free(job.shared);
+	mpi_free(g);
+	mpi_free(p);
+	bytes_free(P);
+	bytes_free(I);
+	return (MUNIT_OK);
+}
+
+
+/* state shared by the threads jumping MT19937 generators */
+struct jump_job {
+	uint32_t seed;
+	uint64_t k;
+	uint32_t out[NTHREADS];
+	atomic_size_t next;
+	atomic_size_t failures;
+};
+
+static void *
+jump_thread(void *arg)
+{
+	struct jump_job *job = arg;
+	const size_t i = atomic_fetch_add(&job->next, 1);
+
+	struct mt19937_generator *gen = mt19937_init(job->seed);
+	if (gen == NULL || mt19937_jump(gen, job->k) != 0 ||
+		    mt19937_next_uint32(gen, &job->out[i]) != 0)
+		(void)atomic_fetch_add(&job->failures, 1);
+	mt19937_free(gen);
+	return (NULL);
+}
+
+static MunitResult
+test_threads_mt19937_jump(const MunitParameter *params, void *data)
+{
+	struct jump_job job = {
+		.seed = munit_rand_uint32(),
+		.k    = 1000003,
+	};
+	atomic_init(&job.next, 0);
+	atomic_init(&job.failures, 0);
+
+	run_threads(jump_thread, &job);
+	munit_assert_size(atomic_load(&job.failures), ==, 0);
+
+	/* compare with the generator stepped by hand */
+	struct mt19937_generator *gen = mt19937_init(job.seed);
+	if (gen == NULL)
+		munit_error("mt19937_init");
+	uint32_t expected = 0;
+	for (uint64_t i = 0; i <= job.k; i++) {
+		if (mt19937_next_uint32(gen, &expected) != 0)
+			munit_error("mt19937_next_uint32");
+	}
+	for (size_t i = 0; i < NTHREADS; i++)
+		munit_assert_uint32(job.out[i], ==, expected);
+
+	mt19937_free(gen);
+	return (MUNIT_OK);
+}
+
+
+/* The test suite. */
+MunitTest test_threads_suite_tests[] = {
+	{ "oracle",              test_threads_oracle,              srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "bytes_random",        test_threads_bytes_random,        srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "bulk",                test_threads_bulk,                srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "pool",                test_threads_pool,                NULL,        NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "cbc_padding_breaker", test_threads_cbc_padding_breaker, srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "exchanges",           test_threads_exchanges,           srand_reset, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{ "mt19937_jump",        test_threads_mt19937_jump,        NULL,        NULL, MUNIT_TEST_OPTION_NONE, NULL },
+	{
+		.name       = NULL,
+		.test       = NULL,
+		.setup      = NULL,
+		.tear_down  = NULL,
+		.options    = MUNIT_TEST_OPTION_NONE,
+		.parameters = NULL,
+	},
+};
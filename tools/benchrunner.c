@@ -0,0 +1,1427 @@
+/*
+ * benchrunner.c
+ *
+ * Measure the throughput of the library primitives and breakers. Each
+ * benchmark reports its time per operation, TSC cycles per byte and count of
+ * allocations per operation as CSV or JSON, so that the results of two builds
+ * can be compared with diff(1) or any script.
+ *
+ * The allocations are counted by wrapping the allocation functions at link
+ * time (see BENCH_WRAP_MALLOC in CMakeLists.txt) and routing OpenSSL's own
+ * through them. When the linker can't do it, they are not reported. The C
+ * library functions allocating internally are not seen by the wrappers, so
+ * asprintf(3) and vasprintf(3) are wrapped too and count as one allocation
+ * (BENCH_WRAP_ASPRINTF); any other one (e.g. getline(3)) is missed.
+ */
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(BENCH_WRAP_MALLOC)
+#include <openssl/crypto.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	HAVE_RDTSC	1
+#endif
+
+#include "compat.h"
+#include "bytes.h"
+#include "xor.h"
+#include "aes.h"
+#include "ecb.h"
+#include "cbc.h"
+#include "ctr.h"
+#include "hash.h"
+#include "mac.h"
+#include "mt19937.h"
+#include "mpi.h"
+#include "oracle.h"
+#include "pool.h"
+#include "dh.h"
+#include "srp.h"
+#include "ssrp.h"
+#include "rsa.h"
+#include "break_plaintext.h"
+#include "break_single_byte_xor.h"
+#include "break_repeating_key_xor.h"
+#include "break_ecb.h"
+#include "break_cbc.h"
+#include "break_ctr.h"
+#include "break_mt19937.h"
+#include "break_mac.h"
+#include "break_dh.h"
+#include "break_srp.h"
+#include "break_ssrp.h"
+#include "break_rsa.h"
+
+
+/* default minimum duration of a measure, in seconds */
+#define	BENCH_MIN_TIME	0.2
+
+/*
+ * A benchmark, timing run() on the state returned by setup().
+ */
+struct bench {
+	/* name matched against the command line prefixes */
+	const char *name;
+	/* count of bytes processed by each run() call, 0 when not relevant */
+	size_t len;
+	/* returns the state given to run(), or NULL on error */
+	void	*(*setup)(size_t len);
+	/* a single operation, returns 0 on success or -1 on error */
+	int	(*run)(void *state);
+	void	(*teardown)(void *state);
+};
+
+/*
+ * The result of a benchmark.
+ */
+struct bench_result {
+	const struct bench *bench;
+	/* count of run() calls measured */
+	uint64_t iterations;
+	double ns_per_op;
+	/* TSC cycles, negative when not available */
+	double cycles_per_op;
+	/* negative when the allocations are not counted */
+	double allocs_per_op;
+};
+
+/* output formats */
+enum bench_format {
+	BENCH_CSV,
+	BENCH_JSON,
+};
+
+
+/* Display the usage message and exit */
+static void	usage(void);
+
+/*
+ * Returns 1 if the given name starts with any of the count prefixes, or if
+ * there are no prefixes at all, 0 otherwise.
+ */
+static int	selected(const char *name, char **prefixes, int count);
+
+/*
+ * Setup and run the given benchmark as many times as needed to last at least
+ * mintime seconds, then teardown.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	measure(const struct bench *bench, double mintime,
+		    struct bench_result *result);
+
+/* Output the header, a result, and the footer in the given format */
+static void	print_header(enum bench_format format, size_t nthreads);
+static void	print_result(enum bench_format format,
+		    const struct bench_result *result, int first);
+static void	print_footer(enum bench_format format);
+
+/* Returns the current time of the monotonic clock, in nanoseconds */
+static uint64_t	now_ns(void);
+
+/* Returns the TSC, or 0 when not available */
+static uint64_t	cycles(void);
+
+/* Returns the count of allocations made so far */
+static uint64_t	allocations(void);
+
+
+/* count of allocations, updated by the wrappers below */
+static atomic_uint_fast64_t	bench_allocs = 0;
+
+#if defined(BENCH_WRAP_MALLOC)
+/*
+ * The linker resolves the calls to the allocation functions to these
+ * wrappers, and the __real_ ones to the C library implementation.
+ */
+void	*__real_malloc(size_t size);
+void	*__real_calloc(size_t nmemb, size_t size);
+void	*__real_realloc(void *ptr, size_t size);
+void	*__real_reallocarray(void *ptr, size_t nmemb, size_t size);
+char	*__real_strdup(const char *s);
+
+void	*__wrap_malloc(size_t size);
+void	*__wrap_calloc(size_t nmemb, size_t size);
+void	*__wrap_realloc(void *ptr, size_t size);
+void	*__wrap_reallocarray(void *ptr, size_t nmemb, size_t size);
+char	*__wrap_strdup(const char *s);
+#if defined(BENCH_WRAP_ASPRINTF)
+int	__real_vasprintf(char **str_p, const char *fmt, va_list ap);
+
+int	__wrap_asprintf(char **str_p, const char *fmt, ...);
+int	__wrap_vasprintf(char **str_p, const char *fmt, va_list ap);
+#endif
+
+
+void *
+__wrap_malloc(size_t size)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_malloc(size));
+}
+
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_calloc(nmemb, size));
+}
+
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_realloc(ptr, size));
+}
+
+
+void *
+__wrap_reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_reallocarray(ptr, nmemb, size));
+}
+
+
+char *
+__wrap_strdup(const char *s)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_strdup(s));
+}
+
+
+#if defined(BENCH_WRAP_ASPRINTF)
+int
+__wrap_asprintf(char **str_p, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = __wrap_vasprintf(str_p, fmt, ap);
+	va_end(ap);
+
+	return (ret);
+}
+
+
+int
+__wrap_vasprintf(char **str_p, const char *fmt, va_list ap)
+{
+	(void)atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+	return (__real_vasprintf(str_p, fmt, ap));
+}
+#endif /* defined(BENCH_WRAP_ASPRINTF) */
+
+
+/* OpenSSL memory functions, going through the wrappers */
+static void *
+crypto_malloc(size_t size, const char *file, int line)
+{
+	(void)file;
+	(void)line;
+	return (malloc(size));
+}
+
+
+static void *
+crypto_realloc(void *ptr, size_t size, const char *file, int line)
+{
+	(void)file;
+	(void)line;
+	return (realloc(ptr, size));
+}
+
+
+static void
+crypto_free(void *ptr, const char *file, int line)
+{
+	(void)file;
+	(void)line;
+	free(ptr);
+}
+#endif /* defined(BENCH_WRAP_MALLOC) */
+
+
+/*
+ * Primitives.
+ */
+
+/* Lewis Carroll's, used as the English plaintext of the breakers */
+static const char *english =
+	"Alice was beginning to get very tired of sitting by her sister on the "
+	"bank, and of having nothing to do: once or twice she had peeped into "
+	"the book her sister was reading, but it had no pictures or "
+	"conversations in it, 'and what is the use of a book,' thought Alice "
+	"'without pictures or conversations?' So she was considering in her "
+	"own mind (as well as she could, for the hot day made her feel very "
+	"sleepy and stupid), whether the pleasure of making a daisy-chain "
+	"would be worth the trouble of getting up and picking the daisies, "
+	"when suddenly a White Rabbit with pink eyes ran close by her. There "
+	"was nothing so very remarkable in that; nor did Alice think it so "
+	"very much out of the way to hear the Rabbit say to itself, 'Oh dear! "
+	"Oh dear! I shall be late!'";
+
+/* state of the primitives benchmarks */
+struct prim {
+	struct bytes *key, *iv, *expkey, *block;
+	/* len random bytes and their ciphertexts */
+	struct bytes *in, *ecb, *cbc;
+	/* a len bytes scratch buffer */
+	struct bytes *out;
+	/* in encoded */
+	char *hex, *base64;
+	struct mt19937_generator *gen;
+};
+
+static void
+prim_teardown(void *arg)
+{
+	struct prim *prim = arg;
+
+	mt19937_free(prim->gen);
+	free(prim->base64);
+	free(prim->hex);
+	bytes_free(prim->out);
+	bytes_free(prim->cbc);
+	bytes_free(prim->ecb);
+	bytes_free(prim->in);
+	bytes_free(prim->block);
+	bytes_free(prim->expkey);
+	bytes_free(prim->iv);
+	bytes_free(prim->key);
+	free(prim);
+}
+
+static void *
+prim_setup(size_t len)
+{
+	struct prim *prim = calloc(1, sizeof(struct prim));
+	if (prim == NULL)
+		return (NULL);
+
+	prim->key = bytes_randomized(aes_128_keylength());
+	prim->iv = bytes_randomized(aes_128_blocksize());
+	prim->block = bytes_randomized(aes_128_blocksize());
+	prim->in = bytes_randomized(len);
+	prim->out = bytes_randomized(len);
+	prim->gen = mt19937_init(5489);
+	if (prim->key == NULL || prim->iv == NULL || prim->block == NULL ||
+		    prim->in == NULL || prim->out == NULL || prim->gen == NULL)
+		goto fail;
+	prim->expkey = aes_128_expand_key(prim->key);
+	prim->ecb = aes_128_ecb_encrypt(prim->in, prim->key);
+	prim->cbc = aes_128_cbc_encrypt(prim->in, prim->key, prim->iv);
+	prim->hex = bytes_to_hex(prim->in);
+	prim->base64 = bytes_to_base64(prim->in);
+	if (prim->expkey == NULL || prim->ecb == NULL || prim->cbc == NULL ||
+		    prim->hex == NULL || prim->base64 == NULL)
+		goto fail;
+
+	return (prim);
+fail:
+	prim_teardown(prim);
+	return (NULL);
+}
+
+/* Returns 0 when the given result is not NULL, -1 otherwise. It is freed. */
+static int
+consume(struct bytes *result)
+{
+	const int ret = (result == NULL ? -1 : 0);
+
+	bytes_free(result);
+	return (ret);
+}
+
+static int
+run_aes_block(void *arg)
+{
+	struct prim *prim = arg;
+	return (aes_128_encrypt(prim->block, prim->expkey));
+}
+
+static int
+run_ecb_encrypt(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(aes_128_ecb_encrypt(prim->in, prim->key)));
+}
+
+static int
+run_ecb_decrypt(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(aes_128_ecb_decrypt(prim->ecb, prim->key)));
+}
+
+static int
+run_cbc_encrypt(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(aes_128_cbc_encrypt(prim->in, prim->key, prim->iv)));
+}
+
+static int
+run_cbc_decrypt(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(aes_128_cbc_decrypt(prim->cbc, prim->key, prim->iv)));
+}
+
+static int
+run_ctr(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(aes_128_ctr_encrypt(prim->in, prim->key, 42)));
+}
+
+static int
+run_sha1(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(hash_sha1.hash(prim->in)));
+}
+
+static int
+run_sha256(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(hash_sha256.hash(prim->in)));
+}
+
+static int
+run_md4(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(hash_md4.hash(prim->in)));
+}
+
+static int
+run_hmac_sha1(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(hmac_sha1(prim->key, prim->in)));
+}
+
+static int
+run_hmac_sha256(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(hmac_sha256(prim->key, prim->in)));
+}
+
+static int
+run_mt19937_next(void *arg)
+{
+	struct prim *prim = arg;
+	uint32_t n;
+	return (mt19937_next_uint32(prim->gen, &n));
+}
+
+static int
+run_mt19937_fill(void *arg)
+{
+	struct prim *prim = arg;
+	return (mt19937_fill_bytes(prim->gen, prim->out->data,
+		    prim->out->len));
+}
+
+static int
+run_xor(void *arg)
+{
+	struct prim *prim = arg;
+	return (bytes_xor(prim->out, prim->in));
+}
+
+static int
+run_repeating_key_xor(void *arg)
+{
+	struct prim *prim = arg;
+	return (repeating_key_xor(prim->out, prim->key));
+}
+
+static int
+run_to_hex(void *arg)
+{
+	struct prim *prim = arg;
+	char *s = bytes_to_hex(prim->in);
+	free(s);
+	return (s == NULL ? -1 : 0);
+}
+
+static int
+run_from_hex(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(bytes_from_hex(prim->hex)));
+}
+
+static int
+run_to_base64(void *arg)
+{
+	struct prim *prim = arg;
+	char *s = bytes_to_base64(prim->in);
+	free(s);
+	return (s == NULL ? -1 : 0);
+}
+
+static int
+run_from_base64(void *arg)
+{
+	struct prim *prim = arg;
+	return (consume(bytes_from_base64(prim->base64)));
+}
+
+
+/* state of the mpi_mod_exp() benchmark */
+struct modexp {
+	struct mpi *N, *g, *k, *exp;
+};
+
+static void
+modexp_teardown(void *arg)
+{
+	struct modexp *modexp = arg;
+
+	mpi_free(modexp->exp);
+	mpi_free(modexp->k);
+	mpi_free(modexp->g);
+	mpi_free(modexp->N);
+	free(modexp);
+}
+
+static void *
+modexp_setup(size_t len)
+{
+	(void)len;
+	struct modexp *modexp = calloc(1, sizeof(struct modexp));
+	if (modexp == NULL)
+		return (NULL);
+
+	/* g^x mod N as computed by SRP */
+	if (srp_parameters(&modexp->N, &modexp->g, &modexp->k) != 0)
+		goto fail;
+	modexp->exp = mpi_rand_range_from_one_to(modexp->N);
+	if (modexp->exp == NULL)
+		goto fail;
+
+	return (modexp);
+fail:
+	modexp_teardown(modexp);
+	return (NULL);
+}
+
+static int
+run_modexp(void *arg)
+{
+	struct modexp *modexp = arg;
+	struct mpi *r = mpi_mod_exp(modexp->g, modexp->exp, modexp->N);
+	mpi_free(r);
+	return (r == NULL ? -1 : 0);
+}
+
+
+/*
+ * Breakers.
+ */
+
+/* state of the breakers benchmarks, each using only some of the members */
+struct breaker {
+	struct bytes *key, *iv, *plaintext, *ciphertext, *mac;
+	struct bytes **ciphertexts;
+	size_t count;
+	struct oracle *oracle;
+	uint32_t outputs[624];
+	uint32_t seed;
+	uint64_t delay;
+	struct bytes *I, *P;
+	struct mpi *p, *g;
+	struct srp_server *server;
+	struct rsa_pubkey *pubk[3];
+	struct bytes *c[3];
+};
+
+static void
+breaker_teardown(void *arg)
+{
+	struct breaker *b = arg;
+
+	for (size_t i = 0; i < 3; i++) {
+		bytes_free(b->c[i]);
+		rsa_pubkey_free(b->pubk[i]);
+	}
+	if (b->server != NULL)
+		b->server->free(b->server);
+	mpi_free(b->g);
+	mpi_free(b->p);
+	bytes_free(b->P);
+	bytes_free(b->I);
+	oracle_free(b->oracle);
+	for (size_t i = 0; i < b->count; i++)
+		bytes_free(b->ciphertexts[i]);
+	free(b->ciphertexts);
+	bytes_free(b->mac);
+	bytes_free(b->ciphertext);
+	bytes_free(b->plaintext);
+	bytes_free(b->iv);
+	bytes_free(b->key);
+	free(b);
+}
+
+/*
+ * Returns a new breaker state with a random AES key and IV, and the first len
+ * bytes of the English text as plaintext (all of it when len is 0).
+ */
+static struct breaker *
+breaker_new(size_t len)
+{
+	struct breaker *b = calloc(1, sizeof(struct breaker));
+	if (b == NULL)
+		return (NULL);
+
+	b->key = bytes_randomized(aes_128_keylength());
+	b->iv = bytes_randomized(aes_128_blocksize());
+	b->plaintext = bytes_from_str(english);
+	if (b->key == NULL || b->iv == NULL || b->plaintext == NULL)
+		goto fail;
+	if (len > 0 && len < b->plaintext->len) {
+		struct bytes *slice = bytes_slice(b->plaintext, 0, len);
+		if (slice == NULL)
+			goto fail;
+		bytes_free(b->plaintext);
+		b->plaintext = slice;
+	}
+
+	return (b);
+fail:
+	breaker_teardown(b);
+	return (NULL);
+}
+
+static void *
+sbx_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(64);
+	if (b == NULL)
+		return (NULL);
+	b->ciphertext = bytes_dup(b->plaintext);
+	if (b->ciphertext == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+	for (size_t i = 0; i < b->ciphertext->len; i++)
+		b->ciphertext->data[i] ^= 0x5a;
+	return (b);
+}
+
+static int
+run_sbx(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(break_single_byte_xor(b->ciphertext,
+		    looks_like_english, NULL, NULL)));
+}
+
+static void *
+rkx_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+	struct bytes *key = bytes_from_str("Rabbit");
+	b->ciphertext = bytes_dup(b->plaintext);
+	if (key == NULL || b->ciphertext == NULL ||
+		    repeating_key_xor(b->ciphertext, key) != 0) {
+		bytes_free(key);
+		breaker_teardown(b);
+		return (NULL);
+	}
+	bytes_free(key);
+	return (b);
+}
+
+static int
+run_rkx(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(break_repeating_key_xor(b->ciphertext, NULL, NULL)));
+}
+
+static void *
+ecb_setup(size_t len)
+{
+	(void)len;
+	return (breaker_new(64));
+}
+
+static int
+run_ecb_baat12(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(ecb_byte_at_a_time_breaker12(b->plaintext, b->key,
+		    NULL)));
+}
+
+static int
+run_ecb_baat14(void *arg)
+{
+	struct breaker *b = arg;
+	/* the IV makes a random prefix */
+	return (consume(ecb_byte_at_a_time_breaker14(b->iv, b->plaintext,
+		    b->key, NULL)));
+}
+
+static int
+run_ecb_cut_and_paste(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(ecb_cut_and_paste_profile_breaker(b->key)));
+}
+
+static void *
+cbc_padding_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(64);
+	if (b == NULL)
+		return (NULL);
+	b->ciphertext = aes_128_cbc_encrypt(b->plaintext, b->key, b->iv);
+	b->oracle = cbc_padding_oracle_new(b->key);
+	if (b->ciphertext == NULL || b->oracle == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+	return (b);
+}
+
+static int
+run_cbc_padding(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(cbc_padding_breaker(b->ciphertext, b->oracle, b->iv,
+		    0)));
+}
+
+static int
+run_cbc_bitflipping(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(cbc_bitflipping_breaker(b->key, b->iv)));
+}
+
+static void *
+cbc_key_as_iv_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+	struct bytes *payload = bytes_repeated(3 * aes_128_blocksize(), 'X');
+	if (payload != NULL) {
+		b->ciphertext = cbc_bitflipping_encrypt(payload, b->key,
+		    b->key);
+	}
+	bytes_free(payload);
+	if (b->ciphertext == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+	return (b);
+}
+
+static int
+run_cbc_key_as_iv(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(cbc_key_as_iv_breaker(b->ciphertext, b->key)));
+}
+
+static void *
+ctr_fixed_nonce_setup(size_t len)
+{
+	(void)len;
+	const size_t linelen = 32;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+
+	/* the English text cut in lines encrypted under the same nonce */
+	const size_t count = b->plaintext->len / linelen;
+	b->ciphertexts = calloc(count, sizeof(struct bytes *));
+	if (b->ciphertexts == NULL)
+		goto fail;
+	for (; b->count < count; b->count++) {
+		struct bytes *line = bytes_slice(b->plaintext,
+			    b->count * linelen, linelen);
+		if (line == NULL)
+			goto fail;
+		b->ciphertexts[b->count] = aes_128_ctr_encrypt(line, b->key, 0);
+		bytes_free(line);
+		if (b->ciphertexts[b->count] == NULL)
+			goto fail;
+	}
+
+	return (b);
+fail:
+	breaker_teardown(b);
+	return (NULL);
+}
+
+static int
+run_ctr_fixed_nonce(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(break_ctr_fixed_nonce(b->ciphertexts, b->count)));
+}
+
+static void *
+ctr_edit_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+	b->ciphertext = aes_128_ctr_encrypt(b->plaintext, b->key, 42);
+	if (b->ciphertext == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+	return (b);
+}
+
+static int
+run_ctr_edit(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(aes_128_ctr_edit_breaker(b->ciphertext, b->key, 42)));
+}
+
+static int
+run_ctr_bitflipping(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(ctr_bitflipping_breaker(b->key, 42)));
+}
+
+static void *
+mt19937_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+
+	/* away from zero, see run_mt19937_recover_seed() */
+	b->seed = 0x10000 + 0xbeef;
+	struct mt19937_generator *gen = mt19937_init(b->seed);
+	const size_t count = sizeof(b->outputs) / sizeof(*b->outputs);
+	if (gen == NULL || mt19937_fill(gen, b->outputs, count) != 0) {
+		mt19937_free(gen);
+		breaker_teardown(b);
+		return (NULL);
+	}
+	mt19937_free(gen);
+
+	/* a 16-bit key stream cipher with a known plaintext suffix */
+	struct bytes *known = bytes_repeated(14, 'A');
+	struct bytes *payload = bytes_joined(2, b->iv, known);
+	if (payload != NULL)
+		b->ciphertext = mt19937_encrypt(payload, 0xc0de);
+	bytes_free(payload);
+	b->mac = known;
+	if (b->ciphertext == NULL || b->mac == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+
+	return (b);
+}
+
+static int
+run_mt19937_clone(void *arg)
+{
+	struct breaker *b = arg;
+	const size_t count = sizeof(b->outputs) / sizeof(*b->outputs);
+	struct mt19937_generator *clone =
+		    mt19937_clone_from_outputs(b->outputs, count);
+	mt19937_free(clone);
+	return (clone == NULL ? -1 : 0);
+}
+
+static int
+run_mt19937_recover_seed(void *arg)
+{
+	struct breaker *b = arg;
+	uint32_t seed = 0;
+	/* search 2^16 seeds, the right one being the last */
+	const int ret = mt19937_recover_seed(b->outputs, 2, b->seed - 0xffff,
+		    b->seed, 0, NULL, NULL, &seed);
+	return (ret == 0 && seed == b->seed ? 0 : -1);
+}
+
+static int
+run_mt19937_encryption(void *arg)
+{
+	struct breaker *b = arg;
+	uint16_t key = 0;
+	const int ret = mt19937_encryption_breaker(b->ciphertext, b->mac, &key);
+	return (ret == 0 && key == 0xc0de ? 0 : -1);
+}
+
+static void *
+mac_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+	b->mac = sha1_mac_keyed_prefix(b->key, b->plaintext);
+	b->oracle = sha1_mac_keyed_prefix_oracle_new(b->key);
+	if (b->mac == NULL || b->oracle == NULL) {
+		breaker_teardown(b);
+		return (NULL);
+	}
+	b->delay = 1000;
+	return (b);
+}
+
+static int
+run_sha1_length_extension(void *arg)
+{
+	struct breaker *b = arg;
+	struct bytes *msg = NULL, *mac = NULL;
+	const int ret = extend_sha1_mac_keyed_prefix(b->oracle, b->plaintext,
+		    b->mac, &msg, &mac);
+	bytes_free(mac);
+	bytes_free(msg);
+	return (ret == 0 ? 0 : -1);
+}
+
+/*
+ * break_timing_leak() probe of a simulated server leaking delay nanoseconds
+ * per matching hex digit of the MAC, with a noise of a few digits.
+ */
+static int
+simulated_probe(void *arg, size_t count, const struct bytes *const *macs,
+		    int *statuses, uint64_t *ns)
+{
+	struct breaker *b = arg;
+	const struct bytes *mac = b->mac;
+
+	for (size_t k = 0; k < count; k++) {
+		const struct bytes *guess = macs[k];
+		if (guess->len != mac->len)
+			return (-1);
+		size_t matching = 0;
+		for (size_t i = 0; i < mac->len; i++) {
+			if ((guess->data[i] >> 4) != (mac->data[i] >> 4))
+				break;
+			matching++;
+			if ((guess->data[i] & 0xf) != (mac->data[i] & 0xf))
+				break;
+			matching++;
+		}
+		statuses[k] = (matching == 2 * mac->len ? 200 : 500);
+		uint16_t noise;
+		if (bytes_random_fill(&noise, sizeof(noise)) != 0)
+			return (-1);
+		ns[k] = 100000 + matching * b->delay + noise % (3 * b->delay);
+	}
+
+	return (0);
+}
+
+static int
+run_timing_leak(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(break_timing_leak(simulated_probe, b, b->mac->len)));
+}
+
+static void *
+exchange_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	if (b == NULL)
+		return (NULL);
+	b->I = bytes_from_str("alice@example.com");
+	b->P = bytes_from_str("daisy-chain");
+	if (b->I == NULL || b->P == NULL)
+		goto fail;
+	if (srp_parameters(&b->p, &b->g, NULL) != 0)
+		goto fail;
+	b->server = srp_local_server_new(b->I, b->P);
+	if (b->server == NULL)
+		goto fail;
+	return (b);
+fail:
+	breaker_teardown(b);
+	return (NULL);
+}
+
+static int
+run_dh_mitm(void *arg)
+{
+	struct breaker *b = arg;
+	struct dh *alice = dh_new();
+	struct dh *mallory = dh_mitm_new(DH_MITM_P_AS_A, dh_new());
+	int ret = -1;
+
+	if (alice != NULL && mallory != NULL &&
+		    alice->exchange(alice, mallory, b->p, b->g) == 0)
+		ret = alice->challenge(alice, mallory, b->plaintext);
+	if (mallory != NULL)
+		mallory->free(mallory);
+	if (alice != NULL)
+		alice->free(alice);
+	return (ret == 0 ? 0 : -1);
+}
+
+static int
+run_srp_spoof(void *arg)
+{
+	struct breaker *b = arg;
+	struct srp_client *client =
+		    srp_spoof_client_new(SRP_SPOOF_CLIENT_0_AS_A, b->I);
+	if (client == NULL)
+		return (-1);
+	const int ret = client->authenticate(client, b->server);
+	client->free(client);
+	return (ret == 0 ? 0 : -1);
+}
+
+static int
+run_ssrp_dictionary(void *arg)
+{
+	static const char *dict[] = {
+		"123456", "password", "12345678", "qwerty", "12345",
+		"123456789", "letmein", "1234567", "football", "iloveyou",
+		"admin", "welcome", "monkey", "login", "abc123", "starwars",
+		"daisy-chain",
+	};
+	const size_t count = sizeof(dict) / sizeof(*dict);
+	struct breaker *b = arg;
+	struct ssrp_server *server = ssrp_local_mitm_server_new();
+	struct ssrp_client *client = ssrp_client_new(b->I, b->P);
+	char *password = NULL;
+	int ret = -1;
+
+	if (server != NULL && client != NULL &&
+		    client->authenticate(client, server) == 0) {
+		password = ssrp_local_mitm_password(server, dict, count);
+		ret = (password == NULL ? -1 : 0);
+	}
+	free(password);
+	if (client != NULL)
+		client->free(client);
+	if (server != NULL)
+		server->free(server);
+	return (ret);
+}
+
+static void *
+rsa_setup(size_t len)
+{
+	(void)len;
+	struct breaker *b = breaker_new(0);
+	struct bytes *msg = bytes_from_str("Squeamish Ossifrage");
+	if (b == NULL || msg == NULL)
+		goto fail;
+
+	for (size_t i = 0; i < 3; i++) {
+		struct rsa_privkey *privk = NULL;
+		if (rsa_keygen(512, &privk, &b->pubk[i]) != 0)
+			goto fail;
+		rsa_privkey_free(privk);
+		b->c[i] = rsa_encrypt(msg, b->pubk[i]);
+		if (b->c[i] == NULL)
+			goto fail;
+	}
+
+	bytes_free(msg);
+	return (b);
+fail:
+	bytes_free(msg);
+	if (b != NULL)
+		breaker_teardown(b);
+	return (NULL);
+}
+
+static int
+run_rsa_e3_broadcast(void *arg)
+{
+	struct breaker *b = arg;
+	return (consume(rsa_e3_broadcast_attack(b->c[0], b->pubk[0], b->c[1],
+		    b->pubk[1], b->c[2], b->pubk[2])));
+}
+
+
+/* The benchmarks, named like the test suites. */
+static const struct bench benches[] = {
+	{ "aes/block",                       16,      prim_setup,            run_aes_block,             prim_teardown },
+	{ "ecb/encrypt/16",                  16,      prim_setup,            run_ecb_encrypt,           prim_teardown },
+	{ "ecb/encrypt/1024",                1024,    prim_setup,            run_ecb_encrypt,           prim_teardown },
+	{ "ecb/encrypt/16384",               16384,   prim_setup,            run_ecb_encrypt,           prim_teardown },
+	{ "ecb/encrypt/1048576",             1048576, prim_setup,            run_ecb_encrypt,           prim_teardown },
+	{ "ecb/decrypt/16",                  16,      prim_setup,            run_ecb_decrypt,           prim_teardown },
+	{ "ecb/decrypt/1024",                1024,    prim_setup,            run_ecb_decrypt,           prim_teardown },
+	{ "ecb/decrypt/16384",               16384,   prim_setup,            run_ecb_decrypt,           prim_teardown },
+	{ "ecb/decrypt/1048576",             1048576, prim_setup,            run_ecb_decrypt,           prim_teardown },
+	{ "cbc/encrypt/16",                  16,      prim_setup,            run_cbc_encrypt,           prim_teardown },
+	{ "cbc/encrypt/1024",                1024,    prim_setup,            run_cbc_encrypt,           prim_teardown },
+	{ "cbc/encrypt/16384",               16384,   prim_setup,            run_cbc_encrypt,           prim_teardown },
+	{ "cbc/encrypt/1048576",             1048576, prim_setup,            run_cbc_encrypt,           prim_teardown },
+	{ "cbc/decrypt/16",                  16,      prim_setup,            run_cbc_decrypt,           prim_teardown },
+	{ "cbc/decrypt/1024",                1024,    prim_setup,            run_cbc_decrypt,           prim_teardown },
+	{ "cbc/decrypt/16384",               16384,   prim_setup,            run_cbc_decrypt,           prim_teardown },
+	{ "cbc/decrypt/1048576",             1048576, prim_setup,            run_cbc_decrypt,           prim_teardown },
+	{ "ctr/crypt/16",                    16,      prim_setup,            run_ctr,                   prim_teardown },
+	{ "ctr/crypt/1024",                  1024,    prim_setup,            run_ctr,                   prim_teardown },
+	{ "ctr/crypt/16384",                 16384,   prim_setup,            run_ctr,                   prim_teardown },
+	{ "ctr/crypt/1048576",               1048576, prim_setup,            run_ctr,                   prim_teardown },
+	{ "sha1/64",                         64,      prim_setup,            run_sha1,                  prim_teardown },
+	{ "sha1/1024",                       1024,    prim_setup,            run_sha1,                  prim_teardown },
+	{ "sha1/16384",                      16384,   prim_setup,            run_sha1,                  prim_teardown },
+	{ "sha1/1048576",                    1048576, prim_setup,            run_sha1,                  prim_teardown },
+	{ "sha256/64",                       64,      prim_setup,            run_sha256,                prim_teardown },
+	{ "sha256/1024",                     1024,    prim_setup,            run_sha256,                prim_teardown },
+	{ "sha256/16384",                    16384,   prim_setup,            run_sha256,                prim_teardown },
+	{ "sha256/1048576",                  1048576, prim_setup,            run_sha256,                prim_teardown },
+	{ "md4/64",                          64,      prim_setup,            run_md4,                   prim_teardown },
+	{ "md4/1024",                        1024,    prim_setup,            run_md4,                   prim_teardown },
+	{ "md4/16384",                       16384,   prim_setup,            run_md4,                   prim_teardown },
+	{ "md4/1048576",                     1048576, prim_setup,            run_md4,                   prim_teardown },
+	{ "mac/hmac_sha1/64",                64,      prim_setup,            run_hmac_sha1,             prim_teardown },
+	{ "mac/hmac_sha1/16384",             16384,   prim_setup,            run_hmac_sha1,             prim_teardown },
+	{ "mac/hmac_sha256/64",              64,      prim_setup,            run_hmac_sha256,           prim_teardown },
+	{ "mac/hmac_sha256/16384",           16384,   prim_setup,            run_hmac_sha256,           prim_teardown },
+	{ "mt/next_uint32",                  4,       prim_setup,            run_mt19937_next,          prim_teardown },
+	{ "mt/fill_bytes/4096",              4096,    prim_setup,            run_mt19937_fill,          prim_teardown },
+	{ "xor/bytes_xor/4096",              4096,    prim_setup,            run_xor,                   prim_teardown },
+	{ "xor/repeating_key/4096",          4096,    prim_setup,            run_repeating_key_xor,     prim_teardown },
+	{ "bytes/to_hex/1024",               1024,    prim_setup,            run_to_hex,                prim_teardown },
+	{ "bytes/to_hex/65536",              65536,   prim_setup,            run_to_hex,                prim_teardown },
+	{ "bytes/from_hex/1024",             1024,    prim_setup,            run_from_hex,              prim_teardown },
+	{ "bytes/from_hex/65536",            65536,   prim_setup,            run_from_hex,              prim_teardown },
+	{ "bytes/to_base64/1024",            1024,    prim_setup,            run_to_base64,             prim_teardown },
+	{ "bytes/to_base64/65536",           65536,   prim_setup,            run_to_base64,             prim_teardown },
+	{ "bytes/from_base64/1024",          1024,    prim_setup,            run_from_base64,           prim_teardown },
+	{ "bytes/from_base64/65536",         65536,   prim_setup,            run_from_base64,           prim_teardown },
+	{ "mpi/mod_exp/1536",                0,       modexp_setup,          run_modexp,                modexp_teardown },
+	{ "sbx/english",                     0,       sbx_setup,             run_sbx,                   breaker_teardown },
+	{ "rkx/english",                     0,       rkx_setup,             run_rkx,                   breaker_teardown },
+	{ "break-ecb/byte_at_a_time12",      0,       ecb_setup,             run_ecb_baat12,            breaker_teardown },
+	{ "break-ecb/byte_at_a_time14",      0,       ecb_setup,             run_ecb_baat14,            breaker_teardown },
+	{ "break-ecb/cut_and_paste",         0,       ecb_setup,             run_ecb_cut_and_paste,     breaker_teardown },
+	{ "break-cbc/padding",               0,       cbc_padding_setup,     run_cbc_padding,           breaker_teardown },
+	{ "break-cbc/bitflipping",           0,       ecb_setup,             run_cbc_bitflipping,       breaker_teardown },
+	{ "break-cbc/key_as_iv",             0,       cbc_key_as_iv_setup,   run_cbc_key_as_iv,         breaker_teardown },
+	{ "break-ctr/fixed_nonce",           0,       ctr_fixed_nonce_setup, run_ctr_fixed_nonce,       breaker_teardown },
+	{ "break-ctr/edit",                  0,       ctr_edit_setup,        run_ctr_edit,              breaker_teardown },
+	{ "break-ctr/bitflipping",           0,       ecb_setup,             run_ctr_bitflipping,       breaker_teardown },
+	{ "break-mt/clone",                  0,       mt19937_setup,         run_mt19937_clone,         breaker_teardown },
+	{ "break-mt/recover_seed",           0,       mt19937_setup,         run_mt19937_recover_seed,  breaker_teardown },
+	{ "break-mt/encrypt",                0,       mt19937_setup,         run_mt19937_encryption,    breaker_teardown },
+	{ "break-mac/sha1_length_extension", 0,       mac_setup,             run_sha1_length_extension, breaker_teardown },
+	{ "break-mac/timing_leak",           0,       mac_setup,             run_timing_leak,           breaker_teardown },
+	{ "break-dh/p_as_a",                 0,       exchange_setup,        run_dh_mitm,               breaker_teardown },
+	{ "break-srp/0_as_a",                0,       exchange_setup,        run_srp_spoof,             breaker_teardown },
+	{ "break-ssrp/dictionary",           0,       exchange_setup,        run_ssrp_dictionary,       breaker_teardown },
+	{ "break-rsa/e3_broadcast",          0,       rsa_setup,             run_rsa_e3_broadcast,      breaker_teardown },
+	{ NULL,                              0,       NULL,                  NULL,                      NULL },
+};
+
+
+int
+main(int argc, char **argv)
+{
+	const struct option options[] = {
+		{ "format",  required_argument, NULL, 'f' },
+		{ "time",    required_argument, NULL, 't' },
+		{ "threads", required_argument, NULL, 'T' },
+		{ "help",    no_argument,       NULL, 'h' },
+		{ NULL,      0,                 NULL, 0   },
+	};
+	enum bench_format format = BENCH_CSV;
+	double mintime = BENCH_MIN_TIME;
+	unsigned long nthreads = 0;
+	int threads_set = 0;
+	char *end = NULL;
+	int ch;
+
+#if defined(BENCH_WRAP_MALLOC)
+	/* must be done before OpenSSL allocates anything */
+	if (CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc,
+		    crypto_free) != 1) {
+		(void)fprintf(stderr, "%s: OpenSSL allocations not counted\n",
+			    argv[0]);
+	}
+#endif
+
+	while ((ch = getopt_long(argc, argv, "f:t:T:h", options,
+		    NULL)) != -1) {
+		switch (ch) {
+		case 'f':
+			if (strcmp(optarg, "csv") == 0)
+				format = BENCH_CSV;
+			else if (strcmp(optarg, "json") == 0)
+				format = BENCH_JSON;
+			else
+				usage();
+			break;
+		case 't':
+			mintime = strtod(optarg, &end);
+			if (*optarg == '\0' || *end != '\0' || !(mintime >= 0))
+				usage();
+			break;
+		case 'T':
+			nthreads = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0')
+				usage();
+			threads_set = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (threads_set && cp_pool_default_nthreads(nthreads) != 0)
+		usage();
+	struct cp_pool *pool = cp_pool_default();
+	if (pool == NULL) {
+		(void)fprintf(stderr, "cp_pool_default: failed\n");
+		return (EXIT_FAILURE);
+	}
+
+	/* a fixed seed so that every run processes the same data */
+	bytes_random_seed(0x5eed);
+
+	int success = 1, first = 1;
+	print_header(format, cp_pool_nthreads(pool));
+	for (const struct bench *bench = benches; bench->name != NULL;
+		    bench++) {
+		if (!selected(bench->name, argv, argc))
+			continue;
+		struct bench_result result;
+		if (measure(bench, mintime, &result) != 0) {
+			(void)fprintf(stderr, "%s: failed\n", bench->name);
+			success = 0;
+			continue;
+		}
+		print_result(format, &result, first);
+		first = 0;
+	}
+	print_footer(format);
+
+	return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+
+static void
+usage(void)
+{
+	(void)fprintf(stderr, "usage: benchrunner [-f csv|json] [-t seconds] "
+		    "[-T threads] [prefix ...]\n");
+	exit(EXIT_FAILURE);
+}
+
+
+static int
+selected(const char *name, char **prefixes, int count)
+{
+	if (count == 0)
+		return (1);
+
+	for (int i = 0; i < count; i++) {
+		if (strncmp(name, prefixes[i], strlen(prefixes[i])) == 0)
+			return (1);
+	}
+	return (0);
+}
+
+
+static int
+measure(const struct bench *bench, double mintime,
+		    struct bench_result *result)
+{
+	const uint64_t min_ns = (uint64_t)(mintime * 1e9);
+	uint64_t iterations = 1, elapsed = 0, ncycles = 0, nallocs = 0;
+	int success = 0;
+
+	void *state = bench->setup(bench->len);
+	if (state == NULL)
+		goto cleanup;
+
+	/* warm up, and catch the errors before measuring anything */
+	if (bench->run(state) != 0)
+		goto cleanup;
+
+	for (;;) {
+		const uint64_t allocs0 = allocations();
+		const uint64_t cycles0 = cycles();
+		const uint64_t start = now_ns();
+		for (uint64_t i = 0; i < iterations; i++) {
+			if (bench->run(state) != 0)
+				goto cleanup;
+		}
+		elapsed = now_ns() - start;
+		ncycles = cycles() - cycles0;
+		nallocs = allocations() - allocs0;
+		if (elapsed >= min_ns || iterations >= UINT64_MAX / 16)
+			break;
+		/* aim a bit above min_ns, growing by at most 10x at once */
+		uint64_t next = iterations * 10;
+		if (elapsed > 0) {
+			const double estimate = 1.2 * iterations *
+				    ((double)min_ns / elapsed);
+			if (estimate < next)
+				next = (uint64_t)estimate;
+		}
+		iterations = (next > iterations ? next : iterations + 1);
+	}
+
+	result->bench = bench;
+	result->iterations = iterations;
+	result->ns_per_op = (double)elapsed / iterations;
+#if defined(HAVE_RDTSC)
+	result->cycles_per_op = (double)ncycles / iterations;
+#else
+	(void)ncycles;
+	result->cycles_per_op = -1;
+#endif
+#if defined(BENCH_WRAP_MALLOC)
+	result->allocs_per_op = (double)nallocs / iterations;
+#else
+	(void)nallocs;
+	result->allocs_per_op = -1;
+#endif
+
+	success = 1;
+	/* FALLTHROUGH */
+cleanup:
+	if (state != NULL)
+		bench->teardown(state);
+	return (success ? 0 : -1);
+}
+
+
+static void
+print_header(enum bench_format format, size_t nthreads)
+{
+	switch (format) {
+	case BENCH_CSV:
+		(void)printf("name,bytes,iterations,ns_per_op,cycles_per_op,"
+			    "cycles_per_byte,allocs_per_op\n");
+		break;
+	case BENCH_JSON:
+		(void)printf("{\n  \"threads\": %zu,\n  \"benchmarks\": [",
+			    nthreads);
+		break;
+	}
+	(void)fflush(stdout);
+}
+
+
+static void
+print_result(enum bench_format format, const struct bench_result *result,
+		    int first)
+{
+	const struct bench *bench = result->bench;
+	const int has_cycles = (result->cycles_per_op >= 0);
+	const int has_cpb = (has_cycles && bench->len > 0);
+	const int has_allocs = (result->allocs_per_op >= 0);
+	const double cpb = (has_cpb ? result->cycles_per_op / bench->len : 0);
+	/* CSV leave the unavailable values empty, JSON use null */
+	const char *none = (format == BENCH_CSV ? "" : "null");
+	char cycles_s[32], cpb_s[32], allocs_s[32];
+
+	(void)snprintf(cycles_s, sizeof(cycles_s), "%.1f",
+		    result->cycles_per_op);
+	(void)snprintf(cpb_s, sizeof(cpb_s), "%.3f", cpb);
+	(void)snprintf(allocs_s, sizeof(allocs_s), "%.2f",
+		    result->allocs_per_op);
+
+	switch (format) {
+	case BENCH_CSV:
+		(void)printf("%s,%zu,%" PRIu64 ",%.1f,%s,%s,%s\n",
+			    bench->name, bench->len, result->iterations,
+			    result->ns_per_op,
+			    has_cycles ? cycles_s : none,
+			    has_cpb ? cpb_s : none,
+			    has_allocs ? allocs_s : none);
+		break;
+	case BENCH_JSON:
+		(void)printf("%s\n    { \"name\": \"%s\", \"bytes\": %zu, "
+			    "\"iterations\": %" PRIu64 ", \"ns_per_op\": %.1f, "
+			    "\"cycles_per_op\": %s, \"cycles_per_byte\": %s, "
+			    "\"allocs_per_op\": %s }",
+			    first ? "" : ",", bench->name, bench->len,
+			    result->iterations, result->ns_per_op,
+			    has_cycles ? cycles_s : none,
+			    has_cpb ? cpb_s : none,
+			    has_allocs ? allocs_s : none);
+		break;
+	}
+	(void)fflush(stdout);
+}
+
+
+static void
+print_footer(enum bench_format format)
+{
+	switch (format) {
+	case BENCH_CSV:
+		break;
+	case BENCH_JSON:
+		(void)printf("\n  ]\n}\n");
+		break;
+	}
+	(void)fflush(stdout);
+}
+
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+
+static uint64_t
+cycles(void)
+{
+#if defined(HAVE_RDTSC)
+	return (__rdtsc());
+#else
+	return (0);
+#endif
+}
+
+
+static uint64_t
+allocations(void)
+{
+	return (atomic_load_explicit(&bench_allocs, memory_order_relaxed));
+}
@@ -0,0 +1,151 @@
+/*
+ * hmac_timing_server.c
+ *
+ * Run a timing leaking HMAC-SHA1 HTTP server, see timing_leaking_serve(). It
+ * takes the same arguments as python/hmac_padding_oracle.py and can be used
+ * in its place.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "break_mac.h"
+
+
+/* Display the usage message and exit */
+static void	usage(void);
+
+/*
+ * Create a TCP socket listening on the given host and port.
+ *
+ * Returns the listening socket on success, -1 on error.
+ */
+static int	tcp_listen(const char *hostname, const char *port);
+
+
+int
+main(int argc, char **argv)
+{
+	const struct option options[] = {
+		{ "hostname", required_argument, NULL, 'H' },
+		{ "port",     required_argument, NULL, 'p' },
+		{ "key",      required_argument, NULL, 'k' },
+		{ "delay",    required_argument, NULL, 'd' },
+		{ "threads",  required_argument, NULL, 't' },
+		{ NULL,       0,                 NULL, 0   },
+	};
+	const char *hostname = NULL, *port = NULL, *hexkey = NULL;
+	double delay = -1;
+	unsigned long nthreads = 1;
+	char *end = NULL;
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "H:p:k:d:t:", options,
+		    NULL)) != -1) {
+		switch (ch) {
+		case 'H':
+			hostname = optarg;
+			break;
+		case 'p':
+			port = optarg;
+			break;
+		case 'k':
+			hexkey = optarg;
+			break;
+		case 'd':
+			errno = 0;
+			delay = strtod(optarg, &end);
+			if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+				    delay < 0)
+				usage();
+			break;
+		case 't':
+			errno = 0;
+			nthreads = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+				    nthreads == 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || hostname == NULL || port == NULL ||
+		    hexkey == NULL || delay < 0)
+		usage();
+
+	struct bytes *key = bytes_from_hex(hexkey);
+	if (key == NULL) {
+		(void)fprintf(stderr, "%s: invalid key\n", hexkey);
+		return (EXIT_FAILURE);
+	}
+	const int listener = tcp_listen(hostname, port);
+	if (listener == -1) {
+		(void)fprintf(stderr, "%s:%s: failed to listen\n", hostname,
+			    port);
+		bytes_free(key);
+		return (EXIT_FAILURE);
+	}
+
+	/* the delay is given in milliseconds */
+	(void)timing_leaking_serve(listener, key, (uint64_t)(delay * 1000000),
+		    nthreads);
+	(void)fprintf(stderr, "%s:%s: server failed\n", hostname, port);
+
+	(void)close(listener);
+	bytes_free(key);
+	return (EXIT_FAILURE);
+}
+
+
+static void
+usage(void)
+{
+	(void)fprintf(stderr,
+		    "usage: hmac_timing_server --hostname host --port port "
+		    "--key hex --delay ms\n"
+		    "                          [--threads n]\n");
+	exit(EXIT_FAILURE);
+}
+
+
+static int
+tcp_listen(const char *hostname, const char *port)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL, *res0 = NULL;
+	const int on = 1;
+	int s = -1;
+
+	/* heavily based on OpenBSD's getaddrinfo(3) manpage example */
+	(void)memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(hostname, port, &hints, &res0) != 0)
+		return (-1);
+	for (res = res0; res != NULL; res = res->ai_next) {
+		s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (s == -1)
+			continue;
+		if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on,
+			    sizeof(on)) == 0 &&
+			    bind(s, res->ai_addr, res->ai_addrlen) == 0 &&
+			    listen(s, SOMAXCONN) == 0) {
+			/* ok we got one */
+			break;
+		}
+		(void)close(s);
+		s = -1;
+	}
+
+	freeaddrinfo(res0);
+	return (s);
+}
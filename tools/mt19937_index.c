@@ -0,0 +1,109 @@
+/*
+ * mt19937_index.c
+ *
+ * Build and query the MT19937 first output to seed index, see
+ * mt19937_index_build().
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "break_mt19937.h"
+
+
+/* Display the usage message and exit */
+static void	usage(void);
+
+/*
+ * Parse the given string as an uint32_t value into x_p.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int	parse_uint32(const char *s, uint32_t *x_p);
+
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage();
+
+	const char *command = argv[1], *path = argv[2];
+	if (strcmp(command, "build") == 0) {
+		uint32_t lo = 0, hi = UINT32_MAX;
+		if (argc != 3 && argc != 5)
+			usage();
+		if (argc == 5) {
+			if (parse_uint32(argv[3], &lo) != 0 ||
+				    parse_uint32(argv[4], &hi) != 0 || lo > hi)
+				usage();
+		}
+		if (mt19937_index_build(path, lo, hi) != 0) {
+			(void)fprintf(stderr, "%s: failed to build the index\n",
+				    path);
+			return (EXIT_FAILURE);
+		}
+	} else if (strcmp(command, "lookup") == 0) {
+		uint32_t seeds[16];
+		const size_t nseeds = sizeof(seeds) / sizeof(*seeds);
+		if (argc < 4)
+			usage();
+		struct mt19937_index *index = mt19937_index_open(path);
+		if (index == NULL) {
+			(void)fprintf(stderr, "%s: invalid index\n", path);
+			return (EXIT_FAILURE);
+		}
+		for (int i = 3; i < argc; i++) {
+			uint32_t output = 0;
+			if (parse_uint32(argv[i], &output) != 0)
+				usage();
+			const int found = mt19937_lookup_seed(index, output,
+				    seeds, nseeds);
+			if (found == -1) {
+				(void)fprintf(stderr, "%s: lookup failed\n",
+					    path);
+				mt19937_index_close(index);
+				return (EXIT_FAILURE);
+			}
+			(void)printf("%" PRIu32 ":", output);
+			for (size_t j = 0; j < (size_t)found && j < nseeds; j++)
+				(void)printf(" %" PRIu32, seeds[j]);
+			if ((size_t)found > nseeds)
+				(void)printf(" ...");
+			(void)printf("\n");
+		}
+		mt19937_index_close(index);
+	} else {
+		usage();
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+
+static void
+usage(void)
+{
+	(void)fprintf(stderr,
+		    "usage: mt19937_index build index [lo hi]\n"
+		    "       mt19937_index lookup index output ...\n");
+	exit(EXIT_FAILURE);
+}
+
+
+static int
+parse_uint32(const char *s, uint32_t *x_p)
+{
+	char *end = NULL;
+
+	errno = 0;
+	const unsigned long long x = strtoull(s, &end, 0);
+	if (*s == '\0' || *s == '-' || *end != '\0' || errno != 0)
+		return (-1);
+	if (x > UINT32_MAX)
+		return (-1);
+	*x_p = (uint32_t)x;
+	return (0);
+}